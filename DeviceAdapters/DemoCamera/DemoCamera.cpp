@@ -30,6 +30,7 @@
 #include <sstream>
 #include <algorithm>
 #include "WriteCompactTiffRGB.h"
+#include "PixelConversion.h"
 #include <iostream>
 
 
@@ -92,6 +93,7 @@ MODULE_API void InitializeModuleData()
    RegisterDevice("ImageFlipX", MM::ImageProcessorDevice, "ImageFlipX");
    RegisterDevice("ImageFlipY", MM::ImageProcessorDevice, "ImageFlipY");
    RegisterDevice("MedianFilter", MM::ImageProcessorDevice, "MedianFilter");
+   RegisterDevice("ImageReducer", MM::ImageProcessorDevice, "Crop, bin and convert to 8-bit before buffering");
    RegisterDevice(g_HubDeviceName, MM::HubDevice, "DHub");
 }
 
@@ -183,6 +185,10 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
    {
       return new MedianFilter();
    }
+   else if(strcmp(deviceName, "ImageReducer") == 0)
+   {
+      return new ImageReducer();
+   }
    else if (strcmp(deviceName, g_HubDeviceName) == 0)
    {
 	  return new DemoHub();
@@ -4069,6 +4075,14 @@ int DemoAutoFocus::Initialize()
    if (DEVICE_OK != ret)
       return ret;
 
+   // Sharpness measure used for the focus score
+   CPropertyAction* pAct = new CPropertyAction(this, &DemoAutoFocus::OnFocusMetric);
+   ret = CreateStringProperty("FocusMetric", FocusScorer::GetMetricName(scorer_.GetMetric()), false, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   std::vector<std::string> metrics = FocusScorer::GetMetricNames();
+   SetAllowedValues("FocusMetric", metrics);
+
    running_ = false;   
 
    ret = UpdateStatus();
@@ -4080,6 +4094,45 @@ int DemoAutoFocus::Initialize()
    return DEVICE_OK;
 }
 
+/**
+ * Scores an image snapped with the current camera.
+ */
+int DemoAutoFocus::GetCurrentFocusScore(double& score)
+{
+   MM::Core* core = GetCoreCallback();
+   if (core == 0)
+      return DEVICE_ERR;
+
+   int width = 0, height = 0, depth = 0;
+   int ret = core->GetImageDimensions(width, height, depth);
+   if (ret != DEVICE_OK)
+      return ret;
+   const unsigned char* pixels = reinterpret_cast<const unsigned char*>(core->GetImage());
+   if (pixels == 0)
+      return DEVICE_SNAP_IMAGE_FAILED;
+
+   score = latestScore_ = scorer_.Score(pixels, width, height, depth);
+   return DEVICE_OK;
+}
+
+int DemoAutoFocus::OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(FocusScorer::GetMetricName(scorer_.GetMetric()));
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      FocusScorer::Metric metric;
+      if (!FocusScorer::GetMetricFromName(name, metric))
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      scorer_.SetMetric(metric);
+   }
+   return DEVICE_OK;
+}
+
 // End of CDemoAutofocus
 //
 
@@ -4865,6 +4918,235 @@ int MedianFilter::Process(unsigned char *pBuffer, unsigned int width, unsigned i
 }
 
 
+ImageReducer::ImageReducer() :
+   binning_(1),
+   to8Bit_(false),
+   scaleMin_(0),
+   scaleMax_(65535)
+{
+   for (int i = 0; i < 4; ++i)
+      crop_[i] = 0;
+   CreateHubIDProperty();
+}
+
+int ImageReducer::Initialize()
+{
+   CPropertyAction* pAct = new CPropertyAction(this, &ImageReducer::OnBinning);
+   int nRet = CreateIntegerProperty("Binning", 1, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue("Binning", "1");
+   AddAllowedValue("Binning", "2");
+   AddAllowedValue("Binning", "4");
+   AddAllowedValue("Binning", "8");
+
+   const char* cropNames[] = { "CropX", "CropY", "CropWidth", "CropHeight" };
+   for (long i = 0; i < 4; ++i)
+   {
+      CPropertyActionEx* pActX = new CPropertyActionEx(this, &ImageReducer::OnCrop, i);
+      nRet = CreateIntegerProperty(cropNames[i], 0, false, pActX);
+      if (nRet != DEVICE_OK)
+         return nRet;
+      SetPropertyLimits(cropNames[i], 0, 65535);
+   }
+
+   pAct = new CPropertyAction(this, &ImageReducer::OnOutputPixelType);
+   nRet = CreateStringProperty("OutputPixelType", "Unchanged", false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue("OutputPixelType", "Unchanged");
+   AddAllowedValue("OutputPixelType", "8bit");
+
+   // 16-bit values mapped to 0 and 255 by the 8-bit conversion
+   const char* limitNames[] = { "8bitMinimum", "8bitMaximum" };
+   for (long i = 0; i < 2; ++i)
+   {
+      CPropertyActionEx* pActX = new CPropertyActionEx(this, &ImageReducer::OnScaleLimit, i);
+      nRet = CreateIntegerProperty(limitNames[i], i == 0 ? scaleMin_ : scaleMax_, false, pActX);
+      if (nRet != DEVICE_OK)
+         return nRet;
+      SetPropertyLimits(limitNames[i], 0, 65535);
+   }
+
+   lut_.resize(65536);
+   PixelConverter::Build16To8Lut(&lut_[0], 16, scaleMin_, scaleMax_);
+   return DEVICE_OK;
+}
+
+int ImageReducer::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   MMThreadGuard guard(lock_);
+   if (eAct == MM::BeforeGet)
+      pProp->Set(binning_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(binning_);
+   return DEVICE_OK;
+}
+
+int ImageReducer::OnCrop(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   MMThreadGuard guard(lock_);
+   if (eAct == MM::BeforeGet)
+      pProp->Set(crop_[index]);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(crop_[index]);
+   return DEVICE_OK;
+}
+
+int ImageReducer::OnOutputPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   MMThreadGuard guard(lock_);
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(to8Bit_ ? "8bit" : "Unchanged");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      to8Bit_ = (value == "8bit");
+   }
+   return DEVICE_OK;
+}
+
+int ImageReducer::OnScaleLimit(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   MMThreadGuard guard(lock_);
+   long& limit = index == 0 ? scaleMin_ : scaleMax_;
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(limit);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(limit);
+      PixelConverter::Build16To8Lut(&lut_[0], 16, scaleMin_, scaleMax_);
+   }
+   return DEVICE_OK;
+}
+
+int ImageReducer::ComputeShape(unsigned width, unsigned height, unsigned byteDepth,
+      unsigned& x0, unsigned& y0, unsigned& outWidth, unsigned& outHeight,
+      unsigned& outByteDepth) const
+{
+   // Binning works on 8- and 16-bit gray and on 32-bit color (per component)
+   if (binning_ > 1 && byteDepth != 1 && byteDepth != 2 && byteDepth != 4)
+      return DEVICE_NOT_SUPPORTED;
+
+   x0 = (std::min)((unsigned)crop_[0], width);
+   y0 = (std::min)((unsigned)crop_[1], height);
+   unsigned cropWidth = width - x0;
+   unsigned cropHeight = height - y0;
+   if (crop_[2] > 0)
+      cropWidth = (std::min)((unsigned)crop_[2], cropWidth);
+   if (crop_[3] > 0)
+      cropHeight = (std::min)((unsigned)crop_[3], cropHeight);
+
+   outWidth = cropWidth / binning_;
+   outHeight = cropHeight / binning_;
+   outByteDepth = (to8Bit_ && byteDepth == 2) ? 1 : byteDepth;
+   return DEVICE_OK;
+}
+
+int ImageReducer::GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+      unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth)
+{
+   MMThreadGuard guard(lock_);
+   unsigned x0, y0;
+   return ComputeShape(width, height, byteDepth, x0, y0,
+         outWidth, outHeight, outByteDepth);
+}
+
+// Only possible when the settings keep the image shape
+int ImageReducer::Process(unsigned char* /*buffer*/, unsigned width, unsigned height, unsigned byteDepth)
+{
+   MMThreadGuard guard(lock_);
+   unsigned x0, y0, outWidth, outHeight, outByteDepth;
+   int ret = ComputeShape(width, height, byteDepth, x0, y0,
+         outWidth, outHeight, outByteDepth);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (outWidth != width || outHeight != height || outByteDepth != byteDepth)
+      return DEVICE_NOT_SUPPORTED;
+   return DEVICE_OK;
+}
+
+template <typename SampleType>
+void ImageReducer::BinRows(const unsigned char* firstRow, size_t rowBytes,
+      unsigned outWidth, unsigned components, SampleType* destination)
+{
+   const unsigned bin = (unsigned)binning_;
+   const unsigned samples = outWidth * components;
+   sums_.assign(samples, 0);
+   for (unsigned by = 0; by < bin; ++by)
+   {
+      const SampleType* row = (const SampleType*)(firstRow + by * rowBytes);
+      for (unsigned ox = 0; ox < outWidth; ++ox)
+      {
+         const SampleType* block = row + ox * bin * components;
+         unsigned* sum = &sums_[ox * components];
+         for (unsigned bx = 0; bx < bin; ++bx)
+            for (unsigned c = 0; c < components; ++c)
+               sum[c] += block[bx * components + c];
+      }
+   }
+
+   const unsigned count = bin * bin;
+   for (unsigned i = 0; i < samples; ++i)
+      destination[i] = (SampleType)((sums_[i] + count / 2) / count);
+}
+
+// The settings may have changed since the caller sized the destination
+int ImageReducer::ProcessTo(const unsigned char* pSource, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned char* pDestination, unsigned expectedWidth,
+      unsigned expectedHeight, unsigned expectedByteDepth)
+{
+   MMThreadGuard guard(lock_);
+   unsigned x0, y0, outWidth, outHeight, outByteDepth;
+   int ret = ComputeShape(width, height, byteDepth, x0, y0,
+         outWidth, outHeight, outByteDepth);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (outWidth != expectedWidth || outHeight != expectedHeight ||
+         outByteDepth != expectedByteDepth)
+      return DEVICE_INCOMPATIBLE_IMAGE;
+
+   const size_t rowBytes = (size_t)width * byteDepth;
+   const size_t outRowBytes = (size_t)outWidth * outByteDepth;
+   const bool to8Bit = (outByteDepth != byteDepth);
+   const unsigned components = (byteDepth == 4) ? 4 : 1;
+   if (to8Bit && row16_.size() < outWidth)
+      row16_.resize(outWidth);
+
+   for (unsigned oy = 0; oy < outHeight; ++oy)
+   {
+      const unsigned char* src = pSource +
+         (y0 + (size_t)oy * binning_) * rowBytes + (size_t)x0 * byteDepth;
+      unsigned char* dst = pDestination + oy * outRowBytes;
+      if (binning_ == 1)
+      {
+         if (to8Bit)
+            PixelConverter::Apply16To8Lut(dst, (const unsigned short*)src,
+                  outWidth, &lut_[0], 16);
+         else
+            memcpy(dst, src, outRowBytes);
+      }
+      else if (byteDepth == 2)
+      {
+         unsigned short* binned = to8Bit ? &row16_[0] : (unsigned short*)dst;
+         BinRows(src, rowBytes, outWidth, 1, binned);
+         if (to8Bit)
+            PixelConverter::Apply16To8Lut(dst, binned, outWidth, &lut_[0], 16);
+      }
+      else
+      {
+         BinRows(src, rowBytes, outWidth, components, dst);
+      }
+   }
+   return DEVICE_OK;
+}
+
+
 int DemoHub::Initialize()
 {
   	initialized_ = true;
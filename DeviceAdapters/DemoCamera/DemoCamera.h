@@ -32,9 +32,11 @@
 
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+#include "FocusScore.h"
 #include "DeviceThreads.h"
 #include <string>
 #include <map>
+#include <vector>
 #include <algorithm>
 #include <stdint.h>
 
@@ -1037,6 +1039,61 @@ private:
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// ImageReducer class
+// Shrinks images before they are buffered: crop, software binning (the
+// average of bin x bin pixels) and 16-bit to 8-bit conversion through a
+// linear lookup table, in that order. Changes the image shape, so it only
+// works through ProcessTo().
+//////////////////////////////////////////////////////////////////////////////
+class ImageReducer : public CImageProcessorBase<ImageReducer>
+{
+public:
+   ImageReducer();
+   ~ImageReducer() {}
+
+   int Shutdown() {return DEVICE_OK;}
+   void GetName(char* name) const {strcpy(name,"ImageReducer");}
+
+   int Initialize();
+   bool Busy(void) { return false;};
+
+   int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth);
+   int ProcessTo(const unsigned char* source, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+         unsigned outHeight, unsigned outByteDepth);
+
+   // action interface
+   // ----------------
+   int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCrop(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+   int OnOutputPixelType(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScaleLimit(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+
+private:
+   // Caller must hold lock_
+   int ComputeShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& x0, unsigned& y0, unsigned& outWidth, unsigned& outHeight,
+         unsigned& outByteDepth) const;
+   // Average binning_ rows starting at firstRow into one row of samples
+   template <typename SampleType>
+   void BinRows(const unsigned char* firstRow, size_t rowBytes,
+         unsigned outWidth, unsigned components, SampleType* destination);
+
+   MMThreadLock lock_;
+   long binning_;
+   long crop_[4]; // x, y, width, height; 0 width or height means to the edge
+   bool to8Bit_;
+   long scaleMin_;
+   long scaleMax_;
+   std::vector<unsigned char> lut_; // 16-bit to 8-bit, rebuilt on change
+   std::vector<unsigned> sums_;
+   std::vector<unsigned short> row16_;
+};
+
+
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1049,7 +1106,8 @@ public:
    DemoAutoFocus() : 
       running_(false), 
       busy_(false), 
-      initialized_(false)  
+      initialized_(false),
+      latestScore_(0.0)
       {
          CreateHubIDProperty();
       }
@@ -1079,21 +1137,22 @@ public:
    virtual int IncrementalFocus() { return DEVICE_OK; }
    virtual int GetLastFocusScore(double& score)
    {
-      score = 0.0;
-      return DEVICE_OK;
-   }
-   virtual int GetCurrentFocusScore(double& score)
-   {
-      score = 1.0;
+      score = latestScore_;
       return DEVICE_OK;
    }
+   virtual int GetCurrentFocusScore(double& score);
    virtual int GetOffset(double& /*offset*/) { return DEVICE_OK; }
    virtual int SetOffset(double /*offset*/) { return DEVICE_OK; }
 
+   // action interface
+   int OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct);
+
 private:
    bool running_;
    bool busy_;
    bool initialized_;
+   FocusScorer scorer_;
+   double latestScore_;
 };
 
 struct Point
@@ -170,3 +170,34 @@ int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, uns
 
    return ret;
 }
+
+// Processors in slot order
+std::vector<MM::ImageProcessor*> ImageProcessorChain::GetProcessorSequence() const
+{
+   std::vector<MM::ImageProcessor*> processors;
+   for (std::map<int, MM::ImageProcessor*>::const_iterator it = processors_.begin();
+         it != processors_.end(); ++it)
+      processors.push_back(it->second);
+   return processors;
+}
+
+// The output shape of the chain is that of its last processor
+int ImageProcessorChain::GetOutputShape(unsigned width, unsigned height,
+      unsigned byteDepth, unsigned& outWidth, unsigned& outHeight,
+      unsigned& outByteDepth)
+{
+   return ImageProcessorSequence::GetOutputShape(GetProcessorSequence(),
+         width, height, byteDepth, outWidth, outHeight, outByteDepth);
+}
+
+int ImageProcessorChain::ProcessTo(const unsigned char* pSource,
+      unsigned int width, unsigned int height, unsigned int byteDepth,
+      unsigned char* pDestination, unsigned outWidth, unsigned outHeight,
+      unsigned outByteDepth)
+{
+   busy_ = true;
+   int ret = sequence_.ProcessTo(GetProcessorSequence(), pSource, width,
+         height, byteDepth, pDestination, outWidth, outHeight, outByteDepth);
+   busy_ = false;
+   return ret;
+}
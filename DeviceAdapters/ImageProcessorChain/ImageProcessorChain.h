@@ -29,8 +29,10 @@
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
 #include "DeviceThreads.h"
+#include "ImageProcessorSequence.h"
 #include <string>
 #include <map>
+#include <vector>
 
 
 
@@ -52,6 +54,11 @@ public:
    bool Busy(void) { return busy_;};
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth);
+   int ProcessTo(const unsigned char* source, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+         unsigned outHeight, unsigned outByteDepth);
 
    // action interface
    // ----------------
@@ -62,6 +69,9 @@ private:
    bool busy_;
    std::map< int, std::string> processorNames_;
    std::map< int, MM::ImageProcessor*> processors_;
+   ImageProcessorSequence sequence_;
+
+   std::vector<MM::ImageProcessor*> GetProcessorSequence() const;
 
    ImageProcessorChain& operator=( const ImageProcessorChain& ){ 
       return *this;
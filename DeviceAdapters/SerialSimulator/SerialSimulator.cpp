@@ -0,0 +1,526 @@
+// DESCRIPTION:   Simulated serial port answering from a script, for testing
+//                and benchmarking serial device adapters without hardware.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SerialSimulator.h"
+
+#include "ModuleInterface.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+
+const char* const g_DeviceName_SimulatedPort = "SimulatedSerialPort";
+
+const char* const g_PropName_ScriptFile = "ScriptFile";
+const char* const g_PropName_RequestTerminator = "RequestTerminator";
+const char* const g_PropName_FixedRequestLength = "FixedRequestLength";
+const char* const g_PropName_UnmatchedRequests = "UnmatchedRequests";
+const char* const g_PropName_DefaultResponse = "DefaultResponse";
+const char* const g_PropName_Baud = "BaudRate";
+const char* const g_PropName_ResponseDelay = "ResponseDelay-ms";
+const char* const g_PropName_Jitter = "ResponseJitter-ms";
+const char* const g_PropName_AnswerTimeout = "AnswerTimeout";
+const char* const g_PropName_ResetStatistics = "ResetStatistics";
+
+const char* const g_PropValue_NoResponse = "No response";
+const char* const g_PropValue_Echo = "Echo request";
+const char* const g_PropValue_DefaultResponse = "Send default response";
+const char* const g_PropValue_Idle = "Idle";
+const char* const g_PropValue_Reset = "Reset";
+
+enum Statistic
+{
+   StatRoundTrips,
+   StatRate,
+   StatMean,
+   StatP50,
+   StatP99,
+   StatMax
+};
+
+const char* const g_StatisticNames[] = {
+   "Stats-RoundTrips",
+   "Stats-RoundTripsPerSecond",
+   "Stats-LatencyMean-ms",
+   "Stats-LatencyP50-ms",
+   "Stats-LatencyP99-ms",
+   "Stats-LatencyMax-ms",
+};
+
+} // anonymous namespace
+
+
+MODULE_API void
+InitializeModuleData()
+{
+   RegisterDevice(g_DeviceName_SimulatedPort, MM::SerialDevice,
+         "Simulated serial port answering from a script");
+}
+
+
+MODULE_API MM::Device*
+CreateDevice(const char* name)
+{
+   if (!name)
+      return 0;
+   if (strcmp(name, g_DeviceName_SimulatedPort) == 0)
+      return new SimulatedSerialPort();
+   return 0;
+}
+
+
+MODULE_API void
+DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+
+SimulatedSerialPort::SimulatedSerialPort() :
+   initialized_(false),
+   requestTerminator_("\\r"),
+   fixedRequestLength_(0),
+   unmatchedRequests_(g_PropValue_NoResponse),
+   answerTimeoutMs_(500.0)
+{
+   SetErrorText(ERR_SCRIPT_FILE, "Cannot open the script file");
+   SetErrorText(ERR_SCRIPT_INVALID, "Invalid script file");
+   SetErrorText(ERR_ESCAPE_INVALID,
+         "Invalid escape sequence in terminator or default response");
+   SetErrorText(ERR_BUFFER_OVERRUN, "Answer does not fit in the buffer");
+   SetErrorText(ERR_TERM_TIMEOUT, "Timed out waiting for the terminator");
+
+   CreateStringProperty(g_PropName_ScriptFile, "", false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnScriptFile), true);
+   CreateStringProperty(g_PropName_RequestTerminator,
+         requestTerminator_.c_str(), false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnRequestTerminator),
+         true);
+   CreateIntegerProperty(g_PropName_FixedRequestLength, 0, false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnFixedRequestLength),
+         true);
+   CreateStringProperty(g_PropName_UnmatchedRequests,
+         unmatchedRequests_.c_str(), false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnUnmatchedRequests),
+         true);
+   AddAllowedValue(g_PropName_UnmatchedRequests, g_PropValue_NoResponse);
+   AddAllowedValue(g_PropName_UnmatchedRequests, g_PropValue_Echo);
+   AddAllowedValue(g_PropName_UnmatchedRequests, g_PropValue_DefaultResponse);
+   CreateStringProperty(g_PropName_DefaultResponse, "", false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnDefaultResponse),
+         true);
+}
+
+
+int
+SimulatedSerialPort::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   std::string terminator, defaultResponse;
+   if (!UnescapeSimulatorString(requestTerminator_, terminator) ||
+         !UnescapeSimulatorString(defaultResponse_, defaultResponse))
+      return ERR_ESCAPE_INVALID;
+
+   controller_.ClearRules();
+   if (!scriptFile_.empty())
+   {
+      std::ifstream script(scriptFile_.c_str(), std::ios_base::binary);
+      if (!script)
+         return ERR_SCRIPT_FILE;
+      std::string message;
+      if (!controller_.LoadScript(script, message))
+      {
+         SetErrorText(ERR_SCRIPT_INVALID, ("Invalid script file: " + message).c_str());
+         return ERR_SCRIPT_INVALID;
+      }
+   }
+   controller_.SetRequestTerminator(terminator);
+   controller_.SetFixedRequestLength(static_cast<size_t>(
+            std::max(0L, fixedRequestLength_)));
+   controller_.SetEchoUnmatched(unmatchedRequests_ == g_PropValue_Echo);
+   controller_.SetDefaultResponse(
+         unmatchedRequests_ == g_PropValue_DefaultResponse ?
+         defaultResponse : std::string());
+
+   int err;
+   err = CreateIntegerProperty(g_PropName_Baud, controller_.GetBaudRate(),
+         false, new CPropertyAction(this, &SimulatedSerialPort::OnBaud));
+   if (err != DEVICE_OK)
+      return err;
+   SetPropertyLimits(g_PropName_Baud, 0, 1000000);
+
+   err = CreateFloatProperty(g_PropName_ResponseDelay,
+         controller_.GetResponseDelayMs(), false,
+         new CPropertyAction(this, &SimulatedSerialPort::OnResponseDelay));
+   if (err != DEVICE_OK)
+      return err;
+   SetPropertyLimits(g_PropName_ResponseDelay, 0.0, 10000.0);
+
+   err = CreateFloatProperty(g_PropName_Jitter, controller_.GetJitterMs(),
+         false, new CPropertyAction(this, &SimulatedSerialPort::OnJitter));
+   if (err != DEVICE_OK)
+      return err;
+   SetPropertyLimits(g_PropName_Jitter, 0.0, 10000.0);
+
+   err = CreateFloatProperty(g_PropName_AnswerTimeout, answerTimeoutMs_,
+         false, new CPropertyAction(this, &SimulatedSerialPort::OnAnswerTimeout));
+   if (err != DEVICE_OK)
+      return err;
+
+   for (long i = StatRoundTrips; i <= StatMax; ++i)
+   {
+      CPropertyActionEx* pAct =
+         new CPropertyActionEx(this, &SimulatedSerialPort::OnStatistic, i);
+      if (i == StatRoundTrips)
+         err = CreateIntegerProperty(g_StatisticNames[i], 0, true, pAct);
+      else
+         err = CreateFloatProperty(g_StatisticNames[i], 0.0, true, pAct);
+      if (err != DEVICE_OK)
+         return err;
+   }
+
+   err = CreateStringProperty(g_PropName_ResetStatistics, g_PropValue_Idle,
+         false, new CPropertyAction(this, &SimulatedSerialPort::OnResetStatistics));
+   if (err != DEVICE_OK)
+      return err;
+   AddAllowedValue(g_PropName_ResetStatistics, g_PropValue_Idle);
+   AddAllowedValue(g_PropName_ResetStatistics, g_PropValue_Reset);
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::Shutdown()
+{
+   if (!initialized_)
+      return DEVICE_OK;
+   LogMessage(FormatStatistics());
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+
+void
+SimulatedSerialPort::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceName_SimulatedPort);
+}
+
+
+int
+SimulatedSerialPort::SetCommand(const char* command, const char* term)
+{
+   std::string request(command ? command : "");
+   if (term)
+      request += term;
+   return Write(reinterpret_cast<const unsigned char*>(request.data()),
+         static_cast<unsigned long>(request.size()));
+}
+
+
+int
+SimulatedSerialPort::GetAnswer(char* answer, unsigned bufLength,
+      const char* term)
+{
+   if (bufLength < 1)
+      return ERR_BUFFER_OVERRUN;
+
+   const std::string terminator(term ? term : "");
+   const double startMs = NowMs();
+   std::string received;
+   for (;;)
+   {
+      // Read one byte at a time so that bytes after the terminator are left
+      // for the next call, as with a real port
+      double nextByteMs;
+      {
+         MMThreadGuard g(lock_);
+         const double nowMs = NowMs();
+         char c;
+         while (controller_.Read(&c, 1, nowMs) == 1)
+         {
+            received += c;
+            if (!terminator.empty() && received.size() >= terminator.size() &&
+                  received.compare(received.size() - terminator.size(),
+                     terminator.size(), terminator) == 0)
+               break;
+         }
+         nextByteMs = controller_.GetNextByteTimeMs();
+      }
+
+      bool done = !terminator.empty() && received.size() >= terminator.size() &&
+         received.compare(received.size() - terminator.size(),
+               terminator.size(), terminator) == 0;
+      if (done)
+         received.erase(received.size() - terminator.size());
+      if (received.size() >= bufLength)
+         return ERR_BUFFER_OVERRUN;
+      if (done)
+      {
+         memcpy(answer, received.c_str(), received.size() + 1);
+         return DEVICE_OK;
+      }
+
+      const double nowMs = NowMs();
+      if (nowMs - startMs > answerTimeoutMs_)
+      {
+         if (terminator.empty())
+         {
+            memcpy(answer, received.c_str(), received.size() + 1);
+            return DEVICE_OK;
+         }
+         return ERR_TERM_TIMEOUT;
+      }
+
+      long sleepMs = 1;
+      if (nextByteMs > nowMs)
+         sleepMs = std::max(1L, static_cast<long>(nextByteMs - nowMs));
+      CDeviceUtils::SleepMs(std::min(sleepMs,
+               static_cast<long>(answerTimeoutMs_) + 1));
+   }
+}
+
+
+int
+SimulatedSerialPort::Write(const unsigned char* buf, unsigned long bufLen)
+{
+   MMThreadGuard g(lock_);
+   controller_.Write(reinterpret_cast<const char*>(buf), bufLen, NowMs());
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::Read(unsigned char* buf, unsigned long bufLen,
+      unsigned long& charsRead)
+{
+   MMThreadGuard g(lock_);
+   charsRead = static_cast<unsigned long>(
+         controller_.Read(reinterpret_cast<char*>(buf), bufLen, NowMs()));
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::Purge()
+{
+   MMThreadGuard g(lock_);
+   controller_.Purge();
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnScriptFile(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(scriptFile_.c_str());
+   else if (eAct == MM::AfterSet)
+      pProp->Get(scriptFile_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnRequestTerminator(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(requestTerminator_.c_str());
+   else if (eAct == MM::AfterSet)
+      pProp->Get(requestTerminator_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnFixedRequestLength(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(fixedRequestLength_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(fixedRequestLength_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnUnmatchedRequests(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(unmatchedRequests_.c_str());
+   else if (eAct == MM::AfterSet)
+      pProp->Get(unmatchedRequests_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnDefaultResponse(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(defaultResponse_.c_str());
+   else if (eAct == MM::AfterSet)
+      pProp->Get(defaultResponse_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnBaud(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   MMThreadGuard g(lock_);
+   if (eAct == MM::BeforeGet)
+      pProp->Set(controller_.GetBaudRate());
+   else if (eAct == MM::AfterSet)
+   {
+      long baud;
+      pProp->Get(baud);
+      controller_.SetBaudRate(baud);
+   }
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnResponseDelay(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   MMThreadGuard g(lock_);
+   if (eAct == MM::BeforeGet)
+      pProp->Set(controller_.GetResponseDelayMs());
+   else if (eAct == MM::AfterSet)
+   {
+      double delayMs;
+      pProp->Get(delayMs);
+      controller_.SetResponseDelayMs(delayMs);
+   }
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnJitter(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   MMThreadGuard g(lock_);
+   if (eAct == MM::BeforeGet)
+      pProp->Set(controller_.GetJitterMs());
+   else if (eAct == MM::AfterSet)
+   {
+      double jitterMs;
+      pProp->Get(jitterMs);
+      controller_.SetJitterMs(jitterMs);
+   }
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnAnswerTimeout(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(answerTimeoutMs_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(answerTimeoutMs_);
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnStatistic(MM::PropertyBase* pProp,
+      MM::ActionType eAct, long which)
+{
+   if (eAct != MM::BeforeGet)
+      return DEVICE_OK;
+
+   MMThreadGuard g(lock_);
+   const RoundTripStatistics& stats = controller_.GetStatistics();
+   switch (which)
+   {
+      case StatRoundTrips:
+         pProp->Set(static_cast<long>(stats.GetCount()));
+         break;
+      case StatRate:
+         pProp->Set(stats.GetRate());
+         break;
+      case StatMean:
+         pProp->Set(stats.GetMeanMs());
+         break;
+      case StatP50:
+         pProp->Set(stats.GetPercentileMs(50.0));
+         break;
+      case StatP99:
+         pProp->Set(stats.GetPercentileMs(99.0));
+         break;
+      case StatMax:
+         pProp->Set(stats.GetMaxMs());
+         break;
+   }
+   return DEVICE_OK;
+}
+
+
+int
+SimulatedSerialPort::OnResetStatistics(MM::PropertyBase* pProp,
+      MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(g_PropValue_Idle);
+   else if (eAct == MM::AfterSet)
+   {
+      std::string value;
+      pProp->Get(value);
+      if (value == g_PropValue_Reset)
+      {
+         MMThreadGuard g(lock_);
+         controller_.ResetStatistics();
+      }
+   }
+   return DEVICE_OK;
+}
+
+
+double
+SimulatedSerialPort::NowMs()
+{
+   return GetCurrentMMTime().getMsec();
+}
+
+
+std::string
+SimulatedSerialPort::FormatStatistics()
+{
+   MMThreadGuard g(lock_);
+   const RoundTripStatistics& stats = controller_.GetStatistics();
+   std::ostringstream s;
+   s << "Round trips: " << stats.GetCount() <<
+      " (" << stats.GetRate() << "/s); latency mean " <<
+      stats.GetMeanMs() << " ms, p50 " << stats.GetPercentileMs(50.0) <<
+      " ms, p99 " << stats.GetPercentileMs(99.0) << " ms, max " <<
+      stats.GetMaxMs() << " ms";
+   return s.str();
+}
@@ -0,0 +1,85 @@
+// DESCRIPTION:   Simulated serial port answering from a script, for testing
+//                and benchmarking serial device adapters without hardware.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "SimulatedController.h"
+
+#include "DeviceBase.h"
+#include "DeviceThreads.h"
+
+#include <string>
+
+
+#define ERR_SCRIPT_FILE 101
+#define ERR_SCRIPT_INVALID 102
+#define ERR_ESCAPE_INVALID 103
+#define ERR_BUFFER_OVERRUN 104
+#define ERR_TERM_TIMEOUT 105
+
+
+/**
+ * \brief A serial port that answers like a scripted controller.
+ *
+ * Give the label of this device as the port of the adapter under test.
+ * Requests and responses come from the script file (see
+ * SimulatedController::LoadScript()); the baud rate, response delay and
+ * jitter set the timing. The round-trip statistics of the traffic through
+ * the port are shown as read-only properties and logged at shutdown.
+ */
+class SimulatedSerialPort : public CSerialBase<SimulatedSerialPort>
+{
+public:
+   SimulatedSerialPort();
+
+   virtual int Initialize();
+   virtual int Shutdown();
+   virtual void GetName(char* name) const;
+   virtual bool Busy() { return false; }
+
+   virtual MM::PortType GetPortType() const { return MM::SerialPort; }
+   virtual int SetCommand(const char* command, const char* term);
+   virtual int GetAnswer(char* answer, unsigned bufLength, const char* term);
+   virtual int Write(const unsigned char* buf, unsigned long bufLen);
+   virtual int Read(unsigned char* buf, unsigned long bufLen,
+         unsigned long& charsRead);
+   virtual int Purge();
+
+private:
+   int OnScriptFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRequestTerminator(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFixedRequestLength(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnUnmatchedRequests(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDefaultResponse(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBaud(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnResponseDelay(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnJitter(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStatistic(MM::PropertyBase* pProp, MM::ActionType eAct, long which);
+   int OnResetStatistics(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   double NowMs();
+   std::string FormatStatistics();
+
+   bool initialized_;
+   std::string scriptFile_;
+   std::string requestTerminator_; // Escaped
+   long fixedRequestLength_;
+   std::string unmatchedRequests_;
+   std::string defaultResponse_; // Escaped
+   double answerTimeoutMs_;
+
+   MMThreadLock lock_;
+   SimulatedController controller_;
+};
@@ -0,0 +1,417 @@
+// DESCRIPTION:   Scripted serial controller with a model of line timing, used
+//                by the simulated serial port.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SimulatedController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+namespace {
+
+int HexDigitValue(char c)
+{
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
+}
+
+} // anonymous namespace
+
+
+bool
+UnescapeSimulatorString(const std::string& escaped, std::string& bytes)
+{
+   bytes.clear();
+   for (std::string::size_type i = 0; i < escaped.size(); ++i)
+   {
+      if (escaped[i] != '\\')
+      {
+         bytes += escaped[i];
+         continue;
+      }
+      if (++i == escaped.size())
+         return false;
+      switch (escaped[i])
+      {
+         case 'r': bytes += '\r'; break;
+         case 'n': bytes += '\n'; break;
+         case 't': bytes += '\t'; break;
+         case '0': bytes += '\0'; break;
+         case '\\': bytes += '\\'; break;
+         case '*': bytes += '*'; break;
+         case 'x':
+         {
+            int high = i + 1 < escaped.size() ? HexDigitValue(escaped[i + 1]) : -1;
+            int low = i + 2 < escaped.size() ? HexDigitValue(escaped[i + 2]) : -1;
+            if (high < 0 || low < 0)
+               return false;
+            bytes += static_cast<char>(high * 16 + low);
+            i += 2;
+            break;
+         }
+         default:
+            return false;
+      }
+   }
+   return true;
+}
+
+
+RoundTripStatistics::RoundTripStatistics() :
+   firstStartMs_(0.0),
+   lastEndMs_(0.0)
+{
+}
+
+
+void
+RoundTripStatistics::Reset()
+{
+   latenciesMs_.clear();
+   firstStartMs_ = lastEndMs_ = 0.0;
+}
+
+
+void
+RoundTripStatistics::Record(double startMs, double endMs)
+{
+   if (latenciesMs_.empty())
+      firstStartMs_ = startMs;
+   lastEndMs_ = endMs;
+   latenciesMs_.push_back(endMs - startMs);
+}
+
+
+double
+RoundTripStatistics::GetRate() const
+{
+   if (latenciesMs_.size() < 2 || lastEndMs_ <= firstStartMs_)
+      return 0.0;
+   return 1000.0 * latenciesMs_.size() / (lastEndMs_ - firstStartMs_);
+}
+
+
+double
+RoundTripStatistics::GetMeanMs() const
+{
+   if (latenciesMs_.empty())
+      return 0.0;
+   double sum = 0.0;
+   for (std::vector<double>::const_iterator it = latenciesMs_.begin(),
+         end = latenciesMs_.end(); it != end; ++it)
+      sum += *it;
+   return sum / latenciesMs_.size();
+}
+
+
+double
+RoundTripStatistics::GetMaxMs() const
+{
+   if (latenciesMs_.empty())
+      return 0.0;
+   return *std::max_element(latenciesMs_.begin(), latenciesMs_.end());
+}
+
+
+double
+RoundTripStatistics::GetPercentileMs(double p) const
+{
+   if (latenciesMs_.empty())
+      return 0.0;
+   std::vector<double> sorted(latenciesMs_);
+   std::sort(sorted.begin(), sorted.end());
+   size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+   rank = std::max<size_t>(1, std::min(rank, sorted.size()));
+   return sorted[rank - 1];
+}
+
+
+SimulatedController::SimulatedController() :
+   requestTerminator_("\r"),
+   fixedRequestLength_(0),
+   echoUnmatched_(false),
+   baudRate_(9600),
+   responseDelayMs_(0.0),
+   jitterMs_(0.0),
+   randomState_(1),
+   transmitFreeMs_(0.0),
+   receiveFreeMs_(0.0)
+{
+}
+
+
+bool
+SimulatedController::LoadScript(std::istream& script,
+      std::string& errorMessage)
+{
+   std::string line;
+   unsigned lineNumber = 0;
+   while (std::getline(script, line))
+   {
+      ++lineNumber;
+      if (!line.empty() && line[line.size() - 1] == '\r')
+         line.erase(line.size() - 1);
+      if (line.empty() || line[0] == '#')
+         continue;
+
+      std::ostringstream where;
+      where << "Line " << lineNumber << " of the script: ";
+
+      std::string::size_type tab = line.find('\t');
+      if (tab == std::string::npos)
+      {
+         errorMessage = where.str() + "expected a request and a response "
+            "separated by a tab";
+         return false;
+      }
+      std::string request = line.substr(0, tab);
+      std::string response = line.substr(tab + 1);
+
+      // A trailing asterisk is a wildcard unless escaped
+      bool prefixMatch = false;
+      if (!request.empty() && request[request.size() - 1] == '*' &&
+            !(request.size() >= 2 && request[request.size() - 2] == '\\'))
+      {
+         prefixMatch = true;
+         request.erase(request.size() - 1);
+      }
+
+      std::string requestBytes, responseBytes;
+      if (!UnescapeSimulatorString(request, requestBytes) ||
+            !UnescapeSimulatorString(response, responseBytes))
+      {
+         errorMessage = where.str() + "invalid escape sequence";
+         return false;
+      }
+      AddRule(requestBytes, responseBytes, prefixMatch);
+   }
+   return true;
+}
+
+
+void
+SimulatedController::AddRule(const std::string& request,
+      const std::string& response, bool prefixMatch)
+{
+   Rule rule;
+   rule.request = request;
+   rule.response = response;
+   rule.prefixMatch = prefixMatch;
+   rules_.push_back(rule);
+}
+
+
+void
+SimulatedController::ClearRules()
+{
+   rules_.clear();
+}
+
+
+void
+SimulatedController::SetRequestTerminator(const std::string& terminator)
+{
+   requestTerminator_ = terminator;
+   partialRequest_.clear();
+}
+
+
+void
+SimulatedController::SetFixedRequestLength(size_t length)
+{
+   fixedRequestLength_ = length;
+   partialRequest_.clear();
+}
+
+
+void
+SimulatedController::SetDefaultResponse(const std::string& response)
+{
+   defaultResponse_ = response;
+}
+
+
+void
+SimulatedController::SetEchoUnmatched(bool echo)
+{
+   echoUnmatched_ = echo;
+}
+
+
+void
+SimulatedController::SetRandomSeed(unsigned long seed)
+{
+   randomState_ = static_cast<long>(seed % 2147483647UL);
+   if (randomState_ == 0)
+      randomState_ = 1;
+}
+
+
+void
+SimulatedController::Write(const char* data, size_t length, double nowMs)
+{
+   const double byteMs = ByteTimeMs();
+   double t = std::max(nowMs, transmitFreeMs_);
+   for (size_t i = 0; i < length; ++i)
+   {
+      t += byteMs;
+      partialRequest_ += data[i];
+
+      if (fixedRequestLength_ > 0)
+      {
+         if (partialRequest_.size() == fixedRequestLength_)
+         {
+            HandleRequest(partialRequest_, t, nowMs);
+            partialRequest_.clear();
+         }
+      }
+      else if (!requestTerminator_.empty() &&
+            partialRequest_.size() >= requestTerminator_.size() &&
+            partialRequest_.compare(
+               partialRequest_.size() - requestTerminator_.size(),
+               requestTerminator_.size(), requestTerminator_) == 0)
+      {
+         HandleRequest(partialRequest_, t, nowMs);
+         partialRequest_.clear();
+      }
+   }
+   transmitFreeMs_ = t;
+
+   if (fixedRequestLength_ == 0 && requestTerminator_.empty() &&
+         !partialRequest_.empty())
+   {
+      HandleRequest(partialRequest_, t, nowMs);
+      partialRequest_.clear();
+   }
+}
+
+
+size_t
+SimulatedController::Read(char* buffer, size_t maxLength, double nowMs)
+{
+   size_t count = 0;
+   while (count < maxLength && !input_.empty() &&
+         input_.front().timeMs <= nowMs)
+   {
+      buffer[count++] = input_.front().byte;
+      input_.pop_front();
+
+      if (!pendingResponses_.empty() &&
+            --pendingResponses_.front().remainingBytes == 0)
+      {
+         statistics_.Record(pendingResponses_.front().requestTimeMs, nowMs);
+         pendingResponses_.pop_front();
+      }
+   }
+   return count;
+}
+
+
+double
+SimulatedController::GetNextByteTimeMs() const
+{
+   if (input_.empty())
+      return -1.0;
+   return input_.front().timeMs;
+}
+
+
+void
+SimulatedController::Purge()
+{
+   input_.clear();
+   pendingResponses_.clear();
+   partialRequest_.clear();
+}
+
+
+void
+SimulatedController::HandleRequest(const std::string& rawRequest,
+      double completeMs, double writtenMs)
+{
+   std::string request = rawRequest;
+   if (fixedRequestLength_ == 0 && !requestTerminator_.empty())
+      request.erase(request.size() - requestTerminator_.size());
+
+   const std::string* response = FindResponse(request);
+   if (!response)
+      response = echoUnmatched_ ? &rawRequest : &defaultResponse_;
+   if (response->empty())
+      return;
+
+   const double byteMs = ByteTimeMs();
+   double t = std::max(completeMs + responseDelayMs_ + NextJitterMs(),
+         receiveFreeMs_);
+   for (std::string::const_iterator it = response->begin(),
+         end = response->end(); it != end; ++it)
+   {
+      t += byteMs;
+      PendingByte pending;
+      pending.byte = *it;
+      pending.timeMs = t;
+      input_.push_back(pending);
+   }
+   receiveFreeMs_ = t;
+
+   PendingResponse pendingResponse;
+   pendingResponse.remainingBytes = response->size();
+   pendingResponse.requestTimeMs = writtenMs;
+   pendingResponses_.push_back(pendingResponse);
+}
+
+
+const std::string*
+SimulatedController::FindResponse(const std::string& request) const
+{
+   for (std::vector<Rule>::const_iterator it = rules_.begin(),
+         end = rules_.end(); it != end; ++it)
+   {
+      if (it->prefixMatch ?
+            request.compare(0, it->request.size(), it->request) == 0 :
+            request == it->request)
+         return &it->response;
+   }
+   return 0;
+}
+
+
+double
+SimulatedController::ByteTimeMs() const
+{
+   // Start bit, 8 data bits, stop bit
+   if (baudRate_ <= 0)
+      return 0.0;
+   return 10.0 * 1000.0 / baudRate_;
+}
+
+
+double
+SimulatedController::NextJitterMs()
+{
+   if (jitterMs_ <= 0.0)
+      return 0.0;
+   // Park-Miller generator (with Schrage's method to avoid overflow);
+   // plenty for simulated timing
+   const long m = 2147483647L, a = 48271L, q = m / a, r = m % a;
+   randomState_ = a * (randomState_ % q) - r * (randomState_ / q);
+   if (randomState_ <= 0)
+      randomState_ += m;
+   return jitterMs_ * (randomState_ / static_cast<double>(m));
+}
@@ -0,0 +1,172 @@
+// DESCRIPTION:   Scripted serial controller with a model of line timing, used
+//                by the simulated serial port.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <deque>
+#include <istream>
+#include <string>
+#include <vector>
+
+
+/**
+ * \brief Convert C-style escapes (\\r, \\n, \\t, \\0, \\\\, \\*, \\xHH) to bytes.
+ *
+ * \return false if an escape sequence is invalid
+ */
+bool UnescapeSimulatorString(const std::string& escaped, std::string& bytes);
+
+
+/**
+ * \brief Round-trip statistics of a simulated port.
+ *
+ * A round trip starts when the request has been written and ends when the
+ * last byte of its response has been read.
+ */
+class RoundTripStatistics
+{
+public:
+   RoundTripStatistics();
+
+   void Reset();
+   void Record(double startMs, double endMs);
+
+   size_t GetCount() const { return latenciesMs_.size(); }
+   // Round trips per second between the start of the first and the end of
+   // the last; 0 if fewer than two
+   double GetRate() const;
+   double GetMeanMs() const;
+   double GetMaxMs() const;
+   // p between 0 and 100; nearest-rank
+   double GetPercentileMs(double p) const;
+
+private:
+   std::vector<double> latenciesMs_;
+   double firstStartMs_;
+   double lastEndMs_;
+};
+
+
+/**
+ * \brief Emulates a serial controller that answers scripted requests.
+ *
+ * Requests are split on a terminator (or, for binary protocols, into
+ * fixed-length frames) and looked up in a table of rules. Each rule has a
+ * request and a response; a request ending in an (unescaped) asterisk
+ * matches any request that starts with the text before the asterisk. The
+ * first matching rule wins.
+ *
+ * Timing follows a simple model of the line. Each byte takes 10 bit times
+ * at the configured baud rate, in both directions. A response starts after
+ * the full request has been transmitted plus the response delay plus a
+ * random jitter (uniform between 0 and the jitter setting), and no earlier
+ * than the end of the previous response. Bytes become readable only once
+ * they have been transmitted.
+ *
+ * All times are in milliseconds on a clock provided by the caller, so that
+ * the model can be tested without waiting.
+ */
+class SimulatedController
+{
+public:
+   SimulatedController();
+
+   /**
+    * \brief Load rules from a script.
+    *
+    * One rule per line: the request, a tab, and the response. Both use
+    * C-style escapes (\\r, \\n, \\t, \\\\, \\xHH); use \\* for a literal
+    * asterisk at the end of a request. Empty lines and lines starting with
+    * '#' are ignored.
+    *
+    * \return false (with a message in errorMessage) if a line is invalid
+    */
+   bool LoadScript(std::istream& script, std::string& errorMessage);
+   void AddRule(const std::string& request, const std::string& response,
+         bool prefixMatch = false);
+   void ClearRules();
+   size_t GetRuleCount() const { return rules_.size(); }
+
+   // Empty terminator and zero length: every write is one request
+   void SetRequestTerminator(const std::string& terminator);
+   void SetFixedRequestLength(size_t length);
+   // Response to requests that match no rule; ignored if echoing
+   void SetDefaultResponse(const std::string& response);
+   void SetEchoUnmatched(bool echo);
+
+   // Baud rate of 0 means transmission takes no time
+   void SetBaudRate(long baud) { baudRate_ = baud; }
+   long GetBaudRate() const { return baudRate_; }
+   void SetResponseDelayMs(double delayMs) { responseDelayMs_ = delayMs; }
+   double GetResponseDelayMs() const { return responseDelayMs_; }
+   void SetJitterMs(double jitterMs) { jitterMs_ = jitterMs; }
+   double GetJitterMs() const { return jitterMs_; }
+   void SetRandomSeed(unsigned long seed);
+
+   void Write(const char* data, size_t length, double nowMs);
+   // Returns the number of bytes read
+   size_t Read(char* buffer, size_t maxLength, double nowMs);
+   // Time at which the next byte can be read; negative if none is pending
+   double GetNextByteTimeMs() const;
+   // Discards pending input and any partial request
+   void Purge();
+
+   const RoundTripStatistics& GetStatistics() const { return statistics_; }
+   void ResetStatistics() { statistics_.Reset(); }
+
+private:
+   struct Rule
+   {
+      std::string request;
+      std::string response;
+      bool prefixMatch;
+   };
+
+   struct PendingByte
+   {
+      char byte;
+      double timeMs;
+   };
+
+   struct PendingResponse
+   {
+      size_t remainingBytes;
+      double requestTimeMs;
+   };
+
+   void HandleRequest(const std::string& request, double completeMs,
+         double writtenMs);
+   const std::string* FindResponse(const std::string& request) const;
+   double ByteTimeMs() const;
+   double NextJitterMs();
+
+   std::vector<Rule> rules_;
+   std::string requestTerminator_;
+   size_t fixedRequestLength_;
+   std::string defaultResponse_;
+   bool echoUnmatched_;
+
+   long baudRate_;
+   double responseDelayMs_;
+   double jitterMs_;
+   long randomState_;
+
+   std::string partialRequest_;
+   double transmitFreeMs_;
+   double receiveFreeMs_;
+   std::deque<PendingByte> input_;
+   std::deque<PendingResponse> pendingResponses_;
+
+   RoundTripStatistics statistics_;
+};
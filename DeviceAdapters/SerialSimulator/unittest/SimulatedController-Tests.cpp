@@ -0,0 +1,198 @@
+// DESCRIPTION:   Unit tests for SerialSimulator
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include <gtest/gtest.h>
+
+#include "SimulatedController.h"
+
+#include <sstream>
+#include <string>
+
+
+namespace {
+
+std::string ReadAll(SimulatedController& controller, double nowMs)
+{
+   char buf[256];
+   size_t n = controller.Read(buf, sizeof(buf), nowMs);
+   return std::string(buf, n);
+}
+
+void WriteString(SimulatedController& controller, const std::string& s,
+      double nowMs)
+{
+   controller.Write(s.data(), s.size(), nowMs);
+}
+
+} // anonymous namespace
+
+
+TEST(SimulatedControllerTests, LoadsScript)
+{
+   std::istringstream script(
+         "# comment\n"
+         "\n"
+         "VER\tPrior 1.0\\r\n"
+         "PS,*\tR\\r\n"
+         "STAR\\*\tliteral\\x0d\n");
+   SimulatedController controller;
+   std::string message;
+   ASSERT_TRUE(controller.LoadScript(script, message)) << message;
+   EXPECT_EQ(3u, controller.GetRuleCount());
+   controller.SetBaudRate(0);
+
+   WriteString(controller, "VER\r", 0.0);
+   EXPECT_EQ("Prior 1.0\r", ReadAll(controller, 0.0));
+   WriteString(controller, "PS,100,200\r", 0.0);
+   EXPECT_EQ("R\r", ReadAll(controller, 0.0));
+   WriteString(controller, "STAR*\r", 0.0);
+   EXPECT_EQ("literal\r", ReadAll(controller, 0.0));
+   WriteString(controller, "STARS\r", 0.0);
+   EXPECT_EQ("", ReadAll(controller, 0.0));
+}
+
+TEST(SimulatedControllerTests, RejectsInvalidScript)
+{
+   std::istringstream noTab("VER Prior\n");
+   SimulatedController controller;
+   std::string message;
+   EXPECT_FALSE(controller.LoadScript(noTab, message));
+   EXPECT_NE(std::string::npos, message.find("Line 1"));
+
+   std::istringstream badEscape("VER\t\\q\n");
+   EXPECT_FALSE(controller.LoadScript(badEscape, message));
+}
+
+TEST(SimulatedControllerTests, HandlesUnmatchedRequests)
+{
+   SimulatedController controller;
+   controller.SetBaudRate(0);
+   controller.SetRequestTerminator("\n");
+   WriteString(controller, "hello\n", 0.0);
+   EXPECT_EQ("", ReadAll(controller, 0.0));
+
+   controller.SetDefaultResponse("?\n");
+   WriteString(controller, "hello\n", 0.0);
+   EXPECT_EQ("?\n", ReadAll(controller, 0.0));
+
+   controller.SetEchoUnmatched(true);
+   WriteString(controller, "hel", 0.0);
+   WriteString(controller, "lo\n", 0.0);
+   EXPECT_EQ("hello\n", ReadAll(controller, 0.0));
+}
+
+TEST(SimulatedControllerTests, SplitsFixedLengthRequests)
+{
+   SimulatedController controller;
+   controller.SetBaudRate(0);
+   controller.SetFixedRequestLength(3);
+   controller.AddRule(std::string("\x01\x02\x03", 3), "ok");
+   WriteString(controller, std::string("\x01\x02\x03\x01\x02", 5), 0.0);
+   EXPECT_EQ("ok", ReadAll(controller, 0.0));
+   WriteString(controller, std::string("\x03", 1), 0.0);
+   EXPECT_EQ("ok", ReadAll(controller, 0.0));
+}
+
+TEST(SimulatedControllerTests, ModelsLineTiming)
+{
+   // 10 bits per byte at 10000 baud: 1 ms per byte
+   SimulatedController controller;
+   controller.SetBaudRate(10000);
+   controller.SetResponseDelayMs(5.0);
+   controller.AddRule("A", "xy\r");
+
+   WriteString(controller, "A\r", 100.0);
+   // Request done at 102, response starts at 107, bytes at 108, 109, 110
+   EXPECT_DOUBLE_EQ(108.0, controller.GetNextByteTimeMs());
+   EXPECT_EQ("", ReadAll(controller, 107.9));
+   EXPECT_EQ("x", ReadAll(controller, 108.0));
+   EXPECT_EQ("y", ReadAll(controller, 109.5));
+   EXPECT_EQ(0u, controller.GetStatistics().GetCount());
+   EXPECT_EQ("\r", ReadAll(controller, 111.0));
+   EXPECT_LT(controller.GetNextByteTimeMs(), 0.0);
+
+   ASSERT_EQ(1u, controller.GetStatistics().GetCount());
+   EXPECT_DOUBLE_EQ(11.0, controller.GetStatistics().GetMaxMs());
+}
+
+TEST(SimulatedControllerTests, QueuesBackToBackRequests)
+{
+   SimulatedController controller;
+   controller.SetBaudRate(10000);
+   controller.AddRule("A", "12\r");
+
+   // Requests are done at 2 and 4 ms. The first response takes 3 to 5 ms;
+   // the second cannot start until the first has been sent.
+   WriteString(controller, "A\rA\r", 0.0);
+   EXPECT_EQ("12\r", ReadAll(controller, 5.0));
+   EXPECT_EQ("", ReadAll(controller, 5.5));
+   EXPECT_DOUBLE_EQ(6.0, controller.GetNextByteTimeMs());
+   EXPECT_EQ("12\r", ReadAll(controller, 8.0));
+   EXPECT_EQ(2u, controller.GetStatistics().GetCount());
+}
+
+TEST(SimulatedControllerTests, JitterStaysInRange)
+{
+   SimulatedController controller;
+   controller.SetBaudRate(0);
+   controller.SetJitterMs(2.0);
+   controller.SetRandomSeed(42);
+   controller.AddRule("A", "B");
+   for (int i = 0; i < 100; ++i)
+   {
+      double t = 10.0 * i;
+      WriteString(controller, "A\r", t);
+      double next = controller.GetNextByteTimeMs();
+      EXPECT_GE(next, t);
+      EXPECT_LE(next, t + 2.0);
+      EXPECT_EQ("B", ReadAll(controller, t + 2.0));
+   }
+}
+
+TEST(SimulatedControllerTests, PurgeDiscardsPendingInput)
+{
+   SimulatedController controller;
+   controller.SetBaudRate(0);
+   controller.SetResponseDelayMs(1.0);
+   controller.AddRule("A", "B");
+   WriteString(controller, "A\r", 0.0);
+   controller.Purge();
+   EXPECT_EQ("", ReadAll(controller, 10.0));
+   EXPECT_EQ(0u, controller.GetStatistics().GetCount());
+}
+
+TEST(RoundTripStatisticsTests, ComputesPercentiles)
+{
+   RoundTripStatistics stats;
+   EXPECT_EQ(0.0, stats.GetPercentileMs(99.0));
+   for (int i = 1; i <= 100; ++i)
+      stats.Record(10.0 * i, 10.0 * i + i);
+   EXPECT_EQ(100u, stats.GetCount());
+   EXPECT_DOUBLE_EQ(50.0, stats.GetPercentileMs(50.0));
+   EXPECT_DOUBLE_EQ(99.0, stats.GetPercentileMs(99.0));
+   EXPECT_DOUBLE_EQ(100.0, stats.GetMaxMs());
+   EXPECT_DOUBLE_EQ(50.5, stats.GetMeanMs());
+   // 100 round trips from 10 ms to 1100 ms
+   EXPECT_DOUBLE_EQ(100.0 * 1000.0 / 1090.0, stats.GetRate());
+
+   stats.Reset();
+   EXPECT_EQ(0u, stats.GetCount());
+   EXPECT_EQ(0.0, stats.GetRate());
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
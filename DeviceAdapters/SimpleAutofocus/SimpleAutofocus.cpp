@@ -184,14 +184,11 @@ SimpleAutofocus::SimpleAutofocus(const char* name) :
    busy_(false),
    latestSharpness_(0.), 
    enableAutoShuttering_(1),
-   sizeOfTempShortBuffer_(0), 
-   pSmoothedIm_(NULL), 
-   sizeOfSmoothedIm_(0), 
-   pShort_(NULL),
    recalculate_(0), 
    mean_(0.), 
    standardDeviationOverMean_(0.),
    pPoints_(NULL), 
+   scoreTimeMs_(0.),
    exposureForAutofocusAcquisition_(0.), 
    binningForAutofocusAcquisition_(0)
 {
@@ -206,10 +203,6 @@ int SimpleAutofocus::Shutdown()
 SimpleAutofocus::~SimpleAutofocus()
 {
    delete pPoints_;
-   if( NULL!=pShort_)
-      free(pShort_);
-   if(NULL!=pSmoothedIm_)
-      free(pSmoothedIm_);
    Shutdown();
 }
 
@@ -310,6 +303,12 @@ int SimpleAutofocus::Initialize()
    AddAllowedValue("SearchAlgorithm","Brent");
    AddAllowedValue("SearchAlgorithm","BruteForce");
    searchAlgorithm_ = "Brent";
+   pAct = new CPropertyAction(this, &SimpleAutofocus::OnFocusMetric);
+   CreateProperty("FocusMetric",FocusScorer::GetMetricName(scorer_.GetMetric()),MM::String, false, pAct);
+   std::vector<std::string> metrics = FocusScorer::GetMetricNames();
+   SetAllowedValues("FocusMetric",metrics);
+   pAct = new CPropertyAction(this, &SimpleAutofocus::OnScoreTime);
+   CreateProperty("ScoreTimeMs","0",MM::Float, true, pAct);
    UpdateStatus();
    return DEVICE_OK;
 }
@@ -672,6 +671,33 @@ int SimpleAutofocus::OnCropFactor(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 };
 
+int SimpleAutofocus::OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(FocusScorer::GetMetricName(scorer_.GetMetric()));
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      FocusScorer::Metric metric;
+      if (!FocusScorer::GetMetricFromName(name, metric))
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      scorer_.SetMetric(metric);
+   }
+   return DEVICE_OK;
+}
+
+int SimpleAutofocus::OnScoreTime(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(scoreTimeMs_);
+   }
+   return DEVICE_OK;
+}
+
 int SimpleAutofocus::OnSharpnessScore(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
@@ -705,210 +731,25 @@ double SimpleAutofocus::SharpnessAtZ(const double z)
    MMThreadGuard g(busyLock_);
    busy_ = true;
    Z(z);
-   min1_ = 1.e8;
-   min2_ = 1.e8;
-   max1_ = -1.e8;
-   max2_ = -1.e8;
-   // the crop factor, median filter and 3x3 high-pass process follows the java implementation from Pakpoom Subsoontorn & Hernan Garcia  -- KH
    int w0 = 0, h0 = 0, d0 = 0;
    double sharpness = 0;
    pCore_->GetImageDimensions(w0, h0, d0);
-   int width =  (int)(cropFactor_*w0);
-   int height = (int)(cropFactor_*h0);
-   int ow = (int)(((1-cropFactor_)/2)*w0);
-   int oh = (int)(((1-cropFactor_)/2)*h0);
-   const unsigned long thisSize = sizeof(*pSmoothedIm_)*width*height;
-   if( thisSize != sizeOfSmoothedIm_)
-   {
-      if(NULL!=pSmoothedIm_)
-         free(pSmoothedIm_);
-      // malloc is faster than new...
-      pSmoothedIm_ = (float*)malloc(thisSize);
-      if(NULL!=pSmoothedIm_)
-      {
-         sizeOfSmoothedIm_ = thisSize;
-      }
-      else // todo throw out of here...
-      {
-         busy_=false;
-         return sharpness;
-      }
-   }
-   // copy from MM image to the working buffer
-   ImgBuffer image(w0,h0,d0);
    //snap an image
    const unsigned char* pI = reinterpret_cast<const unsigned char*>(pCore_->GetImage());
-   const unsigned short* pSInput = reinterpret_cast<const unsigned short*>(pI);
-   int iindex;
-   bool legalFormat = false;
-   // to keep it simple always copy to a short array
-   if( 0 != pSInput)
-   {
-      switch( d0)
-      {
-      case 1:
-         legalFormat = true;
-         if( sizeOfTempShortBuffer_ != sizeof(unsigned short)*w0*h0)
-         {
-            if( NULL != pShort_)
-               free(pShort_);
-            // malloc is faster than new...
-            pShort_ = (unsigned short*)malloc( sizeof(unsigned short)*w0*h0);
-            if( NULL!=pShort_)
-            {
-               sizeOfTempShortBuffer_ = sizeof(unsigned short)*w0*h0;
-            }
-         }
-         for(iindex = 0; iindex < w0*h0; ++iindex)
-         {
-            pShort_[iindex] = pI[iindex];
-         }
-         break;
-      case 2:
-         legalFormat = true;
-         if( sizeOfTempShortBuffer_ != sizeof(unsigned short)*w0*h0)
-         {
-            if( NULL != pShort_)
-               free(pShort_);
-            pShort_ = (unsigned short*)malloc( sizeof(unsigned short)*w0*h0);
-            if( NULL!=pShort_)
-            {
-               sizeOfTempShortBuffer_ = sizeof(unsigned short)*w0*h0;
-            }
-         }
-         for(iindex = 0; iindex < w0*h0; ++iindex)
-         {
-            pShort_[iindex] = pSInput[iindex];
-         }
-         break;
-      default:
-         break;
-      }
-   }
-   if(legalFormat)
+   if( 0 != pI && (1 == d0 || 2 == d0))
    {
-      // calculate the standard deviation & mean
-      long nPts = 0;
-      mean_ = 0;
-      double M2 = 0;
-      double delta;
-      // one-pass algorithm for mean and std from Welford / Knuth  - KH
-      for (int i=0; i<width; i++)
-      {
-         for (int j=0; j<height; j++)
-         {
-            ++nPts;
-            long value = pShort_[ow+i+ width*(oh+j)];
-            delta = value - mean_;
-            mean_ = mean_ + delta/nPts;
-            M2 = M2 + delta*(value - mean_); // #This expression uses the new value of mean_
-         }
-      }
-      //double variance_n = M2/nPts;
-      double variance = M2/(nPts - 1);
-      standardDeviationOverMean_ = 0.;
-      double meanScaling = 1.;
-      if( 0. != mean_)
-      {
-         standardDeviationOverMean_ = pow(variance,0.5)/mean_;
-         meanScaling = 1./mean_;
-      }
-      LogMessage("N " + boost::lexical_cast<std::string,long>(nPts) + " mean " +  boost::lexical_cast<std::string,float>((float)mean_) + " nrmlzd std " +  boost::lexical_cast<std::string,float>((float)standardDeviationOverMean_) );
-      // ToDO -- eliminate copy above.
-      int x[9];
-      int y[9];
-      /*Apply 3x3 median filter to reduce shot noise*/
-      for (int i=0; i<width; i++) {
-         for (int j=0; j<height; j++) {
-            float theValue;
-            x[0]=ow+i-1;
-            y[0]= (oh+j-1);
-            x[1]=ow+i;
-            y[1]= (oh+j-1);
-            x[2]=ow+i+1;
-            y[2]= (oh+j-1);
-            x[3]=ow+i-1;
-            y[3]=(oh+j);
-            x[4]=ow+i;
-            y[4]=(oh+j);
-            x[5]=ow+i+1;
-            y[5]=(oh+j);
-            x[6]=ow+i-1;
-            y[6]=(oh+j+1);
-            x[7]=ow+i;
-            y[7]=(oh+j+1);
-            x[8]=ow+i+1;
-            y[8]=(oh+j+1);
-            // truncate the median filter window  -- duplicate edge points
-            // this could be more efficient, we could fill in the interior image [1,w0-1]x[1,h0-1] then explicitly fill in the edge pixels.
-            for(int ij =0; ij < 9; ++ij)
-            {
-               if( x[ij] < 0)
-                  x[ij] = 0;
-               else if( w0-1 < x[ij])
-                  x[ij] = w0-1;
-               if( y[ij] < 0)
-                  y[ij] = 0;
-               else if( h0-1 < y[ij])
-                  y[ij] = h0-1;
-            }
-            std::vector<unsigned short> windo;
-            for(int ij = 0; ij < 9; ++ij)
-            {
-               windo.push_back(pShort_[ x[ij] + w0*y[ij]]);
-            }
-            // N.B. this window filler as ported from java needs to have a pad guaranteed around the cropped image!!!! KH
-            //windo[0] = pShort_[ow+i-1 + width*(oh+j-1)];
-            //windo[1] = pShort_[ow+i+ width*(oh+j-1)];
-            //windo[2] = pShort_[ow+i+1+ width*(oh+j-1)];
-            //windo[3] = pShort_[ow+i-1+ width*(oh+j)];
-            //windo[4] = pShort_[ow+i+ width*(oh+j)];
-            //windo[5] = pShort_[ow+i+1+ width*(oh+j)];
-            //windo[6] = pShort_[ow+i-1+ width*(oh+j+1)];
-            //windo[7] = pShort_[ow+i+ width*(oh+j+1)];
-            //windo[8] = pShort_[ow+i+1+ width*(oh+j+1)];
-            // to reduce effect of bleaching on the high-pass sharpness measurement, i use the image normalized by the mean - KH.
-            theValue = (float)((double)FindMedian(windo)*meanScaling);
-            pSmoothedIm_[i + j*width] = theValue;
-            // the dynamic range of the normalized image is a very strong function of the image sharpness, also  - KH
-            // here I'm using dynamic range of the median-filter image
-            // a faster measure could skip the median filter, but use the sum of the 5 - 10 highest and 5 - 10 lowest normalized pixels
-            // average over a couple of points to lessen effect of fluctuations & noise
-            // todo - make the active measure of image sharpness user-selectable
-            // save the  max points and the min points
-            if( theValue < min1_ )
-            {
-               min2_ = min1_;
-               min1_ = theValue;
-            }
-            else if (theValue < min2_)
-            {
-               min2_=theValue;
-            }
-            if( max1_ < theValue)
-            {
-               max2_ = max1_;
-               max1_ = theValue;
-            }
-            else if (max2_ < theValue )
-            {
-               max2_=theValue;
-            }
-         }
-      }
-      /*Edge detection using a 3x3 filter: [-2 -1 0; -1 0 1; 0 1 2]. Then sum all pixel values. Ideally, the sum is large if most edges are sharp*/
-      for (int k=1; k<width-1; k++) {
-         for (int l=1; l<height-1; l++)
-         {
-            double convolvedValue = -2.0*pSmoothedIm_[k-1 + width*(l-1)] - pSmoothedIm_[k+ width*(l-1)]-pSmoothedIm_[k-1 + width*l]+pSmoothedIm_[k+1 + width*l]+pSmoothedIm_[k+ width*(l+1)]+2.0*pSmoothedIm_[k+1+ width*(l+1)];
-            sharpness = sharpness + convolvedValue*convolvedValue;
-         }
-      }
-      //free(pShort);
+      // the crop factor, median filter and 3x3 high-pass process of the default metric follows the java implementation from Pakpoom Subsoontorn & Hernan Garcia  -- KH
+      scorer_.SetCropFactor(cropFactor_);
+      MM::MMTime tStart = GetCurrentMMTime();
+      sharpness = scorer_.Score(pI, w0, h0, d0);
+      scoreTimeMs_ = (GetCurrentMMTime() - tStart).getMsec();
+      mean_ = scorer_.GetMean();
+      standardDeviationOverMean_ = scorer_.GetStdOverMean();
+      LogMessage(std::string(FocusScorer::GetMetricName(scorer_.GetMetric())) + " mean " +  boost::lexical_cast<std::string,float>((float)mean_) + " nrmlzd std " +  boost::lexical_cast<std::string,float>((float)standardDeviationOverMean_) + " score time ms " + boost::lexical_cast<std::string,double>(scoreTimeMs_) );
    }
    busy_ = false;
    latestSharpness_ = sharpness;
-   pPoints_->InsertPoint(acquisitionSequenceNumber_++,(float)z,(float)mean_,(float)standardDeviationOverMean_,latestSharpness_,(float)( 0.5*((max1_+max2_)-(min1_+min2_))));
+   pPoints_->InsertPoint(acquisitionSequenceNumber_++,(float)z,(float)mean_,(float)standardDeviationOverMean_,latestSharpness_,(float)scorer_.GetNormalizedDynamicRange());
    return sharpness;
 }
 
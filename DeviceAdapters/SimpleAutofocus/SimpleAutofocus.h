@@ -26,6 +26,7 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+#include "FocusScore.h"
 
 #include <string>
 //#include <iostream>
@@ -42,7 +43,7 @@ class SAFData;
 
 // computational utility functions
 
-double GetScore(short* img, int w0, int h0, double cropFactor);
+double GetScore(unsigned short* img, int w0, int h0, double cropFactor);
 
 class SimpleAutofocus : public CAutoFocusBase<SimpleAutofocus>
 {
@@ -104,6 +105,8 @@ public:
    int OnStandardDeviationOverMean(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSearchAlgorithm(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFocusMetric(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScoreTime(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 
 private:
@@ -142,17 +145,14 @@ private:
    double latestSharpness_;
 
    long enableAutoShuttering_;
-   unsigned long sizeOfTempShortBuffer_;
 
-   float* pSmoothedIm_;
-   unsigned long sizeOfSmoothedIm_;
-
-   unsigned short* pShort_;
    // a flag to trigger recalculation
    long recalculate_;
    double mean_;
    double standardDeviationOverMean_;
    SAFData* pPoints_;
+   FocusScorer scorer_;
+   double scoreTimeMs_;
    std::string selectedChannelConfig_;
    std::vector<std::string> possibleChannels_;
    void RefreshChannelsToSelect(void);
@@ -163,15 +163,6 @@ private:
    long binningForAutofocusAcquisition_; // over-ride the camera setting if this is non-0
 
 
-   //std::multiset<float> mins_;
-   //std::mulitset<float> maxs_;
-   //const int nExtrema_ = 5;
-
-   float min1_;
-   float min2_;
-   float max1_;
-   float max2_;
-
    // this defines member functions that operate on evaluator DoubleFunctionOfDouble
 #include "Brent.h"
 
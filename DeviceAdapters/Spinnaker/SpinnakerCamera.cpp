@@ -4,6 +4,7 @@
 
 #include "SpinnakerCamera.h"
 #include "ModuleInterface.h"
+#include "PixelConversion.h"
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -831,48 +832,16 @@ int SpinnakerCamera::OnLineBoolPropertyChanged(std::string name, MM::PropertyBas
 
 void SpinnakerCamera::Unpack12Bit(uint16_t* unpacked, const uint8_t* packed, size_t width, size_t height, bool flip)
 {
-   unsigned int u_idx;
-   int p_idx;
-   for (u_idx = 0, p_idx = 0; u_idx < width * height; u_idx++)
-   {
-      if (u_idx % 2 == 0)
-      {
-         auto pt = (Unpack12Struct*)(packed + p_idx);
-         if (!flip)
-            unpacked[u_idx] = ((((unsigned short)pt->_1 & 0x0F) << 8) | ((unsigned short)pt->_2));
-         else
-            unpacked[u_idx] = ((((unsigned short)pt->_1 & 0x0F) | ((unsigned short)pt->_2) << 4));
-      }
-      else
-      {
-         auto pt = (Unpack12Struct*)(packed + p_idx);
-         unpacked[u_idx] = ((((unsigned short)pt->_0) << 4) | (((unsigned short)pt->_1) >> 4));
-         p_idx += 3;
-      }
-   }
+   // flip: Mono12Packed (high bits in the outer bytes) rather than Mono12p
+   if (flip)
+      PixelConverter::UnpackMono12Packed(unpacked, packed, width * height);
+   else
+      PixelConverter::UnpackMono12p(unpacked, packed, width * height);
 }
 
 void SpinnakerCamera::RGBtoBGRA(uint8_t* data, size_t imageBuffLength)
 {
-   long dest = 0;
-   for (long i = 0; i < imageBuffLength; i++)
-   {
-      if (i % 3 == 0)
-      {
-         m_imageBuff[dest + 2] = data[i];
-      }
-      else if (i % 3 == 2)
-      {
-         m_imageBuff[dest - 2] = data[i];
-         dest++;
-         m_imageBuff[dest] = 0;
-      }
-      else
-      {
-         m_imageBuff[dest] = data[i];
-      }
-      dest++;
-   }
+   PixelConverter::RGB8ToBGRA(m_imageBuff, data, imageBuffLength / 3);
 }
 
 
@@ -96,14 +96,6 @@ private:
    int allocateImageBuffer(const std::size_t size, const SPKR::PixelFormatEnums buffer_type);
    friend class SpinnakerAcquisitionThread;
 
-#pragma pack(push, 1)
-   struct Unpack12Struct {
-      uint8_t _2;
-      uint8_t _1;
-      uint8_t _0;
-   };
-#pragma pack(pop)
-
    enum BinningControl
    {
       Independent,
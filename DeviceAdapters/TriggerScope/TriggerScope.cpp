@@ -1771,6 +1771,19 @@ int CTriggerScopeDAC::AddToPropertySequence(const char* propertyName, const char
 		return DEVICE_UNSUPPORTED_COMMAND;
 }
 /**
+* Replace the sequence with numeric values
+*/
+int CTriggerScopeDAC::SetPropertySequence(const char* propertyName, const double* values, long count) 
+{
+	if(strcmp(propertyName,"Volts")==0)
+	{
+		sequence_.assign(values, values + count);
+		return DEVICE_OK;
+	}
+	else
+		return DEVICE_UNSUPPORTED_COMMAND;
+}
+/**
 * Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
 */
 int CTriggerScopeDAC::SendPropertySequence(const char* propertyName) 
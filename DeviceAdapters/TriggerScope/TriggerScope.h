@@ -219,6 +219,10 @@ public:
     */
     int AddToPropertySequence(const char* propertyName, const char* value) ;
     /**
+    * Replace the sequence with numeric values
+    */
+    int SetPropertySequence(const char* propertyName, const double* values, long count) ;
+    /**
     * Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
     */
     int SendPropertySequence(const char* propertyName) ;
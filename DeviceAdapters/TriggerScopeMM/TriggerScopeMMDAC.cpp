@@ -259,22 +259,16 @@ int CTriggerScopeMMDAC::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
    } 
    else if (eAct == MM::AfterLoadSequence)
    {
-      std::vector<std::string> sequence = pProp->GetSequence();  
-      // check for invalid values
-      std::ostringstream os;
+      std::vector<double> sequence;
+      if (!pProp->GetNumericSequence(sequence))
+         return ERR_INVALID_VALUE;
       if (sequence.size() > nrEvents_)
          return DEVICE_SEQUENCE_TOO_LARGE;
 
       ClearDASequence(); // also empties sequence_
 
-      double val;
-      for (unsigned int i=0; i < sequence.size(); i++)
-      {
-         std::istringstream os (sequence[i]);
-         os >> val;
-         // Check range?
-         sequence_.push_back(val);
-      }
+      // Check range?
+      sequence_.insert(sequence_.end(), sequence.begin(), sequence.end());
       return SendDASequence();
    }
    else if (eAct == MM::StartSequence)
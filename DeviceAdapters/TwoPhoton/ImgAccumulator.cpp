@@ -29,19 +29,15 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "ImgAccumulator.h"
-#include <math.h>
 #include <assert.h>
-#include <algorithm>
-#include <iostream>
+#include <string.h>
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
 // ImgAccumulator class
-// byte depth of 2 does summation
 
 ImgAccumulator::ImgAccumulator() :
-pixels_(0), width_(0), height_(0), pixDepth_(0), length_(1) {
-   frameIndex_ = 0;
+pixels_(0), width_(0), height_(0), pixDepth_(0), frameIndex_(0), enabled_(true) {
 }
 
 ImgAccumulator::~ImgAccumulator()
@@ -57,15 +53,8 @@ const unsigned char* ImgAccumulator::GetPixels() const
 void ImgAccumulator::AddPixels(const void* pix, unsigned sourceWidth, unsigned, unsigned offsetY)
 {
 	//pixels coming in will always be 8 bit
-	const unsigned char* pixPtr = static_cast<const unsigned char*>(pix);
-
-	for (unsigned i=0; i<height_; i++) {
-		for (unsigned j=0; j<width_; j++) {
-			int srcIdx = (offsetY+i)*sourceWidth+j;
-			int idx = i*width_+j;
-			accumulator_[idx] += pixPtr[srcIdx];
-		}
-	}
+	//only the y offset is applied; the caller positions pix horizontally
+	accumulator_.AddFrame(static_cast<const unsigned char*>(pix), sourceWidth, 0, offsetY);
 	frameIndex_++;
 }
 
@@ -75,9 +64,9 @@ void ImgAccumulator::ResetPixels()
 	if (pixels_)
 		memset(pixels_, 0, width_ * height_ * pixDepth_);
 
-	// reset accumulator
-	accumulator_.clear();
-	accumulator_.assign(width_ * height_, 0);
+	// reset accumulator; the running average window spans successive snaps
+	if (accumulator_.GetMode() != FrameAccumulator::RunningAverage)
+		accumulator_.Reset();
 
 	frameIndex_ = 0;
 }
@@ -97,7 +86,7 @@ void ImgAccumulator::Resize(unsigned xSize, unsigned ySize, unsigned pixDepth)
 
    // initialize content
    memset(pixels_, 0, width_ * height_ * pixDepth_);
-   SetupAccumulator();
+   accumulator_.Resize(width_, height_);
    frameIndex_ = 0;
 }
 
@@ -114,39 +103,23 @@ void ImgAccumulator::Resize(unsigned xSize, unsigned ySize)
    height_ = ySize;
 
    memset(pixels_, 0, width_ * height_ * pixDepth_);
-   accumulator_.resize(width_ * height_, 0.0);
+   accumulator_.Resize(width_, height_);
    frameIndex_ = 0;
 }
 
 void ImgAccumulator::SetLength(unsigned length)
 {
-   length_ = length;
-   SetupAccumulator();
+   accumulator_.SetLength(length);
 }
 
-void ImgAccumulator::SetupAccumulator() 
+void ImgAccumulator::SetMode(FrameAccumulator::Mode mode)
 {
-	accumulator_.resize(width_ * height_, 0);
+   accumulator_.SetMode(mode);
+   frameIndex_ = 0;
 }
 
 void ImgAccumulator::CalculateOutputImage()
 {
-	//Do frame averaging
-	long size = width_ * height_;
-
-	if (pixDepth_ == 1) {
-		for (long i=0; i<size; i++) {
-			//divide by number of frames
-			accumulator_[i] *= (1.0/length_);
-			pixels_[i] = (unsigned char) min(accumulator_[i], (double)UCHAR_MAX);
-		}
-	} else {
-		//reinterperet as two bytes and write to pixels
-		unsigned short* bufPtr = reinterpret_cast<unsigned short*>(pixels_);
-		for (long i=0; i<size; i++)	{
-			bufPtr[i] = (unsigned short) min(accumulator_[i], (double)USHRT_MAX);
-		}
-	}
-
+	// average, sum, running average or median, written at the output byte depth
+	accumulator_.GetOutput(pixels_, pixDepth_);
 }
-
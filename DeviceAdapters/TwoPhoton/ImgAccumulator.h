@@ -16,12 +16,14 @@
 #include <map>
 #include "MMDevice.h"
 #include "ImageMetadata.h"
+#include "FrameAccumulator.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 // ImgAccumulator class
 // ~~~~~~~~~~~~~~~~~~~~
 // Variable pixel depth image buffer, with frame averaging/rank filtering capabilities
+// Accumulation itself is done by FrameAccumulator (MMDevice)
 //
 
 class ImgAccumulator
@@ -33,7 +35,7 @@ public:
    unsigned int Width() const {return width_;}
    unsigned int Height() const {return height_;}
    unsigned int Depth() const {return pixDepth_;}
-   unsigned int Length() const {return length_;}
+   unsigned int Length() const {return accumulator_.Length();}
    void AddPixels(const void* pixArray, unsigned sourceWidth, unsigned offsetX, unsigned offsetY);
    void CalculateOutputImage();
    void ResetPixels();
@@ -42,20 +44,19 @@ public:
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Resize(unsigned xSize, unsigned ySize);
    void SetLength(unsigned length);
+   FrameAccumulator::Mode GetMode() const {return accumulator_.GetMode();}
+   void SetMode(FrameAccumulator::Mode mode);
    //Image accumulator for this channel enabled
    bool IsEnabled() const {return enabled_;}
    void SetEnable(bool s) {enabled_ = s;}
 
 private:
-	void SetupAccumulator();
-
    unsigned char* pixels_;
-   std::vector<double> accumulator_;
+   FrameAccumulator accumulator_;
 
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
-   unsigned int length_;
    unsigned int frameIndex_;
    bool enabled_;
 };
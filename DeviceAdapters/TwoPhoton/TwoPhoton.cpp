@@ -43,6 +43,9 @@ const char* g_On = "On";
 const char* g_Off = "Off";
 const char* g_OnWarp = "On+Unwarp";
 const char* g_FrameAverage = "FrameAverage";
+const char* g_FrameSum = "FrameSum";
+const char* g_RunningAverage = "RunningAverage";
+const char* g_MedianFilter = "MedianFilter";
 const char* g_RawFramesToCircularBuffer = "RawFramesToCircularBuffer";
 const char* g_PropertyDeinterlace = "Deinterlace";
 const char* g_PropertyIntegrationMethod = "IntegrationMethod";
@@ -227,6 +230,9 @@ int BitFlowCamera::Initialize()
 
    vector<string> rfValues;
    rfValues.push_back(g_FrameAverage);
+   rfValues.push_back(g_FrameSum);
+   rfValues.push_back(g_RunningAverage);
+   rfValues.push_back(g_MedianFilter);
    rfValues.push_back(g_RawFramesToCircularBuffer);
    ret = SetAllowedValues(g_PropertyIntegrationMethod, rfValues);
    if (ret != DEVICE_OK)
@@ -760,16 +766,39 @@ int BitFlowCamera::OnFilterMethod(MM::PropertyBase* pProp, MM::ActionType eAct)
 	   if (val.compare(g_RawFramesToCircularBuffer) == 0) {
 		   rawFramesToCircularBuffer_ = true;
 	   } else {
-		   //frame averaging
+		   //frame averaging, summation or rank filtering
 		   rawFramesToCircularBuffer_ = false;
+		   FrameAccumulator::Mode mode = FrameAccumulator::Average;
+		   if (val.compare(g_FrameSum) == 0)
+			   mode = FrameAccumulator::Sum;
+		   else if (val.compare(g_RunningAverage) == 0)
+			   mode = FrameAccumulator::RunningAverage;
+		   else if (val.compare(g_MedianFilter) == 0)
+			   mode = FrameAccumulator::Median;
+		   for (unsigned i=0; i<img_.size(); i++)
+			   img_[i].SetMode(mode);
 	   }
 	   //resize image accumulators to reflect new byte depth
 	   ResizeImageBuffer();
    } else if (eAct == MM::BeforeGet){
 	   if  (rawFramesToCircularBuffer_) {
 		   pProp->Set(g_RawFramesToCircularBuffer);	
-	   } else {
+	   } else if (img_.empty()) {
 		   pProp->Set(g_FrameAverage);
+	   } else {
+		   switch (img_[0].GetMode()) {
+			   case FrameAccumulator::Sum:
+				   pProp->Set(g_FrameSum);
+				   break;
+			   case FrameAccumulator::RunningAverage:
+				   pProp->Set(g_RunningAverage);
+				   break;
+			   case FrameAccumulator::Median:
+				   pProp->Set(g_MedianFilter);
+				   break;
+			   default:
+				   pProp->Set(g_FrameAverage);
+		   }
 	   }
    }
    return DEVICE_OK;
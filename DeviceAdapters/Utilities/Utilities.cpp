@@ -74,6 +74,170 @@ inline long Round(double x)
 }
 
 
+// Sends a command to physical stages, concurrently for stages of different
+// device adapter modules, so that a combined move takes as long as the
+// slowest stage rather than the sum of all. Null stages are skipped.
+// Returns the first error, in the order of the stages.
+static int RunStageCommands(StageCommandThread::Command command,
+      const std::vector<MM::Stage*>& stages,
+      const std::vector<double>& valuesUm)
+{
+   std::vector<int> results(stages.size(), DEVICE_OK);
+   StageCommandThread threads[MAX_NUMBER_PHYSICAL_STAGES];
+   std::vector<std::string> modules;
+   for (size_t i = 0; i < stages.size(); ++i)
+   {
+      if (!stages[i])
+         continue;
+      char module[MM::MaxStrLength];
+      stages[i]->GetModuleName(module);
+      size_t t = std::find(modules.begin(), modules.end(), module) -
+         modules.begin();
+      if (t == modules.size())
+      {
+         modules.push_back(module);
+         threads[t].SetCommand(command, &results);
+      }
+      threads[t].AddStage(i, stages[i], valuesUm[i]);
+   }
+
+   // The first module is commanded from this thread
+   for (size_t t = 1; t < modules.size(); ++t)
+      threads[t].Start();
+   if (!modules.empty())
+      threads[0].svc();
+   for (size_t t = 1; t < modules.size(); ++t)
+      threads[t].Join();
+
+   for (size_t i = 0; i < results.size(); ++i)
+   {
+      if (results[i] != DEVICE_OK)
+         return results[i];
+   }
+   return DEVICE_OK;
+}
+
+
+// Returns whether any of the stages is busy. The stage found busy last time
+// is polled first, so that during a move usually one query suffices.
+static bool AnyStageBusy(const std::vector<MM::Stage*>& stages,
+      unsigned& lastBusy)
+{
+   const size_t n = stages.size();
+   for (size_t k = 0; k < n; ++k)
+   {
+      const size_t i = (lastBusy + k) % n;
+      if (stages[i] && stages[i]->Busy())
+      {
+         lastBusy = static_cast<unsigned>(i);
+         return true;
+      }
+   }
+   return false;
+}
+
+
+void StageCommandThread::Start()
+{
+   if (activate() != 0)
+   {
+      for (size_t i = 0; i < indices_.size(); ++i)
+         (*results_)[indices_[i]] = DEVICE_ERR;
+      return;
+   }
+   started_ = true;
+}
+
+int StageCommandThread::svc()
+{
+   for (size_t i = 0; i < stages_.size(); ++i)
+   {
+      int err;
+      switch (command_)
+      {
+         case SetPositionUm:
+            err = stages_[i]->SetPositionUm(values_[i]);
+            break;
+         case SetRelativePositionUm:
+            err = stages_[i]->SetRelativePositionUm(values_[i]);
+            break;
+         case Home:
+            err = stages_[i]->Home();
+            break;
+         default:
+            err = stages_[i]->Stop();
+            break;
+      }
+      (*results_)[indices_[i]] = err;
+   }
+   return 0;
+}
+
+
+unsigned long CameraSnapBarrier::GetGeneration()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return generation_;
+}
+
+void CameraSnapBarrier::Release(unsigned nrThreads)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   ++generation_;
+   running_ = nrThreads;
+   released_.notify_all();
+}
+
+void CameraSnapBarrier::WaitUntilFinished()
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (running_ > 0)
+      finished_.wait(lock);
+}
+
+void CameraSnapBarrier::Quit()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   quit_ = true;
+   released_.notify_all();
+}
+
+void CameraSnapBarrier::Reset()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   quit_ = false;
+}
+
+bool CameraSnapBarrier::WaitForRelease(unsigned long& lastGeneration)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (!quit_ && generation_ == lastGeneration)
+      released_.wait(lock);
+   lastGeneration = generation_;
+   return !quit_;
+}
+
+void CameraSnapBarrier::Finished()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (--running_ == 0)
+      finished_.notify_one();
+}
+
+
+int CameraSnapThread::svc()
+{
+   // The barrier's lock orders the accesses to camera_ and result_ between
+   // this thread and MultiCamera
+   while (barrier_->WaitForRelease(generation_))
+   {
+      result_ = camera_ != 0 ? camera_->SnapImage() : DEVICE_OK;
+      barrier_->Finished();
+   }
+   return 0;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
 ///////////////////////////////////////////////////////////////////////////////
@@ -333,6 +497,12 @@ MultiCamera::MultiCamera() :
    nrCamerasInUse_(0),
    initialized_(false)
 {
+   for (int i = 0; i < MAX_NUMBER_PHYSICAL_CAMERAS; i++)
+   {
+      snapThreads_[i] = 0;
+      channelImageValid_[i] = false;
+   }
+
    InitializeDefaultErrorMessages();
 
    SetErrorText(ERR_INVALID_DEVICE_NAME, "Please select a valid camera");
@@ -358,11 +528,24 @@ MultiCamera::~MultiCamera()
 
 int MultiCamera::Shutdown()
 {
+   StopSnapThreads();
    delete imageBuffer_;
+   imageBuffer_ = 0;
    // Rely on the cameras to shut themselves down
    return DEVICE_OK;
 }
 
+void MultiCamera::StopSnapThreads()
+{
+   snapBarrier_.Quit();
+   for (int i = 0; i < MAX_NUMBER_PHYSICAL_CAMERAS; i++)
+   {
+      delete snapThreads_[i]; // Joins the thread
+      snapThreads_[i] = 0;
+   }
+   snapBarrier_.Reset();
+}
+
 int MultiCamera::Initialize()
 {
    // get list with available Cameras.   
@@ -425,20 +608,44 @@ int MultiCamera::SnapImage()
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
-   CameraSnapThread t[MAX_NUMBER_PHYSICAL_CAMERAS];
+   // The first camera snaps on this thread, the others on their snap
+   // threads, which are released together
+   MM::Camera* firstCamera = 0;
+   unsigned nrThreads = 0;
    for (unsigned int i = 0; i < usedCameras_.size(); i++)
    {
+      channelImageValid_[i] = false;
       MM::Camera* camera = (MM::Camera*) GetDevice(usedCameras_[i].c_str());
-      if (camera != 0) 
+      if (camera != 0 && firstCamera == 0)
+      {
+         firstCamera = camera;
+         camera = 0;
+      }
+      if (camera != 0 && snapThreads_[i] == 0)
+      {
+         snapThreads_[i] = new CameraSnapThread(&snapBarrier_);
+         snapThreads_[i]->Start();
+      }
+      if (snapThreads_[i] != 0)
       {
-         t[i].SetCamera(camera);
-         t[i].Start();
+         snapThreads_[i]->SetCamera(camera);
+         nrThreads++;
       }
    }
-   // I think that the CameraSnapThread destructor waits until the SnapImage function is done
-   // So, we are likely to be waiting here until all cameras are done snapping
 
-   return DEVICE_OK;
+   if (firstCamera == 0)
+      return ERR_NO_PHYSICAL_CAMERA;
+
+   snapBarrier_.Release(nrThreads);
+   int ret = firstCamera->SnapImage();
+   snapBarrier_.WaitUntilFinished();
+
+   for (unsigned int i = 0; i < usedCameras_.size() && ret == DEVICE_OK; i++)
+   {
+      if (snapThreads_[i] != 0)
+         ret = snapThreads_[i]->GetResult();
+   }
+   return ret;
 }
 
 /**
@@ -467,29 +674,40 @@ const unsigned char* MultiCamera::GetImageBuffer(unsigned channelNr)
          j++;
       if (j == (int) channelNr)
       {
+         if (camera == 0)
+            return 0;
          unsigned thisHeight = camera->GetImageHeight();
          unsigned thisWidth = camera->GetImageWidth();
+         // Cameras of the full size are returned without copying
          if (height == thisHeight && width == thisWidth)
             return camera->GetImageBuffer();
+
+         ImgBuffer& img = channelImages_[i];
+         if (channelImageValid_[i] && img.Width() == width &&
+               img.Height() == height && img.Depth() == pixDepth)
+            return img.GetPixels();
+
+         // Pad to the MultiCamera size, zeroing only the padding
+         img.Resize(width, height, pixDepth);
+         const unsigned char* pixels = camera->GetImageBuffer();
+         unsigned char* dst = img.GetPixelsRW();
+         const size_t rowBytes = (size_t) width * pixDepth;
+         const size_t thisRowBytes = (size_t) thisWidth * pixDepth;
+         if (width == thisWidth)
+         {
+            memcpy(dst, pixels, thisHeight * thisRowBytes);
+         }
          else
          {
-            img_.Resize(width, height, pixDepth);
-            img_.ResetPixels();
-            if (width == thisWidth)
-            {
-               memcpy(img_.GetPixelsRW(), camera->GetImageBuffer(), thisHeight * thisWidth * pixDepth);
-            }
-            else 
+            for (unsigned row = 0; row < thisHeight; row++)
             {
-               // we need to copy line by line
-               const unsigned char* pixels = camera->GetImageBuffer();
-               for (unsigned i=0; i < thisHeight; i++)
-               {
-                  memcpy(img_.GetPixelsRW() + i * width, pixels + i * thisWidth, thisWidth);
-               }
+               memcpy(dst + row * rowBytes, pixels + row * thisRowBytes, thisRowBytes);
+               memset(dst + row * rowBytes + thisRowBytes, 0, rowBytes - thisRowBytes);
             }
-            return img_.GetPixels();
          }
+         memset(dst + thisHeight * rowBytes, 0, (height - thisHeight) * rowBytes);
+         channelImageValid_[i] = true;
+         return img.GetPixels();
       }
    }
    return 0;
@@ -967,6 +1185,7 @@ int MultiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
  */
 MultiStage::MultiStage() :
    nrPhysicalStages_(2),
+   lastBusyStage_(0),
    simulatedStepSizeUm_(0.1),
    initialized_(false)
 {
@@ -985,7 +1204,7 @@ MultiStage::MultiStage() :
    CreateIntegerProperty("NumberOfPhysicalStages", nrPhysicalStages_, false,
          new CPropertyAction(this, &MultiStage::OnNrStages),
          true);
-   for (unsigned i = 0; i < 8; ++i)
+   for (unsigned i = 0; i < MAX_NUMBER_PHYSICAL_STAGES; ++i)
    {
       AddAllowedValue("NumberOfPhysicalStages",
             boost::lexical_cast<std::string>(i + 1).c_str());
@@ -1081,96 +1300,60 @@ int MultiStage::Shutdown()
 
 bool MultiStage::Busy()
 {
+   std::vector<MM::Stage*> stages;
    for (std::vector<std::string>::iterator it = usedStages_.begin(),
          end = usedStages_.end();
          it != end;
          ++it)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      if (stage->Busy())
-         return true;
+      stages.push_back((MM::Stage*)GetDevice((*it).c_str()));
    }
-   return false;
+   return AnyStageBusy(stages, lastBusyStage_);
 }
 
 
 int MultiStage::Stop()
 {
-   // Return last error encountered, but make sure Stop() is attempted on all
-   // stages.
-   int ret = DEVICE_OK;
-
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-         end = usedStages_.end();
-         it != end;
-         ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
-   }
-
-   return ret;
+   // Stop() is attempted on all stages, even if some fail
+   return CommandStages(StageCommandThread::Stop,
+         std::vector<double>(nrPhysicalStages_, 0.0));
 }
 
 
 int MultiStage::Home()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-         end = usedStages_.end();
-         it != end;
-         ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Home();
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+   return CommandStages(StageCommandThread::Home,
+         std::vector<double>(nrPhysicalStages_, 0.0));
 }
 
 
 int MultiStage::SetPositionUm(double pos)
 {
+   std::vector<double> physicalPos(nrPhysicalStages_);
    for (unsigned i = 0; i < nrPhysicalStages_; ++i)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
-      double physicalPos = stageScalings_[i] * pos + stageTranslations_[i];
-      int err = stage->SetPositionUm(physicalPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+      physicalPos[i] = stageScalings_[i] * pos + stageTranslations_[i];
+   return CommandStages(StageCommandThread::SetPositionUm, physicalPos);
 }
 
 
 int MultiStage::SetRelativePositionUm(double d)
 {
+   std::vector<double> physicalRelPos(nrPhysicalStages_);
    for (unsigned i = 0; i < nrPhysicalStages_; ++i)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
+      physicalRelPos[i] = stageScalings_[i] * d;
+   return CommandStages(StageCommandThread::SetRelativePositionUm,
+         physicalRelPos);
+}
 
-      double physicalRelPos = stageScalings_[i] * d;
-      int err = stage->SetRelativePositionUm(physicalRelPos);
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+
+// Sends a command to the physical stages, concurrently where possible
+int MultiStage::CommandStages(StageCommandThread::Command command,
+      const std::vector<double>& valuesUm)
+{
+   std::vector<MM::Stage*> stages(nrPhysicalStages_);
+   for (unsigned i = 0; i < nrPhysicalStages_; ++i)
+      stages[i] = (MM::Stage*)GetDevice(usedStages_[i].c_str());
+   return RunStageCommands(command, stages, valuesUm);
 }
 
 
@@ -1442,6 +1625,59 @@ int MultiStage::SendStageSequence()
 }
 
 
+int MultiStage::IsStageLinearSequenceable(bool& isSequenceable) const
+{
+   bool hasStage = false;
+   for (std::vector<std::string>::const_iterator it = usedStages_.begin(),
+         end = usedStages_.end();
+         it != end;
+         ++it)
+   {
+      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
+      if (!stage)
+         continue;
+
+      hasStage = true;
+
+      bool flag;
+      int err = stage->IsStageLinearSequenceable(flag);
+      if (err != DEVICE_OK)
+         return err;
+
+      if (!flag)
+      {
+         isSequenceable = false;
+         return DEVICE_OK;
+      }
+   }
+
+   if (!hasStage)
+      return ERR_NO_PHYSICAL_STAGE;
+
+   isSequenceable = true;
+   return DEVICE_OK;
+}
+
+
+int MultiStage::SetStageLinearSequence(double dZ_um, long nSlices)
+{
+   // Each physical stage starts from its current position, so only the step
+   // is transformed (translations cancel out)
+   for (unsigned i = 0; i < nrPhysicalStages_; ++i)
+   {
+      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
+      if (!stage)
+         continue;
+
+      int err = stage->SetStageLinearSequence(stageScalings_[i] * dZ_um,
+            nSlices);
+      if (err != DEVICE_OK)
+         return err;
+   }
+   return DEVICE_OK;
+}
+
+
 int MultiStage::OnNrStages(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
@@ -1563,6 +1799,7 @@ int MultiStage::OnBringIntoSync(MM::PropertyBase* pProp, MM::ActionType eAct)
 
 
 ComboXYStage::ComboXYStage() :
+   lastBusyStage_(0),
    simulatedXStepSizeUm_(0.01),
    simulatedYStepSizeUm_(0.01),
    initialized_(0)
@@ -1663,62 +1900,28 @@ int ComboXYStage::Shutdown()
 
 bool ComboXYStage::Busy()
 {
+   std::vector<MM::Stage*> stages;
    for (std::vector<std::string>::iterator it = usedStages_.begin(),
          end = usedStages_.end();
          it != end;
          ++it)
    {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      if (stage->Busy())
-         return true;
+      stages.push_back((MM::Stage*)GetDevice((*it).c_str()));
    }
-   return false;
+   return AnyStageBusy(stages, lastBusyStage_);
 }
 
 
 int ComboXYStage::Stop()
 {
-   // Return last error encountered, but make sure Stop() is attempted on both
-   // axes.
-   int ret = DEVICE_OK;
-
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-         end = usedStages_.end();
-         it != end;
-         ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
-   }
-
-   return ret;
+   // Stop() is attempted on both axes, even if one fails
+   return CommandStages(StageCommandThread::Stop, 0.0, 0.0);
 }
 
 
 int ComboXYStage::Home()
 {
-   for (std::vector<std::string>::iterator it = usedStages_.begin(),
-         end = usedStages_.end();
-         it != end;
-         ++it)
-   {
-      MM::Stage* stage = (MM::Stage*)GetDevice((*it).c_str());
-      if (!stage)
-         continue;
-
-      int err = stage->Home();
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+   return CommandStages(StageCommandThread::Home, 0.0, 0.0);
 }
 
 
@@ -1726,23 +1929,37 @@ int ComboXYStage::SetPositionSteps(long x, long y)
 {
    LogMessage(("SetPositionSteps(" + boost::lexical_cast<std::string>(x) + ", " + boost::lexical_cast<std::string>(y) + ")").c_str(), true);
 
+   double physicalPosUm[2];
    for (int i = 0; i < 2; ++i)
    {
       const long posSteps = (i == 0) ? x : y;
-
-      MM::Stage* stage = (MM::Stage*)GetDevice(usedStages_[i].c_str());
-      if (!stage)
-         continue;
-
       const double& simulatedStepSizeUm = (i == 0) ?
          simulatedXStepSizeUm_ : simulatedYStepSizeUm_;
       double logicalPosUm = static_cast<double>(posSteps) * simulatedStepSizeUm;
-      double physicalPosUm = stageScalings_[i] * logicalPosUm + stageTranslations_[i];
-      int err = stage->SetPositionUm(physicalPosUm);
-      if (err != DEVICE_OK)
-         return err;
+      physicalPosUm[i] = stageScalings_[i] * logicalPosUm + stageTranslations_[i];
    }
-   return DEVICE_OK;
+   return CommandStages(StageCommandThread::SetPositionUm,
+         physicalPosUm[0], physicalPosUm[1]);
+}
+
+
+// Sends a command to the X and Y stages, concurrently where possible
+int ComboXYStage::CommandStages(StageCommandThread::Command command,
+      double xUm, double yUm)
+{
+   std::vector<MM::Stage*> stages;
+   for (std::vector<std::string>::iterator it = usedStages_.begin(),
+         end = usedStages_.end();
+         it != end;
+         ++it)
+   {
+      stages.push_back((MM::Stage*)GetDevice((*it).c_str()));
+   }
+   std::vector<double> valuesUm;
+   valuesUm.push_back(xUm);
+   valuesUm.push_back(yUm);
+   valuesUm.resize(stages.size());
+   return RunStageCommands(command, stages, valuesUm);
 }
 
 
@@ -2897,7 +3114,9 @@ DAZStage::DAZStage() :
    minStagePos_ (0.0),
    maxStagePos_ (200.0),
    pos_ (0.0),
-   originPos_ (0.0)
+   originPos_ (0.0),
+   linearSequenceStepUm_ (0.0),
+   linearSequenceLength_ (0)
 {
    InitializeDefaultErrorMessages();
 
@@ -3025,9 +3244,10 @@ int DAZStage::SetPositionUm(double pos)
    if (da == 0)
       return ERR_NO_DA_DEVICE;
 
-   double volt =  (pos - minStagePos_) / (maxStagePos_ - minStagePos_) * (maxStageVolt_ - minStageVolt_) + minStageVolt_;
-   if (volt > maxStageVolt_ || volt < minStageVolt_)
-      return ERR_POS_OUT_OF_RANGE;
+   double volt;
+   int ret = PositionToVoltage(pos, volt);
+   if (ret != DEVICE_OK)
+      return ret;
 
    pos_ = pos;
    return da->SetSignal(volt);
@@ -3146,6 +3366,28 @@ int DAZStage::StartStageSequence()
    MM::SignalIO* da = (MM::SignalIO*) GetDevice(DADeviceName_.c_str());
    if (da == 0)
       return ERR_NO_DA_DEVICE;
+
+   if (linearSequenceLength_ > 0)
+   {
+      // The linear sequence starts wherever the stage is now, so the DA
+      // sequence can only be built at this point
+      int ret = da->ClearDASequence();
+      if (ret != DEVICE_OK)
+         return ret;
+      for (long i = 0; i < linearSequenceLength_; ++i)
+      {
+         double volt;
+         ret = PositionToVoltage(pos_ + i * linearSequenceStepUm_, volt);
+         if (ret != DEVICE_OK)
+            return ret;
+         ret = da->AddToDASequence(volt);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      ret = da->SendDASequence();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
    return da->StartDASequence();
 }
 
@@ -3162,22 +3404,26 @@ int DAZStage::ClearStageSequence()
    MM::SignalIO* da = (MM::SignalIO*) GetDevice(DADeviceName_.c_str());
    if (da == 0)
       return ERR_NO_DA_DEVICE;
+   linearSequenceLength_ = 0;
    return da->ClearDASequence();
 }
 
+/*
+ * Sequence positions are checked against the stage range just like
+ * SetPositionUm(), rather than silently clamped
+ */
 int DAZStage::AddToStageSequence(double pos) 
 {
    MM::SignalIO* da = (MM::SignalIO*) GetDevice(DADeviceName_.c_str());
    if (da == 0)
       return ERR_NO_DA_DEVICE;
 
-   double voltage =  (pos - minStagePos_) / (maxStagePos_ - minStagePos_) * (maxStageVolt_ - minStageVolt_) + minStageVolt_;
-
-   if (voltage > maxStageVolt_)
-      voltage = maxStageVolt_;
-   else if (voltage < minStageVolt_)
-      voltage = minStageVolt_;
+   double voltage;
+   int ret = PositionToVoltage(pos, voltage);
+   if (ret != DEVICE_OK)
+      return ret;
 
+   linearSequenceLength_ = 0;
    return da->AddToDASequence(voltage);
 }
 
@@ -3189,6 +3435,37 @@ int DAZStage::SendStageSequence()
    return da->SendDASequence();
 }
 
+int DAZStage::IsStageLinearSequenceable(bool& isSequenceable) const
+{
+   return IsStageSequenceable(isSequenceable);
+}
+
+int DAZStage::SetStageLinearSequence(double dZ_um, long nSlices)
+{
+   MM::SignalIO* da = (MM::SignalIO*) GetDevice(DADeviceName_.c_str());
+   if (da == 0)
+      return ERR_NO_DA_DEVICE;
+
+   long maxLength;
+   int ret = da->GetDASequenceMaxLength(maxLength);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (nSlices < 1 || nSlices > maxLength)
+      return DEVICE_SEQUENCE_TOO_LARGE;
+
+   linearSequenceStepUm_ = dZ_um;
+   linearSequenceLength_ = nSlices;
+   return DEVICE_OK;
+}
+
+int DAZStage::PositionToVoltage(double pos, double& volt) const
+{
+   volt = (pos - minStagePos_) / (maxStagePos_ - minStagePos_) * (maxStageVolt_ - minStageVolt_) + minStageVolt_;
+   if (volt > maxStageVolt_ || volt < minStageVolt_)
+      return ERR_POS_OUT_OF_RANGE;
+   return DEVICE_OK;
+}
+
 
 ///////////////////////////////////////
 // Action Interface
@@ -3542,17 +3819,12 @@ int DAXYStage::SetPositionUm(double x, double y)
    if (da_x == 0 || da_y == 0 )
       return ERR_NO_DA_DEVICE;
 
-   double voltX = ( (x - originPosX_) / (maxStagePosX_ - minStagePosX_)) * (maxStageVoltX_ - minStageVoltX_);
-   if (voltX > maxStageVoltX_ || voltX < minStageVoltX_)
-      return ERR_POS_OUT_OF_RANGE;
-   double voltY = ( (y - originPosY_) / (maxStagePosY_ - minStagePosY_)) * (maxStageVoltY_ - minStageVoltY_);
-   if (voltY > maxStageVoltY_ || voltY < minStageVoltY_)
-      return ERR_POS_OUT_OF_RANGE;
-   
-   //posY_ = y;
-
+   double voltX, voltY;
+   int ret = PositionToVoltage(x, y, voltX, voltY);
+   if (ret != DEVICE_OK)
+      return ret;
 
-   int ret = da_x->SetSignal(voltX);
+   ret = da_x->SetSignal(voltX);
    if(ret != DEVICE_OK) return ret;
    ret = da_y->SetSignal(voltY);
    if(ret != DEVICE_OK) return ret;
@@ -3636,11 +3908,15 @@ int DAXYStage::IsXYStageSequenceable(bool& isSequenceable) const
    if (da_x == 0 || da_y == 0 )
       return ERR_NO_DA_DEVICE;
 
-	bool x, y;
-   da_x->IsDASequenceable(x);
-	da_y->IsDASequenceable(y);
-	isSequenceable = x && y;
-	return DEVICE_OK ;
+   bool x, y;
+   int ret = da_x->IsDASequenceable(x);
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = da_y->IsDASequenceable(y);
+   if (ret != DEVICE_OK)
+      return ret;
+   isSequenceable = x && y;
+   return DEVICE_OK;
 }
 
 int DAXYStage::GetXYStageSequenceMaxLength(long& nrEvents) const
@@ -3708,23 +3984,14 @@ int DAXYStage::AddToXYStageSequence(double positionX, double positionY)
    if (da_x == 0 || da_y == 0 )
       return ERR_NO_DA_DEVICE;
 
+   // Same conversion (and range check) as SetPositionUm(), so that a
+   // sequence visits the same points as the equivalent moves
    double voltageX, voltageY;
+   int ret = PositionToVoltage(positionX, positionY, voltageX, voltageY);
+   if (ret != DEVICE_OK)
+      return ret;
 
-      voltageX = ( (positionX + originPosX_) / (maxStagePosX_ - minStagePosX_)) * 
-                     (maxStageVoltX_ - minStageVoltX_);
-      if (voltageX > maxStageVoltX_)
-         voltageX = maxStageVoltX_;
-      else if (voltageX < minStageVoltX_)
-         voltageX = minStageVoltX_;
-
-      voltageY = ( (positionY + originPosY_) / (maxStagePosY_ - minStagePosY_)) * 
-                     (maxStageVoltY_ - minStageVoltY_);
-      if (voltageY > maxStageVoltY_)
-         voltageY = maxStageVoltY_;
-      else if (voltageY < minStageVoltY_)
-         voltageY = minStageVoltY_;
-   
-   int ret = da_x->AddToDASequence(voltageX);
+   ret = da_x->AddToDASequence(voltageX);
    if(ret != DEVICE_OK) return ret;
 
    ret = da_y->AddToDASequence(voltageY);
@@ -3746,6 +4013,18 @@ int DAXYStage::SendXYStageSequence()
    return ret;
 }
 
+int DAXYStage::PositionToVoltage(double x, double y,
+      double& voltX, double& voltY) const
+{
+   voltX = ( (x - originPosX_) / (maxStagePosX_ - minStagePosX_)) * (maxStageVoltX_ - minStageVoltX_);
+   if (voltX > maxStageVoltX_ || voltX < minStageVoltX_)
+      return ERR_POS_OUT_OF_RANGE;
+   voltY = ( (y - originPosY_) / (maxStagePosY_ - minStagePosY_)) * (maxStageVoltY_ - minStageVoltY_);
+   if (voltY > maxStageVoltY_ || voltY < minStageVoltY_)
+      return ERR_POS_OUT_OF_RANGE;
+   return DEVICE_OK;
+}
+
 void DAXYStage::UpdateStepSize() 
 {
    stepSizeXUm_ =  (maxStagePosX_ - minStagePosX_) / (maxStageVoltX_ - minStageVoltX_) / 1000.0;
@@ -4199,7 +4478,8 @@ int DATTLStateDevice::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
             }
          }
       }
-      if (maxSeqLen == LONG_MAX) // No device?
+      // Every DA must follow the sequence, or the outputs go out of step
+      if (maxSeqLen == LONG_MAX || !allSequenceable)
          maxSeqLen = 0;
       pProp->SetSequenceable(maxSeqLen);
    }
@@ -4607,7 +4887,8 @@ int MultiDAStateDevice::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
             }
          }
       }
-      if (maxSeqLen == LONG_MAX) // No device?
+      // Every DA must follow the sequence, or the outputs go out of step
+      if (maxSeqLen == LONG_MAX || !allSequenceable)
          maxSeqLen = 0;
       pProp->SetSequenceable(maxSeqLen);
    }
@@ -27,6 +27,10 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <string>
 #include <map>
 
@@ -55,6 +59,11 @@
 //
 #define MAX_NUMBER_PHYSICAL_CAMERAS       4
 
+//////////////////////////////////////////////////////////////////////////////
+// Max number of physical stages in a MultiStage
+//
+#define MAX_NUMBER_PHYSICAL_STAGES        8
+
 /*
  * MultiShutter: Combines multiple physical shutters into one logical device
  */
@@ -98,26 +107,117 @@ private:
 };
 
 /**
- * CameraSnapThread: helper thread for MultiCamera
+ * CameraSnapBarrier: lets MultiCamera release all of its snap threads at
+ * once and wait until every one of them has finished its snap.
+ */
+class CameraSnapBarrier
+{
+   public:
+      CameraSnapBarrier() :
+         generation_(0),
+         running_(0),
+         quit_(false)
+      {}
+
+      unsigned long GetGeneration();
+      // MultiCamera side: start a snap on nrThreads threads, then wait
+      void Release(unsigned nrThreads);
+      void WaitUntilFinished();
+      // Make all threads return from svc(); Reset() once they are joined
+      void Quit();
+      void Reset();
+
+      // Thread side: false when the thread should exit
+      bool WaitForRelease(unsigned long& lastGeneration);
+      void Finished();
+
+   private:
+      boost::mutex mutex_;
+      boost::condition_variable released_;
+      boost::condition_variable finished_;
+      unsigned long generation_;
+      unsigned running_;
+      bool quit_;
+};
+
+/**
+ * CameraSnapThread: helper thread for MultiCamera. Stays alive between
+ * snaps and snaps its camera each time the barrier releases it.
  */
 class CameraSnapThread : public MMDeviceThreadBase
 {
    public:
-      CameraSnapThread() :
+      CameraSnapThread(CameraSnapBarrier* barrier) :
+         barrier_(barrier),
+         generation_(barrier->GetGeneration()),
          camera_(0),
+         result_(DEVICE_OK),
          started_(false)
       {}
 
       ~CameraSnapThread() { if (started_) wait(); }
 
+      // Only while the thread is not snapping (between barrier releases)
       void SetCamera(MM::Camera* camera) { camera_ = camera; }
+      MM::Camera* GetCamera() const { return camera_; }
+      int GetResult() const { return result_; }
 
-      int svc() { camera_->SnapImage(); return 0; }
+      int svc();
 
       void Start() { activate(); started_ = true; }
 
    private:
+      CameraSnapBarrier* barrier_;
+      unsigned long generation_;
       MM::Camera* camera_;
+      int result_;
+      bool started_;
+};
+
+/**
+ * StageCommandThread: helper thread for MultiStage and ComboXYStage. Sends
+ * a command to each of a set of physical stages, one after another. The
+ * stages of one thread belong to the same device adapter module, since an
+ * adapter may assume that calls into it are not concurrent (e.g. axes that
+ * share a serial port); stages of different modules get their own threads.
+ */
+class StageCommandThread : public MMDeviceThreadBase
+{
+   public:
+      enum Command
+      {
+         SetPositionUm,
+         SetRelativePositionUm,
+         Home,
+         Stop
+      };
+
+      StageCommandThread() :
+         command_(Stop),
+         results_(0),
+         started_(false)
+      {}
+
+      ~StageCommandThread() { if (started_) wait(); }
+
+      void SetCommand(Command command, std::vector<int>* results)
+      { command_ = command; results_ = results; }
+      // The result goes to the given index of the results
+      void AddStage(size_t index, MM::Stage* stage, double valueUm)
+      { indices_.push_back(index); stages_.push_back(stage); values_.push_back(valueUm); }
+
+      int svc();
+
+      // If the thread cannot be started, its stages get an error result
+      void Start();
+      void Join() { if (started_) wait(); started_ = false; }
+
+   private:
+      Command command_;
+      std::vector<int>* results_;
+      std::vector<size_t> indices_;
+      std::vector<MM::Stage*> stages_;
+      std::vector<double> values_;
       bool started_;
 };
 
@@ -168,6 +268,7 @@ public:
 private:
    int Logical2Physical(int logical);
    bool ImageSizesAreEqual();
+   void StopSnapThreads();
    unsigned char* imageBuffer_;
 
    std::vector<std::string> availableCameras_;
@@ -176,7 +277,14 @@ private:
    std::vector<int> cameraHeights_;
    unsigned int nrCamerasInUse_;
    bool initialized_;
-   ImgBuffer img_;
+
+   // One thread per physical camera slot, created on first use
+   CameraSnapBarrier snapBarrier_;
+   CameraSnapThread* snapThreads_[MAX_NUMBER_PHYSICAL_CAMERAS];
+   // Images of cameras smaller than the MultiCamera image, padded to its
+   // size; filled on demand, at most once per snap
+   ImgBuffer channelImages_[MAX_NUMBER_PHYSICAL_CAMERAS];
+   bool channelImageValid_[MAX_NUMBER_PHYSICAL_CAMERAS];
 };
 
 
@@ -216,6 +324,8 @@ public:
    virtual int ClearStageSequence();
    virtual int AddToStageSequence(double position);
    virtual int SendStageSequence();
+   virtual int IsStageLinearSequenceable(bool& isSequenceable) const;
+   virtual int SetStageLinearSequence(double dZ_um, long nSlices);
 
 private:
    int OnNrStages(MM::PropertyBase* pProp, MM::ActionType eAct);
@@ -225,8 +335,12 @@ private:
    int OnTranslationUm(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnBringIntoSync(MM::PropertyBase* pProp, MM::ActionType eAct);
 
+   int CommandStages(StageCommandThread::Command command,
+         const std::vector<double>& valuesUm);
+
 private:
    unsigned nrPhysicalStages_; // constant while initialized
+   unsigned lastBusyStage_; // Polled first by Busy()
    double simulatedStepSizeUm_;
    bool initialized_;
 
@@ -284,7 +398,11 @@ private:
    int OnScaling(MM::PropertyBase* pProp, MM::ActionType eAct, long xy);
    int OnTranslationUm(MM::PropertyBase* pProp, MM::ActionType eAct, long xy);
 
+   int CommandStages(StageCommandThread::Command command,
+         double xUm, double yUm);
+
 private:
+   unsigned lastBusyStage_; // Polled first by Busy()
    double simulatedXStepSizeUm_;
    double simulatedYStepSizeUm_;
    bool initialized_;
@@ -475,8 +593,14 @@ public:
    int ClearStageSequence();
    int AddToStageSequence(double position);
    int SendStageSequence();
+   // Linear sequences are emulated with a DA sequence starting at the
+   // current position
+   int IsStageLinearSequenceable(bool& isSequenceable) const;
+   int SetStageLinearSequence(double dZ_um, long nSlices);
 
 private:
+   int PositionToVoltage(double pos, double& volt) const;
+
    std::vector<std::string> availableDAs_;
    std::string DADeviceName_;
    bool initialized_;
@@ -488,6 +612,8 @@ private:
    double maxStagePos_;
    double pos_;
    double originPos_;
+   double linearSequenceStepUm_;
+   long linearSequenceLength_; // 0 when no linear sequence is set
 };
 
 // DAXYStage 
@@ -554,6 +680,7 @@ public:
 
 private:
    void UpdateStepSize();
+   int PositionToVoltage(double x, double y, double& voltX, double& voltY) const;
    std::vector<std::string> availableDAs_;
    std::string DADeviceNameX_;
    std::string DADeviceNameY_;
@@ -0,0 +1,306 @@
+// DESCRIPTION:   Memory-mapped streaming capture from a video4linux2 device.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "V4L2Capture.h"
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+
+SystemV4L2Io& SystemV4L2Io::Instance()
+{
+  static SystemV4L2Io instance;
+  return instance;
+}
+
+int SystemV4L2Io::Open(const char* path, int flags)
+{
+  return open(path, flags);
+}
+
+int SystemV4L2Io::Close(int fd)
+{
+  return close(fd);
+}
+
+int SystemV4L2Io::Ioctl(int fd, unsigned long request, void* arg)
+{
+  return ioctl(fd, request, arg);
+}
+
+void* SystemV4L2Io::Mmap(size_t length, int prot, int flags, int fd, off_t offset)
+{
+  return mmap(NULL, length, prot, flags, fd, offset);
+}
+
+int SystemV4L2Io::Munmap(void* addr, size_t length)
+{
+  return munmap(addr, length);
+}
+
+int SystemV4L2Io::Poll(struct pollfd* fds, nfds_t nfds, int timeoutMs)
+{
+  return poll(fds, nfds, timeoutMs);
+}
+
+
+V4L2Capture::V4L2Capture(V4L2Io& io) :
+  io_(io),
+  fd_(-1),
+  requestedBuffers_(0),
+  streaming_(false),
+  width_(0),
+  height_(0),
+  bytesPerLine_(0),
+  pixelFormat_(0)
+{
+}
+
+V4L2Capture::~V4L2Capture()
+{
+  Close();
+}
+
+bool V4L2Capture::Open(const string& devicePath, unsigned width,
+    unsigned height, unsigned pixelFormat, unsigned bufferCount)
+{
+  Close();
+  if (!OpenDevice(devicePath, width, height, pixelFormat, bufferCount)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool V4L2Capture::OpenDevice(const string& devicePath, unsigned width,
+    unsigned height, unsigned pixelFormat, unsigned bufferCount)
+{
+  // Non-blocking, so that a dequeue never waits beyond the poll() timeout
+  fd_ = io_.Open(devicePath.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd_ == -1)
+    return Fail("could not open the video device " + devicePath);
+
+  struct v4l2_capability cap;
+  memset(&cap, 0, sizeof(cap));
+  if (-1 == TryIoctl(VIDIOC_QUERYCAP, &cap)) {
+    if (EINVAL == errno)
+      return Fail("device is not a v4l2 device", false);
+    return Fail("could not query v4l2 capabilities");
+  }
+  if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE))
+    return Fail("device is not a v4l2 capture device", false);
+  if (!(cap.capabilities & V4L2_CAP_STREAMING))
+    return Fail("device does not support streaming i/o", false);
+
+  struct v4l2_format fmt;
+  memset(&fmt, 0, sizeof(fmt));
+  fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  fmt.fmt.pix.pixelformat = pixelFormat;
+  fmt.fmt.pix.field       = V4L2_FIELD_ANY;
+  fmt.fmt.pix.width       = width;
+  fmt.fmt.pix.height      = height;
+  if (-1 == TryIoctl(VIDIOC_S_FMT, &fmt))
+    return Fail("could not set format");
+  if (fmt.fmt.pix.pixelformat != pixelFormat) {
+    ostringstream msg;
+    msg << "device does not support pixel format " <<
+      (char)(pixelFormat & 0xff) << (char)((pixelFormat >> 8) & 0xff) <<
+      (char)((pixelFormat >> 16) & 0xff) << (char)((pixelFormat >> 24) & 0xff);
+    return Fail(msg.str(), false);
+  }
+
+  width_ = fmt.fmt.pix.width;
+  height_ = fmt.fmt.pix.height;
+  pixelFormat_ = fmt.fmt.pix.pixelformat;
+  bytesPerLine_ = fmt.fmt.pix.bytesperline;
+  if (bytesPerLine_ == 0 && height_ > 0)
+    bytesPerLine_ = fmt.fmt.pix.sizeimage / height_;
+
+  struct v4l2_requestbuffers reqbuf;
+  memset(&reqbuf, 0, sizeof(reqbuf));
+  reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  reqbuf.memory = V4L2_MEMORY_MMAP;
+  reqbuf.count  = bufferCount;
+  requestedBuffers_ = bufferCount;
+  if (-1 == TryIoctl(VIDIOC_REQBUFS, &reqbuf)) {
+    if (EINVAL == errno)
+      return Fail("the device does not support memory mapping", false);
+    return Fail("could not request memory map buffers");
+  }
+  if (reqbuf.count == 0)
+    return Fail("the device did not provide any buffers", false);
+
+  for (unsigned i = 0; i < reqbuf.count; i++) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = reqbuf.type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = i;
+    if (-1 == TryIoctl(VIDIOC_QUERYBUF, &buf))
+      return Fail("could not query the buffer state");
+
+    Buffer buffer;
+    buffer.length = buf.length;
+    buffer.start = io_.Mmap(buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd_, buf.m.offset);
+    if (buffer.start == MAP_FAILED)
+      return Fail("memory map failed");
+    buffers_.push_back(buffer);
+  }
+  return true;
+}
+
+void V4L2Capture::Close()
+{
+  if (fd_ == -1)
+    return;
+  if (streaming_)
+    StopStreaming();
+  for (size_t i = 0; i < buffers_.size(); i++)
+    io_.Munmap(buffers_[i].start, buffers_[i].length);
+  buffers_.clear();
+  io_.Close(fd_);
+  fd_ = -1;
+  width_ = height_ = bytesPerLine_ = pixelFormat_ = 0;
+}
+
+bool V4L2Capture::StartStreaming()
+{
+  if (streaming_)
+    return true;
+
+  for (unsigned i = 0; i < buffers_.size(); i++) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = i;
+    if (-1 == TryIoctl(VIDIOC_QBUF, &buf))
+      return Fail("could not enqueue buffer");
+  }
+
+  int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (-1 == TryIoctl(VIDIOC_STREAMON, &type))
+    return Fail("could not start stream");
+  streaming_ = true;
+  return true;
+}
+
+bool V4L2Capture::StopStreaming()
+{
+  if (!streaming_)
+    return true;
+  streaming_ = false;
+  int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (-1 == TryIoctl(VIDIOC_STREAMOFF, &type))
+    return Fail("could not stop stream");
+  return true;
+}
+
+int V4L2Capture::Dequeue(int timeoutMs, Frame& frame)
+{
+  if (!streaming_) {
+    Fail("not streaming", false);
+    return -1;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = fd_;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ready = io_.Poll(&pfd, 1, timeoutMs);
+  if (ready == 0 || (ready == -1 && errno == EINTR))
+    return 0;
+  if (ready == -1) {
+    Fail("poll failed");
+    return -1;
+  }
+  if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    Fail("device error while waiting for a frame", false);
+    return -1;
+  }
+
+  struct v4l2_buffer buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  if (-1 == io_.Ioctl(fd_, VIDIOC_DQBUF, &buf)) {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    Fail("could not dequeue image buffer");
+    return -1;
+  }
+  if (buf.index >= buffers_.size()) {
+    Fail("driver returned an invalid buffer index", false);
+    return -1;
+  }
+
+  frame.index = buf.index;
+  frame.data = static_cast<const unsigned char*>(buffers_[buf.index].start);
+  frame.bytesUsed = buf.bytesused;
+  frame.sequence = buf.sequence;
+  return 1;
+}
+
+bool V4L2Capture::Requeue(const Frame& frame)
+{
+  struct v4l2_buffer buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index  = frame.index;
+  if (-1 == TryIoctl(VIDIOC_QBUF, &buf))
+    return Fail("could not requeue image buffer");
+  return true;
+}
+
+int V4L2Capture::TryIoctl(unsigned long request, void* arg)
+{
+  while (-1 == io_.Ioctl(fd_, request, arg)) {
+    if (errno == EINTR)
+      continue;
+    if (!(errno == EBUSY || errno == EAGAIN))
+      return -1;
+
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN | POLLOUT;
+    pfd.revents = 0;
+    int result = io_.Poll(&pfd, 1, 10000);
+    if (0 == result) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    else if (-1 == result && EINTR != errno) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+bool V4L2Capture::Fail(const string& message, bool withErrno)
+{
+  ostringstream msg;
+  msg << "error: " << message;
+  if (withErrno)
+    msg << ": " << strerror(errno) << " (errno " << errno << ")";
+  lastError_ = msg.str();
+  return false;
+}
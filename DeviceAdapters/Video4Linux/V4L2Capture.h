@@ -0,0 +1,96 @@
+// DESCRIPTION:   Memory-mapped streaming capture from a video4linux2 device.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "V4L2Io.h"
+
+#include <linux/videodev2.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Owns an open capture device and its memory-mapped buffers. While
+ * streaming, every buffer that is not being read by the caller is queued
+ * with the driver, so the device never runs out of buffers to fill as long
+ * as each frame is returned with Requeue() promptly.
+ *
+ * Methods that can fail return false (or -1) and leave a description in
+ * GetLastError().
+ */
+class V4L2Capture {
+  public:
+    struct Frame {
+      unsigned index;
+      const unsigned char* data;
+      size_t bytesUsed;
+      unsigned sequence;
+    };
+
+    explicit V4L2Capture(V4L2Io& io);
+    ~V4L2Capture();
+
+    // Opens the device, sets the format (the driver may choose a different
+    // size) and maps the buffers
+    bool Open(const std::string& devicePath, unsigned width, unsigned height,
+        unsigned pixelFormat, unsigned bufferCount = 4);
+    void Close();
+    bool IsOpen() const { return fd_ != -1; }
+
+    // Queues all buffers and starts the stream
+    bool StartStreaming();
+    // Stops the stream; the driver drops all queued buffers
+    bool StopStreaming();
+    bool IsStreaming() const { return streaming_; }
+
+    // Waits up to timeoutMs for a filled buffer. Returns 1 if frame was
+    // dequeued (and must be given back with Requeue()), 0 on timeout and -1
+    // on error.
+    int Dequeue(int timeoutMs, Frame& frame);
+    bool Requeue(const Frame& frame);
+
+    unsigned Width() const { return width_; }
+    unsigned Height() const { return height_; }
+    unsigned BytesPerLine() const { return bytesPerLine_; }
+    unsigned PixelFormat() const { return pixelFormat_; }
+    size_t BufferCount() const { return buffers_.size(); }
+    unsigned RequestedBufferCount() const { return requestedBuffers_; }
+
+    std::string GetLastError() const { return lastError_; }
+
+  private:
+    V4L2Capture(const V4L2Capture&);
+    V4L2Capture& operator=(const V4L2Capture&);
+
+    struct Buffer {
+      void* start;
+      size_t length;
+    };
+
+    bool OpenDevice(const std::string& devicePath, unsigned width,
+        unsigned height, unsigned pixelFormat, unsigned bufferCount);
+    // Retries while the device is busy
+    int TryIoctl(unsigned long request, void* arg);
+    bool Fail(const std::string& message, bool withErrno = true);
+
+    V4L2Io& io_;
+    int fd_;
+    std::vector<Buffer> buffers_;
+    unsigned requestedBuffers_;
+    bool streaming_;
+    unsigned width_;
+    unsigned height_;
+    unsigned bytesPerLine_;
+    unsigned pixelFormat_;
+    std::string lastError_;
+};
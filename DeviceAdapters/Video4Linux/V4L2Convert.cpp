@@ -0,0 +1,132 @@
+// DESCRIPTION:   Conversion of video4linux2 frames to Micro-Manager images.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "V4L2Convert.h"
+
+#include "PixelConversion.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+inline unsigned char clip(int val)
+{
+  if (val <= 0)
+    return 0;
+  else if (val >= 255)
+    return 255;
+  else
+    return val;
+}
+
+// Converts the first 2 * pairs pixels of one row
+void YUYVRowToBGRA(const unsigned char* ptrIn, unsigned char* ptrOut,
+    unsigned pairs)
+{
+  for (unsigned i = 0; i < pairs; ++i) {
+    int y0 = ptrIn[0];
+    int u0 = ptrIn[1];
+    int y1 = ptrIn[2];
+    int v0 = ptrIn[3];
+    ptrIn += 4;
+    int c = y0 - 16;
+    int d = u0 - 128;
+    int e = v0 - 128;
+
+    ptrOut[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
+    ptrOut[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
+    ptrOut[2] = clip((298 * c + 409 * e + 128) >> 8); // red
+    ptrOut[3] = 255; // alpha
+    c = y1 - 16;
+    ptrOut[4] = clip((298 * c + 516 * d + 128) >> 8); // blue
+    ptrOut[5] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
+    ptrOut[6] = clip((298 * c + 409 * e + 128) >> 8); // red
+    ptrOut[7] = 255; // alpha
+    ptrOut += 8;
+  }
+}
+
+#if defined(__SSE2__)
+
+void YUYVRowToGreySSE2(const unsigned char* ptrIn, unsigned char* ptrOut,
+    unsigned width)
+{
+  const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+  unsigned i = 0;
+  for (; i + 16 <= width; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrIn));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrIn + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ptrOut),
+        _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+    ptrIn += 32;
+    ptrOut += 16;
+  }
+  for (; i < width; ++i) {
+    *ptrOut++ = *ptrIn;
+    ptrIn += 2;
+  }
+}
+
+#endif
+
+} // anonymous namespace
+
+
+void YUYVToBGRAScalar(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height)
+{
+  for (unsigned j = 0; j < height; ++j)
+    YUYVRowToBGRA(src + j * srcStride, dst + j * 4 * width, width / 2);
+}
+
+void YUYVToBGRA(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height)
+{
+  if (srcStride == 2 * static_cast<size_t>(width)) {
+    PixelConverter::YUYVToBGRA(dst, src, static_cast<size_t>(width) * height);
+    return;
+  }
+  for (unsigned j = 0; j < height; ++j)
+    PixelConverter::YUYVToBGRA(dst + j * 4 * width, src + j * srcStride,
+        width & ~1u);
+}
+
+void YUYVToGrey(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height)
+{
+  for (unsigned j = 0; j < height; ++j) {
+    const unsigned char* in = src + j * srcStride;
+    unsigned char* out = dst + j * width;
+#if defined(__SSE2__)
+    YUYVRowToGreySSE2(in, out, width);
+#else
+    for (unsigned i = 0; i < width; ++i)
+      out[i] = in[2 * i];
+#endif
+  }
+}
+
+void CopyRows(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, size_t rowBytes, unsigned height)
+{
+  if (srcStride == rowBytes) {
+    memcpy(dst, src, rowBytes * height);
+    return;
+  }
+  for (unsigned j = 0; j < height; ++j)
+    memcpy(dst + j * rowBytes, src + j * srcStride, rowBytes);
+}
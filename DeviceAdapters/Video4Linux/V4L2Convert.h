@@ -0,0 +1,36 @@
+// DESCRIPTION:   Conversion of video4linux2 frames to Micro-Manager images.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+// All functions read rows that are srcStride bytes apart and write a packed
+// destination image. Widths of YUYV images must be even.
+
+// YUYV (4:2:2) to the 32-bit color layout used by Micro-Manager (bytes in
+// the order blue, green, red, alpha). Uses the vectorized PixelConverter.
+void YUYVToBGRA(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height);
+
+// Reference implementation of YUYVToBGRA, always scalar
+void YUYVToBGRAScalar(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height);
+
+// Luminance of a YUYV image as an 8-bit image
+void YUYVToGrey(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, unsigned width, unsigned height);
+
+// Passthrough for formats that need no conversion (GREY, Y16): drops the
+// row padding, if any
+void CopyRows(const unsigned char* src, size_t srcStride,
+    unsigned char* dst, size_t rowBytes, unsigned height);
@@ -0,0 +1,46 @@
+// DESCRIPTION:   System calls used to talk to a video4linux2 device, behind an
+//                interface so that they can be replaced by a fake device in
+//                tests.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <poll.h>
+#include <sys/types.h>
+
+#include <cstddef>
+
+// Same semantics (including errno) as the corresponding system calls
+class V4L2Io {
+  public:
+    virtual ~V4L2Io() {}
+
+    virtual int Open(const char* path, int flags) = 0;
+    virtual int Close(int fd) = 0;
+    virtual int Ioctl(int fd, unsigned long request, void* arg) = 0;
+    virtual void* Mmap(size_t length, int prot, int flags, int fd, off_t offset) = 0;
+    virtual int Munmap(void* addr, size_t length) = 0;
+    virtual int Poll(struct pollfd* fds, nfds_t nfds, int timeoutMs) = 0;
+};
+
+// The real thing
+class SystemV4L2Io : public V4L2Io {
+  public:
+    static SystemV4L2Io& Instance();
+
+    virtual int Open(const char* path, int flags);
+    virtual int Close(int fd);
+    virtual int Ioctl(int fd, unsigned long request, void* arg);
+    virtual void* Mmap(size_t length, int prot, int flags, int fd, off_t offset);
+    virtual int Munmap(void* addr, size_t length);
+    virtual int Poll(struct pollfd* fds, nfds_t nfds, int timeoutMs);
+};
@@ -0,0 +1,318 @@
+// DESCRIPTION:   Unit tests for the Video4Linux adapter, run against a fake
+//                device.
+//
+// LICENSE:       This file is distributed under the "LGPL" license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include <gtest/gtest.h>
+
+#include "V4L2Capture.h"
+#include "V4L2Convert.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+
+namespace {
+
+const int fakeFd = 42;
+const off_t bufferSpacing = 4096;
+
+// Implements just enough of the mmap streaming protocol of a capture device
+class FakeV4L2Io : public V4L2Io {
+  public:
+    FakeV4L2Io() :
+      supportedFormat(V4L2_PIX_FMT_GREY),
+      rowPadding(0),
+      maxBuffers(3),
+      isOpen(false),
+      streaming(false),
+      sequence_(0) {
+    }
+
+    // Device configuration
+    unsigned supportedFormat;
+    unsigned rowPadding;
+    unsigned maxBuffers;
+
+    // Device state
+    bool isOpen;
+    bool streaming;
+    std::vector< std::vector<unsigned char> > buffers;
+    std::deque<unsigned> queued; // waiting to be filled
+    std::deque<unsigned> filled; // waiting to be dequeued
+    unsigned bytesPerLine;
+    unsigned height;
+
+    // Fills the next queued buffer, as the hardware would
+    bool ProduceFrame(unsigned char value) {
+      if (!streaming || queued.empty())
+        return false;
+      unsigned index = queued.front();
+      queued.pop_front();
+      std::fill(buffers[index].begin(), buffers[index].end(), value);
+      filled.push_back(index);
+      return true;
+    }
+
+    virtual int Open(const char*, int) {
+      isOpen = true;
+      return fakeFd;
+    }
+
+    virtual int Close(int fd) {
+      EXPECT_EQ(fakeFd, fd);
+      isOpen = false;
+      return 0;
+    }
+
+    virtual int Ioctl(int fd, unsigned long request, void* arg) {
+      EXPECT_EQ(fakeFd, fd);
+      switch (request) {
+        case VIDIOC_QUERYCAP: {
+          v4l2_capability* cap = static_cast<v4l2_capability*>(arg);
+          cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+          return 0;
+        }
+        case VIDIOC_S_FMT: {
+          v4l2_format* fmt = static_cast<v4l2_format*>(arg);
+          unsigned bpp = fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_GREY ? 1 : 2;
+          if (fmt->fmt.pix.pixelformat != supportedFormat) {
+            fmt->fmt.pix.pixelformat = supportedFormat;
+            bpp = 2;
+          }
+          bytesPerLine = fmt->fmt.pix.width * bpp + rowPadding;
+          height = fmt->fmt.pix.height;
+          fmt->fmt.pix.bytesperline = bytesPerLine;
+          fmt->fmt.pix.sizeimage = bytesPerLine * height;
+          return 0;
+        }
+        case VIDIOC_REQBUFS: {
+          v4l2_requestbuffers* req = static_cast<v4l2_requestbuffers*>(arg);
+          EXPECT_EQ(V4L2_MEMORY_MMAP, req->memory);
+          req->count = std::min(req->count, maxBuffers);
+          buffers.assign(req->count,
+              std::vector<unsigned char>(bytesPerLine * height));
+          return 0;
+        }
+        case VIDIOC_QUERYBUF: {
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          if (buf->index >= buffers.size())
+            return Error(EINVAL);
+          buf->length = buffers[buf->index].size();
+          buf->m.offset = buf->index * bufferSpacing;
+          return 0;
+        }
+        case VIDIOC_QBUF: {
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          if (buf->index >= buffers.size())
+            return Error(EINVAL);
+          queued.push_back(buf->index);
+          return 0;
+        }
+        case VIDIOC_DQBUF: {
+          if (filled.empty())
+            return Error(EAGAIN);
+          v4l2_buffer* buf = static_cast<v4l2_buffer*>(arg);
+          buf->index = filled.front();
+          buf->bytesused = buffers[buf->index].size();
+          buf->sequence = sequence_++;
+          filled.pop_front();
+          return 0;
+        }
+        case VIDIOC_STREAMON:
+          streaming = true;
+          return 0;
+        case VIDIOC_STREAMOFF:
+          streaming = false;
+          queued.clear();
+          filled.clear();
+          return 0;
+        default:
+          return Error(ENOTTY);
+      }
+    }
+
+    virtual void* Mmap(size_t length, int, int, int fd, off_t offset) {
+      EXPECT_EQ(fakeFd, fd);
+      size_t index = offset / bufferSpacing;
+      if (index >= buffers.size() || length != buffers[index].size()) {
+        errno = EINVAL;
+        return MAP_FAILED;
+      }
+      return &buffers[index][0];
+    }
+
+    virtual int Munmap(void*, size_t) {
+      return 0;
+    }
+
+    // Never blocks: a timeout is reported right away
+    virtual int Poll(struct pollfd* fds, nfds_t nfds, int) {
+      EXPECT_EQ(1u, nfds);
+      fds[0].revents = filled.empty() ? 0 : POLLIN;
+      return filled.empty() ? 0 : 1;
+    }
+
+  private:
+    int Error(int code) {
+      errno = code;
+      return -1;
+    }
+
+    unsigned sequence_;
+};
+
+std::vector<unsigned char> RandomBytes(size_t size)
+{
+  std::vector<unsigned char> bytes(size);
+  for (size_t i = 0; i < size; ++i)
+    bytes[i] = static_cast<unsigned char>(rand());
+  return bytes;
+}
+
+} // anonymous namespace
+
+
+TEST(V4L2CaptureTest, StreamsAllBuffers)
+{
+  FakeV4L2Io io;
+  io.rowPadding = 8;
+  V4L2Capture capture(io);
+  ASSERT_TRUE(capture.Open("/dev/video0", 16, 4, V4L2_PIX_FMT_GREY, 4)) <<
+    capture.GetLastError();
+  EXPECT_EQ(16u, capture.Width());
+  EXPECT_EQ(4u, capture.Height());
+  EXPECT_EQ(24u, capture.BytesPerLine());
+  EXPECT_EQ(3u, capture.BufferCount());
+  EXPECT_EQ(4u, capture.RequestedBufferCount());
+
+  ASSERT_TRUE(capture.StartStreaming());
+  EXPECT_EQ(3u, io.queued.size());
+
+  V4L2Capture::Frame frame;
+  EXPECT_EQ(0, capture.Dequeue(100, frame));
+
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(io.ProduceFrame(static_cast<unsigned char>(i)));
+    ASSERT_EQ(1, capture.Dequeue(100, frame));
+    EXPECT_EQ(static_cast<unsigned>(i), frame.sequence);
+    EXPECT_EQ(24u * 4u, frame.bytesUsed);
+    EXPECT_EQ(i, frame.data[0]);
+    EXPECT_EQ(i, frame.data[frame.bytesUsed - 1]);
+    // Everything but the frame being read stays with the driver
+    EXPECT_EQ(2u, io.queued.size());
+    ASSERT_TRUE(capture.Requeue(frame));
+    EXPECT_EQ(3u, io.queued.size());
+  }
+
+  capture.Close();
+  EXPECT_FALSE(io.streaming);
+  EXPECT_FALSE(io.isOpen);
+}
+
+TEST(V4L2CaptureTest, DeliversFramesInOrder)
+{
+  FakeV4L2Io io;
+  V4L2Capture capture(io);
+  ASSERT_TRUE(capture.Open("/dev/video0", 8, 2, V4L2_PIX_FMT_GREY));
+  ASSERT_TRUE(capture.StartStreaming());
+
+  ASSERT_TRUE(io.ProduceFrame(1));
+  ASSERT_TRUE(io.ProduceFrame(2));
+  ASSERT_TRUE(io.ProduceFrame(3));
+  // No more buffers queued: the device would drop frames
+  EXPECT_FALSE(io.ProduceFrame(4));
+
+  V4L2Capture::Frame frame;
+  for (unsigned char expected = 1; expected <= 3; ++expected) {
+    ASSERT_EQ(1, capture.Dequeue(100, frame));
+    EXPECT_EQ(expected, frame.data[0]);
+    ASSERT_TRUE(capture.Requeue(frame));
+  }
+  EXPECT_EQ(0, capture.Dequeue(100, frame));
+}
+
+TEST(V4L2CaptureTest, RejectsUnsupportedFormat)
+{
+  FakeV4L2Io io;
+  io.supportedFormat = V4L2_PIX_FMT_YUYV;
+  V4L2Capture capture(io);
+  EXPECT_FALSE(capture.Open("/dev/video0", 8, 2, V4L2_PIX_FMT_GREY));
+  EXPECT_NE(std::string::npos, capture.GetLastError().find("GREY"));
+  EXPECT_FALSE(capture.IsOpen());
+  EXPECT_FALSE(io.isOpen);
+
+  V4L2Capture::Frame frame;
+  EXPECT_EQ(-1, capture.Dequeue(100, frame));
+}
+
+TEST(V4L2ConvertTest, YUYVToBGRAMatchesScalar)
+{
+  // Odd number of pixel pairs per row exercises the scalar tail
+  const unsigned width = 38, height = 5;
+  const size_t stride = 2 * width + 6;
+  std::vector<unsigned char> src = RandomBytes(stride * height);
+  std::vector<unsigned char> expected(4 * width * height);
+  std::vector<unsigned char> actual(4 * width * height);
+
+  YUYVToBGRAScalar(&src[0], stride, &expected[0], width, height);
+  YUYVToBGRA(&src[0], stride, &actual[0], width, height);
+  EXPECT_TRUE(expected == actual);
+  for (size_t i = 3; i < actual.size(); i += 4)
+    ASSERT_EQ(255, actual[i]);
+}
+
+TEST(V4L2ConvertTest, YUYVToBGRAKnownColors)
+{
+  // Black, white, and saturated blue
+  const unsigned char src[] = {
+    16, 128, 235, 128,
+    41, 240, 41, 110,
+  };
+  unsigned char dst[16];
+  YUYVToBGRA(src, 4, dst, 2, 2);
+  const unsigned char expected[] = {
+    0, 0, 0, 255, 255, 255, 255, 255,
+    255, 0, 0, 255, 255, 0, 0, 255,
+  };
+  EXPECT_EQ(0, memcmp(expected, dst, sizeof(expected)));
+}
+
+TEST(V4L2ConvertTest, YUYVToGreyTakesLuminance)
+{
+  const unsigned width = 36, height = 3;
+  std::vector<unsigned char> src = RandomBytes(2 * width * height);
+  std::vector<unsigned char> dst(width * height);
+  YUYVToGrey(&src[0], 2 * width, &dst[0], width, height);
+  for (size_t i = 0; i < dst.size(); ++i)
+    ASSERT_EQ(src[2 * i], dst[i]) << "pixel " << i;
+}
+
+TEST(V4L2ConvertTest, CopyRowsDropsPadding)
+{
+  const unsigned char src[] = { 1, 2, 0, 3, 4, 0 };
+  unsigned char dst[4];
+  CopyRows(src, 3, dst, 2, 2);
+  const unsigned char expected[] = { 1, 2, 3, 4 };
+  EXPECT_EQ(0, memcmp(expected, dst, sizeof(expected)));
+}
+
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -39,6 +39,12 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 *              - USB ID 1871:7670 Aveo Technology Corp. (uvcvideo) - COLEMETER(R) USB 2.0 Digital Microscope
 *              - USB ID 046d:0826 Logitech, Inc. HD Webcam C525
 *
+*            - Native sequence acquisition: a streaming thread keeps all
+*              buffers queued, waits for frames with poll() and inserts them
+*              directly into the circular buffer.
+*            - GREY and Y16 pixel types, passed through without conversion.
+*            - Device access moved to V4L2Capture, conversions to V4L2Convert.
+*
 */
 // LICENSE:       This file is distributed under the "LGPL" license.
 //
@@ -62,18 +68,15 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 #include <map>
 #include <vector>
 
-#include <sys/ioctl.h>
+#include "V4L2Capture.h"
+#include "V4L2Convert.h"
+
 #include <linux/videodev2.h>
 #include <cstdio>
-#include <fcntl.h>
-#include <unistd.h>
 #include <assert.h>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
-#include <sys/mman.h>
-
-#include <pthread.h>
 
 using namespace std;
 
@@ -88,38 +91,39 @@ const char
 const long gWidthDefault = 640,
            gHeightDefault = 480;
 
-struct VidBuffer {
-  void *start;
-  size_t length;
-};
-
-// v4l2 state
-typedef struct State State;
-struct State {
-  int W, H, fd;
-  struct VidBuffer *buffers;
-  unsigned int buffers_count;
-  struct v4l2_buffer *buf;
-};
+// How long SnapImage() waits for a frame
+const int gSnapTimeoutMs = 10000;
+// How often the streaming thread checks whether it should stop
+const int gStreamPollMs = 1000;
 
 class PixelType {
   public:
-    PixelType(string propertyValue, unsigned bytesPerPixel, unsigned numberOfComponents, unsigned bitDepth) :
+    PixelType(string propertyValue, unsigned v4l2Format, unsigned bytesPerPixel,
+        unsigned numberOfComponents, unsigned bitDepth) :
       m_propertyValue(propertyValue),
+      m_v4l2Format(v4l2Format),
       m_bytesPerPixel(bytesPerPixel),
       m_numberOfComponents(numberOfComponents),
       m_bitDepth(bitDepth) {
       }
 
     string GetPropertyValue() const { return m_propertyValue; }
+    // The format requested from the device
+    unsigned GetV4l2Format() const { return m_v4l2Format; }
     unsigned GetImageBytesPerPixel() const { return m_bytesPerPixel; }
     unsigned GetNumberOfComponents() const { return m_numberOfComponents; }
     unsigned GetBitDepth() const { return m_bitDepth; }
 
-    virtual void convertV4l2ToOutput(
-        State *state, unsigned char* in, unsigned char* output) const = 0;
+    // True if device rows are already in the output format, so that frames
+    // without row padding can be inserted straight from the mapped buffer
+    virtual bool IsPassthrough() const { return false; }
+
+    virtual void convertV4l2ToOutput(const unsigned char* in,
+        unsigned bytesPerLine, unsigned width, unsigned height,
+        unsigned char* output) const = 0;
   private:
     string m_propertyValue;
+    unsigned m_v4l2Format;
     unsigned m_bytesPerPixel;
     unsigned m_numberOfComponents;
     unsigned m_bitDepth;
@@ -130,18 +134,13 @@ class PixelType8Bit : public PixelType {
     static string PROPERTY_VALUE;
 
     PixelType8Bit() :
-      PixelType(PROPERTY_VALUE, 1, 1, 8) {
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_YUYV, 1, 1, 8) {
       }
 
-    virtual void convertV4l2ToOutput(
-        State *state, unsigned char* in, unsigned char* output) const {
-      int i,j;
-      for (j = 0; j < state->H; j++) {
-        int wj = state->W * j;
-        for (i = 0; i < state->W; i++) {
-          output[i + wj] = in[2*i + 2*wj];
-        }
-      }
+    virtual void convertV4l2ToOutput(const unsigned char* in,
+        unsigned bytesPerLine, unsigned width, unsigned height,
+        unsigned char* output) const {
+      YUYVToGrey(in, bytesPerLine, output, width, height);
     }
 };
 string PixelType8Bit::PROPERTY_VALUE = "8bit";
@@ -152,51 +151,75 @@ class PixelTypeYUYV : public PixelType {
     static string PROPERTY_VALUE;
 
     PixelTypeYUYV() :
-      PixelType(PROPERTY_VALUE, 4, 4, 8) {
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_YUYV, 4, 4, 8) {
       }
 
-    virtual void convertV4l2ToOutput(
-        State *state, unsigned char* ptrIn, unsigned char* ptrOut) const {
+    virtual void convertV4l2ToOutput(const unsigned char* in,
+        unsigned bytesPerLine, unsigned width, unsigned height,
+        unsigned char* output) const {
       /* Convert YUYV to RGBA32, apparently mm does only display colors
        * in this format */
-      for (int i = 0;  i < state->W * state->H / 2; ++i) {
-        int y0 = ptrIn[0];
-        int u0 = ptrIn[1];
-        int y1 = ptrIn[2];
-        int v0 = ptrIn[3];
-        ptrIn += 4;
-        int c = y0 - 16;
-        int d = u0 - 128;
-        int e = v0 - 128;
-
-        ptrOut[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[2] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[4] = 255; // alpha
-        c = y1 - 16;
-        ptrOut[4] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[5] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[6] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[7] = 255; // alpha
-        ptrOut += 8;
+      YUYVToBGRA(in, bytesPerLine, output, width, height);
+    }
+};
+string PixelTypeYUYV::PROPERTY_VALUE = "YUYV";
+PixelTypeYUYV PIXELTYPE_YUYV;
+
+class PixelTypeGrey : public PixelType {
+  public:
+    static string PROPERTY_VALUE;
+
+    PixelTypeGrey() :
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_GREY, 1, 1, 8) {
       }
+
+    virtual bool IsPassthrough() const { return true; }
+
+    virtual void convertV4l2ToOutput(const unsigned char* in,
+        unsigned bytesPerLine, unsigned width, unsigned height,
+        unsigned char* output) const {
+      CopyRows(in, bytesPerLine, output, width, height);
     }
+};
+string PixelTypeGrey::PROPERTY_VALUE = "GREY";
+PixelTypeGrey PIXELTYPE_GREY;
 
-  private:
-    inline unsigned char clip(int val) const {
-      if (val <= 0)
-        return 0;
-      else if (val >= 255)
-        return 255;
-      else
-        return val;
+class PixelTypeY16 : public PixelType {
+  public:
+    static string PROPERTY_VALUE;
+
+    PixelTypeY16() :
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_Y16, 2, 1, 16) {
+      }
+
+    virtual bool IsPassthrough() const { return true; }
+
+    // Y16 is little-endian, like Micro-Manager's 16-bit images
+    virtual void convertV4l2ToOutput(const unsigned char* in,
+        unsigned bytesPerLine, unsigned width, unsigned height,
+        unsigned char* output) const {
+      CopyRows(in, bytesPerLine, output, 2 * width, height);
     }
 };
-string PixelTypeYUYV::PROPERTY_VALUE = "YUYV";
-PixelTypeYUYV PIXELTYPE_YUYV;
+string PixelTypeY16::PROPERTY_VALUE = "Y16";
+PixelTypeY16 PIXELTYPE_Y16;
+
+class V4L2;
+
+// Runs V4L2::StreamFrames() during a sequence acquisition
+class StreamThread : public MMDeviceThreadBase
+{
+  public:
+    explicit StreamThread(V4L2* camera) : camera_(camera) {}
+    virtual int svc();
+  private:
+    V4L2* camera_;
+};
 
 class V4L2 : public CCameraBase<V4L2>
 {
+  friend class StreamThread;
+
 public:
 
   // set all variables to default values, create only necessary device
@@ -204,7 +227,15 @@ public:
   // little as possible, don't access hardware, do everything else in
   // Initialize()
   V4L2() :
-    pixelType(&PIXELTYPE_8BIT)
+    capture_(SystemV4L2Io::Instance()),
+    pixelType(&PIXELTYPE_8BIT),
+    thd_(new StreamThread(this)),
+    threadStarted_(false),
+    stopRequested_(false),
+    capturing_(false),
+    stopOnOverflow_(false),
+    numImages_(0),
+    imageCounter_(0)
   {
     initialized_ = 0;
   }
@@ -214,6 +245,7 @@ public:
   ~V4L2()
   {
     Shutdown();
+    delete thd_;
   }
 
   // access hardware, create device properties
@@ -257,6 +289,8 @@ public:
     vector<string> pixTypes;
     pixTypes.push_back(PixelType8Bit::PROPERTY_VALUE);
     pixTypes.push_back(PixelTypeYUYV::PROPERTY_VALUE);
+    pixTypes.push_back(PixelTypeGrey::PROPERTY_VALUE);
+    pixTypes.push_back(PixelTypeY16::PROPERTY_VALUE);
     nRet = SetAllowedValues(MM::g_Keyword_PixelType, pixTypes);
     if (nRet != DEVICE_OK)
        return nRet;
@@ -287,6 +321,7 @@ public:
   // afterwards, unload device, release all resources
   int Shutdown()
   {
+    StopSequenceAcquisition();
     if (initialized_) {
       VideoClose();
     }
@@ -302,9 +337,25 @@ public:
   // blocks until exposure is finished
   int SnapImage()
   {
-    unsigned char* data = VideoTakeBuffer();
-    pixelType->convertV4l2ToOutput(state, data, const_cast<unsigned char*>(imageBuffer.GetPixels()));
-    VideoReturnBuffer();
+    // The streaming thread owns the device queue
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+    V4L2Capture::Frame frame;
+    int ret = capture_.Dequeue(gSnapTimeoutMs, frame);
+    if (ret == 0) {
+      LogMessage("error: timed out waiting for an image");
+      return DEVICE_SNAP_IMAGE_FAILED;
+    }
+    if (ret < 0) {
+      LogMessage(capture_.GetLastError());
+      return DEVICE_SNAP_IMAGE_FAILED;
+    }
+    pixelType->convertV4l2ToOutput(frame.data, capture_.BytesPerLine(),
+        capture_.Width(), capture_.Height(),
+        const_cast<unsigned char*>(imageBuffer.GetPixels()));
+    if (!capture_.Requeue(frame))
+      LogMessage(capture_.GetLastError());
     return DEVICE_OK;
   }
 
@@ -366,7 +417,7 @@ public:
   {
     // FIXME
     // get_roi(&x,&y,&xSize,&ySize);
-    x=0; y=0; xSize=state->W; ySize=state->H;
+    x=0; y=0; xSize=capture_.Width(); ySize=capture_.Height();
     return DEVICE_OK;
   }
 
@@ -445,17 +496,34 @@ public:
 
       string pixType;
       pProp->Get(pixType);
+      PixelType* previous = pixelType;
       if (pixType == PixelType8Bit::PROPERTY_VALUE) {
         pixelType = &PIXELTYPE_8BIT;
       }
       else if (pixType == PixelTypeYUYV::PROPERTY_VALUE) {
         pixelType = &PIXELTYPE_YUYV;
       }
+      else if (pixType == PixelTypeGrey::PROPERTY_VALUE) {
+        pixelType = &PIXELTYPE_GREY;
+      }
+      else if (pixType == PixelTypeY16::PROPERTY_VALUE) {
+        pixelType = &PIXELTYPE_Y16;
+      }
       else {
         return DEVICE_INVALID_PROPERTY;
       }
   
       LogMessage("setting pixelType " + pixelType->GetPropertyValue());
+      if (capture_.IsOpen() &&
+          capture_.PixelFormat() != pixelType->GetV4l2Format()) {
+        // The device has to deliver a different format
+        int ret = reinitializeDeviceIfRunning();
+        if (ret != DEVICE_OK) {
+          pixelType = previous;
+          reinitializeDeviceIfRunning();
+        }
+        return ret;
+      }
       return this->resizeBuffer();
     }
     else if (eAct == MM::BeforeGet)
@@ -482,7 +550,60 @@ public:
      isSequenceable = false; 
      return DEVICE_OK;
   }
-  
+
+  // The device streams continuously since initialization, so the frame rate
+  // is set by the device and interval_ms is ignored
+  int StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+  {
+    (void) interval_ms;
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+    if (!capture_.IsStreaming()) {
+      LogMessage("error: the device is not streaming");
+      return DEVICE_NOT_CONNECTED;
+    }
+
+    int ret = GetCoreCallback()->PrepareForAcq(this);
+    if (ret != DEVICE_OK)
+      return ret;
+
+    // Reap a thread that finished on its own
+    if (threadStarted_)
+      thd_->wait();
+
+    numImages_ = numImages;
+    imageCounter_ = 0;
+    stopOnOverflow_ = stopOnOverflow;
+    sequenceStartTime_ = GetCurrentMMTime();
+    {
+      MMThreadGuard g(stateLock_);
+      stopRequested_ = false;
+      capturing_ = true;
+    }
+    thd_->activate();
+    threadStarted_ = true;
+    return DEVICE_OK;
+  }
+
+  int StopSequenceAcquisition()
+  {
+    {
+      MMThreadGuard g(stateLock_);
+      stopRequested_ = true;
+    }
+    if (threadStarted_) {
+      thd_->wait();
+      threadStarted_ = false;
+    }
+    return DEVICE_OK;
+  }
+
+  bool IsCapturing()
+  {
+    MMThreadGuard g(stateLock_);
+    return capturing_;
+  }
+
 private:
 
   bool
@@ -510,79 +631,46 @@ private:
       return false;
     }
 
-    ret = initDevice(devicePath, requestedWidth, requestedHeight);
-    if (ret != DEVICE_OK)
+    if (!capture_.Open(devicePath, requestedWidth, requestedHeight,
+          pixelType->GetV4l2Format())) {
+      LogMessage(capture_.GetLastError());
       return false;
+    }
+    LogMessage("opened device");
 
-    struct v4l2_requestbuffers reqbuf;
-    memset(&reqbuf, 0, sizeof(reqbuf));
-    reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    reqbuf.memory = V4L2_MEMORY_MMAP;
-    reqbuf.count = 4;
-
-    if (-1 == tryIoctl(state->fd, VIDIOC_REQBUFS, &reqbuf)) {
+    if (capture_.Width() != (unsigned) requestedWidth) {
       ostringstream msg;
-      if (EINVAL == errno) {
-        msg << "error: the device does not support memory mapping";
-      }
-      else {
-        msg << "error: could not request memory map buffers: "
-            << strerror(errno) << " (errno " << errno << ")";
-      }
+      msg << "warning: device did not match requested pixel width: "
+          << capture_.Width() << " requested: " << requestedWidth;
       LogMessage(msg.str().c_str());
-      return false;
+      // not necessarily fatal
     }
 
-    ostringstream bufMsg;
-    bufMsg << "got " << reqbuf.count << " out of 4 requested buffers";
-    LogMessage(bufMsg.str().c_str());
-
-    state->buffers = (struct VidBuffer*)calloc(reqbuf.count, sizeof(*(state->buffers)));
-    if (!state->buffers) {
-      LogMessage("could not allocate buffer(s)");
-      return false;
+    if (capture_.Height() != (unsigned) requestedHeight) {
+      ostringstream msg;
+      msg << "warning: device did not match requested pixel height: "
+          << capture_.Height() << " requested: " << requestedHeight;
+      LogMessage(msg.str().c_str());
+      // not necessarily fatal
     }
 
-    state->buf = (struct v4l2_buffer*) malloc(sizeof(struct v4l2_buffer));
-
-    unsigned int i;
-    for (i = 0; i < reqbuf.count; i++) {
-      struct v4l2_buffer buf;
-      memset(&buf, 0 , sizeof(buf));
-
-      buf.type = reqbuf.type;
-      buf.memory = V4L2_MEMORY_MMAP;
-      buf.index = i;
-      if (-1 == tryIoctl(state->fd, VIDIOC_QUERYBUF, &buf)) {
-        LogMessage("could not query the buffer state");
-        return false;
-      }
-
-      state->buffers[i].length = buf.length; // remember for munmap
-      state->buffers[i].start = mmap(NULL, buf.length,
-          PROT_READ | PROT_WRITE,
-          MAP_SHARED, state->fd, buf.m.offset);
-
-      if (state->buffers[i].start == MAP_FAILED) {
-        LogMessage("memory map failed");
-        return false;
-      }
-
-      if (-1 == tryIoctl(state->fd, VIDIOC_QBUF, &buf)) {
-        LogMessage("could not enqueue buffer");
-        return false;
-      }
-    }
+    ostringstream formatMsg;
+    formatMsg << "device is configured for " << capture_.Width() << "x"
+              << capture_.Height() << " pixel" << " and "
+              << capture_.BytesPerLine() << " bytes per line";
+    LogMessage(formatMsg.str().c_str());
 
-    state->buffers_count = reqbuf.count;
+    ostringstream bufMsg;
+    bufMsg << "got " << capture_.BufferCount() << " out of "
+           << capture_.RequestedBufferCount() << " requested buffers";
+    LogMessage(bufMsg.str().c_str());
 
     ret = this->resizeBuffer();
     if (ret != DEVICE_OK)
       return false;
 
-    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE; 
-    if (-1 == tryIoctl(state->fd, VIDIOC_STREAMON, &type)) {
-      LogMessage("could not initialize stream");
+    if (!capture_.StartStreaming()) {
+      LogMessage(capture_.GetLastError());
       return false;
     }
 
@@ -590,134 +678,96 @@ private:
     return true;
   }
 
-  int
-  initDevice(const char* devicePath, long requestedWidth, long requestedHeight)
+  bool
+  VideoClose()
   {
-    struct v4l2_capability cap;
-    struct v4l2_format fmt;
-
-    state->fd = open(devicePath, O_RDWR);
-  
-    if (-1 == state->fd) {
-      LogMessage("could not open the video device");
-      return false;
-    }
-    LogMessage("opened device");
-
-    if (-1 == tryIoctl(state->fd, VIDIOC_QUERYCAP, &cap)) {
-      ostringstream msg;
-      if (EINVAL == errno) {
-        msg << "error: device is not a v4l2 device";
-      } else {
-        msg << "error: could not query v4l2 capabilities: " << strerror(errno);
-      }
-      LogMessage(msg.str().c_str());
-      return DEVICE_ERR;
-    }
-
-    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+    if (!capture_.StopStreaming()) {
       ostringstream msg;
-      msg << "error: device is not a v4l2 capture device";
+      msg << "warning setting streamoff: " << capture_.GetLastError();
       LogMessage(msg.str().c_str());
-      return DEVICE_ERR;
+      // not fatal
     }
+    capture_.Close();
+    return true;
+  }
 
-    memset(&fmt, 0, sizeof(fmt));
-
-    fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    fmt.fmt.pix.height      = (unsigned) requestedWidth;
-    fmt.fmt.pix.width       = (unsigned) requestedHeight;
+  // Body of the streaming thread
+  int StreamFrames()
+  {
+    const unsigned width = capture_.Width();
+    const unsigned height = capture_.Height();
+    const unsigned bytesPerPixel = pixelType->GetImageBytesPerPixel();
+    // Insert straight from the device buffer when there is nothing to do
+    const bool zeroCopy = pixelType->IsPassthrough() &&
+      capture_.BytesPerLine() == width * bytesPerPixel;
+
+    int ret = DEVICE_OK;
+    while (imageCounter_ < numImages_ && !IsStopRequested()) {
+      V4L2Capture::Frame frame;
+      int got = capture_.Dequeue(gStreamPollMs, frame);
+      if (got == 0)
+        continue;
+      if (got < 0) {
+        LogMessage(capture_.GetLastError());
+        ret = DEVICE_ERR;
+        break;
+      }
 
-    if (-1 == tryIoctl(state->fd, VIDIOC_S_FMT, &fmt)) {
-      ostringstream msg;
-      msg << "error: could not set format YUYV: " << strerror(errno);
-      LogMessage(msg.str().c_str());
-      return DEVICE_ERR;
-    }
+      const unsigned char* pixels = frame.data;
+      if (!zeroCopy) {
+        unsigned char* out = const_cast<unsigned char*>(imageBuffer.GetPixels());
+        pixelType->convertV4l2ToOutput(frame.data, capture_.BytesPerLine(),
+            width, height, out);
+        pixels = out;
+      }
+      ret = InsertFrame(pixels, width, height, bytesPerPixel);
 
-    if (fmt.fmt.pix.width != requestedWidth) {
-      ostringstream msg;
-      msg << "warning: device did not match requested pixel width: "
-          << fmt.fmt.pix.width << " requested: " << requestedWidth;
-      LogMessage(msg.str().c_str());
-      // not necessarily fatal
+      // The circular buffer has its own copy now
+      if (!capture_.Requeue(frame)) {
+        LogMessage(capture_.GetLastError());
+        ret = DEVICE_ERR;
+      }
+      if (ret != DEVICE_OK)
+        break;
+      ++imageCounter_;
     }
 
-    if (fmt.fmt.pix.height != requestedHeight) {
-      ostringstream msg;
-      msg << "warning: device did not match requested pixel height: "
-          << fmt.fmt.pix.height << " requested: " << requestedHeight;
-      LogMessage(msg.str().c_str());
-      // not necessarily fatal
+    {
+      MMThreadGuard g(stateLock_);
+      capturing_ = false;
     }
-
-    state->W = fmt.fmt.pix.width;
-    state->H = fmt.fmt.pix.height;
-
-    ostringstream formatMsg;
-    formatMsg << "device is configured for " << state->W << "x" << state->H << " pixel"
-              << " and " << fmt.fmt.pix.bytesperline << " bytes per line ("
-              << (fmt.fmt.pix.bytesperline / state->H) <<" bpp)";
-    LogMessage(formatMsg.str().c_str());
-    return DEVICE_OK;
+    GetCoreCallback()->AcqFinished(this, ret);
+    return ret;
   }
 
-  bool
-  VideoClose()
+  int InsertFrame(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned bytesPerPixel)
   {
-    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (-1 == tryIoctl(state->fd, VIDIOC_STREAMOFF, &type)) {
-      ostringstream msg;
-      msg << "warning setting streamoff: " << strerror(errno);
-      LogMessage(msg.str().c_str());
-      // not fatal
-    }
-  
-    unsigned int i;
-    for (i = 0; i < state->buffers_count; i++)
-      munmap(state->buffers[i].start, state->buffers[i].length);
-    close(state->fd);
-    free(state->buf);
-  
-    state->fd = 0;
-    state->W = 0;
-    state->H = 0;
-    state->buffers_count = 0;
-    state->buffers = 0;
-  
-    return true;
+    char label[MM::MaxStrLength];
+    GetLabel(label);
+    MM::MMTime timeStamp = GetCurrentMMTime();
+    Metadata md;
+    md.put("Camera", label);
+    md.put(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString(
+          (timeStamp - sequenceStartTime_).getMsec()));
+    string serialized = md.Serialize();
+
+    const unsigned nComponents = pixelType->GetNumberOfComponents();
+    int ret = GetCoreCallback()->InsertImage(this, pixels, width, height,
+        bytesPerPixel, nComponents, serialized.c_str());
+    if (!stopOnOverflow_ && ret == DEVICE_BUFFER_OVERFLOW) {
+      // do not stop on overflow - just reset the buffer
+      GetCoreCallback()->ClearImageBuffer(this);
+      ret = GetCoreCallback()->InsertImage(this, pixels, width, height,
+          bytesPerPixel, nComponents, serialized.c_str(), false);
+    }
+    return ret;
   }
 
-  /*  has to be followed by a call to videoreturnbuffer */
-  unsigned char*
-  VideoTakeBuffer()
+  bool IsStopRequested()
   {
-    memset(state->buf, 0, sizeof(struct v4l2_buffer));
-    state->buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    state->buf->memory = V4L2_MEMORY_MMAP;
-    // By default VIDIOC_DQBUF blocks when no buffer is in the outgoing queue
-    if (-1 == tryIoctl(state->fd, VIDIOC_DQBUF, state->buf)) {
-      ostringstream msg;
-      msg << "error: could not prepare next image buffer: " << strerror(errno);
-      LogMessage(msg.str().c_str());
-      assert(false);
-    }
-
-    assert(state->buf->index < state->buffers_count);
-    return (unsigned char*)state->buffers[state->buf->index].start;
-  }
-  
-  void
-  VideoReturnBuffer()
-  {
-    if (-1 == tryIoctl(state->fd, VIDIOC_QBUF, state->buf)) {
-      ostringstream msg;
-      msg << "error: could not get next image buffer: " << strerror(errno);
-      LogMessage(msg.str().c_str());
-      return;
-    }
+    MMThreadGuard g(stateLock_);
+    return stopRequested_;
   }
 
   int reinitializeDeviceIfRunning() {
@@ -763,42 +813,32 @@ private:
   
   int resizeBuffer()
   {
-    imageBuffer.Resize(state->W, state->H, pixelType->GetImageBytesPerPixel());
+    imageBuffer.Resize(capture_.Width(), capture_.Height(),
+        pixelType->GetImageBytesPerPixel());
     return DEVICE_OK;
   }
 
-  int tryIoctl(int fd, unsigned long ioctlCode, void *parameter) const
-  {
-      while (-1 == ioctl(fd, ioctlCode, parameter)) {
-          if (!(errno == EBUSY || errno == EAGAIN))
-              return -1;
-  
-          fd_set fds;
-          FD_ZERO(&fds);
-          FD_SET(fd, &fds);
-  
-          struct timeval tv;
-          tv.tv_sec = 10;
-          tv.tv_usec = 0;
-  
-          int result = select(fd + 1, &fds, NULL, NULL, &tv);
-          if (0 == result) {
-            LogMessage("tryIoctl select timeout");
-            return -1;
-          }
-          else if (-1 == result && EINTR != errno) {
-            return -1;
-          }
-      }
-      return 0;
-  }
-
   bool initialized_;
-  State state[1];
+  V4L2Capture capture_;
   ImgBuffer imageBuffer;
   PixelType *pixelType;
+
+  StreamThread* thd_;
+  bool threadStarted_;
+  MMThreadLock stateLock_;
+  bool stopRequested_;
+  bool capturing_;
+  bool stopOnOverflow_;
+  long numImages_;
+  long imageCounter_;
+  MM::MMTime sequenceStartTime_;
 };
 
+int StreamThread::svc()
+{
+  return camera_->StreamFrames();
+}
+
 MODULE_API void InitializeModuleData()
 {
   RegisterDevice(gName, MM::CameraDevice, gDescription);
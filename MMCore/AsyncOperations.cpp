@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncOperations.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs device operations in the background, so that several
+//                can be in progress at once, and keeps their outcome until
+//                it is collected.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AsyncOperations.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <exception>
+
+namespace mm {
+
+AsyncOperations::AsyncOperations() :
+   nextId_(1)
+{
+}
+
+
+AsyncOperations::~AsyncOperations()
+{
+   Clear();
+}
+
+
+long
+AsyncOperations::Start(Operation operation)
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   long id = nextId_++;
+   Record& record = records_[id];
+   record.done = false;
+   // The thread cannot look up its record before we release the lock
+   record.thread = boost::make_shared<boost::thread>(
+         boost::bind(&AsyncOperations::Run, this, id, operation));
+   return id;
+}
+
+
+bool
+AsyncOperations::IsKnown(long id) const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return records_.count(id) > 0;
+}
+
+
+bool
+AsyncOperations::IsDone(long id, bool& done) const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   std::map<long, Record>::const_iterator it = records_.find(id);
+   if (it == records_.end())
+      return false;
+   done = it->second.done;
+   return true;
+}
+
+
+bool
+AsyncOperations::Wait(long id) throw (CMMError)
+{
+   boost::shared_ptr<boost::thread> thread;
+   boost::shared_ptr<CMMError> error;
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      std::map<long, Record>::iterator it = records_.find(id);
+      if (it == records_.end())
+         return false;
+      while (!it->second.done)
+      {
+         cond_.wait(lock);
+         // Another waiter may have collected the operation meanwhile
+         it = records_.find(id);
+         if (it == records_.end())
+            return false;
+      }
+      thread = it->second.thread;
+      error = it->second.error;
+      records_.erase(it);
+   }
+   thread->join();
+   if (error)
+      throw CMMError(*error);
+   return true;
+}
+
+
+std::vector<long>
+AsyncOperations::GetIds() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   std::vector<long> ids;
+   for (std::map<long, Record>::const_iterator it = records_.begin(),
+         end = records_.end(); it != end; ++it)
+      ids.push_back(it->first);
+   return ids;
+}
+
+
+void
+AsyncOperations::Clear()
+{
+   std::vector<long> ids = GetIds();
+   for (std::vector<long>::const_iterator it = ids.begin(), end = ids.end();
+         it != end; ++it)
+   {
+      try
+      {
+         Wait(*it);
+      }
+      catch (const CMMError&)
+      {
+      }
+   }
+}
+
+
+void
+AsyncOperations::Run(long id, Operation operation)
+{
+   boost::shared_ptr<CMMError> error;
+   try
+   {
+      operation();
+   }
+   catch (const CMMError& e)
+   {
+      error = boost::make_shared<CMMError>(e);
+   }
+   catch (const std::exception& e)
+   {
+      error = boost::make_shared<CMMError>(e.what());
+   }
+   catch (...)
+   {
+      error = boost::make_shared<CMMError>("Unknown exception in asynchronous operation");
+   }
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   Record& record = records_[id];
+   record.done = true;
+   record.error = error;
+   cond_.notify_all();
+}
+
+} // namespace mm
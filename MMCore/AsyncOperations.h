@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncOperations.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs device operations in the background, so that several
+//                can be in progress at once, and keeps their outcome until
+//                it is collected.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <boost/function.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <vector>
+
+namespace mm {
+
+// Each operation runs on its own thread, so that an operation that blocks
+// (for example, one that waits for a device to stop being busy) does not
+// hold up the others. Serialization of access to a device is left to the
+// operations themselves (the Core uses the device module locks).
+//
+// Operations are identified by positive ids that are not reused. The
+// outcome of an operation is kept until it is collected with Wait().
+class AsyncOperations
+{
+public:
+   // Throws CMMError on failure
+   typedef boost::function<void ()> Operation;
+
+   AsyncOperations();
+   // Waits for running operations
+   ~AsyncOperations();
+
+   long Start(Operation operation);
+
+   // Return false if the id is not that of an uncollected operation
+   bool IsKnown(long id) const;
+   bool IsDone(long id, bool& done) const;
+
+   // Waits for the operation to finish, forgets it, and rethrows the error
+   // if it failed. Returns false (without waiting) if the id is unknown, or
+   // if another caller collects the operation while this one waits.
+   bool Wait(long id) throw (CMMError);
+
+   // Ids of all uncollected operations, in the order they were started
+   std::vector<long> GetIds() const;
+
+   // Waits for all operations to finish and forgets them, discarding their
+   // errors
+   void Clear();
+
+private:
+   AsyncOperations(const AsyncOperations&);
+   AsyncOperations& operator=(const AsyncOperations&);
+
+   struct Record
+   {
+      boost::shared_ptr<boost::thread> thread;
+      bool done;
+      boost::shared_ptr<CMMError> error;
+   };
+
+   void Run(long id, Operation operation);
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable cond_; // Signaled when an operation finishes
+   std::map<long, Record> records_;
+   long nextId_;
+};
+
+} // namespace mm
@@ -0,0 +1,415 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CallbackDispatcher.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Delivers MMEventCallback notifications on a dedicated thread,
+//                coalescing redundant updates.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "CallbackDispatcher.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+
+#include <vector>
+
+
+namespace mm {
+
+namespace {
+
+// The callback interface takes non-const names for some notifications
+class MutableName
+{
+   std::vector<char> buf_;
+public:
+   explicit MutableName(const std::string& s) : buf_(s.begin(), s.end())
+   { buf_.push_back('\0'); }
+   char* Get() { return &buf_[0]; }
+};
+
+} // anonymous namespace
+
+
+CallbackDispatcher::Event::Event(EventType t, const char* n, const char* k,
+      const char* v) :
+   type(t),
+   name(n ? n : ""),
+   key(k ? k : ""),
+   value(v ? v : "")
+{
+   for (int i = 0; i < 6; ++i)
+      values[i] = 0.0;
+}
+
+
+CallbackDispatcher::CallbackDispatcher() :
+   target_(0),
+   busy_(false),
+   stopping_(false),
+   maxQueueDepth_(0),
+   deliveredCount_(0),
+   coalescedCount_(0),
+   totalLatencyMs_(0.0),
+   maxLatencyMs_(0.0)
+{
+}
+
+
+CallbackDispatcher::~CallbackDispatcher()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stopping_ = true;
+      queue_.clear();
+   }
+   cond_.notify_all();
+
+   if (thread_)
+   {
+      if (IsDispatcherThread())
+         thread_->detach();
+      else
+         thread_->join();
+   }
+}
+
+
+void
+CallbackDispatcher::SetTarget(MMEventCallback* target)
+{
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      queue_.clear();
+      if (!IsDispatcherThread())
+      {
+         while (busy_)
+            cond_.wait(lock);
+      }
+      target_ = target;
+
+      if (target_ && !thread_)
+         thread_ = boost::make_shared<boost::thread>(
+               boost::bind(&CallbackDispatcher::ThreadFunc, this));
+   }
+   cond_.notify_all();
+}
+
+
+MMEventCallback*
+CallbackDispatcher::GetTarget() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return target_;
+}
+
+
+void
+CallbackDispatcher::Flush()
+{
+   if (IsDispatcherThread())
+      return;
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (target_ && !stopping_ && (!queue_.empty() || busy_))
+      cond_.wait(lock);
+}
+
+
+unsigned long
+CallbackDispatcher::GetQueueDepth() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return static_cast<unsigned long>(queue_.size());
+}
+
+
+unsigned long
+CallbackDispatcher::GetMaxQueueDepth() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return maxQueueDepth_;
+}
+
+
+unsigned long long
+CallbackDispatcher::GetDeliveredCount() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return deliveredCount_;
+}
+
+
+unsigned long long
+CallbackDispatcher::GetCoalescedCount() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return coalescedCount_;
+}
+
+
+double
+CallbackDispatcher::GetMeanLatencyMs() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   if (deliveredCount_ == 0)
+      return 0.0;
+   return totalLatencyMs_ / deliveredCount_;
+}
+
+
+double
+CallbackDispatcher::GetMaxLatencyMs() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return maxLatencyMs_;
+}
+
+
+void
+CallbackDispatcher::Post(Event event)
+{
+   event.subject.assign(1, static_cast<char>('A' + event.type));
+   event.subject += event.name;
+   if (event.type == PropertyChanged)
+   {
+      event.subject += '\0';
+      event.subject += event.key;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (!target_ || stopping_)
+         return;
+
+      // Coalescing with an earlier entry would deliver this event ahead of
+      // the ones queued after that entry
+      if (!queue_.empty() && queue_.back().subject == event.subject)
+      {
+         // Keep the original queuing time, so that a stream of updates
+         // cannot postpone delivery indefinitely
+         Event& queued = queue_.back();
+         queued.key = event.key;
+         queued.value = event.value;
+         for (int i = 0; i < 6; ++i)
+            queued.values[i] = event.values[i];
+         ++coalescedCount_;
+         return;
+      }
+
+      event.queued = boost::posix_time::microsec_clock::universal_time();
+      queue_.push_back(event);
+      if (queue_.size() > maxQueueDepth_)
+         maxQueueDepth_ = static_cast<unsigned long>(queue_.size());
+   }
+   cond_.notify_all();
+}
+
+
+void
+CallbackDispatcher::Deliver(Event& event, MMEventCallback* target)
+{
+   switch (event.type)
+   {
+      case PropertiesChanged:
+         target->onPropertiesChanged();
+         break;
+      case PropertyChanged:
+         target->onPropertyChanged(event.name.c_str(), event.key.c_str(),
+               event.value.c_str());
+         break;
+      case ChannelGroupChanged:
+         target->onChannelGroupChanged(event.value.c_str());
+         break;
+      case ConfigGroupChanged:
+         target->onConfigGroupChanged(event.name.c_str(), event.key.c_str());
+         break;
+      case SystemConfigurationLoaded:
+         target->onSystemConfigurationLoaded();
+         break;
+      case PixelSizeChanged:
+         target->onPixelSizeChanged(event.values[0]);
+         break;
+      case PixelSizeAffineChanged:
+         target->onPixelSizeAffineChanged(event.values[0], event.values[1],
+               event.values[2], event.values[3], event.values[4],
+               event.values[5]);
+         break;
+      case StagePositionChanged:
+         target->onStagePositionChanged(MutableName(event.name).Get(),
+               event.values[0]);
+         break;
+      case XYStagePositionChanged:
+         target->onXYStagePositionChanged(MutableName(event.name).Get(),
+               event.values[0], event.values[1]);
+         break;
+      case ExposureChanged:
+         target->onExposureChanged(MutableName(event.name).Get(),
+               event.values[0]);
+         break;
+      case SLMExposureChanged:
+         target->onSLMExposureChanged(MutableName(event.name).Get(),
+               event.values[0]);
+         break;
+   }
+}
+
+
+void
+CallbackDispatcher::ThreadFunc()
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   for (;;)
+   {
+      while (!stopping_ && (queue_.empty() || !target_))
+         cond_.wait(lock);
+      if (stopping_)
+         return;
+
+      // Dequeue first, so that further updates are queued afresh rather than
+      // coalesced into the notification being delivered
+      Event event = queue_.front();
+      queue_.pop_front();
+
+      const double latencyMs = (boost::posix_time::microsec_clock::universal_time() -
+            event.queued).total_microseconds() / 1000.0;
+      totalLatencyMs_ += latencyMs;
+      if (latencyMs > maxLatencyMs_)
+         maxLatencyMs_ = latencyMs;
+
+      MMEventCallback* target = target_;
+      busy_ = true;
+      lock.unlock();
+      try
+      {
+         Deliver(event, target);
+      }
+      catch (...)
+      {
+         // The listener's problem; keep delivering
+      }
+      lock.lock();
+      busy_ = false;
+      ++deliveredCount_;
+      cond_.notify_all();
+   }
+}
+
+
+bool
+CallbackDispatcher::IsDispatcherThread() const
+{
+   return thread_ && thread_->get_id() == boost::this_thread::get_id();
+}
+
+
+void
+CallbackDispatcher::onPropertiesChanged()
+{
+   Post(Event(PropertiesChanged));
+}
+
+
+void
+CallbackDispatcher::onPropertyChanged(const char* name, const char* propName,
+      const char* propValue)
+{
+   Post(Event(PropertyChanged, name, propName, propValue));
+}
+
+
+void
+CallbackDispatcher::onChannelGroupChanged(const char* newChannelGroupName)
+{
+   Post(Event(ChannelGroupChanged, "", "", newChannelGroupName));
+}
+
+
+void
+CallbackDispatcher::onConfigGroupChanged(const char* groupName,
+      const char* newConfigName)
+{
+   Post(Event(ConfigGroupChanged, groupName, newConfigName));
+}
+
+
+void
+CallbackDispatcher::onSystemConfigurationLoaded()
+{
+   Post(Event(SystemConfigurationLoaded));
+}
+
+
+void
+CallbackDispatcher::onPixelSizeChanged(double newPixelSizeUm)
+{
+   Event event(PixelSizeChanged);
+   event.values[0] = newPixelSizeUm;
+   Post(event);
+}
+
+
+void
+CallbackDispatcher::onPixelSizeAffineChanged(double v0, double v1, double v2,
+      double v3, double v4, double v5)
+{
+   Event event(PixelSizeAffineChanged);
+   event.values[0] = v0;
+   event.values[1] = v1;
+   event.values[2] = v2;
+   event.values[3] = v3;
+   event.values[4] = v4;
+   event.values[5] = v5;
+   Post(event);
+}
+
+
+void
+CallbackDispatcher::onStagePositionChanged(char* name, double pos)
+{
+   Event event(StagePositionChanged, name);
+   event.values[0] = pos;
+   Post(event);
+}
+
+
+void
+CallbackDispatcher::onXYStagePositionChanged(char* name, double xpos,
+      double ypos)
+{
+   Event event(XYStagePositionChanged, name);
+   event.values[0] = xpos;
+   event.values[1] = ypos;
+   Post(event);
+}
+
+
+void
+CallbackDispatcher::onExposureChanged(char* name, double newExposure)
+{
+   Event event(ExposureChanged, name);
+   event.values[0] = newExposure;
+   Post(event);
+}
+
+
+void
+CallbackDispatcher::onSLMExposureChanged(char* name, double newExposure)
+{
+   Event event(SLMExposureChanged, name);
+   event.values[0] = newExposure;
+   Post(event);
+}
+
+} // namespace mm
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CallbackDispatcher.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Delivers MMEventCallback notifications on a dedicated thread,
+//                coalescing redundant updates.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "MMEventCallback.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <list>
+#include <string>
+
+namespace mm {
+
+// An MMEventCallback that queues each notification and returns immediately;
+// a dedicated thread then forwards the notifications, in order, to the target
+// callback. This keeps device threads (stage polling, camera sequence
+// threads) from being held up by a slow listener.
+//
+// A notification of the same kind and for the same subject (the same stage,
+// the same device property, the same config group, ...) as the most recently
+// queued one replaces that one's values rather than being queued, so that a
+// burst of updates is delivered as its latest state. Only the last queued
+// notification is replaced, so notifications are never reordered.
+class CallbackDispatcher : public MMEventCallback
+{
+public:
+   CallbackDispatcher();
+   // Discards undelivered notifications and stops the thread
+   ~CallbackDispatcher();
+
+   // Sets the callback that notifications are forwarded to (null to stop
+   // forwarding). Undelivered notifications for the previous target are
+   // discarded, and unless called from within a notification, waits for a
+   // notification that is being delivered to return, so that the previous
+   // target can safely be destroyed afterwards.
+   void SetTarget(MMEventCallback* target);
+   MMEventCallback* GetTarget() const;
+
+   // Waits until all queued notifications have been delivered. Returns
+   // immediately when called from within a notification.
+   void Flush();
+
+   unsigned long GetQueueDepth() const;
+   unsigned long GetMaxQueueDepth() const;
+   unsigned long long GetDeliveredCount() const;
+   unsigned long long GetCoalescedCount() const;
+   // Time from when a notification was first queued until its delivery began
+   double GetMeanLatencyMs() const;
+   double GetMaxLatencyMs() const;
+
+   virtual void onPropertiesChanged();
+   virtual void onPropertyChanged(const char* name, const char* propName,
+         const char* propValue);
+   virtual void onChannelGroupChanged(const char* newChannelGroupName);
+   virtual void onConfigGroupChanged(const char* groupName,
+         const char* newConfigName);
+   virtual void onSystemConfigurationLoaded();
+   virtual void onPixelSizeChanged(double newPixelSizeUm);
+   virtual void onPixelSizeAffineChanged(double v0, double v1, double v2,
+         double v3, double v4, double v5);
+   virtual void onStagePositionChanged(char* name, double pos);
+   virtual void onXYStagePositionChanged(char* name, double xpos, double ypos);
+   virtual void onExposureChanged(char* name, double newExposure);
+   virtual void onSLMExposureChanged(char* name, double newExposure);
+
+private:
+   CallbackDispatcher(const CallbackDispatcher&);
+   CallbackDispatcher& operator=(const CallbackDispatcher&);
+
+   enum EventType
+   {
+      PropertiesChanged,
+      PropertyChanged,
+      ChannelGroupChanged,
+      ConfigGroupChanged,
+      SystemConfigurationLoaded,
+      PixelSizeChanged,
+      PixelSizeAffineChanged,
+      StagePositionChanged,
+      XYStagePositionChanged,
+      ExposureChanged,
+      SLMExposureChanged
+   };
+
+   struct Event
+   {
+      EventType type;
+      std::string name; // Device or config group
+      std::string key; // Property or config
+      std::string value; // Property value or channel group
+      double values[6];
+      std::string subject; // Identifies events that supersede each other
+      boost::posix_time::ptime queued;
+
+      explicit Event(EventType t, const char* n = "", const char* k = "",
+            const char* v = "");
+   };
+
+   typedef std::list<Event> EventQueue;
+
+   void Post(Event event);
+   static void Deliver(Event& event, MMEventCallback* target);
+   void ThreadFunc();
+   bool IsDispatcherThread() const;
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable cond_; // Signaled when queue_ or busy_ change
+   EventQueue queue_;
+   MMEventCallback* target_;
+   bool busy_; // Delivering an event to target_
+   bool stopping_;
+   boost::shared_ptr<boost::thread> thread_;
+
+   unsigned long maxQueueDepth_;
+   unsigned long long deliveredCount_;
+   unsigned long long coalescedCount_;
+   double totalLatencyMs_;
+   double maxLatencyMs_;
+};
+
+} // namespace mm
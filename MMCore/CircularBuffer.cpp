@@ -25,6 +25,8 @@
 // 
 #include "CircularBuffer.h"
 #include "CoreUtils.h"
+#include "DiskStreamWriter.h"
+#include "FrameSpillFile.h"
 
 #include "TaskSet_CopyMemory.h"
 
@@ -32,6 +34,8 @@
 
 #include <boost/make_shared.hpp>
 
+#include <cstring>
+
 
 const long long bytesInMB = 1 << 20;
 const long adjustThreshold = LONG_MAX / 2;
@@ -51,20 +55,32 @@ CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    memorySizeMB_(memorySizeMB), 
    overflow_(false),
    threadPool_(boost::make_shared<ThreadPool>()),
-   tasksMemCopy_(boost::make_shared<TaskSet_CopyMemory>(threadPool_))
+   tasksMemCopy_(boost::make_shared<TaskSet_CopyMemory>(threadPool_)),
+   spillHead_(0),
+   spillCount_(0),
+   spillBytesWritten_(0),
+   spillBytesRead_(0),
+   spillWriteSeconds_(0.0),
+   spillReadSeconds_(0.0),
+   nextPinHandle_(1),
+   pinWaitTimeoutMs_(0)
 {
-   facet = new boost::posix_time::time_facet("%Y-%m-%d %H:%M:%s");
-   tStream.imbue(std::locale(tStream.getloc(), facet));
 }
 
 CircularBuffer::~CircularBuffer() {}
 
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
+{
+   return Initialize(channels, w, h, pixDepth,
+         boost::shared_ptr<const mm::MultiROILayout>());
+}
+
+bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth,
+      boost::shared_ptr<const mm::MultiROILayout> layout)
 {
    MMThreadGuard guard(g_bufferLock);
    imageNumbers_.clear();
-   boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
-   startTime_ = GetMMTimeNow(t);
+   startTime_ = GetMMTimeNow();
 
    bool ret = true;
    try
@@ -72,19 +88,42 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (w == 0 || h==0 || pixDepth == 0 || channels == 0)
          return false; // does not make sense
 
-      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_)
+      if (layout && layout->IsEmpty())
+         layout.reset();
+      if (layout)
+      {
+         if (w != layout->GetFrameWidth() || h != layout->GetFrameHeight())
+            return false;
+         // Images are stored as a single row of the packed ROIs
+         w = static_cast<unsigned>(layout->GetPackedPixelCount());
+         h = 1;
+      }
+      const bool sameLayout = layout ? (layout_ && *layout == *layout_) : !layout_;
+
+      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_ && sameLayout)
          if (frameArray_.size() > 0)
             return true; // nothing to change
 
+      // Pinned images must survive the reallocation below
+      boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+      DetachAllSlots();
+
       width_ = w;
       height_ = h;
       pixDepth_ = pixDepth;
+      layout_ = layout;
       numChannels_ = channels;
 
       insertIndex_ = 0;
       saveIndex_ = 0;
       overflow_ = false;
 
+      spillHead_ = 0;
+      spillCount_ = 0;
+      spillMetadata_.clear();
+      spillTraces_.clear();
+      slotTraces_.clear();
+
       // calculate the size of the entire buffer array once all images get allocated
       // the actual size at the time of the creation is going to be less, because
       // images are not allocated until pixels become available
@@ -101,6 +140,9 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (cbSize > maxCBSize)
          cbSize = maxCBSize; 
 
+      if (spill_)
+         spill_->SetSlotSize(frameSizeBytes);
+
       // TODO: verify if we have enough RAM to satisfy this request
 
       for (unsigned long i=0; i<frameArray_.size(); i++)
@@ -113,6 +155,7 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
          frameArray_[i].Resize(w, h, pixDepth);
          frameArray_[i].Preallocate(numChannels_);
       }
+      slotPins_.assign(frameArray_.size(), 0);
    }
 
    catch( ... /* std::bad_alloc& ex */)
@@ -123,21 +166,37 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
    return ret;
 }
 
+boost::shared_ptr<const mm::MultiROILayout> CircularBuffer::GetMultiROILayout() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return layout_;
+}
+
 void CircularBuffer::Clear() 
 {
    MMThreadGuard guard(g_bufferLock); 
    insertIndex_=0; 
    saveIndex_=0; 
    overflow_ = false;
-   boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
-   startTime_ = GetMMTimeNow(t);
+   spillHead_ = 0;
+   spillCount_ = 0;
+   spillMetadata_.clear();
+   spillTraces_.clear();
+   slotTraces_.clear();
+   startTime_ = GetMMTimeNow();
    imageNumbers_.clear();
 }
 
+/**
+* Returns the number of frames the buffer can hold, including the spill tier.
+*/
 unsigned long CircularBuffer::GetSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)frameArray_.size();
+   unsigned long size = (unsigned long)frameArray_.size();
+   if (spill_)
+      size += spill_->GetSlotCount();
+   return size;
 }
 
 unsigned long CircularBuffer::GetFreeSize() const
@@ -145,74 +204,141 @@ unsigned long CircularBuffer::GetFreeSize() const
    MMThreadGuard guard(g_bufferLock);
    long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
    if (freeSize < 0)
-      return 0;
-   else
-      return (unsigned long)freeSize;
+      freeSize = 0;
+   if (spill_)
+      freeSize += (long)(spill_->GetSlotCount() - spillCount_);
+   return (unsigned long)freeSize;
 }
 
 unsigned long CircularBuffer::GetRemainingImageCount() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)(insertIndex_ - saveIndex_);
+   return (unsigned long)(insertIndex_ - saveIndex_) + spillCount_;
 }
 
 /**
 * Inserts a single image in the buffer.
 */
-bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd, const mm::FrameTrace* trace) throw (CMMError)
 {
-   return InsertMultiChannel(pixArray, 1, width, height, byteDepth, pMd);
+   return InsertMultiChannel(pixArray, 1, width, height, byteDepth, pMd, trace);
 }
 
 /**
 * Inserts a single image, possibly with multiple channels, but with 1 component, in the buffer.
 */
-bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd, const mm::FrameTrace* trace) throw (CMMError)
 {
-   return InsertMultiChannel(pixArray, numChannels, width, height, byteDepth, 1, pMd);
+   return InsertMultiChannel(pixArray, numChannels, width, height, byteDepth, 1, pMd, trace);
 }
 
 /**
 * Inserts a single image, possibly with multiple components, in the buffer.
 */
-bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const mm::FrameTrace* trace) throw (CMMError)
 {
-    return InsertMultiChannel(pixArray, 1, width, height, byteDepth, nComponents, pMd);
+    return InsertMultiChannel(pixArray, 1, width, height, byteDepth, nComponents, pMd, trace);
 }
  
 /**
 * Inserts a multi-channel frame in the buffer.
+*
+* If the RAM buffer is full and a spill file has been enabled, the frame is
+* written to the spill file instead.
 */
-bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
+bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const mm::FrameTrace* trace) throw (CMMError)
 {
+    mm::FrameTrace frameTrace;
+    if (trace)
+    {
+       frameTrace = *trace;
+       frameTrace.insertStartUs = mm::GetMonotonicMicroseconds();
+    }
+    std::string traceCamera;
+
     MMThreadGuard guard(g_insertLock);
  
-    mm::ImgBuffer* pImg;
+    mm::ImgBuffer* pImg = 0;
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+    // Size of a channel as stored; differs when packing multi-ROI frames
+    unsigned long storedChannelSize = singleChannelSize;
+    boost::shared_ptr<const mm::MultiROILayout> packLayout;
+    unsigned frameWidth = width;
+    unsigned frameHeight = height;
+    unsigned roiCount = 0;
+    bool toSpill = false;
+    unsigned long spillSlot = 0;
+    long waitSlot = -1;
  
     {
        MMThreadGuard guard(g_bufferLock);
  
        // check image dimensions
-       if (width != width_ || height != height_ || byteDepth != pixDepth_)
+       if (layout_ && width == layout_->GetFrameWidth() &&
+             height == layout_->GetFrameHeight() && byteDepth == pixDepth_)
+       {
+          packLayout = layout_;
+          storedChannelSize = (unsigned long)width_ * height_ * pixDepth_;
+       }
+       else if (width != width_ || height != height_ || byteDepth != pixDepth_)
           throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+       else if (layout_)
+       {
+          // Already packed by the camera
+          frameWidth = layout_->GetFrameWidth();
+          frameHeight = layout_->GetFrameHeight();
+       }
+       if (layout_)
+          roiCount = static_cast<unsigned>(layout_->GetROICount());
  
        bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
-          overflow_ = true;
+       if (spill_ && spill_->GetSlotCount() > 0 && (overflowed || spillCount_ > 0))
+       {
+          // Keep frames in order: once spilling, stay spilled until drained
+          if (spillCount_ >= spill_->GetSlotCount()) {
+             SetOverflow();
+             return false;
+          }
+          toSpill = true;
+          spillSlot = (spillHead_ + spillCount_) % spill_->GetSlotCount();
+       }
+       else if (overflowed) {
+          SetOverflow();
           return false;
        }
+
+       if (!toSpill)
+       {
+          long slot = insertIndex_ % frameArray_.size();
+          if (!MakeSlotWritable(slot))
+             waitSlot = slot;
+       }
+    }
+
+    if (waitSlot >= 0 && !WaitForUnpinnedSlot(waitSlot))
+    {
+       MMThreadGuard guard(g_bufferLock);
+       SetOverflow();
+       return false;
     }
  
+    std::vector<Metadata> spilledMetadata;
+    boost::posix_time::ptime spillStart;
+    if (toSpill)
+       spillStart = boost::posix_time::microsec_clock::universal_time();
+
     for (unsigned i=0; i<numChannels; i++)
     {
        Metadata md;
        {
           MMThreadGuard guard(g_bufferLock);
-          // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
-          if (!pImg)
-             return false;
+          if (!toSpill)
+          {
+             // we assume that all buffers are pre-allocated
+             pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
+             if (!pImg)
+                return false;
+          }
  
           if (pMd)
           {
@@ -230,22 +356,24 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
          // insert image number. 
          md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
          ++imageNumbers_[cameraName];
+         if (trace && i == 0)
+            traceCamera = cameraName;
       }
 
-      boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
+      const long long nowUs = mm::GetMonotonicMicroseconds();
       if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
       {
          // if time tag was not supplied by the camera insert current timestamp
-         MM::MMTime timestamp = GetMMTimeNow(t);
+         MM::MMTime timestamp = mm::MonotonicToMMTime(nowUs);
          md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString((timestamp - startTime_).getMsec()));
       }
-      tStream << t;
-      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, tStream.str().c_str());
-      tStream.str(std::string());
-      tStream.clear();
+      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore,
+            mm::FormatTimestamp(mm::MonotonicToLocalTime(nowUs)));
 
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
+      md.PutImageTag("Width",frameWidth);
+      md.PutImageTag("Height",frameHeight);
+      if (roiCount > 0)
+         md.PutImageTag(MM::g_Keyword_Metadata_MultiROICount, roiCount);
       if (byteDepth == 1)
          md.PutImageTag("PixelType","GRAY8");
       else if (byteDepth == 2)
@@ -262,32 +390,188 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
       else
          md.PutImageTag("PixelType","Unknown"); 
 
+      if (streamWriter_)
+         streamWriter_->Append(pixArray + i * singleChannelSize,
+               singleChannelSize, width, height, byteDepth, i, md);
+
+      if (toSpill)
+      {
+         // The slot is reserved for us; readers only see it once committed
+         unsigned char* dst = spill_->GetSlot(spillSlot) + i * storedChannelSize;
+         if (packLayout)
+            packLayout->Pack(dst, pixArray + i * singleChannelSize, byteDepth);
+         else
+            tasksMemCopy_->MemCopy(dst, pixArray + i * singleChannelSize, singleChannelSize);
+         spilledMetadata.push_back(md);
+         continue;
+      }
+
       pImg->SetMetadata(md);
       //pImg->SetPixels(pixArray + i * singleChannelSize);
       // TODO: In MMCore the ImgBuffer::GetPixels() returns const pointer.
       //       It would be better to have something like ImgBuffer::GetPixelsRW() in MMDevice.
       //       Or even better - pass tasksMemCopy_ to ImgBuffer constructor
       //       and utilize parallel copy also in single snap acquisitions.
-      tasksMemCopy_->MemCopy((void*)pImg->GetPixels(),
-            pixArray + i * singleChannelSize, singleChannelSize);
+      if (packLayout)
+         packLayout->Pack(const_cast<unsigned char*>(pImg->GetPixels()),
+               pixArray + i * singleChannelSize, byteDepth);
+      else
+         tasksMemCopy_->MemCopy((void*)pImg->GetPixels(),
+               pixArray + i * singleChannelSize, singleChannelSize);
    }
 
+   if (toSpill)
    {
+      spill_->BeginWriteBack(spillSlot);
+      boost::posix_time::time_duration elapsed =
+         boost::posix_time::microsec_clock::universal_time() - spillStart;
+
       MMThreadGuard guard(g_bufferLock);
+      if (trace && tracer_)
+      {
+         frameTrace.insertedUs = mm::GetMonotonicMicroseconds();
+         frameTrace.spilled = true;
+         tracer_->RecordInserted(frameTrace, traceCamera);
+      }
+      spillMetadata_.push_back(spilledMetadata);
+      spillTraces_.push_back(frameTrace);
+      ++spillCount_;
+      ++imageCounter_;
+      spillBytesWritten_ += (unsigned long long)storedChannelSize * numChannels;
+      spillWriteSeconds_ += elapsed.total_microseconds() / 1e6;
+      return true;
+   }
 
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
+   {
+      MMThreadGuard guard(g_bufferLock);
+
+      if (trace && tracer_)
       {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
+         frameTrace.insertedUs = mm::GetMonotonicMicroseconds();
+         tracer_->RecordInserted(frameTrace, traceCamera);
       }
+      SetSlotTrace(insertIndex_ % frameArray_.size(), frameTrace);
+      imageCounter_++;
+      AdvanceInsertIndex();
    }
 
    return true;
 }
- 
+
+// Caller must hold g_bufferLock
+void CircularBuffer::AdvanceInsertIndex()
+{
+   insertIndex_++;
+   if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
+   {
+      // adjust buffer indices to avoid overflowing integer size
+      insertIndex_ -= adjustThreshold;
+      saveIndex_ -= adjustThreshold;
+   }
+}
+
+// Caller must hold g_bufferLock
+void CircularBuffer::SetOverflow()
+{
+   overflow_ = true;
+   if (tracer_ && tracer_->IsEnabled())
+      tracer_->RecordOverflow(mm::GetMonotonicMicroseconds());
+}
+
+// Caller must hold g_bufferLock
+void CircularBuffer::SetSlotTrace(long slot, const mm::FrameTrace& trace)
+{
+   if (trace.id < 0 && slotTraces_.empty())
+      return;
+   if (slotTraces_.size() != frameArray_.size())
+      slotTraces_.assign(frameArray_.size(), mm::FrameTrace());
+   slotTraces_[slot] = trace;
+}
+
+// Caller must hold g_bufferLock
+void CircularBuffer::TracePop(long slot)
+{
+   if (static_cast<unsigned long>(slot) >= slotTraces_.size())
+      return;
+   mm::FrameTrace& trace = slotTraces_[slot];
+   if (trace.id < 0)
+      return;
+   trace.poppedUs = mm::GetMonotonicMicroseconds();
+   if (tracer_)
+      tracer_->RecordPopped(trace);
+   trace.id = -1;
+}
+
+// Move spilled frames back into free RAM slots, oldest first. Caller must hold
+// g_bufferLock. This is only called before handing out the next image, so the
+// slot returned by the previous call (which the consumer is done with by then)
+// may be reused.
+void CircularBuffer::ReadBackSpilledFrames()
+{
+   if (!spill_ || spillCount_ == 0)
+      return;
+
+   boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+   unsigned long long bytesRead = 0;
+   const unsigned long singleChannelSize = (unsigned long)width_ * height_ * pixDepth_;
+   while (spillCount_ > 0 &&
+         (insertIndex_ - saveIndex_) < static_cast<long>(frameArray_.size()))
+   {
+      // Cannot wait here; a pinned slot is retried on the next call
+      if (!MakeSlotWritable(insertIndex_ % frameArray_.size()))
+         break;
+      mm::FrameBuffer& frame = frameArray_[insertIndex_ % frameArray_.size()];
+      const unsigned char* src = spill_->GetSlot(spillHead_);
+      const std::vector<Metadata>& mds = spillMetadata_.front();
+      for (unsigned i = 0; i < mds.size(); i++)
+      {
+         mm::ImgBuffer* img = frame.FindImage(i);
+         if (!img)
+            continue;
+         memcpy((void*)img->GetPixels(), src + i * singleChannelSize,
+               singleChannelSize);
+         img->SetMetadata(mds[i]);
+         bytesRead += singleChannelSize;
+      }
+      spill_->Release(spillHead_);
+
+      SetSlotTrace(insertIndex_ % frameArray_.size(), spillTraces_.front());
+      spillMetadata_.pop_front();
+      spillTraces_.pop_front();
+      spillHead_ = (spillHead_ + 1) % spill_->GetSlotCount();
+      --spillCount_;
+      if (spillCount_ > 0)
+         spill_->Prefetch(spillHead_);
+      AdvanceInsertIndex();
+   }
+
+   spillBytesRead_ += bytesRead;
+   spillReadSeconds_ += (boost::posix_time::microsec_clock::universal_time() -
+         start).total_microseconds() / 1e6;
+}
+
+// Copy the n-th newest spilled frame into spillPeekFrame_. Caller must hold
+// g_bufferLock and ensure n < spillCount_.
+const mm::ImgBuffer* CircularBuffer::PeekSpilledFrame(unsigned long n,
+      unsigned channel) const
+{
+   const std::vector<Metadata>& mds = spillMetadata_[spillCount_ - 1 - n];
+   if (channel >= mds.size())
+      return 0;
+
+   if (spillPeekFrame_.Width() != width_ || spillPeekFrame_.Height() != height_ ||
+         spillPeekFrame_.Depth() != pixDepth_)
+      spillPeekFrame_.Resize(width_, height_, pixDepth_);
+   spillPeekFrame_.Preallocate(channel + 1);
+
+   const unsigned long singleChannelSize = (unsigned long)width_ * height_ * pixDepth_;
+   unsigned long slot = (spillHead_ + spillCount_ - 1 - n) % spill_->GetSlotCount();
+   mm::ImgBuffer* img = spillPeekFrame_.FindImage(channel);
+   img->SetPixels(spill_->GetSlot(slot) + channel * singleChannelSize);
+   img->SetMetadata(mds[channel]);
+   return img;
+}
 
 const unsigned char* CircularBuffer::GetTopImage() const
 {
@@ -312,6 +596,10 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
 {
    MMThreadGuard guard(g_bufferLock);
 
+   if (n >= 0 && static_cast<unsigned long>(n) < spillCount_)
+      return PeekSpilledFrame(static_cast<unsigned long>(n), channel);
+   n -= static_cast<long>(spillCount_);
+
    long availableImages = insertIndex_ - saveIndex_;
    if (n + 1 > availableImages)
       return 0;
@@ -336,11 +624,310 @@ const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
 {
    MMThreadGuard guard(g_bufferLock);
 
+   ReadBackSpilledFrames();
+
    long availableImages = insertIndex_ - saveIndex_;
    if (availableImages < 1)
       return 0;
 
    long targetIndex = saveIndex_ % frameArray_.size();
    ++saveIndex_;
+   TracePop(targetIndex);
    return frameArray_[targetIndex].FindImage(channel);
 }
+
+/**
+* Pins the newest image and returns its handle, or 0 if there is none. An
+* image still in the spill file is copied into memory owned by the pin.
+*/
+long CircularBuffer::PinTopImage(unsigned channel)
+{
+   MMThreadGuard guard(g_bufferLock);
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+
+   if (spillCount_ > 0)
+   {
+      const mm::ImgBuffer* img = PeekSpilledFrame(0, channel);
+      if (!img)
+         return 0;
+      boost::shared_ptr<mm::FrameBuffer> frame =
+         boost::make_shared<mm::FrameBuffer>(width_, height_, pixDepth_);
+      frame->SetPixels(channel, img->GetPixels());
+      frame->FindImage(channel)->SetMetadata(img->GetMetadata());
+      return AddPin(-1, frame, channel);
+   }
+
+   if (insertIndex_ - saveIndex_ < 1)
+      return 0;
+   return AddPin((insertIndex_ - 1) % frameArray_.size(),
+         boost::shared_ptr<mm::FrameBuffer>(), channel);
+}
+
+/**
+* Removes the next image from the buffer, like GetNextImageBuffer(), but pins
+* it. Returns its handle, or 0 if the buffer is empty.
+*/
+long CircularBuffer::PinNextImage(unsigned channel)
+{
+   MMThreadGuard guard(g_bufferLock);
+
+   ReadBackSpilledFrames();
+
+   if (insertIndex_ - saveIndex_ < 1)
+      return 0;
+
+   long targetIndex = saveIndex_ % frameArray_.size();
+   ++saveIndex_;
+   TracePop(targetIndex);
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   return AddPin(targetIndex, boost::shared_ptr<mm::FrameBuffer>(), channel);
+}
+
+/**
+* Returns the pinned image, or 0 if the handle is not (or no longer) valid.
+*/
+const mm::ImgBuffer* CircularBuffer::GetPinnedImage(long handle) const
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   std::map<long, Pin>::const_iterator it = pins_.find(handle);
+   if (it == pins_.end())
+      return 0;
+   return it->second.image;
+}
+
+/**
+* Releases a pin. Returns false if the handle is not valid.
+*/
+bool CircularBuffer::Unpin(long handle)
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   std::map<long, Pin>::iterator it = pins_.find(handle);
+   if (it == pins_.end())
+      return false;
+
+   long slot = it->second.slot;
+   if (slot >= 0 && --slotPins_[slot] == 0)
+      pinReleased_.notify_all();
+   // A detached frame is freed with its last pin
+   pins_.erase(it);
+   return true;
+}
+
+unsigned long CircularBuffer::GetPinnedImageCount() const
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   return (unsigned long)pins_.size();
+}
+
+/**
+* Sets how long the producer waits for a pinned slot to be released before
+* overflowing. With 0 (the default), pinned images are moved out of the
+* buffer instead, so the producer never waits.
+*/
+void CircularBuffer::SetPinWaitTimeoutMs(long timeoutMs)
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   pinWaitTimeoutMs_ = timeoutMs > 0 ? timeoutMs : 0;
+}
+
+long CircularBuffer::GetPinWaitTimeoutMs() const
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   return pinWaitTimeoutMs_;
+}
+
+// Caller must hold pinMutex_. Returns 0 if the channel does not exist.
+long CircularBuffer::AddPin(long slot, boost::shared_ptr<mm::FrameBuffer> frame,
+      unsigned channel)
+{
+   Pin pin;
+   pin.slot = slot;
+   pin.frame = frame;
+   pin.image = slot >= 0 ? frameArray_[slot].FindImage(channel) :
+      frame->FindImage(channel);
+   if (!pin.image)
+      return 0;
+
+   if (slot >= 0)
+      ++slotPins_[slot];
+   if (nextPinHandle_ == LONG_MAX)
+      nextPinHandle_ = 1;
+   long handle = nextPinHandle_++;
+   pins_[handle] = pin;
+   return handle;
+}
+
+// Caller must hold g_bufferLock. Prepares a slot for writing: returns true if
+// it is not pinned or its pinned images have been moved out of the buffer,
+// false if the producer has to wait for it.
+bool CircularBuffer::MakeSlotWritable(long slot)
+{
+   boost::lock_guard<boost::mutex> pinGuard(pinMutex_);
+   if (slotPins_[slot] == 0)
+      return true;
+   if (pinWaitTimeoutMs_ > 0)
+      return false;
+
+   DetachSlot(slot);
+   frameArray_[slot].Resize(width_, height_, pixDepth_);
+   frameArray_[slot].Preallocate(numChannels_);
+   return true;
+}
+
+// Caller must hold g_bufferLock and pinMutex_. Moves the images of a pinned
+// slot into a frame owned by its pins, leaving the slot without images. The
+// images keep their addresses, so pointers handed out stay valid.
+void CircularBuffer::DetachSlot(long slot)
+{
+   boost::shared_ptr<mm::FrameBuffer> frame =
+      boost::make_shared<mm::FrameBuffer>();
+   frame->Swap(frameArray_[slot]);
+   for (std::map<long, Pin>::iterator it = pins_.begin(), end = pins_.end();
+         it != end; ++it)
+   {
+      if (it->second.slot == slot)
+      {
+         it->second.slot = -1;
+         it->second.frame = frame;
+      }
+   }
+   slotPins_[slot] = 0;
+}
+
+// Caller must hold g_bufferLock and pinMutex_
+void CircularBuffer::DetachAllSlots()
+{
+   for (long slot = 0; slot < static_cast<long>(slotPins_.size()); ++slot)
+   {
+      if (slotPins_[slot] > 0)
+         DetachSlot(slot);
+   }
+   slotPins_.clear();
+   pinReleased_.notify_all();
+}
+
+// Caller must hold g_insertLock (only). Returns false on timeout.
+bool CircularBuffer::WaitForUnpinnedSlot(long slot)
+{
+   boost::unique_lock<boost::mutex> lock(pinMutex_);
+   const boost::system_time deadline = boost::get_system_time() +
+      boost::posix_time::milliseconds(pinWaitTimeoutMs_);
+   while (slot < static_cast<long>(slotPins_.size()) && slotPins_[slot] > 0)
+   {
+      if (!pinReleased_.timed_wait(lock, deadline))
+         break;
+   }
+   return slot >= static_cast<long>(slotPins_.size()) || slotPins_[slot] == 0;
+}
+
+/**
+* Enables the spill tier using a preallocated file of sizeMB at path.
+* Frames already spilled to a previous file are discarded.
+*/
+void CircularBuffer::EnableSpill(const std::string& path, unsigned sizeMB) throw (CMMError)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+
+   // Release the previous file (which may have the same path) before creating
+   // the new one
+   {
+      MMThreadGuard guard(g_bufferLock);
+      spill_.reset();
+   }
+   boost::shared_ptr<mm::FrameSpillFile> spill =
+      boost::make_shared<mm::FrameSpillFile>(path, sizeMB);
+
+   MMThreadGuard guard(g_bufferLock);
+   spill->SetSlotSize((size_t)width_ * height_ * pixDepth_ * numChannels_);
+   spill_ = spill;
+   spillHead_ = 0;
+   spillCount_ = 0;
+   spillMetadata_.clear();
+   spillTraces_.clear();
+   spillBytesWritten_ = 0;
+   spillBytesRead_ = 0;
+   spillWriteSeconds_ = 0.0;
+   spillReadSeconds_ = 0.0;
+}
+
+/**
+* Disables the spill tier and deletes the spill file. Spilled frames are
+* discarded.
+*/
+void CircularBuffer::DisableSpill()
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   spill_.reset();
+   spillHead_ = 0;
+   spillCount_ = 0;
+   spillMetadata_.clear();
+   spillTraces_.clear();
+}
+
+bool CircularBuffer::IsSpillEnabled() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spill_ != 0;
+}
+
+std::string CircularBuffer::GetSpillPath() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spill_ ? spill_->GetPath() : std::string();
+}
+
+unsigned CircularBuffer::GetSpillSizeMB() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spill_ ? spill_->GetSizeMB() : 0;
+}
+
+unsigned long CircularBuffer::GetSpillCapacity() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spill_ ? spill_->GetSlotCount() : 0;
+}
+
+unsigned long CircularBuffer::GetSpilledImageCount() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spillCount_;
+}
+
+/**
+* Average rate at which frames have been written to the spill file since it was
+* enabled (time spent copying into the mapping, not including the asynchronous
+* write-back).
+*/
+double CircularBuffer::GetSpillWriteMBPerSec() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   if (spillWriteSeconds_ <= 0.0)
+      return 0.0;
+   return (double)spillBytesWritten_ / bytesInMB / spillWriteSeconds_;
+}
+
+/**
+* Average rate at which spilled frames have been read back into RAM.
+*/
+double CircularBuffer::GetSpillReadMBPerSec() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   if (spillReadSeconds_ <= 0.0)
+      return 0.0;
+   return (double)spillBytesRead_ / bytesInMB / spillReadSeconds_;
+}
+
+void CircularBuffer::SetStreamWriter(boost::shared_ptr<mm::DiskStreamWriter> writer)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   streamWriter_ = writer;
+}
+
+void CircularBuffer::SetFrameTracer(boost::shared_ptr<mm::FrameTracer> tracer)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   tracer_ = tracer;
+}
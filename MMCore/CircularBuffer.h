@@ -27,13 +27,19 @@
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "FrameBuffer.h"
+#include "FrameTrace.h"
+#include "MultiROILayout.h"
 
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
+#include <deque>
+#include <map>
+#include <string>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -44,6 +50,11 @@
 class ThreadPool;
 class TaskSet_CopyMemory;
 
+namespace mm {
+   class DiskStreamWriter;
+   class FrameSpillFile;
+} // namespace mm
+
 class CircularBuffer
 {
 public:
@@ -53,6 +64,13 @@ public:
    unsigned GetMemorySizeMB() const { return memorySizeMB_; }
 
    bool Initialize(unsigned channels, unsigned int xSize, unsigned int ySize, unsigned int pixDepth);
+   // Store multi-ROI frames packed: images in the buffer hold only the ROIs
+   // (packed pixel count x 1). Inserts accept frames of the layout's frame
+   // size, which are packed on the way in, or already packed images.
+   bool Initialize(unsigned channels, unsigned int xSize, unsigned int ySize, unsigned int pixDepth,
+         boost::shared_ptr<const mm::MultiROILayout> layout);
+   // Null unless images are packed
+   boost::shared_ptr<const mm::MultiROILayout> GetMultiROILayout() const;
    unsigned long GetSize() const;
    unsigned long GetFreeSize() const;
    unsigned long GetRemainingImageCount() const;
@@ -61,10 +79,12 @@ public:
    unsigned int Height() const {MMThreadGuard guard(g_bufferLock); return height_;}
    unsigned int Depth() const {MMThreadGuard guard(g_bufferLock); return pixDepth_;}
 
-   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
-   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
-   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
-   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   // A frame inserted with a trace (stamped up to the insert) is traced
+   // through the buffer and reported to the frame tracer, if set
+   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd, const mm::FrameTrace* trace = 0) throw (CMMError);
+   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd, const mm::FrameTrace* trace = 0) throw (CMMError);
+   bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const mm::FrameTrace* trace = 0) throw (CMMError);
+   bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd, const mm::FrameTrace* trace = 0) throw (CMMError);
    const unsigned char* GetTopImage() const;
    const unsigned char* GetNextImage();
    const mm::ImgBuffer* GetTopImageBuffer(unsigned channel) const;
@@ -75,13 +95,61 @@ public:
 
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
+   // Optional second tier: frames that do not fit in RAM are written to a
+   // memory-mapped file and transparently read back by GetNextImage*().
+   void EnableSpill(const std::string& path, unsigned sizeMB) throw (CMMError);
+   void DisableSpill();
+   bool IsSpillEnabled() const;
+   std::string GetSpillPath() const;
+   unsigned GetSpillSizeMB() const;
+   unsigned long GetSpillCapacity() const;
+   unsigned long GetSpilledImageCount() const;
+   double GetSpillWriteMBPerSec() const;
+   double GetSpillReadMBPerSec() const;
+
+   // Pinned images: a reader pins an image to use its pixels in place and
+   // unpins it when done. The producer never overwrites a pinned image.
+   // With a wait timeout of 0 it moves the pinned image out of the buffer
+   // (the slot gets new memory) and carries on; otherwise it waits up to the
+   // timeout for the image to be unpinned, then overflows. Pins are
+   // identified by positive handles and remain valid across Clear() and
+   // Initialize(), but not beyond the buffer's lifetime.
+   long PinTopImage(unsigned channel);
+   long PinNextImage(unsigned channel);
+   const mm::ImgBuffer* GetPinnedImage(long handle) const;
+   bool Unpin(long handle);
+   unsigned long GetPinnedImageCount() const;
+   void SetPinWaitTimeoutMs(long timeoutMs);
+   long GetPinWaitTimeoutMs() const;
+
+   // Every inserted image is also passed to the stream writer, if set
+   void SetStreamWriter(boost::shared_ptr<mm::DiskStreamWriter> writer);
+
+   // Traced frames are reported to the tracer when inserted and when popped
+   // (by GetNextImage*() or PinNextImage()); overflows are reported too
+   void SetFrameTracer(boost::shared_ptr<mm::FrameTracer> tracer);
+
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
 private:
+   void AdvanceInsertIndex();
+   void SetOverflow();
+   void SetSlotTrace(long slot, const mm::FrameTrace& trace);
+   void TracePop(long slot);
+   void ReadBackSpilledFrames();
+   const mm::ImgBuffer* PeekSpilledFrame(unsigned long n, unsigned channel) const;
+   long AddPin(long slot, boost::shared_ptr<mm::FrameBuffer> frame,
+         unsigned channel);
+   bool MakeSlotWritable(long slot);
+   void DetachSlot(long slot);
+   void DetachAllSlots();
+   bool WaitForUnpinnedSlot(long slot);
+
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
+   boost::shared_ptr<const mm::MultiROILayout> layout_;
    long imageCounter_;
    MM::MMTime startTime_;
    std::map<std::string, long> imageNumbers_;
@@ -100,6 +168,44 @@ private:
    boost::shared_ptr<ThreadPool> threadPool_;
    boost::shared_ptr<TaskSet_CopyMemory> tasksMemCopy_;
 
-   boost::posix_time::time_facet * facet;
-   std::ostringstream tStream;
+   // Spill tier, guarded by both locks for (re)configuration and by
+   // g_bufferLock for bookkeeping. Spilled frames are always newer than the
+   // frames in frameArray_, so once anything has been spilled all further
+   // inserts go to the spill file until it has been drained.
+   boost::shared_ptr<mm::FrameSpillFile> spill_;
+   unsigned long spillHead_;
+   unsigned long spillCount_;
+   std::deque< std::vector<Metadata> > spillMetadata_;
+   mutable mm::FrameBuffer spillPeekFrame_;
+   unsigned long long spillBytesWritten_;
+   unsigned long long spillBytesRead_;
+   double spillWriteSeconds_;
+   double spillReadSeconds_;
+
+   boost::shared_ptr<mm::DiskStreamWriter> streamWriter_; // Guarded by g_insertLock
+
+   // Frame tracing. The tracer is guarded by both locks for setting; the
+   // traces by g_bufferLock. slotTraces_ parallels frameArray_ but is only
+   // allocated once a traced frame is stored; spillTraces_ parallels
+   // spillMetadata_ (untraced frames have an id of -1).
+   boost::shared_ptr<mm::FrameTracer> tracer_;
+   std::vector<mm::FrameTrace> slotTraces_;
+   std::deque<mm::FrameTrace> spillTraces_;
+
+   // Pins, guarded by pinMutex_ (taken after g_bufferLock when both are
+   // needed). A pin refers either to a slot of frameArray_ (counted in
+   // slotPins_) or, once the producer has needed that slot, to a frame
+   // detached from the buffer and shared by the pins of that slot.
+   struct Pin
+   {
+      long slot; // -1 when detached
+      boost::shared_ptr<mm::FrameBuffer> frame; // Set when detached
+      const mm::ImgBuffer* image;
+   };
+   mutable boost::mutex pinMutex_;
+   boost::condition_variable pinReleased_; // Signaled when a slot is unpinned
+   std::map<long, Pin> pins_;
+   std::vector<unsigned> slotPins_;
+   long nextPinHandle_;
+   long pinWaitTimeoutMs_;
 };
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ConfigFileParser.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Parses system configuration files into a list of commands,
+//                separately from applying them.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ConfigFileParser.h"
+
+#include "../MMDevice/DeviceUtils.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <iterator>
+
+
+namespace mm {
+
+namespace {
+
+struct CommandSyntax
+{
+   const char* name;
+   ConfigCommand::Type type;
+   size_t fields; // Including the command name
+   bool lastMayBeOmitted;
+};
+
+// ConfigGroup is special-cased, as it has two forms
+const CommandSyntax commandSyntax[] =
+{
+   { MM::g_CFGCommand_Device, ConfigCommand::LoadDevice, 4, false },
+   { MM::g_CFGCommand_Property, ConfigCommand::SetProperty, 4, true },
+   { MM::g_CFGCommand_Delay, ConfigCommand::SetDelay, 3, false },
+   { MM::g_CFGCommand_FocusDirection, ConfigCommand::SetFocusDirection, 3, false },
+   { MM::g_CFGCommand_Label, ConfigCommand::DefineLabel, 4, false },
+   { MM::g_CFGCommand_Configuration, ConfigCommand::ObsoleteConfiguration, 5, false },
+   { MM::g_CFGCommand_ConfigPixelSize, ConfigCommand::DefinePixelSizeConfig, 5, false },
+   { MM::g_CFGCommand_PixelSize_um, ConfigCommand::SetPixelSize, 3, false },
+   { MM::g_CFGCommand_PixelSizeAffine, ConfigCommand::SetPixelSizeAffine, 8, false },
+   { MM::g_CFGCommand_Equipment, ConfigCommand::DefinePropertyBlock, 4, false },
+   { MM::g_CFGCommand_ImageSynchro, ConfigCommand::AssignImageSynchro, 2, false },
+   { MM::g_CFGCommand_ParentID, ConfigCommand::SetParent, 3, false },
+};
+
+// Returns false for unrecognized commands
+bool
+ParseTokens(std::vector<std::string>& tokens, ConfigCommand& command)
+{
+   command.type = ConfigCommand::Invalid;
+   if (tokens.empty())
+      return true;
+
+   const std::string& name = tokens[0];
+   if (name == MM::g_CFGCommand_ConfigGroup)
+   {
+      if (tokens.size() == 2)
+         command.type = ConfigCommand::DefineConfigGroup;
+      else if (tokens.size() == 6 || tokens.size() == 5)
+         command.type = ConfigCommand::DefineConfig;
+      if (tokens.size() == 5)
+         tokens.push_back("");
+   }
+   else
+   {
+      const size_t nCommands = sizeof(commandSyntax) / sizeof(commandSyntax[0]);
+      size_t i = 0;
+      while (i < nCommands && name != commandSyntax[i].name)
+         ++i;
+      if (i == nCommands)
+         return false;
+
+      const CommandSyntax& syntax = commandSyntax[i];
+      if (syntax.lastMayBeOmitted && tokens.size() == syntax.fields - 1)
+         tokens.push_back("");
+      if (tokens.size() == syntax.fields)
+         command.type = syntax.type;
+   }
+
+   if (command.type != ConfigCommand::Invalid)
+      command.args.assign(tokens.begin() + 1, tokens.end());
+   return true;
+}
+
+} // anonymous namespace
+
+
+std::vector<ConfigCommand>
+ParseConfigFile(std::istream& in)
+{
+   const std::string text((std::istreambuf_iterator<char>(in)),
+         std::istreambuf_iterator<char>());
+
+   std::vector<ConfigCommand> commands;
+   std::vector<std::string> tokens;
+   int lineNumber = 0;
+   std::string::size_type start = 0;
+   while (start < text.size())
+   {
+      std::string::size_type end = text.find('\n', start);
+      if (end == std::string::npos)
+         end = text.size();
+      ++lineNumber;
+
+      // Strip a Windows/DOS CR (and anything after it)
+      std::string::size_type lineEnd = text.find('\r', start);
+      if (lineEnd == std::string::npos || lineEnd > end)
+         lineEnd = end;
+      const std::string line(text, start, lineEnd - start);
+      start = end + 1;
+
+      if (line.empty() || line[0] == '#')
+         continue;
+
+      tokens.clear();
+      CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
+
+      ConfigCommand command;
+      command.lineNumber = lineNumber;
+      command.line = line;
+      if (ParseTokens(tokens, command))
+         commands.push_back(command);
+   }
+   return commands;
+}
+
+} // namespace mm
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ConfigFileParser.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Parses system configuration files into a list of commands,
+//                separately from applying them.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// One command line of a system configuration file
+struct ConfigCommand
+{
+   enum Type
+   {
+      Invalid, // Wrong number of fields for the command
+      LoadDevice, // label, module, device
+      SetProperty, // label, property, value
+      SetDelay, // label, delay
+      SetFocusDirection, // label, direction
+      DefineLabel, // label, position, state label
+      ObsoleteConfiguration,
+      DefineConfigGroup, // group
+      DefineConfig, // group, preset, label, property, value
+      DefinePixelSizeConfig, // preset, label, property, value
+      SetPixelSize, // preset, size
+      SetPixelSizeAffine, // preset, 6 values
+      DefinePropertyBlock, // block, property, value
+      AssignImageSynchro, // label
+      SetParent // label, parent label
+   };
+
+   Type type;
+   int lineNumber; // 1-based
+   std::string line;
+   // The fields following the command name. An omitted trailing value
+   // (where the format allows it) is filled in as an empty string.
+   std::vector<std::string> args;
+
+   bool IsPresetDefinition() const
+   { return type == DefineConfigGroup || type == DefineConfig ||
+      type == DefinePixelSizeConfig; }
+};
+
+// Parses configuration file text. Comments, blank lines and unrecognized
+// commands are skipped; lines with the wrong number of fields are returned
+// as Invalid so that the caller can report them before applying anything.
+std::vector<ConfigCommand> ParseConfigFile(std::istream& in);
+
+} // namespace mm
@@ -30,7 +30,11 @@
 #include "../MMDevice/ImgBuffer.h"
 #include "CircularBuffer.h"
 #include "CoreCallback.h"
+#include "DeviceInitScheduler.h"
 #include "DeviceManager.h"
+#include "FrameTrace.h"
+#include "MonotonicClock.h"
+#include "StateCache.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <string>
@@ -77,6 +81,7 @@ CoreCallback::GetDevice(const MM::Device* caller, const char* label)
    if (!caller || !label)
       return 0;
 
+   WaitForEarlierDeviceInitialization(caller, label);
    try
    {
       MM::Device* pDevice = core_->deviceManager_->GetDevice(label)->GetRawPtr();
@@ -122,8 +127,9 @@ CoreCallback::GetImageProcessor(const MM::Device*)
 
 
 MM::State*
-CoreCallback::GetStateDevice(const MM::Device*, const char* label)
+CoreCallback::GetStateDevice(const MM::Device* caller, const char* label)
 {
+   WaitForEarlierDeviceInitialization(caller, label);
    try
    {
       return core_->deviceManager_->GetDeviceOfType<StateInstance>(label)->
@@ -185,10 +191,11 @@ CoreCallback::GetParentHub(const MM::Device* caller) const
 
 
 void
-CoreCallback::GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType devType,
+CoreCallback::GetLoadedDeviceOfType(const MM::Device* caller, MM::DeviceType devType,
       char* deviceName, const unsigned int deviceIterator)
 {
    deviceName[0] = 0;
+   WaitForEarlierDeviceInitialization(caller, 0);
    std::vector<std::string> v = core_->getLoadedDevicesOfType(devType);
    if( deviceIterator < v.size())
       strncpy( deviceName, v.at(deviceIterator).c_str(), MM::MaxStrLength);
@@ -196,6 +203,29 @@ CoreCallback::GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType devType,
 }
 
 
+void
+CoreCallback::WaitForEarlierDeviceInitialization(const MM::Device* caller,
+      const char* label)
+{
+   std::string callerLabel;
+   if (caller)
+   {
+      try
+      {
+         callerLabel = core_->deviceManager_->GetDevice(caller)->GetLabel();
+      }
+      catch (const CMMError&)
+      {
+      }
+   }
+
+   if (label)
+      core_->initScheduler_->WaitForDevice(callerLabel, label);
+   else
+      core_->initScheduler_->WaitForEarlierDevices(callerLabel);
+}
+
+
 void
 CoreCallback::Sleep(const MM::Device*, double intervalMs)
 {
@@ -251,17 +281,22 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 {
    try 
    {
+      mm::FrameTrace trace;
+      const bool tracing = core_->frameTracer_->IsEnabled();
+      if (tracing)
+         trace.receivedUs = mm::GetMonotonicMicroseconds();
+
       Metadata md = AddCameraMetadata(caller, pMd);
 
       if(doProcess)
       {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
+         int ret = ProcessImages(caller, buf, 1, width, height, byteDepth,
+               tracing ? &trace : 0);
+         if (ret != DEVICE_OK)
+            return ret;
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
+      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md,
+               tracing ? &trace : 0))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -283,17 +318,22 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 {
    try 
    {
+      mm::FrameTrace trace;
+      const bool tracing = core_->frameTracer_->IsEnabled();
+      if (tracing)
+         trace.receivedUs = mm::GetMonotonicMicroseconds();
+
       Metadata md = AddCameraMetadata(caller, pMd);
 
       if(doProcess)
       {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
+         int ret = ProcessImages(caller, buf, 1, width, height, byteDepth,
+               tracing ? &trace : 0);
+         if (ret != DEVICE_OK)
+            return ret;
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
+      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md,
+               tracing ? &trace : 0))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -307,13 +347,6 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf)
 {
    Metadata md = imgBuf.GetMetadata();
-   unsigned char* p = const_cast<unsigned char*>(imgBuf.GetPixels());
-   MM::ImageProcessor* ip = GetImageProcessor(caller);
-   if( NULL != ip)
-   {
-      ip->Process(p, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth());
-   }
-
    return InsertImage(caller, imgBuf.GetPixels(), imgBuf.Width(), 
       imgBuf.Height(), imgBuf.Depth(), &md);
 }
@@ -330,7 +363,68 @@ bool CoreCallback::InitializeImageBuffer(unsigned channels, unsigned slices,
    if (slices != 1)
       return false;
 
-   return core_->cbuf_->Initialize(channels, w, h, pixDepth);
+   // The buffer holds images as they come out of the image processor
+   unsigned outWidth = w, outHeight = h, outDepth = pixDepth;
+   MM::ImageProcessor* ip = GetImageProcessor(0);
+   if (ip && ip->GetOutputShape(w, h, pixDepth,
+            outWidth, outHeight, outDepth) != DEVICE_OK)
+      return false;
+   return core_->cbuf_->Initialize(channels, outWidth, outHeight, outDepth);
+}
+
+int CoreCallback::ProcessImages(const MM::Device* caller,
+      const unsigned char*& buf, unsigned numImages, unsigned& width,
+      unsigned& height, unsigned& byteDepth, mm::FrameTrace* trace)
+{
+   MM::ImageProcessor* ip = GetImageProcessor(caller);
+   if (!ip)
+      return DEVICE_OK;
+   if (trace)
+      trace->processStartUs = mm::GetMonotonicMicroseconds();
+
+   unsigned outWidth, outHeight, outDepth;
+   int ret = ip->GetOutputShape(width, height, byteDepth,
+         outWidth, outHeight, outDepth);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   const size_t imageSize = (size_t)width * height * byteDepth;
+   if (outWidth == width && outHeight == height && outDepth == byteDepth)
+   {
+      for (unsigned i = 0; i < numImages; ++i)
+         ip->Process(const_cast<unsigned char*>(buf) + i * imageSize,
+               width, height, byteDepth);
+      if (trace)
+         trace->processEndUs = mm::GetMonotonicMicroseconds();
+      return DEVICE_OK;
+   }
+
+   const size_t outSize = (size_t)outWidth * outHeight * outDepth;
+   if (outSize == 0)
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   std::vector<unsigned char>* out = processedImages_.get();
+   if (!out)
+   {
+      out = new std::vector<unsigned char>();
+      processedImages_.reset(out);
+   }
+   if (out->size() < outSize * numImages)
+      out->resize(outSize * numImages);
+
+   for (unsigned i = 0; i < numImages; ++i)
+   {
+      ret = ip->ProcessTo(buf + i * imageSize, width, height, byteDepth,
+            &(*out)[i * outSize], outWidth, outHeight, outDepth);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   buf = &(*out)[0];
+   width = outWidth;
+   height = outHeight;
+   byteDepth = outDepth;
+   if (trace)
+      trace->processEndUs = mm::GetMonotonicMicroseconds();
+   return DEVICE_OK;
 }
 
 int CoreCallback::InsertMultiChannel(const MM::Device* caller,
@@ -343,14 +437,19 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
 {
    try
    {
+      mm::FrameTrace trace;
+      const bool tracing = core_->frameTracer_->IsEnabled();
+      if (tracing)
+         trace.receivedUs = mm::GetMonotonicMicroseconds();
+
       Metadata md = AddCameraMetadata(caller, pMd);
 
-      MM::ImageProcessor* ip = GetImageProcessor(caller);
-      if( NULL != ip)
-      {
-         ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
-      }
-      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
+      int ret = ProcessImages(caller, buf, numChannels, width, height, byteDepth,
+            tracing ? &trace : 0);
+      if (ret != DEVICE_OK)
+         return ret;
+      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md,
+               tracing ? &trace : 0))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -470,10 +569,7 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
       bool readOnly;
       device->GetPropertyReadOnly(propName, readOnly);
       const PropertySetting* ps = new PropertySetting(label, propName, value, readOnly);
-      {
-         MMThreadGuard scg(core_->stateCacheLock_);
-         core_->stateCache_.addSetting(*ps);
-      }
+      core_->stateCache_->Set(*ps);
       core_->externalCallback_->onPropertyChanged(label, propName, value);
 
       // Find all configs that contain this property and callback to indicate 
@@ -1062,17 +1158,12 @@ void CoreCallback::ClearPostedErrors()
 /**
  * Returns the number of microsecond tick
  * N.B. an unsigned long microsecond count rolls over in just over an hour!!!!
+ * Only differences are meaningful; the ticks come from a monotonic clock.
  * NOTE: This method is 'obsolete.'
  */
 unsigned long CoreCallback::GetClockTicksUs(const MM::Device* /*caller*/)
 {
-	using namespace boost::posix_time;
-	using namespace boost::gregorian;
-	boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
-	boost::gregorian::date today( day_clock::local_day());
-	boost::posix_time::ptime timet_start(today); 
-	time_duration diff = t - timet_start; 
-	return (unsigned long) diff.total_microseconds();
+	return (unsigned long) mm::GetMonotonicMicroseconds();
 }
 
 MM::MMTime CoreCallback::GetCurrentMMTime()
@@ -31,9 +31,14 @@
 #include "MMEventCallback.h"
 #include "../MMDevice/DeviceUtils.h"
 
+#include <boost/thread/tss.hpp>
+
+#include <vector>
+
 namespace mm
 {
    class DeviceManager;
+   struct FrameTrace;
 }
 
 
@@ -144,6 +149,20 @@ private:
 
    Metadata AddCameraMetadata(const MM::Device* caller, const Metadata* pMd);
 
+   // Run the current image processor on numImages consecutive images. When
+   // the processor changes the image shape, the output goes to a buffer owned
+   // by the calling thread and buf and the shape are updated to refer to it.
+   // The processing time is stamped on the trace, if given.
+   int ProcessImages(const MM::Device* caller, const unsigned char*& buf,
+         unsigned numImages, unsigned& width, unsigned& height,
+         unsigned& byteDepth, mm::FrameTrace* trace);
+   boost::thread_specific_ptr< std::vector<unsigned char> > processedImages_;
+
+   // During initializeAllDevices(), let a device see devices loaded before
+   // it as initialized (label null to wait for all of them)
+   void WaitForEarlierDeviceInitialization(const MM::Device* caller,
+         const char* label);
+
    int OnConfigGroupChanged(const char* groupName, const char* newConfigName);
    int OnPixelSizeChanged(double newPixelSizeUm);
    int OnPixelSizeAffineChanged(std::vector<double> newPixelSizeAffine);
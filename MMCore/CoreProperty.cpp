@@ -160,6 +160,10 @@ void CorePropertyCollection::Execute(const char* propName, const char* value)
    {
       core_->setChannelGroup(value);
    }
+   else if (strcmp(propName, MM::g_Keyword_CoreParallelInitialize) == 0)
+   {
+      core_->enableParallelInitialization(strcmp(value, "1") == 0);
+   }
    // unknown property
    else
    {
@@ -241,6 +245,10 @@ void CorePropertyCollection::Refresh()
    // Channel group
    Set(MM::g_Keyword_CoreChannelGroup, core_->getChannelGroup().c_str());
 
+   // Parallel initialization
+   Set(MM::g_Keyword_CoreParallelInitialize,
+         core_->isParallelInitializationEnabled() ? "1" : "0");
+
 }
 
 bool CorePropertyCollection::IsReadOnly(const char* propName) const
@@ -26,6 +26,7 @@
 #pragma once
 
 #include "../MMDevice/MMDevice.h"
+#include "MonotonicClock.h"
 
 // suppress hideous boost warnings
 #ifdef WIN32
@@ -106,8 +107,9 @@ inline MM::MMTime GetMMTimeNow(boost::posix_time::ptime t0)
 }
 
 //NB we are starting the 'epoch' on 2000 01 01
+// Monotonic: not affected by changes to the system time after the first call
 inline MM::MMTime GetMMTimeNow()
 {
-   return GetMMTimeNow(boost::posix_time::microsec_clock::local_time());
+   return mm::MonotonicToMMTime(mm::GetMonotonicMicroseconds());
 }
 
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceCallStats.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Optional per-device statistics of calls into device adapters:
+//                call counts and latency histograms.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCallStats.h"
+
+#include "MonotonicClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mm {
+
+const int LatencyHistogram::SubBucketBits;
+const int LatencyHistogram::BucketCount;
+
+LatencyHistogram::LatencyHistogram() :
+   buckets_(BucketCount, 0),
+   count_(0),
+   total_(0),
+   min_(0),
+   max_(0)
+{
+}
+
+int LatencyHistogram::BucketIndex(long long us)
+{
+   if (us < (1 << SubBucketBits))
+      return us < 0 ? 0 : static_cast<int>(us);
+   int exponent = 0;
+   while ((us >> (exponent + 1)) != 0)
+      ++exponent;
+   const int group = exponent - SubBucketBits;
+   const int index = (1 << SubBucketBits) * (group + 1) +
+      static_cast<int>((us >> group) & ((1 << SubBucketBits) - 1));
+   return std::min(index, BucketCount - 1);
+}
+
+long long LatencyHistogram::BucketUpperBound(int index)
+{
+   const int subBuckets = 1 << SubBucketBits;
+   if (index < subBuckets)
+      return index;
+   const int group = index / subBuckets - 1;
+   const long long lower = static_cast<long long>(subBuckets + index % subBuckets) << group;
+   return lower + (1LL << group) - 1;
+}
+
+void LatencyHistogram::Record(long long us)
+{
+   if (us < 0)
+      us = 0;
+   ++buckets_[BucketIndex(us)];
+   if (count_ == 0 || us < min_)
+      min_ = us;
+   if (us > max_)
+      max_ = us;
+   ++count_;
+   total_ += us;
+}
+
+void LatencyHistogram::Reset()
+{
+   std::fill(buckets_.begin(), buckets_.end(), 0);
+   count_ = 0;
+   total_ = 0;
+   min_ = 0;
+   max_ = 0;
+}
+
+long long LatencyHistogram::GetPercentile(double percent) const
+{
+   if (count_ == 0)
+      return 0;
+   percent = std::max(0.0, std::min(100.0, percent));
+   long long rank = static_cast<long long>(std::ceil(percent / 100.0 * count_));
+   rank = std::max(rank, 1LL);
+
+   long long seen = 0;
+   for (int i = 0; i < BucketCount; ++i)
+   {
+      seen += buckets_[i];
+      if (seen >= rank)
+         return std::max(min_, std::min(BucketUpperBound(i), max_));
+   }
+   return max_;
+}
+
+
+const char* const DeviceCallStats::ModuleLockWaitName = "ModuleLockWait";
+
+DeviceCallStats::DeviceCallStats() :
+   enabled_(false)
+{
+}
+
+void DeviceCallStats::Record(const char* call, long long us)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   calls_[call].Record(us);
+}
+
+void DeviceCallStats::Reset()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   calls_.clear();
+}
+
+std::vector<std::string> DeviceCallStats::GetCallNames() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   std::vector<std::string> names;
+   for (std::map<std::string, LatencyHistogram>::const_iterator it = calls_.begin(),
+         end = calls_.end(); it != end; ++it)
+      names.push_back(it->first);
+   return names;
+}
+
+LatencyHistogram DeviceCallStats::GetHistogram(const std::string& call) const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   std::map<std::string, LatencyHistogram>::const_iterator it = calls_.find(call);
+   if (it == calls_.end())
+      return LatencyHistogram();
+   return it->second;
+}
+
+
+DeviceCallStats::Timer::Timer(DeviceCallStats& stats, const char* call) :
+   stats_(stats.IsEnabled() ? &stats : 0),
+   call_(call),
+   startUs_(stats_ ? GetMonotonicMicroseconds() : 0)
+{
+}
+
+DeviceCallStats::Timer::~Timer()
+{
+   if (stats_)
+      stats_->Record(call_, GetMonotonicMicroseconds() - startUs_);
+}
+
+} // namespace mm
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceCallStats.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Optional per-device statistics of calls into device adapters:
+//                call counts and latency histograms.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// Histogram of durations in microseconds with bounded relative error, in the
+// manner of HdrHistogram: values below 8 get a bucket each, and every
+// power-of-two range above is split into 8 equal buckets, so a value is
+// known to within 12.5%. Memory is fixed (a few kB) and recording is O(1).
+// Values beyond about 12 days go into the last bucket.
+class LatencyHistogram
+{
+public:
+   LatencyHistogram();
+
+   void Record(long long us);
+   void Reset();
+
+   long long GetCount() const { return count_; }
+   long long GetTotal() const { return total_; }
+   long long GetMin() const { return count_ > 0 ? min_ : 0; }
+   long long GetMax() const { return max_; }
+   // Smallest recorded value that at least the given percentage (0 to 100)
+   // of values do not exceed, rounded up to its bucket's upper bound (but not
+   // beyond the maximum); 0 if nothing was recorded
+   long long GetPercentile(double percent) const;
+
+   static const int SubBucketBits = 3;
+   static const int BucketCount = 8 + 37 * 8;
+   static int BucketIndex(long long us);
+   static long long BucketUpperBound(int index);
+
+private:
+   std::vector<long long> buckets_;
+   long long count_;
+   long long total_;
+   long long min_;
+   long long max_;
+};
+
+
+// Statistics of one device's calls, by call name. The device module lock
+// wait is recorded like a call, under ModuleLockWaitName.
+//
+// Recording is off until enabled. While off, Timer costs a check of a flag;
+// the flag is read without locking, so a call that overlaps enabling or
+// disabling may or may not be recorded.
+class DeviceCallStats
+{
+public:
+   static const char* const ModuleLockWaitName;
+
+   DeviceCallStats();
+
+   void SetEnabled(bool enabled) { enabled_ = enabled; }
+   bool IsEnabled() const { return enabled_; }
+
+   void Record(const char* call, long long us);
+   void Reset();
+
+   // Names of calls recorded since the last reset, sorted
+   std::vector<std::string> GetCallNames() const;
+   // Copy of one call's histogram (empty if not recorded)
+   LatencyHistogram GetHistogram(const std::string& call) const;
+
+   // Times a call into the device: from construction to destruction, so
+   // that calls that throw are counted too. call must be a string literal
+   // (or otherwise outlive the timer).
+   class Timer
+   {
+   public:
+      Timer(DeviceCallStats& stats, const char* call);
+      ~Timer();
+
+   private:
+      Timer(const Timer&);
+      Timer& operator=(const Timer&);
+
+      DeviceCallStats* stats_; // Null if not recording
+      const char* call_;
+      long long startUs_;
+   };
+
+private:
+   DeviceCallStats(const DeviceCallStats&);
+   DeviceCallStats& operator=(const DeviceCallStats&);
+
+   bool enabled_;
+   mutable boost::mutex mutex_;
+   std::map<std::string, LatencyHistogram> calls_;
+};
+
+} // namespace mm
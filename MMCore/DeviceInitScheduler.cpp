@@ -0,0 +1,241 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceInitScheduler.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Initializes independent devices concurrently, respecting
+//                hub, port and module dependencies.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceInitScheduler.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+
+
+namespace mm {
+
+DeviceInitScheduler::DeviceInitScheduler() :
+   running_(false),
+   activeCount_(0)
+{
+}
+
+
+void
+DeviceInitScheduler::Clear()
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   devices_.clear();
+   indices_.clear();
+   firstError_.reset();
+}
+
+
+void
+DeviceInitScheduler::AddDevice(const std::string& label,
+      const std::vector<std::string>& dependencies)
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+
+   Device device;
+   device.label = label;
+   device.state = Pending;
+   device.initTimeMs = 0.0;
+   for (std::vector<std::string>::const_iterator it = dependencies.begin(),
+         end = dependencies.end(); it != end; ++it)
+   {
+      size_t index = IndexOf(*it);
+      if (index < devices_.size() &&
+            std::find(device.dependencies.begin(), device.dependencies.end(),
+               index) == device.dependencies.end())
+         device.dependencies.push_back(index);
+   }
+
+   indices_[label] = devices_.size();
+   devices_.push_back(device);
+}
+
+
+void
+DeviceInitScheduler::Run(InitFunction init) throw (CMMError)
+{
+   std::vector< boost::shared_ptr<boost::thread> > threads;
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      for (size_t i = 0; i < devices_.size(); ++i)
+      {
+         devices_[i].state = Pending;
+         devices_[i].initTimeMs = 0.0;
+      }
+      firstError_.reset();
+      running_ = true;
+      activeCount_ = 0;
+
+      for (;;)
+      {
+         if (!firstError_)
+         {
+            for (size_t i = 0; i < devices_.size(); ++i)
+            {
+               if (devices_[i].state == Pending && IsReady(devices_[i]))
+               {
+                  devices_[i].state = Running;
+                  ++activeCount_;
+                  threads.push_back(boost::make_shared<boost::thread>(
+                        boost::bind(&DeviceInitScheduler::InitOne, this, i,
+                           init)));
+               }
+            }
+         }
+         // Since dependencies always point to earlier devices, nothing can
+         // be left pending unless a device failed
+         if (activeCount_ == 0)
+            break;
+         cond_.wait(lock);
+      }
+
+      running_ = false;
+   }
+   cond_.notify_all();
+
+   for (size_t i = 0; i < threads.size(); ++i)
+      threads[i]->join();
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   if (firstError_)
+      throw *firstError_;
+}
+
+
+void
+DeviceInitScheduler::InitOne(size_t index, InitFunction init)
+{
+   std::string label;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      label = devices_[index].label;
+   }
+
+   boost::shared_ptr<CMMError> error;
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+   try
+   {
+      init(label);
+   }
+   catch (const CMMError& e)
+   {
+      error = boost::make_shared<CMMError>(e);
+   }
+   catch (const std::exception& e)
+   {
+      error = boost::make_shared<CMMError>("Error initializing device " +
+            label + ": " + e.what());
+   }
+   const double elapsedMs = (boost::posix_time::microsec_clock::universal_time() -
+         start).total_microseconds() / 1000.0;
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      Device& device = devices_[index];
+      device.initTimeMs = elapsedMs;
+      device.state = error ? Failed : Done;
+      if (error && !firstError_)
+         firstError_ = error;
+      --activeCount_;
+   }
+   cond_.notify_all();
+}
+
+
+void
+DeviceInitScheduler::WaitForDevice(const std::string& caller,
+      const std::string& label)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   if (!running_)
+      return;
+   const size_t target = IndexOf(label);
+   const size_t self = IndexOf(caller);
+   if (target >= devices_.size() || target >= self)
+      return;
+   while (running_ && !firstError_ && !IsFinished(target))
+      cond_.wait(lock);
+}
+
+
+void
+DeviceInitScheduler::WaitForEarlierDevices(const std::string& caller)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   if (!running_)
+      return;
+   const size_t self = std::min(IndexOf(caller), devices_.size());
+   for (size_t i = 0; i < self; ++i)
+   {
+      while (running_ && !firstError_ && !IsFinished(i))
+         cond_.wait(lock);
+   }
+}
+
+
+std::vector<std::string>
+DeviceInitScheduler::GetInitializedDevices() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   std::vector<std::string> labels;
+   for (size_t i = 0; i < devices_.size(); ++i)
+      if (devices_[i].state == Done)
+         labels.push_back(devices_[i].label);
+   return labels;
+}
+
+
+double
+DeviceInitScheduler::GetInitTimeMs(const std::string& label) const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   size_t index = IndexOf(label);
+   return index < devices_.size() ? devices_[index].initTimeMs : 0.0;
+}
+
+
+bool
+DeviceInitScheduler::IsReady(const Device& device) const
+{
+   for (size_t i = 0; i < device.dependencies.size(); ++i)
+      if (devices_[device.dependencies[i]].state != Done)
+         return false;
+   return true;
+}
+
+
+bool
+DeviceInitScheduler::IsFinished(size_t index) const
+{
+   return devices_[index].state == Done || devices_[index].state == Failed;
+}
+
+
+size_t
+DeviceInitScheduler::IndexOf(const std::string& label) const
+{
+   std::map<std::string, size_t>::const_iterator it = indices_.find(label);
+   return it == indices_.end() ? devices_.size() : it->second;
+}
+
+} // namespace mm
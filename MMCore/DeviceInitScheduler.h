@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceInitScheduler.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Initializes independent devices concurrently, respecting
+//                hub, port and module dependencies.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <boost/function.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// Runs an initialization function for each of a list of devices, starting
+// each device on its own thread as soon as the devices it depends on have
+// been initialized. Devices are added in load order, and a device may only
+// depend on devices added before it, so the order in which devices would
+// have been initialized one by one is always a valid order.
+//
+// In addition to the declared dependencies, a device that is being
+// initialized can wait for any device added before it (see
+// WaitForDevice()), so that a device that looks up other devices during
+// initialization sees them initialized, as it would if devices were
+// initialized one by one.
+class DeviceInitScheduler
+{
+public:
+   // Throws CMMError on failure
+   typedef boost::function<void (const std::string&)> InitFunction;
+
+   DeviceInitScheduler();
+
+   // Removes all devices; must not be called while running
+   void Clear();
+   // Dependencies that are unknown or not added earlier are ignored
+   void AddDevice(const std::string& label,
+         const std::vector<std::string>& dependencies);
+
+   // Initializes all devices. If initialization of a device fails, no
+   // further devices are started; Run() waits for those already started and
+   // then rethrows the first error.
+   void Run(InitFunction init) throw (CMMError);
+
+   // Blocks until the given device has finished initializing, if Run() is
+   // in progress and the device was added before the caller (or the caller
+   // is not a device being initialized). Returns early if a device fails.
+   void WaitForDevice(const std::string& caller, const std::string& label);
+   // Blocks until all devices added before the caller have finished
+   // initializing (returns immediately when not running)
+   void WaitForEarlierDevices(const std::string& caller);
+
+   // Labels of the devices that were initialized successfully, in load
+   // order, and the time each took
+   std::vector<std::string> GetInitializedDevices() const;
+   double GetInitTimeMs(const std::string& label) const;
+
+private:
+   DeviceInitScheduler(const DeviceInitScheduler&);
+   DeviceInitScheduler& operator=(const DeviceInitScheduler&);
+
+   enum State { Pending, Running, Done, Failed };
+
+   struct Device
+   {
+      std::string label;
+      std::vector<size_t> dependencies;
+      State state;
+      double initTimeMs;
+   };
+
+   void InitOne(size_t index, InitFunction init);
+   bool IsReady(const Device& device) const;
+   bool IsFinished(size_t index) const;
+   size_t IndexOf(const std::string& label) const; // devices_.size() if none
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable cond_; // Signaled when a device finishes
+   std::vector<Device> devices_;
+   std::map<std::string, size_t> indices_;
+   bool running_;
+   size_t activeCount_;
+   boost::shared_ptr<CMMError> firstError_;
+};
+
+} // namespace mm
@@ -293,8 +293,21 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
 
 
 DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device) :
-   g_(device->GetAdapterModule()->GetLock())
-{}
+   lock_(device->GetAdapterModule()->GetLock())
+{
+   if (lock_ != 0)
+   {
+      DeviceCallStats::Timer timer(device->GetCallStats(),
+            DeviceCallStats::ModuleLockWaitName);
+      lock_->Lock();
+   }
+}
+
+DeviceModuleLockGuard::~DeviceModuleLockGuard()
+{
+   if (lock_ != 0)
+      lock_->Unlock();
+}
 
 
 } // namespace mm
@@ -134,12 +134,18 @@ public:
 };
 
 
-// Scoped acquisition of a device's module's lock
+// Scoped acquisition of a device's module's lock. The time spent waiting for
+// the lock goes to the device's call statistics.
 class DeviceModuleLockGuard
 {
-   MMThreadGuard g_;
+   MMThreadLock* lock_;
 public:
    explicit DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device);
+   ~DeviceModuleLockGuard();
+
+private:
+   DeviceModuleLockGuard(const DeviceModuleLockGuard&);
+   DeviceModuleLockGuard& operator=(const DeviceModuleLockGuard&);
 };
 
 } // namespace mm
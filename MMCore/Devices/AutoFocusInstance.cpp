@@ -22,13 +22,13 @@
 #include "AutoFocusInstance.h"
 
 
-int AutoFocusInstance::SetContinuousFocusing(bool state) { return GetImpl()->SetContinuousFocusing(state); }
+int AutoFocusInstance::SetContinuousFocusing(bool state) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetContinuousFocusing"); return GetImpl()->SetContinuousFocusing(state); }
 int AutoFocusInstance::GetContinuousFocusing(bool& state) { return GetImpl()->GetContinuousFocusing(state); }
-bool AutoFocusInstance::IsContinuousFocusLocked() { return GetImpl()->IsContinuousFocusLocked(); }
-int AutoFocusInstance::FullFocus() { return GetImpl()->FullFocus(); }
-int AutoFocusInstance::IncrementalFocus() { return GetImpl()->IncrementalFocus(); }
-int AutoFocusInstance::GetLastFocusScore(double& score) { return GetImpl()->GetLastFocusScore(score); }
-int AutoFocusInstance::GetCurrentFocusScore(double& score) { return GetImpl()->GetCurrentFocusScore(score); }
+bool AutoFocusInstance::IsContinuousFocusLocked() { mm::DeviceCallStats::Timer t(GetCallStats(), "IsContinuousFocusLocked"); return GetImpl()->IsContinuousFocusLocked(); }
+int AutoFocusInstance::FullFocus() { mm::DeviceCallStats::Timer t(GetCallStats(), "FullFocus"); return GetImpl()->FullFocus(); }
+int AutoFocusInstance::IncrementalFocus() { mm::DeviceCallStats::Timer t(GetCallStats(), "IncrementalFocus"); return GetImpl()->IncrementalFocus(); }
+int AutoFocusInstance::GetLastFocusScore(double& score) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetLastFocusScore"); return GetImpl()->GetLastFocusScore(score); }
+int AutoFocusInstance::GetCurrentFocusScore(double& score) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetCurrentFocusScore"); return GetImpl()->GetCurrentFocusScore(score); }
 int AutoFocusInstance::AutoSetParameters() { return GetImpl()->AutoSetParameters(); }
 int AutoFocusInstance::GetOffset(double &offset) { return GetImpl()->GetOffset(offset); }
 int AutoFocusInstance::SetOffset(double offset) { return GetImpl()->SetOffset(offset); }
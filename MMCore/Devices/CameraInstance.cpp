@@ -22,9 +22,9 @@
 #include "CameraInstance.h"
 
 
-int CameraInstance::SnapImage() { return GetImpl()->SnapImage(); }
-const unsigned char* CameraInstance::GetImageBuffer() { return GetImpl()->GetImageBuffer(); }
-const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr) { return GetImpl()->GetImageBuffer(channelNr); }
+int CameraInstance::SnapImage() { mm::DeviceCallStats::Timer t(GetCallStats(), "SnapImage"); return GetImpl()->SnapImage(); }
+const unsigned char* CameraInstance::GetImageBuffer() { mm::DeviceCallStats::Timer t(GetCallStats(), "GetImageBuffer"); return GetImpl()->GetImageBuffer(); }
+const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetImageBuffer"); return GetImpl()->GetImageBuffer(channelNr); }
 const unsigned int* CameraInstance::GetImageBufferAsRGB32() { return GetImpl()->GetImageBufferAsRGB32(); }
 unsigned CameraInstance::GetNumberOfComponents() const { return GetImpl()->GetNumberOfComponents(); }
 
@@ -54,10 +54,10 @@ unsigned CameraInstance::GetImageBytesPerPixel() const { return GetImpl()->GetIm
 unsigned CameraInstance::GetBitDepth() const { return GetImpl()->GetBitDepth(); }
 double CameraInstance::GetPixelSizeUm() const { return GetImpl()->GetPixelSizeUm(); }
 int CameraInstance::GetBinning() const { return GetImpl()->GetBinning(); }
-int CameraInstance::SetBinning(int binSize) { return GetImpl()->SetBinning(binSize); }
-void CameraInstance::SetExposure(double exp_ms) { return GetImpl()->SetExposure(exp_ms); }
-double CameraInstance::GetExposure() const { return GetImpl()->GetExposure(); }
-int CameraInstance::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize) { return GetImpl()->SetROI(x, y, xSize, ySize); }
+int CameraInstance::SetBinning(int binSize) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetBinning"); return GetImpl()->SetBinning(binSize); }
+void CameraInstance::SetExposure(double exp_ms) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetExposure"); return GetImpl()->SetExposure(exp_ms); }
+double CameraInstance::GetExposure() const { mm::DeviceCallStats::Timer t(GetCallStats(), "GetExposure"); return GetImpl()->GetExposure(); }
+int CameraInstance::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetROI"); return GetImpl()->SetROI(x, y, xSize, ySize); }
 int CameraInstance::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) { return GetImpl()->GetROI(x, y, xSize, ySize); }
 int CameraInstance::ClearROI() { return GetImpl()->ClearROI(); }
 
@@ -120,10 +120,10 @@ int CameraInstance::GetMultiROI(unsigned* xs, unsigned* ys, unsigned* widths,
    return GetImpl()->GetMultiROI(xs, ys, widths, heights, length);
 }
 
-int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow) { return GetImpl()->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow); }
-int CameraInstance::StartSequenceAcquisition(double interval_ms) { return GetImpl()->StartSequenceAcquisition(interval_ms); }
-int CameraInstance::StopSequenceAcquisition() { return GetImpl()->StopSequenceAcquisition(); }
-int CameraInstance::PrepareSequenceAcqusition() { return GetImpl()->PrepareSequenceAcqusition(); }
+int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow) { mm::DeviceCallStats::Timer t(GetCallStats(), "StartSequenceAcquisition"); return GetImpl()->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow); }
+int CameraInstance::StartSequenceAcquisition(double interval_ms) { mm::DeviceCallStats::Timer t(GetCallStats(), "StartSequenceAcquisition"); return GetImpl()->StartSequenceAcquisition(interval_ms); }
+int CameraInstance::StopSequenceAcquisition() { mm::DeviceCallStats::Timer t(GetCallStats(), "StopSequenceAcquisition"); return GetImpl()->StopSequenceAcquisition(); }
+int CameraInstance::PrepareSequenceAcqusition() { mm::DeviceCallStats::Timer t(GetCallStats(), "PrepareSequenceAcqusition"); return GetImpl()->PrepareSequenceAcqusition(); }
 bool CameraInstance::IsCapturing() { return GetImpl()->IsCapturing(); }
 
 std::string CameraInstance::GetTags()
@@ -141,7 +141,7 @@ void CameraInstance::AddTag(const char* key, const char* deviceLabel, const char
 void CameraInstance::RemoveTag(const char* key) { return GetImpl()->RemoveTag(key); }
 int CameraInstance::IsExposureSequenceable(bool& isSequenceable) const { return GetImpl()->IsExposureSequenceable(isSequenceable); }
 int CameraInstance::GetExposureSequenceMaxLength(long& nrEvents) const { return GetImpl()->GetExposureSequenceMaxLength(nrEvents); }
-int CameraInstance::StartExposureSequence() { return GetImpl()->StartExposureSequence(); }
+int CameraInstance::StartExposureSequence() { mm::DeviceCallStats::Timer t(GetCallStats(), "StartExposureSequence"); return GetImpl()->StartExposureSequence(); }
 int CameraInstance::StopExposureSequence() { return GetImpl()->StopExposureSequence(); }
 int CameraInstance::ClearExposureSequence() { return GetImpl()->ClearExposureSequence(); }
 int CameraInstance::AddToExposureSequence(double exposureTime_ms) { return GetImpl()->AddToExposureSequence(exposureTime_ms); }
@@ -149,6 +149,7 @@ std::string
 DeviceInstance::GetProperty(const std::string& name) const
 {
    DeviceStringBuffer valueBuf(this, "GetProperty");
+   mm::DeviceCallStats::Timer timer(callStats_, "GetProperty");
    int err = pImpl_->GetProperty(name.c_str(), valueBuf.GetBuffer());
    ThrowIfError(err, "Cannot get value of property " +
          ToQuotedString(name));
@@ -162,7 +163,11 @@ DeviceInstance::SetProperty(const std::string& name,
    LOG_DEBUG(Logger()) << "Will set property \"" << name << "\" to \"" <<
       value << "\"";
 
-   int err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   int err;
+   {
+      mm::DeviceCallStats::Timer timer(callStats_, "SetProperty");
+      err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   }
 
    ThrowIfError(err, "Cannot set property " + ToQuotedString(name) +
          " to " + ToQuotedString(value));
@@ -272,12 +277,14 @@ DeviceInstance::GetPropertySequenceMaxLength(const char* propertyName) const
 void
 DeviceInstance::StartPropertySequence(const char* propertyName)
 {
+   mm::DeviceCallStats::Timer timer(callStats_, "StartPropertySequence");
    ThrowIfError(pImpl_->StartPropertySequence(propertyName));
 }
 
 void
 DeviceInstance::StopPropertySequence(const char* propertyName)
 {
+   mm::DeviceCallStats::Timer timer(callStats_, "StopPropertySequence");
    ThrowIfError(pImpl_->StopPropertySequence(propertyName));
 }
 
@@ -293,9 +300,16 @@ DeviceInstance::AddToPropertySequence(const char* propertyName, const char* valu
    ThrowIfError(pImpl_->AddToPropertySequence(propertyName, value));
 }
 
+void
+DeviceInstance::SetPropertySequence(const char* propertyName, const double* values, long count)
+{
+   ThrowIfError(pImpl_->SetPropertySequence(propertyName, values, count));
+}
+
 void
 DeviceInstance::SendPropertySequence(const char* propertyName)
 {
+   mm::DeviceCallStats::Timer timer(callStats_, "SendPropertySequence");
    ThrowIfError(pImpl_->SendPropertySequence(propertyName));
 }
 
@@ -315,7 +329,10 @@ DeviceInstance::GetErrorText(int code) const
 
 bool
 DeviceInstance::Busy()
-{ return pImpl_->Busy(); }
+{
+   mm::DeviceCallStats::Timer timer(callStats_, "Busy");
+   return pImpl_->Busy();
+}
 
 double
 DeviceInstance::GetDelayMs() const
@@ -332,12 +349,14 @@ DeviceInstance::UsesDelay()
 void
 DeviceInstance::Initialize()
 {
+   mm::DeviceCallStats::Timer timer(callStats_, "Initialize");
    ThrowIfError(pImpl_->Initialize());
 }
 
 void
 DeviceInstance::Shutdown()
 {
+   mm::DeviceCallStats::Timer timer(callStats_, "Shutdown");
    ThrowIfError(pImpl_->Shutdown());
 }
 
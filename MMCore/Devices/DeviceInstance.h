@@ -20,6 +20,7 @@
 #pragma once
 
 #include "../../MMDevice/MMDeviceConstants.h"
+#include "../DeviceCallStats.h"
 #include "../Error.h"
 #include "../Logging/Logger.h"
 
@@ -71,6 +72,7 @@ private:
    DeleteDeviceFunction deleteFunction_;
    mm::logging::Logger deviceLogger_;
    mm::logging::Logger coreLogger_;
+   mutable mm::DeviceCallStats callStats_;
 
 public:
    boost::shared_ptr<LoadedDeviceAdapter> GetAdapterModule() const /* final */ { return adapter_; }
@@ -82,6 +84,10 @@ public:
    // need it for the few CoreCallback methods that return a device pointer.
    MM::Device* GetRawPtr() const /* final */ { return pImpl_; }
 
+   // Statistics of calls into the device (when enabled); the wrappers below
+   // time the calls that talk to hardware
+   mm::DeviceCallStats& GetCallStats() const /* final */ { return callStats_; }
+
    // Callback API
    int LogMessage(const char* msg, bool debugOnly);
 
@@ -193,6 +199,7 @@ public:
    void StopPropertySequence(const char* propertyName);
    void ClearPropertySequence(const char* propertyName);
    void AddToPropertySequence(const char* propertyName, const char* value);
+   void SetPropertySequence(const char* propertyName, const double* values, long count);
    void SendPropertySequence(const char* propertyName);
    std::string GetErrorText(int code) const;
    bool Busy();
@@ -22,10 +22,10 @@
 #include "GalvoInstance.h"
 
 
-int GalvoInstance::PointAndFire(double x, double y, double time_us) { return GetImpl()->PointAndFire(x, y, time_us); }
+int GalvoInstance::PointAndFire(double x, double y, double time_us) { mm::DeviceCallStats::Timer t(GetCallStats(), "PointAndFire"); return GetImpl()->PointAndFire(x, y, time_us); }
 int GalvoInstance::SetSpotInterval(double pulseInterval_us) { return GetImpl()->SetSpotInterval(pulseInterval_us); }
-int GalvoInstance::SetPosition(double x, double y) { return GetImpl()->SetPosition(x, y); }
-int GalvoInstance::GetPosition(double& x, double& y) { return GetImpl()->GetPosition(x, y); }
+int GalvoInstance::SetPosition(double x, double y) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPosition"); return GetImpl()->SetPosition(x, y); }
+int GalvoInstance::GetPosition(double& x, double& y) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPosition"); return GetImpl()->GetPosition(x, y); }
 int GalvoInstance::SetIlluminationState(bool on) { return GetImpl()->SetIlluminationState(on); }
 double GalvoInstance::GetXRange() { return GetImpl()->GetXRange(); }
 double GalvoInstance::GetXMinimum() { return GetImpl()->GetXMinimum(); }
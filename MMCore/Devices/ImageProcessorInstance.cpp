@@ -22,4 +22,6 @@
 #include "ImageProcessorInstance.h"
 
 
-int ImageProcessorInstance::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { return GetImpl()->Process(buffer, width, height, byteDepth); }
+int ImageProcessorInstance::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { mm::DeviceCallStats::Timer t(GetCallStats(), "Process"); return GetImpl()->Process(buffer, width, height, byteDepth); }
+int ImageProcessorInstance::GetOutputShape(unsigned width, unsigned height, unsigned byteDepth, unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth) { return GetImpl()->GetOutputShape(width, height, byteDepth, outWidth, outHeight, outByteDepth); }
+int ImageProcessorInstance::ProcessTo(const unsigned char* source, unsigned width, unsigned height, unsigned byteDepth, unsigned char* destination, unsigned outWidth, unsigned outHeight, unsigned outByteDepth) { return GetImpl()->ProcessTo(source, width, height, byteDepth, destination, outWidth, outHeight, outByteDepth); }
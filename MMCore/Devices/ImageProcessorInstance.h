@@ -37,4 +37,9 @@ public:
    {}
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth);
+   int ProcessTo(const unsigned char* source, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+         unsigned outHeight, unsigned outByteDepth);
 };
@@ -22,12 +22,12 @@
 #include "SLMInstance.h"
 
 
-int SLMInstance::SetImage(unsigned char* pixels) { return GetImpl()->SetImage(pixels); }
-int SLMInstance::SetImage(unsigned int* pixels) { return GetImpl()->SetImage(pixels); }
-int SLMInstance::DisplayImage() { return GetImpl()->DisplayImage(); }
+int SLMInstance::SetImage(unsigned char* pixels) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetImage"); return GetImpl()->SetImage(pixels); }
+int SLMInstance::SetImage(unsigned int* pixels) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetImage"); return GetImpl()->SetImage(pixels); }
+int SLMInstance::DisplayImage() { mm::DeviceCallStats::Timer t(GetCallStats(), "DisplayImage"); return GetImpl()->DisplayImage(); }
 int SLMInstance::SetPixelsTo(unsigned char intensity) { return GetImpl()->SetPixelsTo(intensity); }
 int SLMInstance::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue) { return GetImpl()->SetPixelsTo(red, green, blue); }
-int SLMInstance::SetExposure(double interval_ms) { return GetImpl()->SetExposure(interval_ms); }
+int SLMInstance::SetExposure(double interval_ms) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetExposure"); return GetImpl()->SetExposure(interval_ms); }
 double SLMInstance::GetExposure() { return GetImpl()->GetExposure(); }
 unsigned SLMInstance::GetWidth() { return GetImpl()->GetWidth(); }
 unsigned SLMInstance::GetHeight() { return GetImpl()->GetHeight(); }
@@ -23,8 +23,8 @@
 
 
 MM::PortType SerialInstance::GetPortType() const { return GetImpl()->GetPortType(); }
-int SerialInstance::SetCommand(const char* command, const char* term) { return GetImpl()->SetCommand(command, term); }
-int SerialInstance::GetAnswer(char* txt, unsigned maxChars, const char* term) { return GetImpl()->GetAnswer(txt, maxChars, term); }
-int SerialInstance::Write(const unsigned char* buf, unsigned long bufLen) { return GetImpl()->Write(buf, bufLen); }
-int SerialInstance::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead) { return GetImpl()->Read(buf, bufLen, charsRead); }
+int SerialInstance::SetCommand(const char* command, const char* term) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetCommand"); return GetImpl()->SetCommand(command, term); }
+int SerialInstance::GetAnswer(char* txt, unsigned maxChars, const char* term) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetAnswer"); return GetImpl()->GetAnswer(txt, maxChars, term); }
+int SerialInstance::Write(const unsigned char* buf, unsigned long bufLen) { mm::DeviceCallStats::Timer t(GetCallStats(), "Write"); return GetImpl()->Write(buf, bufLen); }
+int SerialInstance::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead) { mm::DeviceCallStats::Timer t(GetCallStats(), "Read"); return GetImpl()->Read(buf, bufLen, charsRead); }
 int SerialInstance::Purge() { return GetImpl()->Purge(); }
@@ -22,6 +22,6 @@
 #include "ShutterInstance.h"
 
 
-int ShutterInstance::SetOpen(bool open) { return GetImpl()->SetOpen(open); }
-int ShutterInstance::GetOpen(bool& open) { return GetImpl()->GetOpen(open); }
+int ShutterInstance::SetOpen(bool open) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetOpen"); return GetImpl()->SetOpen(open); }
+int ShutterInstance::GetOpen(bool& open) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetOpen"); return GetImpl()->GetOpen(open); }
 int ShutterInstance::Fire(double deltaT) { return GetImpl()->Fire(deltaT); }
@@ -22,10 +22,10 @@
 #include "SignalIOInstance.h"
 
 
-int SignalIOInstance::SetGateOpen(bool open) { return GetImpl()->SetGateOpen(open); }
+int SignalIOInstance::SetGateOpen(bool open) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetGateOpen"); return GetImpl()->SetGateOpen(open); }
 int SignalIOInstance::GetGateOpen(bool& open) { return GetImpl()->GetGateOpen(open); }
-int SignalIOInstance::SetSignal(double volts) { return GetImpl()->SetSignal(volts); }
-int SignalIOInstance::GetSignal(double& volts) { return GetImpl()->GetSignal(volts); }
+int SignalIOInstance::SetSignal(double volts) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetSignal"); return GetImpl()->SetSignal(volts); }
+int SignalIOInstance::GetSignal(double& volts) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetSignal"); return GetImpl()->GetSignal(volts); }
 int SignalIOInstance::GetLimits(double& minVolts, double& maxVolts) { return GetImpl()->GetLimits(minVolts, maxVolts); }
 int SignalIOInstance::IsDASequenceable(bool& isSequenceable) const { return GetImpl()->IsDASequenceable(isSequenceable); }
 int SignalIOInstance::GetDASequenceMaxLength(long& nrEvents) const { return GetImpl()->GetDASequenceMaxLength(nrEvents); }
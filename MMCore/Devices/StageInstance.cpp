@@ -22,15 +22,15 @@
 #include "StageInstance.h"
 
 
-int StageInstance::SetPositionUm(double pos) { return GetImpl()->SetPositionUm(pos); }
-int StageInstance::SetRelativePositionUm(double d) { return GetImpl()->SetRelativePositionUm(d); }
-int StageInstance::Move(double velocity) { return GetImpl()->Move(velocity); }
-int StageInstance::Stop() { return GetImpl()->Stop(); }
-int StageInstance::Home() { return GetImpl()->Home(); }
+int StageInstance::SetPositionUm(double pos) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPositionUm"); return GetImpl()->SetPositionUm(pos); }
+int StageInstance::SetRelativePositionUm(double d) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetRelativePositionUm"); return GetImpl()->SetRelativePositionUm(d); }
+int StageInstance::Move(double velocity) { mm::DeviceCallStats::Timer t(GetCallStats(), "Move"); return GetImpl()->Move(velocity); }
+int StageInstance::Stop() { mm::DeviceCallStats::Timer t(GetCallStats(), "Stop"); return GetImpl()->Stop(); }
+int StageInstance::Home() { mm::DeviceCallStats::Timer t(GetCallStats(), "Home"); return GetImpl()->Home(); }
 int StageInstance::SetAdapterOriginUm(double d) { return GetImpl()->SetAdapterOriginUm(d); }
-int StageInstance::GetPositionUm(double& pos) { return GetImpl()->GetPositionUm(pos); }
-int StageInstance::SetPositionSteps(long steps) { return GetImpl()->SetPositionSteps(steps); }
-int StageInstance::GetPositionSteps(long& steps) { return GetImpl()->GetPositionSteps(steps); }
+int StageInstance::GetPositionUm(double& pos) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPositionUm"); return GetImpl()->GetPositionUm(pos); }
+int StageInstance::SetPositionSteps(long steps) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPositionSteps"); return GetImpl()->SetPositionSteps(steps); }
+int StageInstance::GetPositionSteps(long& steps) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPositionSteps"); return GetImpl()->GetPositionSteps(steps); }
 int StageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
 int StageInstance::GetLimits(double& lower, double& upper) { return GetImpl()->GetLimits(lower, upper); }
 
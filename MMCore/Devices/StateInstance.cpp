@@ -22,9 +22,9 @@
 #include "StateInstance.h"
 
 
-int StateInstance::SetPosition(long pos) { return GetImpl()->SetPosition(pos); }
-int StateInstance::SetPosition(const char* label) { return GetImpl()->SetPosition(label); }
-int StateInstance::GetPosition(long& pos) const { return GetImpl()->GetPosition(pos); }
+int StateInstance::SetPosition(long pos) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPosition"); return GetImpl()->SetPosition(pos); }
+int StateInstance::SetPosition(const char* label) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPosition"); return GetImpl()->SetPosition(label); }
+int StateInstance::GetPosition(long& pos) const { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPosition"); return GetImpl()->GetPosition(pos); }
 
 std::string StateInstance::GetPositionLabel() const
 {
@@ -45,5 +45,5 @@ std::string StateInstance::GetPositionLabel(long pos) const
 int StateInstance::GetLabelPosition(const char* label, long& pos) const { return GetImpl()->GetLabelPosition(label, pos); }
 int StateInstance::SetPositionLabel(long pos, const char* label) { return GetImpl()->SetPositionLabel(pos, label); }
 unsigned long StateInstance::GetNumberOfPositions() const { return GetImpl()->GetNumberOfPositions(); }
-int StateInstance::SetGateOpen(bool open) { return GetImpl()->SetGateOpen(open); }
+int StateInstance::SetGateOpen(bool open) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetGateOpen"); return GetImpl()->SetGateOpen(open); }
 int StateInstance::GetGateOpen(bool& open) { return GetImpl()->GetGateOpen(open); }
@@ -22,17 +22,17 @@
 #include "XYStageInstance.h"
 
 
-int XYStageInstance::SetPositionUm(double x, double y) { return GetImpl()->SetPositionUm(x, y); }
-int XYStageInstance::SetRelativePositionUm(double dx, double dy) { return GetImpl()->SetRelativePositionUm(dx, dy); }
+int XYStageInstance::SetPositionUm(double x, double y) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPositionUm"); return GetImpl()->SetPositionUm(x, y); }
+int XYStageInstance::SetRelativePositionUm(double dx, double dy) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetRelativePositionUm"); return GetImpl()->SetRelativePositionUm(dx, dy); }
 int XYStageInstance::SetAdapterOriginUm(double x, double y) { return GetImpl()->SetAdapterOriginUm(x, y); }
-int XYStageInstance::GetPositionUm(double& x, double& y) { return GetImpl()->GetPositionUm(x, y); }
+int XYStageInstance::GetPositionUm(double& x, double& y) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPositionUm"); return GetImpl()->GetPositionUm(x, y); }
 int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { return GetImpl()->GetLimitsUm(xMin, xMax, yMin, yMax); }
-int XYStageInstance::Move(double vx, double vy) { return GetImpl()->Move(vx, vy); }
-int XYStageInstance::SetPositionSteps(long x, long y) { return GetImpl()->SetPositionSteps(x, y); }
-int XYStageInstance::GetPositionSteps(long& x, long& y) { return GetImpl()->GetPositionSteps(x, y); }
-int XYStageInstance::SetRelativePositionSteps(long x, long y) { return GetImpl()->SetRelativePositionSteps(x, y); }
-int XYStageInstance::Home() { return GetImpl()->Home(); }
-int XYStageInstance::Stop() { return GetImpl()->Stop(); }
+int XYStageInstance::Move(double vx, double vy) { mm::DeviceCallStats::Timer t(GetCallStats(), "Move"); return GetImpl()->Move(vx, vy); }
+int XYStageInstance::SetPositionSteps(long x, long y) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetPositionSteps"); return GetImpl()->SetPositionSteps(x, y); }
+int XYStageInstance::GetPositionSteps(long& x, long& y) { mm::DeviceCallStats::Timer t(GetCallStats(), "GetPositionSteps"); return GetImpl()->GetPositionSteps(x, y); }
+int XYStageInstance::SetRelativePositionSteps(long x, long y) { mm::DeviceCallStats::Timer t(GetCallStats(), "SetRelativePositionSteps"); return GetImpl()->SetRelativePositionSteps(x, y); }
+int XYStageInstance::Home() { mm::DeviceCallStats::Timer t(GetCallStats(), "Home"); return GetImpl()->Home(); }
+int XYStageInstance::Stop() { mm::DeviceCallStats::Timer t(GetCallStats(), "Stop"); return GetImpl()->Stop(); }
 int XYStageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
 int XYStageInstance::SetXOrigin() { return GetImpl()->SetXOrigin(); }
 int XYStageInstance::SetYOrigin() { return GetImpl()->SetYOrigin(); }
@@ -0,0 +1,575 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DiskStreamWriter.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   High-throughput raw frame writer fed from the circular buffer
+//                insert path.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DiskStreamWriter.h"
+
+#include "ErrorCodes.h"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#include <direct.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const unsigned long long bytesInMB = 1 << 20;
+
+// Size of each write. Large writes keep the number of system calls low and let
+// the block layer split them into many concurrent requests.
+const size_t chunkSizeMB = 16;
+// Number of chunks, i.e. how much data can be buffered while the disk is busy
+const size_t chunkCount = 8;
+// Number of concurrent writes
+const size_t ioThreadCount = 2;
+
+size_t PageSize()
+{
+#ifdef _WINDOWS
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwPageSize;
+#else
+   long size = sysconf(_SC_PAGESIZE);
+   return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+}
+
+unsigned char* AllocateAligned(size_t bytes, size_t alignment)
+{
+#ifdef _WINDOWS
+   return static_cast<unsigned char*>(_aligned_malloc(bytes, alignment));
+#else
+   void* p = 0;
+   if (posix_memalign(&p, alignment, bytes) != 0)
+      return 0;
+   return static_cast<unsigned char*>(p);
+#endif
+}
+
+void FreeAligned(unsigned char* p)
+{
+#ifdef _WINDOWS
+   _aligned_free(p);
+#else
+   free(p);
+#endif
+}
+
+std::string LastErrorString()
+{
+#ifdef _WINDOWS
+   std::ostringstream oss;
+   oss << "system error " << GetLastError();
+   return oss.str();
+#else
+   return std::strerror(errno);
+#endif
+}
+
+void MakeDirectory(const std::string& path)
+{
+#ifdef _WINDOWS
+   _mkdir(path.c_str());
+#else
+   mkdir(path.c_str(), 0777);
+#endif
+}
+
+std::string FileName(const std::string& directory, const std::string& prefix,
+      unsigned index, const char* suffix)
+{
+   char num[16];
+   snprintf(num, sizeof(num), "%04u", index);
+   return directory + "/" + prefix + "_" + num + suffix;
+}
+
+std::string JSONEscape(const std::string& s)
+{
+   std::string out;
+   out.reserve(s.size() + 16);
+   for (std::string::const_iterator it = s.begin(), end = s.end(); it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '"': out += "\\\""; break;
+         case '\\': out += "\\\\"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         case '\t': out += "\\t"; break;
+         default:
+            if (static_cast<unsigned char>(*it) < 0x20)
+            {
+               char buf[8];
+               snprintf(buf, sizeof(buf), "\\u%04x", *it);
+               out += buf;
+            }
+            else
+               out += *it;
+      }
+   }
+   return out;
+}
+
+} // anonymous namespace
+
+
+namespace mm {
+
+// One raw file opened for unbuffered writing, plus its index. The file is
+// truncated to its logical size (removing the padding of the last write) when
+// the last reference is released.
+class DiskStreamFile
+{
+public:
+   DiskStreamFile(const std::string& rawPath, const std::string& indexPath)
+      throw (CMMError) :
+      logicalBytes_(0),
+#ifdef _WINDOWS
+      handle_(INVALID_HANDLE_VALUE)
+#else
+      fd_(-1)
+#endif
+   {
+#ifdef _WINDOWS
+      handle_ = CreateFileA(rawPath.c_str(), GENERIC_WRITE, 0, NULL,
+            CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING, NULL);
+      if (handle_ == INVALID_HANDLE_VALUE)
+         throw CMMError("Cannot create stream file " + rawPath + " (" +
+               LastErrorString() + ")", MMERR_FileOpenFailed);
+#else
+      const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+      fd_ = open(rawPath.c_str(), flags | O_DIRECT, 0644);
+      // Some file systems (e.g. tmpfs) do not support direct I/O
+      if (fd_ < 0 && errno == EINVAL)
+#endif
+         fd_ = open(rawPath.c_str(), flags, 0644);
+      if (fd_ < 0)
+         throw CMMError("Cannot create stream file " + rawPath + " (" +
+               LastErrorString() + ")", MMERR_FileOpenFailed);
+#ifdef __APPLE__
+      fcntl(fd_, F_NOCACHE, 1);
+#endif
+#endif
+
+      index_.rdbuf()->pubsetbuf(indexBuffer_, sizeof(indexBuffer_));
+      index_.open(indexPath.c_str(), std::ios::out | std::ios::trunc);
+      if (!index_)
+      {
+         Close();
+         throw CMMError("Cannot create stream index file " + indexPath,
+               MMERR_FileOpenFailed);
+      }
+   }
+
+   ~DiskStreamFile()
+   {
+      Close();
+   }
+
+   // Writes must start and end on page boundaries
+   bool WriteAt(const unsigned char* data, size_t bytes,
+         unsigned long long offset, std::string& errorMessage)
+   {
+#ifdef _WINDOWS
+      OVERLAPPED ov;
+      memset(&ov, 0, sizeof(ov));
+      ov.Offset = static_cast<DWORD>(offset & 0xffffffffULL);
+      ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD written = 0;
+      if (!WriteFile(handle_, data, static_cast<DWORD>(bytes), &written, &ov) ||
+            written != bytes)
+      {
+         errorMessage = LastErrorString();
+         return false;
+      }
+#else
+      while (bytes > 0)
+      {
+         ssize_t n = pwrite(fd_, data, bytes, static_cast<off_t>(offset));
+         if (n < 0)
+         {
+            if (errno == EINTR)
+               continue;
+            errorMessage = LastErrorString();
+            return false;
+         }
+         data += n;
+         bytes -= static_cast<size_t>(n);
+         offset += static_cast<unsigned long long>(n);
+      }
+#endif
+      return true;
+   }
+
+   std::ofstream& Index() { return index_; }
+   void SetLogicalSize(unsigned long long bytes) { logicalBytes_ = bytes; }
+
+private:
+   DiskStreamFile(const DiskStreamFile&);
+   DiskStreamFile& operator=(const DiskStreamFile&);
+
+   void Close()
+   {
+      if (index_.is_open())
+         index_.close();
+#ifdef _WINDOWS
+      if (handle_ != INVALID_HANDLE_VALUE)
+      {
+         LARGE_INTEGER size;
+         size.QuadPart = static_cast<LONGLONG>(logicalBytes_);
+         if (SetFilePointerEx(handle_, size, NULL, FILE_BEGIN))
+            SetEndOfFile(handle_);
+         CloseHandle(handle_);
+         handle_ = INVALID_HANDLE_VALUE;
+      }
+#else
+      if (fd_ >= 0)
+      {
+         if (ftruncate(fd_, static_cast<off_t>(logicalBytes_)) != 0)
+         {
+            // Leave the padding in place; the index has the frame offsets
+         }
+         close(fd_);
+         fd_ = -1;
+      }
+#endif
+   }
+
+   unsigned long long logicalBytes_;
+   std::ofstream index_;
+   char indexBuffer_[1 << 16];
+#ifdef _WINDOWS
+   HANDLE handle_;
+#else
+   int fd_;
+#endif
+};
+
+
+DiskStreamWriter::DiskStreamWriter(const std::string& directory,
+      const std::string& prefix, unsigned maxFileSizeMB) throw (CMMError) :
+   directory_(directory),
+   prefix_(prefix.empty() ? std::string("stream") : prefix),
+   maxFileBytes_(maxFileSizeMB * bytesInMB),
+   chunkBytes_(chunkSizeMB * static_cast<size_t>(bytesInMB)),
+   pageBytes_(PageSize()),
+   current_(0),
+   fileIndex_(0),
+   fileBytes_(0),
+   fileFrames_(0),
+   stopping_(false),
+   active_(false),
+   imageCount_(0),
+   droppedCount_(0),
+   bytesWritten_(0)
+{
+   if (directory_.empty())
+      throw CMMError("Stream directory is empty", MMERR_FileOpenFailed);
+   if (maxFileSizeMB == 0)
+      throw CMMError("Maximum stream file size must be greater than zero");
+
+   MakeDirectory(directory_);
+   OpenNextFile();
+
+   chunks_.resize(chunkCount);
+   for (size_t i = 0; i < chunks_.size(); ++i)
+   {
+      chunks_[i].data = AllocateAligned(chunkBytes_, pageBytes_);
+      chunks_[i].used = 0;
+      chunks_[i].offset = 0;
+      if (!chunks_[i].data)
+      {
+         for (size_t j = 0; j < i; ++j)
+            FreeAligned(chunks_[j].data);
+         chunks_.clear();
+         throw CMMError("Cannot allocate stream write buffers", MMERR_OutOfMemory);
+      }
+      free_.push_back(&chunks_[i]);
+   }
+
+   for (size_t i = 0; i < ioThreadCount; ++i)
+      threads_.push_back(boost::make_shared<boost::thread>(
+               &DiskStreamWriter::IOThreadFunc, this));
+
+   startTime_ = boost::posix_time::microsec_clock::universal_time();
+   lastWriteTime_ = startTime_;
+   active_ = true;
+}
+
+DiskStreamWriter::~DiskStreamWriter()
+{
+   Stop();
+}
+
+void DiskStreamWriter::OpenNextFile() throw (CMMError)
+{
+   if (file_)
+   {
+      file_->SetLogicalSize(fileBytes_);
+      file_.reset(); // Closed when the last chunk referencing it is written
+      ++fileIndex_;
+   }
+   file_ = boost::make_shared<DiskStreamFile>(
+         FileName(directory_, prefix_, fileIndex_, ".raw"),
+         FileName(directory_, prefix_, fileIndex_, ".index.jsonl"));
+   fileBytes_ = 0;
+   fileFrames_ = 0;
+}
+
+bool DiskStreamWriter::Append(const unsigned char* pixels, size_t bytes,
+      unsigned width, unsigned height, unsigned byteDepth, unsigned channel,
+      const Metadata& md)
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (!active_)
+         return false;
+   }
+
+   if (fileBytes_ > 0 && fileBytes_ + bytes > maxFileBytes_)
+   {
+      if (current_)
+         DispatchCurrentChunk();
+      try
+      {
+         OpenNextFile();
+      }
+      catch (const CMMError& e)
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         lastError_ = e.getMsg();
+         active_ = false;
+         ++droppedCount_;
+         return false;
+      }
+   }
+
+   // Make sure the whole frame can be buffered before copying anything
+   const size_t available = current_ ? chunkBytes_ - current_->used : 0;
+   const size_t chunksNeeded = bytes > available ?
+      (bytes - available + chunkBytes_ - 1) / chunkBytes_ : 0;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (free_.size() < chunksNeeded)
+      {
+         ++droppedCount_;
+         return false;
+      }
+   }
+
+   const unsigned long long frameOffset = fileBytes_;
+   size_t remaining = bytes;
+   while (remaining > 0)
+   {
+      if (!current_)
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         current_ = free_.back();
+         free_.pop_back();
+         current_->used = 0;
+         current_->offset = fileBytes_;
+         current_->file = file_;
+      }
+      const size_t n = std::min(remaining, chunkBytes_ - current_->used);
+      memcpy(current_->data + current_->used, pixels, n);
+      current_->used += n;
+      pixels += n;
+      remaining -= n;
+      fileBytes_ += n;
+      if (current_->used == chunkBytes_)
+         DispatchCurrentChunk();
+   }
+
+   file_->Index() << "{\"frame\":" << fileFrames_ <<
+      ",\"offset\":" << frameOffset <<
+      ",\"bytes\":" << bytes <<
+      ",\"width\":" << width <<
+      ",\"height\":" << height <<
+      ",\"byteDepth\":" << byteDepth <<
+      ",\"channel\":" << channel <<
+      ",\"metadata\":\"" << JSONEscape(md.Serialize()) << "\"}\n";
+   ++fileFrames_;
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   ++imageCount_;
+   return true;
+}
+
+void DiskStreamWriter::DispatchCurrentChunk()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      pending_.push_back(current_);
+   }
+   current_ = 0;
+   cond_.notify_one();
+}
+
+void DiskStreamWriter::IOThreadFunc()
+{
+   for (;;)
+   {
+      Chunk* chunk = 0;
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (pending_.empty() && !stopping_)
+            cond_.wait(lock);
+         if (pending_.empty())
+            break;
+         chunk = pending_.front();
+         pending_.pop_front();
+      }
+
+      // Unbuffered writes must be a multiple of the page size; the padding is
+      // truncated away when the file is closed.
+      const size_t writeBytes =
+         ((chunk->used + pageBytes_ - 1) / pageBytes_) * pageBytes_;
+      if (writeBytes > chunk->used)
+         memset(chunk->data + chunk->used, 0, writeBytes - chunk->used);
+
+      std::string error;
+      bool ok = chunk->file->WriteAt(chunk->data, writeBytes, chunk->offset,
+            error);
+      const size_t written = chunk->used;
+      chunk->file.reset();
+
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         if (ok)
+         {
+            bytesWritten_ += written;
+            lastWriteTime_ = boost::posix_time::microsec_clock::universal_time();
+         }
+         else if (active_)
+         {
+            lastError_ = "Write to stream file failed (" + error + ")";
+            active_ = false;
+         }
+         chunk->used = 0;
+         free_.push_back(chunk);
+      }
+   }
+}
+
+bool DiskStreamWriter::Stop()
+{
+   if (threads_.empty())
+      return false;
+
+   if (current_ && current_->used > 0)
+      DispatchCurrentChunk();
+   if (file_)
+   {
+      file_->SetLogicalSize(fileBytes_);
+      file_.reset();
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stopping_ = true;
+   }
+   cond_.notify_all();
+   for (size_t i = 0; i < threads_.size(); ++i)
+      threads_[i]->join();
+   threads_.clear();
+
+   for (size_t i = 0; i < chunks_.size(); ++i)
+      FreeAligned(chunks_[i].data);
+   chunks_.clear();
+   free_.clear();
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      active_ = false;
+   }
+   WriteSummary();
+   return true;
+}
+
+void DiskStreamWriter::WriteSummary()
+{
+   std::ofstream summary((directory_ + "/" + prefix_ + "_summary.json").c_str());
+   summary << "{\"files\":" << (fileIndex_ + 1) <<
+      ",\"images\":" << GetImageCount() <<
+      ",\"droppedImages\":" << GetDroppedImageCount() <<
+      ",\"bytes\":" << GetBytesWritten() <<
+      ",\"MBPerSec\":" << GetMBPerSec() <<
+      ",\"error\":\"" << JSONEscape(GetLastError()) << "\"}\n";
+}
+
+bool DiskStreamWriter::IsActive() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return active_;
+}
+
+unsigned long long DiskStreamWriter::GetImageCount() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return imageCount_;
+}
+
+unsigned long long DiskStreamWriter::GetDroppedImageCount() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return droppedCount_;
+}
+
+unsigned long long DiskStreamWriter::GetBytesWritten() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return bytesWritten_;
+}
+
+// Average rate from start to the completion of the most recent write
+double DiskStreamWriter::GetMBPerSec() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   const double seconds =
+      (lastWriteTime_ - startTime_).total_microseconds() / 1e6;
+   if (seconds <= 0.0)
+      return 0.0;
+   return (double)bytesWritten_ / bytesInMB / seconds;
+}
+
+std::string DiskStreamWriter::GetLastError() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return lastError_;
+}
+
+} // namespace mm
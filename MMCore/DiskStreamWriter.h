@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DiskStreamWriter.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   High-throughput raw frame writer fed from the circular buffer
+//                insert path.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+class DiskStreamFile;
+
+// Writes every frame it is given, back to back, into a series of raw files
+// (<prefix>_NNNN.raw), each accompanied by a JSON-lines index
+// (<prefix>_NNNN.index.jsonl) that gives the byte offset, geometry and
+// serialized metadata of each frame. A new file is started whenever the next
+// frame would exceed the maximum file size.
+//
+// Frames are copied into large page-aligned chunks, and full chunks are
+// written by a small pool of I/O threads using unbuffered (O_DIRECT /
+// FILE_FLAG_NO_BUFFERING) positional writes, so that several writes can be in
+// flight at once and the page cache is bypassed. Append() never waits for the
+// disk: if all chunks are in flight, the frame is dropped and counted.
+class DiskStreamWriter
+{
+public:
+   // Creates the directory if needed and starts the I/O threads. Throws
+   // CMMError if the first file cannot be created.
+   DiskStreamWriter(const std::string& directory, const std::string& prefix,
+         unsigned maxFileSizeMB) throw (CMMError);
+   ~DiskStreamWriter();
+
+   // Returns false if the frame was dropped. Not thread-safe with respect to
+   // other calls to Append(); the circular buffer serializes inserts.
+   bool Append(const unsigned char* pixels, size_t bytes, unsigned width,
+         unsigned height, unsigned byteDepth, unsigned channel,
+         const Metadata& md);
+
+   // Writes all pending data, closes the files and writes the summary.
+   // Returns false if already stopped.
+   bool Stop();
+
+   bool IsActive() const;
+   unsigned long long GetImageCount() const;
+   unsigned long long GetDroppedImageCount() const;
+   unsigned long long GetBytesWritten() const;
+   double GetMBPerSec() const;
+   std::string GetLastError() const;
+
+private:
+   DiskStreamWriter(const DiskStreamWriter&);
+   DiskStreamWriter& operator=(const DiskStreamWriter&);
+
+   struct Chunk
+   {
+      unsigned char* data;
+      size_t used;
+      unsigned long long offset;
+      boost::shared_ptr<DiskStreamFile> file;
+   };
+
+   void OpenNextFile() throw (CMMError);
+   void DispatchCurrentChunk();
+   void IOThreadFunc();
+   void WriteSummary();
+
+   std::string directory_;
+   std::string prefix_;
+   unsigned long long maxFileBytes_;
+   size_t chunkBytes_;
+   size_t pageBytes_;
+
+   std::vector<Chunk> chunks_;
+   Chunk* current_; // Only accessed by the appending thread
+
+   boost::shared_ptr<DiskStreamFile> file_;
+   unsigned fileIndex_;
+   unsigned long long fileBytes_;
+   unsigned long long fileFrames_;
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable cond_; // Signaled when pending_/free_ change
+   std::deque<Chunk*> pending_;
+   std::vector<Chunk*> free_;
+   std::vector< boost::shared_ptr<boost::thread> > threads_;
+   bool stopping_;
+   bool active_;
+   std::string lastError_;
+
+   unsigned long long imageCount_;
+   unsigned long long droppedCount_;
+   unsigned long long bytesWritten_;
+   boost::posix_time::ptime startTime_;
+   boost::posix_time::ptime lastWriteTime_;
+};
+
+} // namespace mm
@@ -78,4 +78,9 @@
 #define MMERR_CreatePeripheralFailed   50
 #define MMERR_PropertyNotInCache       51
 #define MMERR_BadAffineTransform       52
+#define MMERR_UnknownOperation         53
+#define MMERR_InvalidSequencePlan      54
+#define MMERR_InvalidImageHandle       55
+#define MMERR_ImageNotMultiROIPacked   56
+#define MMERR_InvalidMultiROIIndex     57
 #endif //_ERRORCODES_H_
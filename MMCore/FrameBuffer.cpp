@@ -20,6 +20,7 @@
 
 #include <cmath>
 #include <cstring>
+#include <utility>
 
 namespace mm {
 
@@ -127,6 +128,14 @@ void FrameBuffer::Preallocate(unsigned channels)
    }
 }
 
+void FrameBuffer::Swap(FrameBuffer& other)
+{
+   channels_.swap(other.channels_);
+   std::swap(width_, other.width_);
+   std::swap(height_, other.height_);
+   std::swap(depth_, other.depth_);
+}
+
 void FrameBuffer::Resize(unsigned xSize, unsigned ySize, unsigned byteDepth)
 {
    Clear();
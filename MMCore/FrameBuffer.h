@@ -71,6 +71,8 @@ public:
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Clear();
    void Preallocate(unsigned channels);
+   // Exchange images and dimensions; the images keep their addresses
+   void Swap(FrameBuffer& other);
 
    ImgBuffer* FindImage(unsigned channel) const;
    const unsigned char* GetPixels(unsigned channel) const;
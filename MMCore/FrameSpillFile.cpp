@@ -0,0 +1,258 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameSpillFile.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory-mapped overflow storage for the circular buffer.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameSpillFile.h"
+
+#include "ErrorCodes.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <sstream>
+
+
+namespace {
+
+const size_t bytesInMB = 1 << 20;
+
+size_t PageSize()
+{
+#ifdef _WINDOWS
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwPageSize;
+#else
+   long size = sysconf(_SC_PAGESIZE);
+   return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+}
+
+std::string LastErrorString()
+{
+#ifdef _WINDOWS
+   std::ostringstream oss;
+   oss << "system error " << GetLastError();
+   return oss.str();
+#else
+   return std::strerror(errno);
+#endif
+}
+
+} // anonymous namespace
+
+
+namespace mm {
+
+FrameSpillFile::FrameSpillFile(const std::string& path, unsigned sizeMB)
+   throw (CMMError) :
+   path_(path),
+   sizeMB_(sizeMB),
+   fileBytes_(static_cast<size_t>(sizeMB) * bytesInMB),
+   slotBytes_(0),
+   slotCount_(0),
+   mapping_(0),
+#ifdef _WINDOWS
+   fileHandle_(INVALID_HANDLE_VALUE),
+   mappingHandle_(0)
+#else
+   fd_(-1)
+#endif
+{
+   if (path.empty())
+      throw CMMError("Spill file path is empty", MMERR_FileOpenFailed);
+   if (sizeMB == 0)
+      throw CMMError("Spill file size must be greater than zero");
+
+#ifdef _WINDOWS
+   HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+         0, NULL, CREATE_ALWAYS,
+         FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+      throw CMMError("Cannot create spill file " + path + " (" +
+            LastErrorString() + ")", MMERR_FileOpenFailed);
+   fileHandle_ = file;
+
+   LARGE_INTEGER size;
+   size.QuadPart = static_cast<LONGLONG>(fileBytes_);
+   if (!SetFilePointerEx(file, size, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+   {
+      std::string err = LastErrorString();
+      CloseHandle(file);
+      throw CMMError("Cannot preallocate spill file " + path + " (" +
+            err + ")", MMERR_OutOfMemory);
+   }
+
+   HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+         size.HighPart, size.LowPart, NULL);
+   if (mapping == NULL)
+   {
+      std::string err = LastErrorString();
+      CloseHandle(file);
+      throw CMMError("Cannot map spill file " + path + " (" + err + ")",
+            MMERR_OutOfMemory);
+   }
+   mappingHandle_ = mapping;
+
+   mapping_ = static_cast<unsigned char*>(MapViewOfFile(mapping,
+            FILE_MAP_ALL_ACCESS, 0, 0, fileBytes_));
+   if (mapping_ == 0)
+   {
+      std::string err = LastErrorString();
+      CloseHandle(mapping);
+      CloseHandle(file);
+      throw CMMError("Cannot map spill file " + path + " (" + err + ")",
+            MMERR_OutOfMemory);
+   }
+#else
+   int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+   if (fd < 0)
+      throw CMMError("Cannot create spill file " + path + " (" +
+            LastErrorString() + ")", MMERR_FileOpenFailed);
+
+   // Reserve the disk blocks up front so that spilling never fails (or
+   // stalls on block allocation) in the middle of an acquisition.
+   int err = 0;
+#ifdef __APPLE__
+   if (ftruncate(fd, static_cast<off_t>(fileBytes_)) != 0)
+      err = errno;
+#else
+   err = posix_fallocate(fd, 0, static_cast<off_t>(fileBytes_));
+#endif
+   if (err != 0)
+   {
+      close(fd);
+      unlink(path.c_str());
+      throw CMMError("Cannot preallocate spill file " + path + " (" +
+            std::strerror(err) + ")", MMERR_OutOfMemory);
+   }
+
+   void* addr = mmap(0, fileBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (addr == MAP_FAILED)
+   {
+      std::string msg = LastErrorString();
+      close(fd);
+      unlink(path.c_str());
+      throw CMMError("Cannot map spill file " + path + " (" + msg + ")",
+            MMERR_OutOfMemory);
+   }
+   mapping_ = static_cast<unsigned char*>(addr);
+   fd_ = fd;
+#endif
+}
+
+FrameSpillFile::~FrameSpillFile()
+{
+   Unmap();
+}
+
+void FrameSpillFile::Unmap()
+{
+#ifdef _WINDOWS
+   if (mapping_)
+      UnmapViewOfFile(mapping_);
+   if (mappingHandle_)
+      CloseHandle(mappingHandle_);
+   // The file was opened with FILE_FLAG_DELETE_ON_CLOSE
+   if (fileHandle_ != INVALID_HANDLE_VALUE)
+      CloseHandle(fileHandle_);
+   mappingHandle_ = 0;
+   fileHandle_ = INVALID_HANDLE_VALUE;
+#else
+   if (mapping_)
+      munmap(mapping_, fileBytes_);
+   if (fd_ >= 0)
+   {
+      close(fd_);
+      unlink(path_.c_str());
+   }
+   fd_ = -1;
+#endif
+   mapping_ = 0;
+}
+
+unsigned long FrameSpillFile::SetSlotSize(size_t bytes)
+{
+   // Round up to whole pages so that write-back and release of one slot
+   // never touch the pages of its neighbors.
+   const size_t page = PageSize();
+   slotBytes_ = ((bytes + page - 1) / page) * page;
+   slotCount_ = slotBytes_ > 0 ?
+      static_cast<unsigned long>(fileBytes_ / slotBytes_) : 0;
+   return slotCount_;
+}
+
+unsigned char* FrameSpillFile::GetSlot(unsigned long index)
+{
+   return mapping_ + static_cast<size_t>(index) * slotBytes_;
+}
+
+const unsigned char* FrameSpillFile::GetSlot(unsigned long index) const
+{
+   return mapping_ + static_cast<size_t>(index) * slotBytes_;
+}
+
+void FrameSpillFile::BeginWriteBack(unsigned long index)
+{
+#ifdef _WINDOWS
+   // FlushViewOfFile() initiates the writes but does not wait for them to
+   // reach the disk.
+   FlushViewOfFile(GetSlot(index), slotBytes_);
+#elif defined(__linux__)
+   sync_file_range(fd_, static_cast<off_t>(index) * slotBytes_,
+         slotBytes_, SYNC_FILE_RANGE_WRITE);
+#else
+   msync(GetSlot(index), slotBytes_, MS_ASYNC);
+#endif
+}
+
+void FrameSpillFile::Prefetch(unsigned long index) const
+{
+#ifndef _WINDOWS
+   posix_madvise(const_cast<unsigned char*>(GetSlot(index)), slotBytes_,
+         POSIX_MADV_WILLNEED);
+#else
+   (void)index;
+#endif
+}
+
+void FrameSpillFile::Release(unsigned long index) const
+{
+#ifndef _WINDOWS
+   // Unmap the pages from our address space first; otherwise the page cache
+   // cannot drop them.
+   madvise(const_cast<unsigned char*>(GetSlot(index)), slotBytes_,
+         MADV_DONTNEED);
+#ifdef __linux__
+   posix_fadvise(fd_, static_cast<off_t>(index) * slotBytes_, slotBytes_,
+         POSIX_FADV_DONTNEED);
+#endif
+#else
+   (void)index;
+#endif
+}
+
+} // namespace mm
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameSpillFile.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory-mapped overflow storage for the circular buffer.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <cstddef>
+#include <string>
+
+namespace mm {
+
+// A preallocated, memory-mapped file divided into fixed-size frame slots that
+// are used as a FIFO. It serves as the second (disk) tier of CircularBuffer:
+// frames that do not fit in RAM are written here and read back in order.
+//
+// Writes go into the shared mapping and write-back to disk is started
+// immediately (without waiting for completion), so the kernel performs the
+// disk I/O asynchronously to the inserting thread. Once a slot has been read
+// back, its pages are released from the page cache so that spilling does not
+// in turn consume the RAM it is meant to save.
+//
+// This class does no locking; CircularBuffer serializes access to it.
+class FrameSpillFile
+{
+public:
+   // Creates (or truncates) the file at path and preallocates sizeMB of disk
+   // space. Throws CMMError if the file cannot be created or mapped.
+   FrameSpillFile(const std::string& path, unsigned sizeMB) throw (CMMError);
+   ~FrameSpillFile();
+
+   const std::string& GetPath() const { return path_; }
+   unsigned GetSizeMB() const { return sizeMB_; }
+
+   // Sets the slot size and discards any stored frames. Returns the number of
+   // slots that fit in the file (may be zero).
+   unsigned long SetSlotSize(size_t bytes);
+   size_t GetSlotSize() const { return slotBytes_; }
+   unsigned long GetSlotCount() const { return slotCount_; }
+
+   // Address of slot index (0 <= index < GetSlotCount()) in the mapping.
+   unsigned char* GetSlot(unsigned long index);
+   const unsigned char* GetSlot(unsigned long index) const;
+
+   // Start asynchronous write-back of a slot that has been filled.
+   void BeginWriteBack(unsigned long index);
+   // Hint that a slot will be read soon.
+   void Prefetch(unsigned long index) const;
+   // Drop the cached pages of a slot whose contents are no longer needed.
+   void Release(unsigned long index) const;
+
+private:
+   FrameSpillFile(const FrameSpillFile&);
+   FrameSpillFile& operator=(const FrameSpillFile&);
+
+   void Unmap();
+
+   std::string path_;
+   unsigned sizeMB_;
+   size_t fileBytes_;
+   size_t slotBytes_;
+   unsigned long slotCount_;
+   unsigned char* mapping_;
+
+#ifdef _WINDOWS
+   void* fileHandle_;
+   void* mappingHandle_;
+#else
+   int fd_;
+#endif
+};
+
+} // namespace mm
@@ -0,0 +1,292 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameTrace.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Optional per-frame tracing of the image pipeline, from the
+//                camera's insert to the consumer's pop, with aggregate
+//                statistics and export in Chrome trace format.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameTrace.h"
+
+#include <cstdio>
+#include <sstream>
+
+namespace mm {
+
+namespace {
+
+std::string JSONEscape(const std::string& s)
+{
+   std::string out;
+   out.reserve(s.size() + 16);
+   for (std::string::const_iterator it = s.begin(), end = s.end(); it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '"': out += "\\\""; break;
+         case '\\': out += "\\\\"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         case '\t': out += "\\t"; break;
+         default:
+            if (static_cast<unsigned char>(*it) < 0x20)
+            {
+               char buf[8];
+               snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(*it));
+               out += buf;
+            }
+            else
+               out += *it;
+      }
+   }
+   return out;
+}
+
+// Camera tracks are numbered from 1; overflows go on track 0
+void WriteCompleteEvent(std::ostream& os, const char* name, long long startUs,
+      long long endUs, const FrameTrace& trace)
+{
+   os << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"X\""
+      << ",\"ts\":" << startUs << ",\"dur\":" << (endUs - startUs)
+      << ",\"pid\":1,\"tid\":" << (trace.camera + 1)
+      << ",\"args\":{\"frame\":" << trace.id << "}}";
+}
+
+void WriteAsyncEvent(std::ostream& os, const char* ph, long long us,
+      const FrameTrace& trace)
+{
+   os << ",\n{\"name\":\"Queued\",\"cat\":\"frame\",\"ph\":\"" << ph << "\""
+      << ",\"id\":" << trace.id << ",\"ts\":" << us
+      << ",\"pid\":1,\"tid\":" << (trace.camera + 1) << "}";
+}
+
+} // anonymous namespace
+
+
+FrameTrace::FrameTrace() :
+   id(-1),
+   camera(0),
+   spilled(false),
+   receivedUs(0),
+   processStartUs(0),
+   processEndUs(0),
+   insertStartUs(0),
+   insertedUs(0),
+   poppedUs(0)
+{
+}
+
+
+const size_t FrameTracer::DefaultCapacity;
+
+FrameTracer::FrameTracer(size_t capacity) :
+   enabled_(false),
+   capacity_(capacity),
+   nextId_(0),
+   resetId_(0),
+   insertedCount_(0),
+   poppedCount_(0),
+   overflowCount_(0),
+   firstInsertUs_(0),
+   lastInsertUs_(0)
+{
+}
+
+void FrameTracer::Reset()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   resetId_ = nextId_;
+   traces_.clear();
+   overflows_.clear();
+   cameras_.clear();
+   insertedCount_ = 0;
+   poppedCount_ = 0;
+   overflowCount_ = 0;
+   firstInsertUs_ = 0;
+   lastInsertUs_ = 0;
+   processing_.Reset();
+   insert_.Reset();
+   residence_.Reset();
+}
+
+int FrameTracer::CameraIndex(const std::string& camera)
+{
+   for (size_t i = 0; i < cameras_.size(); ++i)
+      if (cameras_[i] == camera)
+         return static_cast<int>(i);
+   cameras_.push_back(camera);
+   return static_cast<int>(cameras_.size() - 1);
+}
+
+void FrameTracer::RecordInserted(FrameTrace& trace, const std::string& camera)
+{
+   if (!enabled_)
+   {
+      trace.id = -1;
+      return;
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   trace.id = nextId_++;
+   trace.camera = CameraIndex(camera);
+
+   if (insertedCount_ == 0)
+      firstInsertUs_ = trace.insertedUs;
+   lastInsertUs_ = trace.insertedUs;
+   ++insertedCount_;
+   if (trace.processStartUs != 0)
+      processing_.Record(trace.processEndUs - trace.processStartUs);
+   if (trace.receivedUs != 0)
+      insert_.Record(trace.insertedUs - trace.receivedUs);
+
+   traces_.push_back(trace);
+   if (traces_.size() > capacity_)
+      traces_.pop_front();
+}
+
+void FrameTracer::RecordPopped(const FrameTrace& trace)
+{
+   if (!enabled_ || trace.id < 0)
+      return;
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (trace.id < resetId_)
+      return;
+   ++poppedCount_;
+   residence_.Record(trace.poppedUs - trace.insertedUs);
+
+   if (!traces_.empty() && trace.id >= traces_.front().id)
+   {
+      const size_t index = static_cast<size_t>(trace.id - traces_.front().id);
+      if (index < traces_.size())
+         traces_[index].poppedUs = trace.poppedUs;
+   }
+}
+
+void FrameTracer::RecordOverflow(long long us)
+{
+   if (!enabled_)
+      return;
+
+   boost::mutex::scoped_lock lock(mutex_);
+   ++overflowCount_;
+   overflows_.push_back(us);
+   if (overflows_.size() > capacity_)
+      overflows_.pop_front();
+}
+
+long long FrameTracer::GetInsertedCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return insertedCount_;
+}
+
+long long FrameTracer::GetPoppedCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return poppedCount_;
+}
+
+long long FrameTracer::GetOverflowCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return overflowCount_;
+}
+
+double FrameTracer::GetInsertRate() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (insertedCount_ < 2 || lastInsertUs_ <= firstInsertUs_)
+      return 0.0;
+   return (insertedCount_ - 1) * 1e6 / (lastInsertUs_ - firstInsertUs_);
+}
+
+LatencyHistogram FrameTracer::GetProcessingHistogram() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return processing_;
+}
+
+LatencyHistogram FrameTracer::GetInsertHistogram() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return insert_;
+}
+
+LatencyHistogram FrameTracer::GetResidenceHistogram() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return residence_;
+}
+
+std::vector<FrameTrace> FrameTracer::GetTraces() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return std::vector<FrameTrace>(traces_.begin(), traces_.end());
+}
+
+std::vector<std::string> FrameTracer::GetCameraNames() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return cameras_;
+}
+
+std::string FrameTracer::GetChromeTrace() const
+{
+   std::vector<FrameTrace> traces;
+   std::vector<long long> overflows;
+   std::vector<std::string> cameras;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      traces.assign(traces_.begin(), traces_.end());
+      overflows.assign(overflows_.begin(), overflows_.end());
+      cameras = cameras_;
+   }
+
+   std::ostringstream os;
+   os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+      << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0"
+      << ",\"args\":{\"name\":\"MMCore\"}}";
+   os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0"
+      << ",\"args\":{\"name\":\"Circular buffer\"}}";
+   for (size_t i = 0; i < cameras.size(); ++i)
+      os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (i + 1)
+         << ",\"args\":{\"name\":\"" << JSONEscape(cameras[i]) << "\"}}";
+
+   for (std::vector<FrameTrace>::const_iterator it = traces.begin(),
+         end = traces.end(); it != end; ++it)
+   {
+      const FrameTrace& t = *it;
+      if (t.receivedUs != 0)
+         WriteCompleteEvent(os, "Frame", t.receivedUs, t.insertedUs, t);
+      if (t.processStartUs != 0)
+         WriteCompleteEvent(os, "Process", t.processStartUs, t.processEndUs, t);
+      WriteCompleteEvent(os, t.spilled ? "Spill" : "Insert",
+            t.insertStartUs, t.insertedUs, t);
+      WriteAsyncEvent(os, "b", t.insertedUs, t);
+      if (t.poppedUs != 0)
+         WriteAsyncEvent(os, "e", t.poppedUs, t);
+   }
+
+   for (std::vector<long long>::const_iterator it = overflows.begin(),
+         end = overflows.end(); it != end; ++it)
+      os << ",\n{\"name\":\"Overflow\",\"cat\":\"buffer\",\"ph\":\"i\",\"s\":\"p\""
+         << ",\"ts\":" << *it << ",\"pid\":1,\"tid\":0}";
+
+   os << "\n]}\n";
+   return os.str();
+}
+
+} // namespace mm
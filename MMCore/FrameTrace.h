@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameTrace.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Optional per-frame tracing of the image pipeline, from the
+//                camera's insert to the consumer's pop, with aggregate
+//                statistics and export in Chrome trace format.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceCallStats.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// Monotonic timestamps (see MonotonicClock.h), in microseconds, of one
+// frame's way through the Core. A stage the frame did not go through is 0.
+struct FrameTrace
+{
+   FrameTrace();
+
+   long long id; // Assigned by FrameTracer on insert; -1 if not traced
+   int camera; // Index into FrameTracer::GetCameraNames()
+   bool spilled; // Went through the spill file
+   long long receivedUs; // Camera called InsertImage() on the Core callback
+   long long processStartUs; // Image processor
+   long long processEndUs;
+   long long insertStartUs; // Circular buffer insert, including lock waits
+   long long insertedUs; // Visible to consumers
+   long long poppedUs; // Removed from the buffer by a consumer
+};
+
+
+// Collects frame traces and their statistics:
+// - insert rate, over the inserted frames
+// - processing time (image processor)
+// - insert latency, from the Core callback until the frame is in the buffer
+// - queue residence time, from insert until popped
+// - overflows (frames dropped because the buffer was full)
+//
+// The most recent traces are kept (up to the capacity) for export.
+//
+// Recording is off until enabled; the flag is read without locking, like in
+// DeviceCallStats. The Core only stamps frames while enabled, so disabled
+// tracing costs a check of the flag per frame.
+class FrameTracer
+{
+public:
+   static const size_t DefaultCapacity = 100000;
+
+   explicit FrameTracer(size_t capacity = DefaultCapacity);
+
+   void SetEnabled(bool enabled) { enabled_ = enabled; }
+   bool IsEnabled() const { return enabled_; }
+
+   // Clears traces and statistics. Frames inserted before the reset are not
+   // counted when popped.
+   void Reset();
+
+   // Called by the buffer once a frame is visible to consumers. Assigns
+   // trace.id and trace.camera (leaves id at -1 if disabled).
+   void RecordInserted(FrameTrace& trace, const std::string& camera);
+   void RecordPopped(const FrameTrace& trace);
+   void RecordOverflow(long long us);
+
+   long long GetInsertedCount() const;
+   long long GetPoppedCount() const;
+   long long GetOverflowCount() const;
+   // Frames per second between the first and the last insert; 0 if fewer
+   // than 2 frames were inserted
+   double GetInsertRate() const;
+   LatencyHistogram GetProcessingHistogram() const;
+   LatencyHistogram GetInsertHistogram() const;
+   LatencyHistogram GetResidenceHistogram() const;
+
+   // Kept traces, oldest first
+   std::vector<FrameTrace> GetTraces() const;
+   std::vector<std::string> GetCameraNames() const;
+
+   // Kept traces and overflows as JSON in the Chrome trace event format, for
+   // chrome://tracing or Perfetto: per frame a complete event per stage on
+   // the camera's track, and an async event for the time spent queued.
+   std::string GetChromeTrace() const;
+
+private:
+   FrameTracer(const FrameTracer&);
+   FrameTracer& operator=(const FrameTracer&);
+
+   int CameraIndex(const std::string& camera); // Caller must hold mutex_
+
+   bool enabled_;
+   const size_t capacity_;
+   mutable boost::mutex mutex_;
+
+   long long nextId_;
+   long long resetId_; // First id counted since the last reset
+   std::deque<FrameTrace> traces_; // Ids are consecutive
+   std::deque<long long> overflows_;
+   std::vector<std::string> cameras_;
+
+   long long insertedCount_;
+   long long poppedCount_;
+   long long overflowCount_;
+   long long firstInsertUs_;
+   long long lastInsertUs_;
+   LatencyHistogram processing_;
+   LatencyHistogram insert_;
+   LatencyHistogram residence_;
+};
+
+} // namespace mm
@@ -0,0 +1,275 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   On-disk index of the devices provided by device adapter
+//                modules, so that they can be listed without loading the
+//                modules.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceAdapterIndex.h"
+
+#include "../../MMDevice/MMDevice.h"
+#include "../../MMDevice/ModuleInterface.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+
+const char* const indexHeader = "# Micro-Manager device adapter index, version 1";
+
+// Fields are tab-separated; escape tabs, newlines and backslashes
+std::string
+Escape(const std::string& s)
+{
+   std::string escaped;
+   escaped.reserve(s.size());
+   for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+   {
+      switch (*it)
+      {
+         case '\\': escaped += "\\\\"; break;
+         case '\t': escaped += "\\t"; break;
+         case '\n': escaped += "\\n"; break;
+         case '\r': escaped += "\\r"; break;
+         default: escaped += *it; break;
+      }
+   }
+   return escaped;
+}
+
+std::string
+Unescape(const std::string& s)
+{
+   std::string unescaped;
+   unescaped.reserve(s.size());
+   for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+   {
+      if (*it != '\\' || it + 1 == s.end())
+      {
+         unescaped += *it;
+         continue;
+      }
+      switch (*++it)
+      {
+         case 't': unescaped += '\t'; break;
+         case 'n': unescaped += '\n'; break;
+         case 'r': unescaped += '\r'; break;
+         default: unescaped += *it; break;
+      }
+   }
+   return unescaped;
+}
+
+std::vector<std::string>
+SplitFields(const std::string& line)
+{
+   std::vector<std::string> fields;
+   std::string::size_type start = 0;
+   for (;;)
+   {
+      std::string::size_type tab = line.find('\t', start);
+      fields.push_back(Unescape(line.substr(start, tab - start)));
+      if (tab == std::string::npos)
+         return fields;
+      start = tab + 1;
+   }
+}
+
+long long
+ParseInteger(const std::string& s)
+{
+   long long value = 0;
+   std::istringstream(s) >> value;
+   return value;
+}
+
+} // anonymous namespace
+
+
+DeviceAdapterIndex::DeviceAdapterIndex()
+{
+}
+
+
+void
+DeviceAdapterIndex::SetFile(const std::string& path)
+{
+   if (path == file_)
+      return;
+   file_ = path;
+   entries_.clear();
+   Load();
+}
+
+
+bool
+DeviceAdapterIndex::Lookup(const std::string& modulePath,
+      std::vector<DeviceInfo>& devices) const
+{
+   std::map<std::string, Entry>::const_iterator it = entries_.find(modulePath);
+   if (it == entries_.end())
+      return false;
+
+   const Entry& entry = it->second;
+   if (entry.moduleInterfaceVersion != MODULE_INTERFACE_VERSION ||
+         entry.deviceInterfaceVersion != DEVICE_INTERFACE_VERSION)
+      return false;
+
+   long long mtime, size;
+   if (!GetFileStamp(modulePath, mtime, size) ||
+         mtime != entry.mtime || size != entry.size)
+      return false;
+
+   devices = entry.devices;
+   return true;
+}
+
+
+void
+DeviceAdapterIndex::Update(const std::string& modulePath,
+      const std::vector<DeviceInfo>& devices)
+{
+   Entry entry;
+   if (!GetFileStamp(modulePath, entry.mtime, entry.size))
+   {
+      entries_.erase(modulePath);
+      return;
+   }
+   entry.moduleInterfaceVersion = MODULE_INTERFACE_VERSION;
+   entry.deviceInterfaceVersion = DEVICE_INTERFACE_VERSION;
+   entry.devices = devices;
+   entries_[modulePath] = entry;
+
+   Save();
+}
+
+
+bool
+DeviceAdapterIndex::GetFileStamp(const std::string& path, long long& mtime,
+      long long& size)
+{
+#ifdef WIN32
+   struct _stat64 st;
+   if (_stat64(path.c_str(), &st) != 0)
+      return false;
+#else
+   struct stat st;
+   if (stat(path.c_str(), &st) != 0)
+      return false;
+#endif
+   mtime = static_cast<long long>(st.st_mtime);
+   size = static_cast<long long>(st.st_size);
+   return true;
+}
+
+
+void
+DeviceAdapterIndex::Load()
+{
+   if (file_.empty())
+      return;
+
+   std::ifstream in(file_.c_str(), std::ios_base::binary);
+   std::string line;
+   if (!std::getline(in, line) || line != indexHeader)
+      return;
+
+   // module <path> <mtime> <size> <module ver> <device ver> <device count>
+   // device <name> <type> <description>
+   Entry* entry = 0;
+   size_t expectedDevices = 0;
+   std::string path;
+   while (std::getline(in, line))
+   {
+      std::vector<std::string> fields = SplitFields(line);
+      if (fields[0] == "module" && fields.size() == 7)
+      {
+         if (entry && entry->devices.size() != expectedDevices)
+            entries_.erase(path);
+         path = fields[1];
+         entry = &entries_[path];
+         entry->mtime = ParseInteger(fields[2]);
+         entry->size = ParseInteger(fields[3]);
+         entry->moduleInterfaceVersion = static_cast<long>(ParseInteger(fields[4]));
+         entry->deviceInterfaceVersion = static_cast<long>(ParseInteger(fields[5]));
+         entry->devices.clear();
+         expectedDevices = static_cast<size_t>(ParseInteger(fields[6]));
+      }
+      else if (fields[0] == "device" && fields.size() == 4 && entry)
+      {
+         DeviceInfo device;
+         device.name = fields[1];
+         device.type = static_cast<MM::DeviceType>(ParseInteger(fields[2]));
+         device.description = fields[3];
+         entry->devices.push_back(device);
+      }
+      else
+      {
+         // Corrupt; start from scratch
+         entries_.clear();
+         return;
+      }
+   }
+   if (entry && entry->devices.size() != expectedDevices)
+      entries_.erase(path);
+}
+
+
+void
+DeviceAdapterIndex::Save() const
+{
+   if (file_.empty())
+      return;
+
+   // Write a new file and replace the old one, so that a reader never sees
+   // a partially written index
+   const std::string tmpFile = file_ + ".tmp";
+   {
+      std::ofstream out(tmpFile.c_str(), std::ios_base::binary);
+      out << indexHeader << '\n';
+      for (std::map<std::string, Entry>::const_iterator it = entries_.begin(),
+            end = entries_.end(); it != end; ++it)
+      {
+         const Entry& entry = it->second;
+         out << "module\t" << Escape(it->first) << '\t' << entry.mtime <<
+            '\t' << entry.size << '\t' << entry.moduleInterfaceVersion <<
+            '\t' << entry.deviceInterfaceVersion << '\t' <<
+            entry.devices.size() << '\n';
+         for (std::vector<DeviceInfo>::const_iterator dev = entry.devices.begin();
+               dev != entry.devices.end(); ++dev)
+         {
+            out << "device\t" << Escape(dev->name) << '\t' <<
+               static_cast<int>(dev->type) << '\t' <<
+               Escape(dev->description) << '\n';
+         }
+      }
+      out.close();
+      if (out.fail())
+      {
+         std::remove(tmpFile.c_str());
+         return;
+      }
+   }
+
+#ifdef WIN32
+   std::remove(file_.c_str());
+#endif
+   if (std::rename(tmpFile.c_str(), file_.c_str()) != 0)
+      std::remove(tmpFile.c_str());
+}
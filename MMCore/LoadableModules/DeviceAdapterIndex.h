@@ -0,0 +1,81 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   On-disk index of the devices provided by device adapter
+//                modules, so that they can be listed without loading the
+//                modules.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../../MMDevice/MMDeviceConstants.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Remembers, for each device adapter module file, the devices it provides.
+ *
+ * Entries are keyed by the module's path and are only used while the file's
+ * modification time and size are unchanged, and while the module and device
+ * interface versions are those of this build, so a rebuilt or replaced
+ * module is always loaded afresh.
+ */
+class DeviceAdapterIndex /* final */
+{
+public:
+   struct DeviceInfo
+   {
+      std::string name;
+      std::string description;
+      MM::DeviceType type;
+   };
+
+   DeviceAdapterIndex();
+
+   // Selects the file the index is kept in and reads it (an empty path
+   // keeps the index in memory only). A missing or unreadable file results
+   // in an empty index.
+   void SetFile(const std::string& path);
+   std::string GetFile() const { return file_; }
+
+   // Returns false if the module is not indexed or has changed
+   bool Lookup(const std::string& modulePath,
+         std::vector<DeviceInfo>& devices) const;
+   // Records the devices of a module that was just loaded, and saves the
+   // index file
+   void Update(const std::string& modulePath,
+         const std::vector<DeviceInfo>& devices);
+
+   size_t GetSize() const { return entries_.size(); }
+
+private:
+   struct Entry
+   {
+      long long mtime;
+      long long size;
+      long moduleInterfaceVersion;
+      long deviceInterfaceVersion;
+      std::vector<DeviceInfo> devices;
+   };
+
+   static bool GetFileStamp(const std::string& path, long long& mtime,
+         long long& size);
+   void Load();
+   void Save() const;
+
+   std::string file_;
+   std::map<std::string, Entry> entries_;
+};
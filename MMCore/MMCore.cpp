@@ -42,21 +42,33 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AsyncOperations.h"
+#include "CallbackDispatcher.h"
 #include "CircularBuffer.h"
+#include "ConfigFileParser.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
 #include "CoreCallback.h"
 #include "CoreProperty.h"
 #include "CoreUtils.h"
+#include "DeviceInitScheduler.h"
 #include "DeviceManager.h"
+#include "DiskStreamWriter.h"
+#include "FrameTrace.h"
 #include "Devices/DeviceInstances.h"
 #include "Host.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
+#include "MultiROILayout.h"
 #include "PluginManager.h"
+#include "SequencePlanner.h"
+#include "StateCache.h"
 
+#include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
 
 #include <algorithm>
 #include <assert.h>
@@ -113,7 +125,7 @@ using namespace std;
  * (Keep the 3 numbers on one line to make it easier to look at diffs when
  * merging/rebasing.)
  */
-const int MMCore_versionMajor = 10, MMCore_versionMinor = 1, MMCore_versionPatch = 1;
+const int MMCore_versionMajor = 10, MMCore_versionMinor = 14, MMCore_versionPatch = 0;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -137,10 +149,20 @@ CMMCore::CMMCore() :
    configGroups_(0),
    properties_(0),
    externalCallback_(0),
+   callbackDispatcher_(new mm::CallbackDispatcher()),
+   asyncCallbacks_(false),
    pixelSizeGroup_(0),
    cbuf_(0),
+   multiROIPacking_(false),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   initScheduler_(new mm::DeviceInitScheduler()),
+   asyncOperations_(new mm::AsyncOperations()),
+   parallelInit_(false),
+   deviceCallStatsEnabled_(false),
+   frameTracer_(new mm::FrameTracer()),
+   stateCache_(new mm::StateCache()),
+   hardwareSequenceStopRequested_(false),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
@@ -153,6 +175,7 @@ CMMCore::CMMCore() :
 
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
    cbuf_ = new CircularBuffer(seqBufMegabytes);
+   cbuf_->SetFrameTracer(frameTracer_);
 
    nullAffine_ = new std::vector<double>(6);
    for (int i = 0; i < 6; i++) {
@@ -168,6 +191,9 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   // Operations in progress may still be using devices
+   asyncOperations_->Clear();
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -179,6 +205,13 @@ CMMCore::~CMMCore()
       LOG_ERROR(coreLogger_) << "Exception caught in CMMCore destructor.";
    }
 
+   // Stop notifications before the rest of the Core goes away
+   externalCallback_ = 0;
+   callbackDispatcher_->SetTarget(0);
+
+   if (streamWriter_)
+      streamWriter_->Stop();
+
    delete callback_;
    delete configGroups_;
    delete properties_;
@@ -363,9 +396,18 @@ string CMMCore::getVersionInfo() const
 std::vector<std::string>
 CMMCore::getAvailableDevices(const char* moduleName) throw (CMMError)
 {
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   return module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
+   std::vector<std::string> names;
+   names.reserve(devices.size());
+   for (std::vector<DeviceAdapterIndex::DeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
+   {
+      names.push_back(it->name);
+   }
+   return names;
 }
 
 /**
@@ -376,15 +418,16 @@ CMMCore::getAvailableDeviceDescriptions(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of descriptions, rather
    // than provide access to the description of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<std::string> descriptions;
-   descriptions.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   descriptions.reserve(devices.size());
+   for (std::vector<DeviceAdapterIndex::DeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      descriptions.push_back(module->GetDeviceDescription(*it));
+      descriptions.push_back(it->description);
    }
    return descriptions;
 }
@@ -397,16 +440,16 @@ CMMCore::getAvailableDeviceTypes(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of types, rather than
    // provide access to the type of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<long> types;
-   types.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   types.reserve(devices.size());
+   for (std::vector<DeviceAdapterIndex::DeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      MM::DeviceType devType = module->GetAdvertisedDeviceType(*it);
-      types.push_back(static_cast<long>(devType));
+      types.push_back(static_cast<long>(it->type));
    }
    return types;
 }
@@ -481,8 +524,50 @@ Configuration CMMCore::getSystemState()
  */
 Configuration CMMCore::getSystemStateCache() const
 {
-   MMThreadGuard scg(stateCacheLock_);
-   return stateCache_;
+   return stateCache_->GetAll();
+}
+
+/**
+ * Returns the current version of the system state cache.
+ *
+ * The version increases whenever a cached value changes. To keep a copy of
+ * the cache up to date, call this first and then
+ * getSystemStateCacheChangesSince() with the version obtained by the
+ * previous round (or getSystemStateCache() for the first round). Doing it in
+ * this order never misses a change, although a change can occasionally be
+ * reported twice.
+ *
+ * @return the version of the system state cache
+ */
+long CMMCore::getSystemStateCacheVersion() const
+{
+   return stateCache_->GetVersion();
+}
+
+/**
+ * Returns the cached property values that have been added or changed since
+ * the given version of the system state cache. This is much cheaper than
+ * getSystemStateCache() when only a few values change between calls.
+ *
+ * @param version   a version returned by getSystemStateCacheVersion()
+ * @return  the changed device-property-value triplets
+ */
+Configuration CMMCore::getSystemStateCacheChangesSince(long version) const
+{
+   return stateCache_->GetChangesSince(version);
+}
+
+/**
+ * Returns the properties that have been removed from the system state cache
+ * since the given version (for example because their device was unloaded),
+ * with their last cached values.
+ *
+ * @param version   a version returned by getSystemStateCacheVersion()
+ * @return  the removed device-property-value triplets
+ */
+Configuration CMMCore::getSystemStateCacheRemovalsSince(long version) const
+{
+   return stateCache_->GetRemovalsSince(version);
 }
 
 /**
@@ -629,6 +714,36 @@ void CMMCore::setDeviceAdapterSearchPaths(const std::vector<std::string>& paths)
    pluginManager_->SetSearchPaths(paths.begin(), paths.end());
 }
 
+/**
+ * Set the file in which to keep an index of the devices provided by device
+ * adapters.
+ *
+ * getAvailableDevices(), getAvailableDeviceDescriptions() and
+ * getAvailableDeviceTypes() record the devices of each device adapter in the
+ * index, and subsequently (including in later sessions) answer from the index
+ * without loading the device adapter, as long as the device adapter file has
+ * the same modification time and size. The index file is read when set and
+ * rewritten whenever a device adapter is added to it.
+ *
+ * @param path   the index file; empty (the default) to keep the index in
+ *               memory only
+ */
+void CMMCore::setDeviceAdapterIndexFile(const char* path)
+{
+   pluginManager_->SetIndexFile(path ? path : "");
+   LOG_DEBUG(coreLogger_) << "Device adapter index file set to " <<
+      (path ? path : "");
+}
+
+/**
+ * Return the file in which the device adapter index is kept, or an empty
+ * string if none.
+ */
+std::string CMMCore::getDeviceAdapterIndexFile()
+{
+   return pluginManager_->GetIndexFile();
+}
+
 /**
  * Return the names of discoverable device adapters.
  *
@@ -711,6 +826,7 @@ void CMMCore::loadDevice(const char* label, const char* moduleName, const char*
          deviceManager_->LoadDevice(module, deviceName, label, this,
                deviceLogger, coreLogger);
       pDevice->SetCallback(callback_);
+      pDevice->GetCallStats().SetEnabled(deviceCallStatsEnabled_);
    }
    catch (const CMMError& e)
    {
@@ -787,6 +903,7 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
       deviceManager_->UnloadDevice(pDevice);
+      initTimesMs_.erase(label);
       LOG_DEBUG(coreLogger_) << "Did unload device " << label;
    }
    catch (CMMError& err) {
@@ -802,6 +919,7 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 void CMMCore::unloadAllDevices() throw (CMMError)
 {
    try {
+      asyncOperations_->Clear();
       configGroups_->Clear();
 
       //selected channel group is no longer valid
@@ -820,6 +938,7 @@ void CMMCore::unloadAllDevices() throw (CMMError)
 
       LOG_DEBUG(coreLogger_) << "Will unload all devices";
       deviceManager_->UnloadAllDevices();
+      initTimesMs_.clear();
       LOG_INFO(coreLogger_) << "Did unload all devices";
 
 	   properties_->Refresh();
@@ -877,35 +996,198 @@ void CMMCore::reset() throw (CMMError)
  * Calls Initialize() method for each loaded device.
  * This method also initialized allowed values for core properties, based
  * on the collection of loaded devices.
+ *
+ * If enabled with enableParallelInitialization() (or the Core property
+ * ParallelInitialize, e.g. set in a configuration file before
+ * Core,Initialize), devices that do not depend on each other are
+ * initialized concurrently. A device is initialized
+ * only after its parent hub, the device named by its Port property, and the
+ * devices loaded before it from the same device adapter. If a device looks up
+ * another device loaded before it during initialization, it waits for that
+ * device to be initialized. Default roles (current camera, stage, etc.) are
+ * assigned in load order, as when initializing one device at a time.
  */
 void CMMCore::initializeAllDevices() throw (CMMError)
 {
    vector<string> devices = deviceManager_->GetDeviceList();
-   LOG_INFO(coreLogger_) << "Will initialize " << devices.size() << " devices";
+   LOG_INFO(coreLogger_) << "Will initialize " << devices.size() << " devices" <<
+      (parallelInit_ ? " in parallel" : "");
 
-   for (size_t i=0; i<devices.size(); i++)
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+
+   if (!parallelInit_)
+   {
+      for (size_t i=0; i<devices.size(); i++)
+      {
+         initTimesMs_[devices[i]] = initializeDeviceInstance(devices[i]);
+         assignDefaultRole(deviceManager_->GetDevice(devices[i]));
+      }
+   }
+   else
    {
-      boost::shared_ptr<DeviceInstance> pDevice;
+      initScheduler_->Clear();
+      for (size_t i=0; i<devices.size(); i++)
+      {
+         boost::shared_ptr<DeviceInstance> pDevice;
+         try {
+            pDevice = deviceManager_->GetDevice(devices[i]);
+         }
+         catch (CMMError& err) {
+            logError(devices[i].c_str(), err.getMsg().c_str());
+            throw;
+         }
+         initScheduler_->AddDevice(devices[i],
+               getInitializationDependencies(pDevice));
+      }
+
+      CMMError* failure = 0;
       try {
-         pDevice = deviceManager_->GetDevice(devices[i]);
+         initScheduler_->Run(boost::bind(&CMMCore::initializeDeviceInstance,
+                  this, _1));
       }
       catch (CMMError& err) {
-         logError(devices[i].c_str(), err.getMsg().c_str());
-         throw;
+         failure = new CMMError(err);
       }
-      mm::DeviceModuleLockGuard guard(pDevice);
-      LOG_INFO(coreLogger_) << "Will initialize device " << devices[i];
-      pDevice->Initialize();
-      LOG_INFO(coreLogger_) << "Did initialize device " << devices[i];
 
-      assignDefaultRole(pDevice);
+      vector<string> initialized = initScheduler_->GetInitializedDevices();
+      for (size_t i=0; i<initialized.size(); i++)
+      {
+         initTimesMs_[initialized[i]] =
+            initScheduler_->GetInitTimeMs(initialized[i]);
+         assignDefaultRole(deviceManager_->GetDevice(initialized[i]));
+      }
+      initScheduler_->Clear();
+
+      if (failure)
+      {
+         CMMError err(*failure);
+         delete failure;
+         throw err;
+      }
    }
 
-   LOG_INFO(coreLogger_) << "Finished initializing " << devices.size() << " devices";
+   double sumMs = 0.0;
+   for (size_t i=0; i<devices.size(); i++)
+      sumMs += initTimesMs_[devices[i]];
+   LOG_INFO(coreLogger_) << "Finished initializing " << devices.size() <<
+      " devices in " << (boost::posix_time::microsec_clock::universal_time() -
+            start).total_milliseconds() << " ms (" << sumMs <<
+      " ms device total)";
 
    updateCoreProperties();
 }
 
+/**
+ * Initializes one device, returning the time taken in milliseconds.
+ */
+double CMMCore::initializeDeviceInstance(const std::string& label) throw (CMMError)
+{
+   boost::shared_ptr<DeviceInstance> pDevice;
+   try {
+      pDevice = deviceManager_->GetDevice(label);
+   }
+   catch (CMMError& err) {
+      logError(label.c_str(), err.getMsg().c_str());
+      throw;
+   }
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   LOG_INFO(coreLogger_) << "Will initialize device " << label;
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+   pDevice->Initialize();
+   const double elapsedMs = (boost::posix_time::microsec_clock::universal_time() -
+         start).total_microseconds() / 1000.0;
+   LOG_INFO(coreLogger_) << "Did initialize device " << label << " in " <<
+      elapsedMs << " ms";
+   return elapsedMs;
+}
+
+/**
+ * Returns the devices that must be initialized before the given device: its
+ * parent hub, the device named by its Port property (if any), and the
+ * previously loaded device from the same adapter module.
+ */
+std::vector<std::string> CMMCore::getInitializationDependencies(
+      boost::shared_ptr<DeviceInstance> pDevice)
+{
+   std::vector<std::string> dependencies;
+   const std::string label = pDevice->GetLabel();
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   std::string parent = pDevice->GetParentID();
+   if (!parent.empty())
+      dependencies.push_back(parent);
+
+   if (pDevice->HasProperty(MM::g_Keyword_Port))
+   {
+      try {
+         dependencies.push_back(pDevice->GetProperty(MM::g_Keyword_Port));
+      }
+      catch (const CMMError&) {
+         // No usable port; nothing to wait for
+      }
+   }
+
+   // Devices from the same adapter may share global state in the adapter,
+   // so keep them in load order
+   const std::string module = pDevice->GetAdapterModule()->GetName();
+   vector<string> devices = deviceManager_->GetDeviceList();
+   std::string previous;
+   for (vector<string>::iterator it = devices.begin();
+         it != devices.end() && *it != label; ++it)
+   {
+      if (deviceManager_->GetDevice(*it)->GetAdapterModule()->GetName() == module)
+         previous = *it;
+   }
+   if (!previous.empty())
+      dependencies.push_back(previous);
+
+   LOG_DEBUG(coreLogger_) << "Device " << label << " will be initialized after " <<
+      (dependencies.empty() ? std::string("no other device") :
+       boost::algorithm::join(dependencies, ", "));
+   return dependencies;
+}
+
+/**
+ * Enables or disables concurrent initialization of independent devices in
+ * initializeAllDevices(). Disabled by default.
+ *
+ * @param enable   false to initialize devices one at a time, in load order
+ */
+void CMMCore::enableParallelInitialization(bool enable)
+{
+   properties_->Set(MM::g_Keyword_CoreParallelInitialize, enable ? "1" : "0");
+   parallelInit_ = enable;
+}
+
+/**
+ * Returns true if initializeAllDevices() initializes independent devices
+ * concurrently.
+ */
+bool CMMCore::isParallelInitializationEnabled()
+{
+   return parallelInit_;
+}
+
+/**
+ * Returns the time that the most recent initialization of the device took,
+ * in milliseconds, or 0 if the device has not been initialized.
+ *
+ * @param label   the device label
+ */
+double CMMCore::getDeviceInitializationTimeMs(const char* label) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   if (strcmp(label, MM::g_Keyword_CoreDevice) == 0)
+      return 0.0;
+   deviceManager_->GetDevice(label);
+
+   std::map<std::string, double>::const_iterator it = initTimesMs_.find(label);
+   return it == initTimesMs_.end() ? 0.0 : it->second;
+}
+
 /**
  * Updates CoreProperties (currently all Core properties are 
  * devices types) with the loaded hardware.
@@ -946,13 +1228,8 @@ void CMMCore::updateCoreProperty(const char* propName, MM::DeviceType devType) t
 void CMMCore::initializeDevice(const char* label ///< the device to initialize
                                ) throw (CMMError)
 {
-   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
-
-   mm::DeviceModuleLockGuard guard(pDevice);
-
-   LOG_INFO(coreLogger_) << "Will initialize device " << label;
-   pDevice->Initialize();
-   LOG_INFO(coreLogger_) << "Did initialize device " << label;
+   CheckDeviceLabel(label);
+   initTimesMs_[label] = initializeDeviceInstance(label);
 
    updateCoreProperties();
 }
@@ -966,10 +1243,7 @@ void CMMCore::updateSystemStateCache()
 {
    LOG_DEBUG(coreLogger_) << "Will update system state cache";
    Configuration wk = getSystemState();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_ = wk;
-   }
+   stateCache_->Replace(wk);
    LOG_INFO(coreLogger_) << "Did update system state cache";
 }
 
@@ -1309,6 +1583,188 @@ void CMMCore::waitForConfig(const char* group, const char* configName) throw (CM
    }
 }
 
+/**
+ * Starts moving a stage to an absolute position and returns without waiting
+ * for the move to finish.
+ *
+ * The returned operation completes when the stage is no longer busy. Several
+ * operations can be in progress at once (for example, a focus move, an XY
+ * move and a filter change), and operations on devices in different device
+ * adapters proceed in parallel. Every operation should eventually be passed
+ * to waitForOperation() or waitForOperations(), which report whether it
+ * succeeded.
+ *
+ * @param stageLabel  the stage device label
+ * @param position    the desired stage position, in microns
+ * @return the operation id
+ */
+long CMMCore::setPositionAsync(const char* stageLabel, double position) throw (CMMError)
+{
+   // Report an invalid device now rather than when waiting
+   deviceManager_->GetDeviceOfType<StageInstance>(stageLabel);
+
+   long id = asyncOperations_->Start(boost::bind(&CMMCore::setPositionAndWait,
+            this, std::string(stageLabel), position));
+   LOG_DEBUG(coreLogger_) << "Started operation " << id << ": move " <<
+      stageLabel << " to " << std::fixed << std::setprecision(5) <<
+      position << " um";
+   return id;
+}
+
+/**
+ * Starts moving an XY stage to an absolute position and returns without
+ * waiting for the move to finish. See setPositionAsync().
+ *
+ * @param xyStageLabel  the XY stage device label
+ * @param x             the X axis position in microns
+ * @param y             the Y axis position in microns
+ * @return the operation id
+ */
+long CMMCore::setXYPositionAsync(const char* xyStageLabel, double x, double y) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<XYStageInstance>(xyStageLabel);
+
+   long id = asyncOperations_->Start(boost::bind(&CMMCore::setXYPositionAndWait,
+            this, std::string(xyStageLabel), x, y));
+   LOG_DEBUG(coreLogger_) << "Started operation " << id << ": move " <<
+      xyStageLabel << " to (" << std::fixed << std::setprecision(3) << x <<
+      ", " << y << ") um";
+   return id;
+}
+
+/**
+ * Starts setting the state of a state device and returns without waiting
+ * for the device to settle. See setPositionAsync().
+ *
+ * @param stateDeviceLabel  the device label
+ * @param state             the new state
+ * @return the operation id
+ */
+long CMMCore::setStateAsync(const char* stateDeviceLabel, long state) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<StateInstance>(stateDeviceLabel);
+
+   long id = asyncOperations_->Start(boost::bind(&CMMCore::setStateAndWait,
+            this, std::string(stateDeviceLabel), state));
+   LOG_DEBUG(coreLogger_) << "Started operation " << id << ": set " <<
+      stateDeviceLabel << " to state " << state;
+   return id;
+}
+
+/**
+ * Starts applying a configuration preset and returns without waiting for
+ * the devices to settle. The operation completes when all devices in the
+ * preset are no longer busy. See setPositionAsync().
+ *
+ * @param groupName   the configuration group name
+ * @param configName  the configuration preset name
+ * @return the operation id
+ */
+long CMMCore::setConfigAsync(const char* groupName, const char* configName) throw (CMMError)
+{
+   CheckConfigGroupName(groupName);
+   CheckConfigPresetName(configName);
+   if (!configGroups_->Find(groupName, configName))
+   {
+      throw CMMError("Preset " + ToQuotedString(configName) +
+            " of configuration group " + ToQuotedString(groupName) +
+            " does not exist",
+            MMERR_NoConfiguration);
+   }
+
+   long id = asyncOperations_->Start(boost::bind(&CMMCore::setConfigAndWait,
+            this, std::string(groupName), std::string(configName)));
+   LOG_DEBUG(coreLogger_) << "Started operation " << id << ": apply preset " <<
+      configName << " of group " << groupName;
+   return id;
+}
+
+/**
+ * Checks whether an operation started by one of the asynchronous methods
+ * (such as setPositionAsync()) has finished, successfully or not.
+ *
+ * @param operationId  the operation id
+ */
+bool CMMCore::isOperationDone(long operationId) throw (CMMError)
+{
+   bool done = false;
+   if (!asyncOperations_->IsDone(operationId, done))
+      throwUnknownOperation(operationId);
+   return done;
+}
+
+/**
+ * Blocks until an operation started by one of the asynchronous methods (such
+ * as setPositionAsync()) has finished, and throws its error if it failed. An
+ * operation can only be waited for once.
+ *
+ * @param operationId  the operation id
+ */
+void CMMCore::waitForOperation(long operationId) throw (CMMError)
+{
+   if (!asyncOperations_->Wait(operationId))
+      throwUnknownOperation(operationId);
+}
+
+/**
+ * Blocks until all of the given operations have finished. If any of them
+ * failed, the error of the first one that failed (in the order given) is
+ * thrown after all have finished.
+ *
+ * @param operationIds  the operation ids
+ */
+void CMMCore::waitForOperations(std::vector<long> operationIds) throw (CMMError)
+{
+   boost::shared_ptr<CMMError> firstError;
+   for (std::vector<long>::const_iterator it = operationIds.begin(),
+         end = operationIds.end(); it != end; ++it)
+   {
+      try
+      {
+         waitForOperation(*it);
+      }
+      catch (const CMMError& e)
+      {
+         if (!firstError)
+            firstError = boost::make_shared<CMMError>(e);
+      }
+   }
+   if (firstError)
+      throw CMMError(*firstError);
+}
+
+void CMMCore::setPositionAndWait(const std::string& label, double position) throw (CMMError)
+{
+   setPosition(label.c_str(), position);
+   waitForDevice(label.c_str());
+}
+
+void CMMCore::setXYPositionAndWait(const std::string& label, double x, double y) throw (CMMError)
+{
+   setXYPosition(label.c_str(), x, y);
+   waitForDevice(label.c_str());
+}
+
+void CMMCore::setStateAndWait(const std::string& label, long state) throw (CMMError)
+{
+   setState(label.c_str(), state);
+   waitForDevice(label.c_str());
+}
+
+void CMMCore::setConfigAndWait(const std::string& group, const std::string& config) throw (CMMError)
+{
+   setConfig(group.c_str(), config.c_str());
+   waitForConfig(group.c_str(), config.c_str());
+}
+
+void CMMCore::throwUnknownOperation(long operationId) throw (CMMError)
+{
+   std::ostringstream msg;
+   msg << getCoreErrorText(MMERR_UnknownOperation) << " (id " <<
+      operationId << ")";
+   throw CMMError(msg.str(), MMERR_UnknownOperation);
+}
+
 /**
  * Wait for the slowest device in the ImageSynchro list.
  */
@@ -2086,47 +2542,525 @@ void CMMCore::loadExposureSequence(const char* cameraLabel, std::vector<double>
 
 
 /**
- * Queries stage if it can be used in a sequence
- * @param label   the stage device label
- * @return   true if the stage can be sequenced
+ * Works out how startHardwareSequence() would split a list of frames into
+ * hardware-sequenced bursts, without changing any device settings. The
+ * parameters are the same as for startHardwareSequence().
+ *
+ * @return the number of frames in each burst, in order
  */
-bool CMMCore::isStageSequenceable(const char* label) throw (CMMError)
+std::vector<long> CMMCore::planHardwareSequence(std::vector<double> zPositionsUm,
+      std::vector<double> xPositionsUm, std::vector<double> yPositionsUm,
+      const char* channelGroup, std::vector<std::string> channelPresets,
+      std::vector<double> exposuresMs) throw (CMMError)
 {
-   boost::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
-
-   mm::DeviceModuleLockGuard guard(pStage);
-
-   bool isSequenceable;
-   int ret = pStage->IsStageSequenceable(isSequenceable);
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+   size_t frameCount;
+   std::vector<mm::SequenceAxis> axes = buildSequenceAxes(zPositionsUm,
+         xPositionsUm, yPositionsUm, channelGroup, channelPresets, exposuresMs,
+         frameCount);
+   std::vector<mm::SequenceBurst> bursts =
+      mm::PlanSequenceBursts(axes, frameCount);
 
-   return isSequenceable;
+   std::vector<long> lengths;
+   for (std::vector<mm::SequenceBurst>::const_iterator it = bursts.begin(),
+         end = bursts.end(); it != end; ++it)
+      lengths.push_back(static_cast<long>(it->length));
+   return lengths;
 }
 
 /**
- * Queries if the stage can be used in a linear sequence
- * A linear sequence is defined by a stepsize and number of slices
- * @param label   the stage device label
- * @return   true if the stage supports linear sequences
- */
-bool CMMCore::isStageLinearSequenceable(const char* label) throw (CMMError)
+ * Acquires a list of frames with the current camera, letting the hardware
+ * step through the per-frame settings wherever the devices allow.
+ *
+ * Each frame can have its own focus position, XY position, channel (a
+ * preset of channelGroup) and exposure. Pass an empty list for any of these
+ * that should be left alone; the other lists must all have one entry per
+ * frame. A property that is not part of every channel preset keeps its
+ * previous value in frames whose preset does not include it.
+ *
+ * The frames are split into the fewest bursts in which each setting either
+ * stays the same or can be sequenced by its device (and fits in the
+ * device's maximum sequence length); planHardwareSequence() shows the split.
+ * Before each burst, settings that change are applied and waited for,
+ * sequences are loaded and started, and the camera then runs a sequence
+ * acquisition of the burst's frames. Sequenced devices are expected to
+ * advance on trigger signals from the camera.
+ *
+ * This returns once the acquisition is set up; the bursts run in the
+ * background. The circular buffer is cleared at the start (but not between
+ * bursts) and receives the images in order, as with
+ * startSequenceAcquisition(). The returned operation id is to be passed to
+ * waitForOperation() (see setPositionAsync()), which reports any error.
+ *
+ * @param zPositionsUm    focus stage position for each frame, in microns
+ * @param xPositionsUm    XY stage X position for each frame, in microns
+ * @param yPositionsUm    XY stage Y position for each frame, in microns
+ * @param channelGroup    the configuration group containing the channels
+ * @param channelPresets  channel preset for each frame
+ * @param exposuresMs     exposure for each frame, in milliseconds
+ * @return the operation id
+ */
+long CMMCore::startHardwareSequence(std::vector<double> zPositionsUm,
+      std::vector<double> xPositionsUm, std::vector<double> yPositionsUm,
+      const char* channelGroup, std::vector<std::string> channelPresets,
+      std::vector<double> exposuresMs) throw (CMMError)
 {
-   boost::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+   {
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(),
+            MMERR_CameraNotAvailable);
+   }
 
-   mm::DeviceModuleLockGuard guard(pStage);
+   size_t frameCount;
+   std::vector<mm::SequenceAxis> axes = buildSequenceAxes(zPositionsUm,
+         xPositionsUm, yPositionsUm, channelGroup, channelPresets, exposuresMs,
+         frameCount);
+   std::vector<mm::SequenceBurst> bursts =
+      mm::PlanSequenceBursts(axes, frameCount);
 
-   bool isSequenceable;
-   int ret = pStage->IsStageLinearSequenceable(isSequenceable);
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      if (camera->IsCapturing())
+      {
+         throw CMMError(getCoreErrorText(
+                  MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+               MMERR_NotAllowedDuringSequenceAcquisition);
+      }
+   }
 
-   return isSequenceable;
-}
+   {
+      MMThreadGuard g(*pPostedErrorsLock_);
+      postedErrors_.clear();
+   }
+   if (!initializeCircularBufferFor(camera))
+   {
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(),
+            MMERR_CircularBufferFailedToInitialize);
+   }
+   cbuf_->Clear();
 
-/**
+   {
+      MMThreadGuard g(hardwareSequenceLock_);
+      hardwareSequenceStopRequested_ = false;
+   }
+
+   long id = asyncOperations_->Start(boost::bind(&CMMCore::runHardwareSequence,
+            this, axes, bursts));
+   LOG_INFO(coreLogger_) << "Started hardware sequence of " << frameCount <<
+      " frames in " << bursts.size() << " burst(s) (operation " << id << ")";
+   return id;
+}
+
+/**
+ * Stops a hardware sequence started with startHardwareSequence(). The burst
+ * in progress is stopped and no further bursts are started.
+ */
+void CMMCore::stopHardwareSequence() throw (CMMError)
+{
+   {
+      MMThreadGuard g(hardwareSequenceLock_);
+      hardwareSequenceStopRequested_ = true;
+   }
+   stopSequenceAcquisition();
+}
+
+std::vector<mm::SequenceAxis> CMMCore::buildSequenceAxes(
+      const std::vector<double>& zPositionsUm,
+      const std::vector<double>& xPositionsUm,
+      const std::vector<double>& yPositionsUm,
+      const char* channelGroup,
+      const std::vector<std::string>& channelPresets,
+      const std::vector<double>& exposuresMs,
+      size_t& frameCount) throw (CMMError)
+{
+   const size_t lengths[] = { zPositionsUm.size(), xPositionsUm.size(),
+      yPositionsUm.size(), channelPresets.size(), exposuresMs.size() };
+   frameCount = 0;
+   for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+   {
+      if (lengths[i] == 0)
+         continue;
+      if (frameCount > 0 && lengths[i] != frameCount)
+      {
+         throw CMMError(getCoreErrorText(MMERR_InvalidSequencePlan) +
+               " The per-frame lists have different lengths.",
+               MMERR_InvalidSequencePlan);
+      }
+      frameCount = lengths[i];
+   }
+   if (frameCount == 0)
+   {
+      throw CMMError(getCoreErrorText(MMERR_InvalidSequencePlan) +
+            " No frames given.", MMERR_InvalidSequencePlan);
+   }
+   if (xPositionsUm.size() != yPositionsUm.size())
+   {
+      throw CMMError(getCoreErrorText(MMERR_InvalidSequencePlan) +
+            " X and Y positions must be given together.",
+            MMERR_InvalidSequencePlan);
+   }
+
+   std::vector<mm::SequenceAxis> axes;
+
+   if (!zPositionsUm.empty())
+   {
+      mm::SequenceAxis axis;
+      axis.kind = mm::SequenceAxis::FocusPosition;
+      axis.device = getFocusDevice();
+      if (axis.device.empty())
+      {
+         throw CMMError(getCoreErrorText(MMERR_InvalidSequencePlan) +
+               " Focus positions given but no focus device is set.",
+               MMERR_InvalidSequencePlan);
+      }
+      axis.numbers = zPositionsUm;
+      axis.sequenceable = isStageSequenceable(axis.device.c_str());
+      axis.maxSequenceLength = axis.sequenceable ?
+         getStageSequenceMaxLength(axis.device.c_str()) : 0;
+      axes.push_back(axis);
+   }
+
+   if (!xPositionsUm.empty())
+   {
+      mm::SequenceAxis axis;
+      axis.kind = mm::SequenceAxis::XYPosition;
+      axis.device = getXYStageDevice();
+      if (axis.device.empty())
+      {
+         throw CMMError(getCoreErrorText(MMERR_InvalidSequencePlan) +
+               " XY positions given but no XY stage device is set.",
+               MMERR_InvalidSequencePlan);
+      }
+      axis.numbers = xPositionsUm;
+      axis.yNumbers = yPositionsUm;
+      axis.sequenceable = isXYStageSequenceable(axis.device.c_str());
+      axis.maxSequenceLength = axis.sequenceable ?
+         getXYStageSequenceMaxLength(axis.device.c_str()) : 0;
+      axes.push_back(axis);
+   }
+
+   if (!channelPresets.empty())
+   {
+      // Look up each preset once
+      std::map<std::string, Configuration> presets;
+      for (std::vector<std::string>::const_iterator it = channelPresets.begin(),
+            end = channelPresets.end(); it != end; ++it)
+      {
+         if (presets.find(*it) == presets.end())
+            presets[*it] = getConfigData(channelGroup, it->c_str());
+      }
+
+      // One axis per property that appears in any of the presets, in order
+      // of first appearance
+      std::vector< std::pair<std::string, std::string> > keys;
+      std::set< std::pair<std::string, std::string> > seen;
+      for (std::vector<std::string>::const_iterator it = channelPresets.begin(),
+            end = channelPresets.end(); it != end; ++it)
+      {
+         const Configuration& preset = presets[*it];
+         for (size_t i = 0; i < preset.size(); ++i)
+         {
+            PropertySetting setting = preset.getSetting(i);
+            std::pair<std::string, std::string> key(setting.getDeviceLabel(),
+                  setting.getPropertyName());
+            if (seen.insert(key).second)
+               keys.push_back(key);
+         }
+      }
+
+      for (size_t k = 0; k < keys.size(); ++k)
+      {
+         const char* device = keys[k].first.c_str();
+         const char* property = keys[k].second.c_str();
+
+         mm::SequenceAxis axis;
+         axis.kind = mm::SequenceAxis::DeviceProperty;
+         axis.device = keys[k].first;
+         axis.property = keys[k].second;
+         std::string value;
+         for (size_t f = 0; f < frameCount; ++f)
+         {
+            Configuration& preset = presets[channelPresets[f]];
+            if (preset.isPropertyIncluded(device, property))
+               value = preset.getSetting(device, property).getPropertyValue();
+            else if (f == 0)
+               value = getProperty(device, property);
+            axis.values.push_back(value);
+         }
+         axis.sequenceable = isPropertySequenceable(device, property);
+         axis.maxSequenceLength = axis.sequenceable ?
+            getPropertySequenceMaxLength(device, property) : 0;
+         axes.push_back(axis);
+      }
+   }
+
+   if (!exposuresMs.empty())
+   {
+      mm::SequenceAxis axis;
+      axis.kind = mm::SequenceAxis::Exposure;
+      axis.device = getCameraDevice();
+      axis.numbers = exposuresMs;
+      axis.sequenceable = isExposureSequenceable(axis.device.c_str());
+      axis.maxSequenceLength = axis.sequenceable ?
+         getExposureSequenceMaxLength(axis.device.c_str()) : 0;
+      axes.push_back(axis);
+   }
+
+   return axes;
+}
+
+void CMMCore::runHardwareSequence(const std::vector<mm::SequenceAxis>& axes,
+      const std::vector<mm::SequenceBurst>& bursts) throw (CMMError)
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+   {
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(),
+            MMERR_CameraNotAvailable);
+   }
+
+   // Whether each axis was set directly (rather than sequenced) for the
+   // previous burst
+   std::vector<bool> wasSet(axes.size(), false);
+
+   for (std::vector<mm::SequenceBurst>::const_iterator burst = bursts.begin(),
+         end = bursts.end(); burst != end; ++burst)
+   {
+      {
+         MMThreadGuard g(hardwareSequenceLock_);
+         if (hardwareSequenceStopRequested_)
+         {
+            LOG_INFO(coreLogger_) << "Hardware sequence stopped before frame " <<
+               burst->start;
+            return;
+         }
+      }
+
+      LOG_DEBUG(coreLogger_) << "Hardware sequence: setting up frames " <<
+         burst->start << " to " << (burst->start + burst->length - 1);
+
+      // Set what stays the same during the burst (skipping what is already
+      // set), load sequences for the rest
+      std::vector<size_t> sequenced;
+      std::set<std::string> changedDevices;
+      for (size_t i = 0; i < axes.size(); ++i)
+      {
+         if (mm::IsConstantDuring(axes[i], *burst))
+         {
+            bool unchanged = wasSet[i] &&
+               axes[i].IsSameValue(burst->start - 1, burst->start);
+            if (!unchanged)
+            {
+               setSequenceAxisValue(axes[i], burst->start);
+               changedDevices.insert(axes[i].device);
+            }
+            wasSet[i] = true;
+         }
+         else
+         {
+            loadSequenceAxis(axes[i], *burst);
+            sequenced.push_back(i);
+            wasSet[i] = false;
+         }
+      }
+      for (std::set<std::string>::const_iterator it = changedDevices.begin(),
+            end = changedDevices.end(); it != end; ++it)
+         waitForDevice(it->c_str());
+
+      // Sequenced devices must be ready for triggers before the camera starts
+      for (size_t i = 0; i < sequenced.size(); ++i)
+         setSequenceAxisRunning(axes[sequenced[i]], true);
+
+      bool stopped = false;
+      try
+      {
+         {
+            // Check again while holding the lock until the camera has
+            // started: stopHardwareSequence() either sets the flag before
+            // this check or stops the started acquisition after it
+            MMThreadGuard g(hardwareSequenceLock_);
+            stopped = hardwareSequenceStopRequested_;
+            if (!stopped)
+            {
+               mm::DeviceModuleLockGuard guard(camera);
+               int nRet = camera->StartSequenceAcquisition(
+                     static_cast<long>(burst->length), 0.0, true);
+               if (nRet != DEVICE_OK)
+                  throw CMMError(getDeviceErrorText(nRet, camera).c_str(),
+                        MMERR_DEVICE_GENERIC);
+            }
+         }
+         // Poll at a short interval so that the next burst follows promptly
+         while (!stopped)
+         {
+            {
+               mm::DeviceModuleLockGuard guard(camera);
+               if (!camera->IsCapturing())
+                  break;
+            }
+            CDeviceUtils::SleepMs(1);
+         }
+      }
+      catch (const CMMError&)
+      {
+         for (size_t i = 0; i < sequenced.size(); ++i)
+         {
+            try
+            {
+               setSequenceAxisRunning(axes[sequenced[i]], false);
+            }
+            catch (const CMMError&)
+            {
+            }
+         }
+         throw;
+      }
+
+      for (size_t i = 0; i < sequenced.size(); ++i)
+         setSequenceAxisRunning(axes[sequenced[i]], false);
+
+      if (stopped)
+      {
+         LOG_INFO(coreLogger_) << "Hardware sequence stopped before frame " <<
+            burst->start;
+         return;
+      }
+
+      if (cbuf_->Overflow())
+      {
+         throw CMMError("Circular buffer overflowed during hardware sequence "
+               "(at frame " + ToString(burst->start + burst->length) + ")");
+      }
+   }
+   LOG_INFO(coreLogger_) << "Hardware sequence finished";
+}
+
+void CMMCore::setSequenceAxisValue(const mm::SequenceAxis& axis, size_t frame) throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case mm::SequenceAxis::FocusPosition:
+         setPosition(device, axis.numbers[frame]);
+         break;
+      case mm::SequenceAxis::XYPosition:
+         setXYPosition(device, axis.numbers[frame], axis.yNumbers[frame]);
+         break;
+      case mm::SequenceAxis::DeviceProperty:
+         setProperty(device, axis.property.c_str(), axis.values[frame].c_str());
+         break;
+      case mm::SequenceAxis::Exposure:
+         setExposure(device, axis.numbers[frame]);
+         break;
+   }
+}
+
+void CMMCore::loadSequenceAxis(const mm::SequenceAxis& axis,
+      const mm::SequenceBurst& burst) throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   const size_t first = burst.start;
+   const size_t last = burst.start + burst.length;
+   switch (axis.kind)
+   {
+      case mm::SequenceAxis::FocusPosition:
+         loadStageSequence(device, std::vector<double>(
+                  axis.numbers.begin() + first, axis.numbers.begin() + last));
+         break;
+      case mm::SequenceAxis::XYPosition:
+         loadXYStageSequence(device,
+               std::vector<double>(axis.numbers.begin() + first,
+                  axis.numbers.begin() + last),
+               std::vector<double>(axis.yNumbers.begin() + first,
+                  axis.yNumbers.begin() + last));
+         break;
+      case mm::SequenceAxis::DeviceProperty:
+         loadPropertySequence(device, axis.property.c_str(),
+               std::vector<std::string>(axis.values.begin() + first,
+                  axis.values.begin() + last));
+         break;
+      case mm::SequenceAxis::Exposure:
+         loadExposureSequence(device, std::vector<double>(
+                  axis.numbers.begin() + first, axis.numbers.begin() + last));
+         break;
+   }
+}
+
+void CMMCore::setSequenceAxisRunning(const mm::SequenceAxis& axis, bool start) throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case mm::SequenceAxis::FocusPosition:
+         if (start)
+            startStageSequence(device);
+         else
+            stopStageSequence(device);
+         break;
+      case mm::SequenceAxis::XYPosition:
+         if (start)
+            startXYStageSequence(device);
+         else
+            stopXYStageSequence(device);
+         break;
+      case mm::SequenceAxis::DeviceProperty:
+         if (start)
+            startPropertySequence(device, axis.property.c_str());
+         else
+            stopPropertySequence(device, axis.property.c_str());
+         break;
+      case mm::SequenceAxis::Exposure:
+         if (start)
+            startExposureSequence(device);
+         else
+            stopExposureSequence(device);
+         break;
+   }
+}
+
+
+/**
+ * Queries stage if it can be used in a sequence
+ * @param label   the stage device label
+ * @return   true if the stage can be sequenced
+ */
+bool CMMCore::isStageSequenceable(const char* label) throw (CMMError)
+{
+   boost::shared_ptr<StageInstance> pStage =
+      deviceManager_->GetDeviceOfType<StageInstance>(label);
+
+   mm::DeviceModuleLockGuard guard(pStage);
+
+   bool isSequenceable;
+   int ret = pStage->IsStageSequenceable(isSequenceable);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
+
+   return isSequenceable;
+}
+
+/**
+ * Queries if the stage can be used in a linear sequence
+ * A linear sequence is defined by a stepsize and number of slices
+ * @param label   the stage device label
+ * @return   true if the stage supports linear sequences
+ */
+bool CMMCore::isStageLinearSequenceable(const char* label) throw (CMMError)
+{
+   boost::shared_ptr<StageInstance> pStage =
+      deviceManager_->GetDeviceOfType<StageInstance>(label);
+
+   mm::DeviceModuleLockGuard guard(pStage);
+
+   bool isSequenceable;
+   int ret = pStage->IsStageLinearSequenceable(isSequenceable);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
+
+   return isSequenceable;
+}
+
+/**
  * Starts an ongoing sequence of triggered events in a stage
  * This should only be called for stages
  * @param label    the stage device label
@@ -2499,10 +3433,7 @@ void CMMCore::setAutoShutter(bool state)
 {
    properties_->Set(MM::g_Keyword_CoreAutoShutter, state ? "1" : "0");
    autoShutter_ = state;
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
    LOG_DEBUG(coreLogger_) << "Autoshutter turned " << (state ? "on" : "off");
 }
 
@@ -2534,10 +3465,7 @@ void CMMCore::setShutterOpen(const char* shutterLabel, bool state) throw (CMMErr
 
       if (pShutter->HasProperty(MM::g_Keyword_State))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-         }
+         stateCache_->Set(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
       }
    }
 }
@@ -2639,9 +3567,11 @@ void* CMMCore::getImage() throw (CMMError)
 
          boost::shared_ptr<ImageProcessorInstance> imageProcessor =
             currentImageProcessor_.lock();
-         if (imageProcessor)
+         if (imageProcessor && pBuf)
 	      {
-            imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            pBuf = processSnappedImage(imageProcessor, pBuf, 0,
+                  camera->GetImageWidth(), camera->GetImageHeight(),
+                  camera->GetImageBytesPerPixel());
 	      }
 		} catch( CMMError& e){
 			throw e;
@@ -2686,9 +3616,11 @@ void* CMMCore::getImage(unsigned channelNr) throw (CMMError)
 
          boost::shared_ptr<ImageProcessorInstance> imageProcessor =
             currentImageProcessor_.lock();
-         if (imageProcessor)
+         if (imageProcessor && pBuf)
 	      {
-            imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
+            pBuf = processSnappedImage(imageProcessor, pBuf, channelNr,
+                  camera->GetImageWidth(), camera->GetImageHeight(),
+                  camera->GetImageBytesPerPixel());
 	      }
 		} catch( CMMError& e){
 			throw e;
@@ -2708,7 +3640,8 @@ void* CMMCore::getImage(unsigned channelNr) throw (CMMError)
 }
 
 /**
-* Returns the size of the internal image buffer.
+* Returns the size of the internal image buffer (of the processed image, if
+* the current image processor changes the image shape).
 *
 * @return buffer size
 */
@@ -2717,6 +3650,11 @@ long CMMCore::getImageBufferSize()
    boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera) {
       mm::DeviceModuleLockGuard guard(camera);
+      unsigned width = camera->GetImageWidth();
+      unsigned height = camera->GetImageHeight();
+      unsigned depth = camera->GetImageBytesPerPixel();
+      if (getProcessedImageShape(width, height, depth))
+         return (long)width * height * depth;
       return camera->GetImageBufferSize();
    }
    else
@@ -2753,7 +3691,7 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 
 		try
 		{
-			if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+			if (!initializeCircularBufferFor(camera))
 			{
 				logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
 				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
@@ -2841,7 +3779,7 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
    if (camera)
    {
       mm::DeviceModuleLockGuard guard(camera);
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+      if (!initializeCircularBufferFor(camera))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
          throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
@@ -2893,7 +3831,7 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
             ,MMERR_NotAllowedDuringSequenceAcquisition);
       }
 
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+      if (!initializeCircularBufferFor(camera))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
          throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
@@ -2990,9 +3928,9 @@ void* CMMCore::getLastImage() throw (CMMError)
       }
    }
 
-   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetTopImage());
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBuffer(0);
    if (pBuf != 0)
-      return pBuf;
+      return fullFramePixels(pBuf, 0);
    else
    {
       logError("CMMCore::getLastImage", getCoreErrorText(MMERR_CircularBufferEmpty).c_str());
@@ -3010,7 +3948,7 @@ void* CMMCore::getLastImageMD(unsigned channel, unsigned slice, Metadata& md) co
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return fullFramePixels(pBuf, channel);
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3051,7 +3989,7 @@ void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return fullFramePixels(pBuf, 0);
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3071,9 +4009,9 @@ void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw
  */
 void* CMMCore::popNextImage() throw (CMMError)
 {
-   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetNextImage());
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(0);
    if (pBuf != 0)
-      return pBuf;
+      return fullFramePixels(pBuf, 0);
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
 }
@@ -3093,7 +4031,7 @@ void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) th
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return fullFramePixels(pBuf, channel);
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3108,86 +4046,359 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
 }
 
 /**
- * Removes all images from the circular buffer.
+ * Acquires a handle to the image that was last inserted into the circular
+ * buffer, without copying it.
  *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * Unlike the pointer returned by getLastImageMD(), the image behind a handle
+ * is never overwritten: while the handle is held, the buffer either moves
+ * the image out of its way or waits for it (see
+ * setImageHandleWaitTimeoutMs()). Access the image with
+ * getImageHandlePixels() or getImageHandlePixelsMD(), and release the handle
+ * with releaseImageHandle() as soon as you are done with it.
+ *
+ * @return a positive handle
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+long CMMCore::acquireLastImageHandle() throw (CMMError)
 {
-   cbuf_->Clear();
+   return acquireLastImageHandle(0);
 }
 
 /**
- * Reserve memory for the circular buffer.
+ * Acquires a handle to the given camera channel of the image that was last
+ * inserted into the circular buffer.
+ *
+ * @see acquireLastImageHandle()
  */
-void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
-                                               ) throw (CMMError)
+long CMMCore::acquireLastImageHandle(unsigned channel) throw (CMMError)
 {
-   delete cbuf_; // discard old buffer
-   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
-      sizeMB << " MB";
-	try
-	{
-		cbuf_ = new CircularBuffer(sizeMB);
-	}
-	catch(bad_alloc& ex)
-	{
-      // This is an out-of-memory error before even allocating the buffers.
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
-
-
-	try
-	{
-
-		// attempt to initialize based on the current camera settings
-      boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
-      if (camera)
-		{
-         mm::DeviceModuleLockGuard guard(camera);
-         if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-		}
-
-      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
-         sizeMB << " MB";
-	}
-	catch(bad_alloc& ex)
-	{
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_)
-      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+   long handle = cbuf_->PinTopImage(channel);
+   if (handle == 0)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return handle;
 }
 
 /**
- * Returns the size of the Circular Buffer in MB
+ * Removes the next image from the circular buffer, like popNextImageMD(),
+ * and returns a handle to it instead of a pointer. The image stays valid
+ * (and is not copied) until the handle is released with
+ * releaseImageHandle().
+ *
+ * @see acquireLastImageHandle()
+ * @return a positive handle
  */
-unsigned CMMCore::getCircularBufferMemoryFootprint()
+long CMMCore::acquireNextImageHandle() throw (CMMError)
 {
-   if (cbuf_)
-   {
-      return cbuf_->GetMemorySizeMB();
-   }
-   return 0;
+   return acquireNextImageHandle(0);
 }
 
 /**
- * Returns number ofimages available in the Circular Buffer
+ * Removes the next image from the circular buffer and returns a handle to
+ * the given camera channel of it.
+ *
+ * @see acquireNextImageHandle()
  */
-long CMMCore::getRemainingImageCount()
+long CMMCore::acquireNextImageHandle(unsigned channel) throw (CMMError)
 {
-   if (cbuf_)
-   {
-      return cbuf_->GetRemainingImageCount();
-   }
-   return 0;
+   long handle = cbuf_->PinNextImage(channel);
+   if (handle == 0)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   return handle;
+}
+
+/**
+ * Returns a pointer to the pixels of the image behind a handle. The pointer
+ * is valid until the handle is released.
+ *
+ * Packed multi-ROI images are unpacked into a full frame (a copy); use
+ * getImageHandleROIPixels() to access their ROIs without copying.
+ *
+ * @param handle a handle from acquireLastImageHandle() or
+ * acquireNextImageHandle()
+ */
+void* CMMCore::getImageHandlePixels(long handle) throw (CMMError)
+{
+   Metadata md;
+   return getImageHandlePixelsMD(handle, md);
+}
+
+/**
+ * Returns a pointer to the pixels of the image behind a handle, and provides
+ * the image metadata.
+ *
+ * @see getImageHandlePixels()
+ */
+void* CMMCore::getImageHandlePixelsMD(long handle, Metadata& md) throw (CMMError)
+{
+   const mm::ImgBuffer* img = cbuf_->GetPinnedImage(handle);
+   if (!img)
+      throw CMMError(getCoreErrorText(MMERR_InvalidImageHandle).c_str(), MMERR_InvalidImageHandle);
+   md = img->GetMetadata();
+
+   boost::shared_ptr<const mm::MultiROILayout> layout = packedLayoutOf(img);
+   if (!layout)
+      return const_cast<unsigned char*>(img->GetPixels());
+
+   // Unpack once per handle, so that the pointer stays valid until release
+   MMThreadGuard guard(unpackedHandleImagesLock_);
+   std::vector<unsigned char>& frame = unpackedHandleImages_[handle];
+   if (frame.empty())
+   {
+      frame.resize((size_t)layout->GetFrameWidth() *
+            layout->GetFrameHeight() * img->Depth());
+      layout->Unpack(&frame[0], img->GetPixels(), img->Depth());
+   }
+   return &frame[0];
+}
+
+/**
+ * Releases an image handle, allowing the buffer to reuse the image memory.
+ * Pointers obtained through the handle must not be used afterwards.
+ */
+void CMMCore::releaseImageHandle(long handle) throw (CMMError)
+{
+   if (!cbuf_->Unpin(handle))
+      throw CMMError(getCoreErrorText(MMERR_InvalidImageHandle).c_str(), MMERR_InvalidImageHandle);
+   MMThreadGuard guard(unpackedHandleImagesLock_);
+   unpackedHandleImages_.erase(handle);
+}
+
+/**
+ * Returns the number of image handles that have not been released.
+ */
+long CMMCore::getImageHandleCount()
+{
+   return cbuf_->GetPinnedImageCount();
+}
+
+/**
+ * Sets what happens when a camera inserts an image into a circular buffer
+ * slot whose image is held through a handle.
+ *
+ * With a timeout of 0 (the default), the held image is moved out of the
+ * buffer and the slot gets new memory, so acquisition is never slowed down
+ * (but memory use grows by one image per handle held across a full buffer
+ * cycle). With a positive timeout, the camera waits up to that long for the
+ * handle to be released, and the buffer overflows if it is not; this bounds
+ * memory use and makes slow readers throttle the acquisition.
+ *
+ * @param timeoutMs the maximum wait in milliseconds, or 0 to never wait
+ */
+void CMMCore::setImageHandleWaitTimeoutMs(long timeoutMs)
+{
+   cbuf_->SetPinWaitTimeoutMs(timeoutMs);
+   LOG_DEBUG(coreLogger_) << "Did set image handle wait timeout to " <<
+      cbuf_->GetPinWaitTimeoutMs() << " ms";
+}
+
+/**
+ * Returns the time a camera waits for a held image slot.
+ *
+ * @see setImageHandleWaitTimeoutMs()
+ */
+long CMMCore::getImageHandleWaitTimeoutMs()
+{
+   return cbuf_->GetPinWaitTimeoutMs();
+}
+
+/**
+ * Enables or disables packed storage of multi-ROI images in the circular
+ * buffer.
+ *
+ * When enabled and the camera has multiple ROIs set (see setMultiROI()),
+ * the buffer stores only the pixels of the ROIs, back to back, instead of
+ * the padded frame the camera delivers, so that it holds more images. The
+ * setting takes effect the next time the buffer is initialized (e.g. when
+ * a sequence acquisition starts).
+ *
+ * The full-frame accessors (getLastImage(), popNextImage() and their
+ * variants) keep working: they rebuild the frame, with zeros outside the
+ * ROIs, in a buffer that is reused by the next call from the same thread
+ * for the same camera channel. Use image handles and
+ * getImageHandleROIPixels() to read the ROIs without copying.
+ */
+void CMMCore::enableMultiROIPacking(bool enable)
+{
+   multiROIPacking_ = enable;
+   LOG_DEBUG(coreLogger_) << "Multi-ROI packing " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether packed storage of multi-ROI images is enabled.
+ *
+ * @see enableMultiROIPacking()
+ */
+bool CMMCore::isMultiROIPackingEnabled()
+{
+   return multiROIPacking_;
+}
+
+/**
+ * Returns whether the circular buffer currently stores packed multi-ROI
+ * images. This is the case after the buffer was initialized with packing
+ * enabled for a camera with multiple ROIs that match its image.
+ *
+ * @see enableMultiROIPacking()
+ */
+bool CMMCore::isBufferMultiROIPacked()
+{
+   return cbuf_->GetMultiROILayout().get() != 0;
+}
+
+/**
+ * Returns the ROIs of the packed images in the circular buffer, in the
+ * order they are stored. The vectors are empty if the buffer does not hold
+ * packed images.
+ */
+void CMMCore::getBufferMultiROI(std::vector<unsigned>& xs,
+      std::vector<unsigned>& ys, std::vector<unsigned>& widths,
+      std::vector<unsigned>& heights)
+{
+   xs.clear();
+   ys.clear();
+   widths.clear();
+   heights.clear();
+   boost::shared_ptr<const mm::MultiROILayout> layout =
+      cbuf_->GetMultiROILayout();
+   if (!layout)
+      return;
+   for (size_t i = 0; i < layout->GetROICount(); ++i)
+   {
+      xs.push_back(layout->GetX(i));
+      ys.push_back(layout->GetY(i));
+      widths.push_back(layout->GetWidth(i));
+      heights.push_back(layout->GetHeight(i));
+   }
+}
+
+/**
+ * Returns a pointer to the pixels of one ROI of a packed multi-ROI image,
+ * without copying. The ROI's rows follow each other without padding (its
+ * size is given by getBufferMultiROI()). The pointer is valid until the
+ * handle is released.
+ *
+ * @param handle a handle from acquireLastImageHandle() or
+ * acquireNextImageHandle()
+ * @param roiIndex index of the ROI, in the order of getBufferMultiROI()
+ */
+void* CMMCore::getImageHandleROIPixels(long handle, unsigned roiIndex) throw (CMMError)
+{
+   const mm::ImgBuffer* img = cbuf_->GetPinnedImage(handle);
+   if (!img)
+      throw CMMError(getCoreErrorText(MMERR_InvalidImageHandle).c_str(), MMERR_InvalidImageHandle);
+   boost::shared_ptr<const mm::MultiROILayout> layout = packedLayoutOf(img);
+   if (!layout)
+      throw CMMError(getCoreErrorText(MMERR_ImageNotMultiROIPacked).c_str(), MMERR_ImageNotMultiROIPacked);
+   if (roiIndex >= layout->GetROICount())
+      throw CMMError(getCoreErrorText(MMERR_InvalidMultiROIIndex).c_str(), MMERR_InvalidMultiROIIndex);
+   return const_cast<unsigned char*>(img->GetPixels()) +
+      layout->GetPackedOffset(roiIndex) * img->Depth();
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
+}
+
+/**
+ * Reserve memory for the circular buffer.
+ */
+void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
+                                               ) throw (CMMError)
+{
+   // Pinned images live in the buffer's memory
+   if (cbuf_ && cbuf_->GetPinnedImageCount() > 0)
+      throw CMMError("Cannot reallocate the circular buffer while image handles are held");
+
+   // The spill tier (if any) and the image handle policy are carried over
+   // to the new buffer
+   std::string spillPath;
+   unsigned spillSizeMB = 0;
+   long pinWaitTimeoutMs = 0;
+   if (cbuf_ && cbuf_->IsSpillEnabled())
+   {
+      spillPath = cbuf_->GetSpillPath();
+      spillSizeMB = cbuf_->GetSpillSizeMB();
+   }
+   if (cbuf_)
+      pinWaitTimeoutMs = cbuf_->GetPinWaitTimeoutMs();
+
+   delete cbuf_; // discard old buffer
+   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
+      sizeMB << " MB";
+	try
+	{
+		cbuf_ = new CircularBuffer(sizeMB);
+	}
+	catch(bad_alloc& ex)
+	{
+      // This is an out-of-memory error before even allocating the buffers.
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+
+   cbuf_->SetPinWaitTimeoutMs(pinWaitTimeoutMs);
+   if (spillSizeMB > 0)
+      cbuf_->EnableSpill(spillPath, spillSizeMB);
+   if (streamWriter_ && streamWriter_->IsActive())
+      cbuf_->SetStreamWriter(streamWriter_);
+   cbuf_->SetFrameTracer(frameTracer_);
+
+	try
+	{
+
+		// attempt to initialize based on the current camera settings
+      boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+      if (camera)
+		{
+         mm::DeviceModuleLockGuard guard(camera);
+         if (!initializeCircularBufferFor(camera))
+				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+		}
+
+      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
+         sizeMB << " MB";
+	}
+	catch(bad_alloc& ex)
+	{
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_)
+      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+}
+
+/**
+ * Returns the size of the Circular Buffer in MB
+ */
+unsigned CMMCore::getCircularBufferMemoryFootprint()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetMemorySizeMB();
+   }
+   return 0;
+}
+
+/**
+ * Returns number ofimages available in the Circular Buffer
+ */
+long CMMCore::getRemainingImageCount()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetRemainingImageCount();
+   }
+   return 0;
 }
 
 /**
@@ -3224,6 +4435,200 @@ bool CMMCore::isBufferOverflowed() const
    return cbuf_->Overflow();
 }
 
+/**
+ * Enables spilling of sequence images to disk when the circular buffer is full.
+ *
+ * When the consumer falls behind and the in-memory buffer fills up, further
+ * images are written to a preallocated, memory-mapped file instead of being
+ * dropped. Spilled images are read back transparently (and in order) by
+ * popNextImage() and related methods as space becomes available in memory.
+ * The buffer only overflows when the spill file is also full.
+ *
+ * For best results, place the spill file on a fast local volume (NVMe). The
+ * file is created (or truncated) immediately, and deleted when spilling is
+ * disabled or the Core is destroyed.
+ *
+ * Cannot be called during a sequence acquisition.
+ *
+ * @param path the spill file to create
+ * @param sizeMB size of the spill file in megabytes
+ */
+void CMMCore::enableBufferSpill(const char* path, unsigned sizeMB) throw (CMMError)
+{
+   if (!path)
+      throw CMMError(getCoreErrorText(MMERR_NullPointerException).c_str(),
+            MMERR_NullPointerException);
+   if (isSequenceRunning())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   LOG_DEBUG(coreLogger_) << "Will enable buffer spill file " << path <<
+      " (" << sizeMB << " MB)";
+   cbuf_->EnableSpill(path, sizeMB);
+   LOG_INFO(coreLogger_) << "Did enable buffer spill file " << path <<
+      " (" << sizeMB << " MB, " << cbuf_->GetSpillCapacity() << " images)";
+}
+
+/**
+ * Disables spilling of sequence images to disk and deletes the spill file.
+ * Any images remaining in the spill file are discarded.
+ *
+ * Cannot be called during a sequence acquisition.
+ */
+void CMMCore::disableBufferSpill() throw (CMMError)
+{
+   if (!cbuf_->IsSpillEnabled())
+      return;
+   if (isSequenceRunning())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   LOG_INFO(coreLogger_) << "Disabling buffer spill file; spill rate " <<
+      cbuf_->GetSpillWriteMBPerSec() << " MB/s, read-back rate " <<
+      cbuf_->GetSpillReadMBPerSec() << " MB/s";
+   cbuf_->DisableSpill();
+}
+
+/**
+ * Returns true if sequence images can spill to disk.
+ */
+bool CMMCore::isBufferSpillEnabled()
+{
+   return cbuf_->IsSpillEnabled();
+}
+
+/**
+ * Returns the number of images that fit in the spill file at the current
+ * image size (0 if spilling is disabled).
+ */
+long CMMCore::getBufferSpillCapacity()
+{
+   return cbuf_->GetSpillCapacity();
+}
+
+/**
+ * Returns the number of images currently held in the spill file. These are
+ * included in getRemainingImageCount().
+ */
+long CMMCore::getBufferSpilledImageCount()
+{
+   return cbuf_->GetSpilledImageCount();
+}
+
+/**
+ * Returns the average throughput, in MB/s, of writing images to the spill
+ * file since spilling was enabled.
+ */
+double CMMCore::getBufferSpillWriteMBPerSec()
+{
+   return cbuf_->GetSpillWriteMBPerSec();
+}
+
+/**
+ * Returns the average throughput, in MB/s, of reading spilled images back
+ * into memory since spilling was enabled.
+ */
+double CMMCore::getBufferSpillReadMBPerSec()
+{
+   return cbuf_->GetSpillReadMBPerSec();
+}
+
+/**
+ * Starts writing every image inserted into the circular buffer to disk.
+ *
+ * Images from any camera are written, as they are inserted, into raw files
+ * named <prefix>_NNNN.raw in the given directory (created if necessary). Each
+ * raw file has a JSON-lines index, <prefix>_NNNN.index.jsonl, giving the byte
+ * offset, dimensions and serialized metadata of each image. A new file is
+ * started when the next image would exceed maxFileSizeMB. When streaming is
+ * stopped, a summary is written to <prefix>_summary.json.
+ *
+ * Writes bypass the OS cache and are performed by background threads, so the
+ * insert path only pays for a memory copy. If the disk cannot keep up and the
+ * write buffers fill, images are dropped from the stream (but still inserted
+ * into the circular buffer); see getStreamToDiskDroppedImageCount().
+ *
+ * Images are written regardless of whether they are later retrieved from the
+ * circular buffer. For streaming without a consumer, start the sequence
+ * acquisition with stopOnOverflow set to false.
+ *
+ * @param directory the directory to write to
+ * @param prefix the file name prefix ("stream" if empty)
+ * @param maxFileSizeMB the maximum size of each raw file
+ */
+void CMMCore::startStreamToDisk(const char* directory, const char* prefix,
+      unsigned maxFileSizeMB) throw (CMMError)
+{
+   if (!directory || !prefix)
+      throw CMMError(getCoreErrorText(MMERR_NullPointerException).c_str(),
+            MMERR_NullPointerException);
+
+   stopStreamToDisk();
+
+   LOG_DEBUG(coreLogger_) << "Will start streaming to disk in " << directory;
+   streamWriter_ = boost::make_shared<mm::DiskStreamWriter>(directory, prefix,
+         maxFileSizeMB);
+   cbuf_->SetStreamWriter(streamWriter_);
+   LOG_INFO(coreLogger_) << "Did start streaming to disk in " << directory;
+}
+
+/**
+ * Stops writing images to disk, waiting for pending writes to complete.
+ * The image counts and throughput remain available until streaming is
+ * started again.
+ */
+void CMMCore::stopStreamToDisk() throw (CMMError)
+{
+   if (!streamWriter_)
+      return;
+
+   cbuf_->SetStreamWriter(boost::shared_ptr<mm::DiskStreamWriter>());
+   if (!streamWriter_->Stop())
+      return;
+
+   LOG_INFO(coreLogger_) << "Stopped streaming to disk: " <<
+      streamWriter_->GetImageCount() << " images, " <<
+      streamWriter_->GetDroppedImageCount() << " dropped, " <<
+      streamWriter_->GetMBPerSec() << " MB/s";
+   std::string error = streamWriter_->GetLastError();
+   if (!error.empty())
+      throw CMMError("Streaming to disk failed: " + error);
+}
+
+/**
+ * Returns true if images are being written to disk.
+ */
+bool CMMCore::isStreamingToDisk()
+{
+   return streamWriter_ && streamWriter_->IsActive();
+}
+
+/**
+ * Returns the number of images written (or queued to be written) to disk
+ * since streaming was started.
+ */
+long CMMCore::getStreamToDiskImageCount()
+{
+   return streamWriter_ ? (long)streamWriter_->GetImageCount() : 0;
+}
+
+/**
+ * Returns the number of images that could not be written to disk because
+ * the disk did not keep up.
+ */
+long CMMCore::getStreamToDiskDroppedImageCount()
+{
+   return streamWriter_ ? (long)streamWriter_->GetDroppedImageCount() : 0;
+}
+
+/**
+ * Returns the average write throughput, in MB/s, since streaming was started.
+ */
+double CMMCore::getStreamToDiskMBPerSec()
+{
+   return streamWriter_ ? streamWriter_->GetMBPerSec() : 0.0;
+}
+
 /**
  * Returns the label of the currently selected camera device.
  * @return camera name
@@ -3311,10 +4716,7 @@ void CMMCore::setAutoFocusDevice(const char* autofocusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newAutofocusLabel = getAutoFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
 }
 
 /**
@@ -3378,10 +4780,7 @@ void CMMCore::setImageProcessorDevice(const char* procLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newProcLabel = getImageProcessorDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
 }
 
 /**
@@ -3402,10 +4801,7 @@ void CMMCore::setSLMDevice(const char* slmLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newSLMLabel = getSLMDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
 }
 
 
@@ -3427,10 +4823,7 @@ void CMMCore::setGalvoDevice(const char* galvoLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newGalvoLabel = getGalvoDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
 }
 
 /**
@@ -3454,10 +4847,7 @@ void CMMCore::setChannelGroup(const char* chGroup) throw (CMMError)
    channelGroup_ = chGroup;
    LOG_INFO(coreLogger_) << "Channel group set to " << chGroup;
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
    if (externalCallback_ != 0) 
    {
       externalCallback_->onChannelGroupChanged(channelGroup_.c_str());
@@ -3516,10 +4906,7 @@ void CMMCore::setShutterDevice(const char* shutterLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newShutterLabel = getShutterDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
 }
 
 /**
@@ -3541,10 +4928,7 @@ void CMMCore::setFocusDevice(const char* focusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newFocusLabel = getFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
 }
 
 /**
@@ -3564,10 +4948,7 @@ void CMMCore::setXYStageDevice(const char* xyDeviceLabel) throw (CMMError)
       LOG_INFO(coreLogger_) << "Default xy stage unset";
    }
    std::string newXYStageLabel = getXYStageDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
 }
 
 /**
@@ -3603,10 +4984,7 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newCameraLabel = getCameraDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
 }
 
 /**
@@ -3705,12 +5083,8 @@ string CMMCore::getProperty(const char* label, const char* propName) throw (CMME
    std::string value = pDevice->GetProperty(propName);
 
    // use the opportunity to update the cache
-   // Note, stateCache is mutable so that we can update it from this const function
    PropertySetting s(label, propName, value.c_str());
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(s);
-   }
+   stateCache_->Set(s);
 
    return value;
 }
@@ -3729,15 +5103,12 @@ string CMMCore::getPropertyFromCache(const char* label, const char* propName) co
    CheckDeviceLabel(label);
    CheckPropertyName(propName);
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      if (!stateCache_.isPropertyIncluded(label, propName))
-         throw CMMError("Property " + ToQuotedString(propName) + " of device " +
-               ToQuotedString(label) + " not found in cache",
-               MMERR_PropertyNotInCache);
-      PropertySetting s = stateCache_.getSetting(label, propName);
-      return s.getPropertyValue();
-   }
+   PropertySetting s;
+   if (!stateCache_->Get(label, propName, s))
+      throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+            ToQuotedString(label) + " not found in cache",
+            MMERR_PropertyNotInCache);
+   return s.getPropertyValue();
 }
 
 /**
@@ -3760,10 +5131,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
          propName << " = " << propValue;
 
       properties_->Execute(propName, propValue);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
-      }
+      stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
 
       LOG_DEBUG(coreLogger_) << "Did set Core property: " <<
          propName << " = " << propValue;
@@ -3776,10 +5144,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
 
       pDevice->SetProperty(propName, propValue);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(label, propName, propValue));
-      }
+      stateCache_->Set(PropertySetting(label, propName, propValue));
    }
 }
 
@@ -4031,6 +5396,35 @@ void CMMCore::loadPropertySequence(const char* label, const char* propName, std:
    pDevice->SendPropertySequence(propName);
 }
 
+/**
+ * Transfer a sequence of numeric values to the sequence buffer of the given
+ * property.
+ *
+ * Same as the string version of loadPropertySequence(), but the values are
+ * passed to the device as an array of numbers in a single call, rather than
+ * being formatted and sent one at a time. This is much faster for long
+ * sequences (such as DAC voltages), especially with adapters that read the
+ * sequence with GetNumericSequence().
+ *
+ * @param label    the device label
+ * @param propName the property name
+ * @param eventSequence the sequence of values
+ */
+void CMMCore::loadPropertySequence(const char* label, const char* propName, std::vector<double> eventSequence) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      // XXX Should be a throw
+      return;
+   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   pDevice->SetPropertySequence(propName,
+         eventSequence.empty() ? 0 : &eventSequence[0],
+         static_cast<long>(eventSequence.size()));
+   pDevice->SendPropertySequence(propName);
+}
+
 /**
  * Returns the intrinsic property type.
  */
@@ -4049,6 +5443,9 @@ MM::PropertyType CMMCore::getPropertyType(const char* label, const char* propNam
 
 /**
  * Horizontal dimension of the image buffer in pixels.
+ * If the current image processor changes the image shape (e.g. binning or
+ * cropping), this and the other image dimensions describe the processed
+ * images, which are what getImage() and the circular buffer return.
  * @return   the width in pixels (an integer)
  */
 unsigned CMMCore::getImageWidth()
@@ -4060,7 +5457,11 @@ unsigned CMMCore::getImageWidth()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
-   return camera->GetImageWidth();
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned depth = camera->GetImageBytesPerPixel();
+   getProcessedImageShape(width, height, depth);
+   return width;
 }
 
 /**
@@ -4076,7 +5477,11 @@ unsigned CMMCore::getImageHeight()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
-   return camera->GetImageHeight();
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned depth = camera->GetImageBytesPerPixel();
+   getProcessedImageShape(width, height, depth);
+   return height;
 }
 
 /**
@@ -4093,7 +5498,11 @@ unsigned CMMCore::getBytesPerPixel()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
-   return camera->GetImageBytesPerPixel();
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned depth = camera->GetImageBytesPerPixel();
+   getProcessedImageShape(width, height, depth);
+   return depth;
 }
 
 /**
@@ -4112,7 +5521,14 @@ unsigned CMMCore::getImageBitDepth()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
-   return camera->GetBitDepth();
+   unsigned bitDepth = camera->GetBitDepth();
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned depth = camera->GetImageBytesPerPixel();
+   if (getProcessedImageShape(width, height, depth) &&
+         depth < camera->GetImageBytesPerPixel())
+      bitDepth = (std::min)(bitDepth, 8 * depth);
+   return bitDepth;
 }
 
 /**
@@ -4201,10 +5617,7 @@ void CMMCore::setExposure(const char* label, double dExp) throw (CMMError)
       pCamera->SetExposure(dExp);
       if (pCamera->HasProperty(MM::g_Keyword_Exposure))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
-         }
+         stateCache_->Set(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
       }
    }
 
@@ -4584,19 +5997,13 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
 
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
    }
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
       std::string posLbl = pStateDev->GetPositionLabel(state);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
    }
 
    LOG_DEBUG(coreLogger_) << "Did set " << deviceLabel << " to state " << state;
@@ -4655,19 +6062,13 @@ void CMMCore::setStateLabel(const char* deviceLabel, const char* stateLabel) thr
 
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
    }
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
       long state = getStateFromLabel(deviceLabel, stateLabel);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State,
-                  CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_State,
+               CDeviceUtils::ConvertToString(state)));
    }
 }
 
@@ -4879,13 +6280,7 @@ void CMMCore::defineConfig(const char* groupName, const char* configName) throw
  */
 void CMMCore::defineConfig(const char* groupName, const char* configName, const char* deviceLabel, const char* propName, const char* value) throw (CMMError)
 {
-   CheckConfigGroupName(groupName);
-   CheckConfigPresetName(configName);
-   CheckDeviceLabel(deviceLabel);
-   CheckPropertyName(propName);
-   CheckPropertyValue(value);
-
-   configGroups_->Define(groupName, configName, deviceLabel, propName, value);
+   addConfigSetting(groupName, configName, deviceLabel, propName, value);
 
    LOG_DEBUG(coreLogger_) << "Config group " << groupName <<
       ": preset " << configName << ": added setting " <<
@@ -4909,6 +6304,34 @@ void CMMCore::defineConfig(const char* groupName, const char* configName, const
  * @param value property value
 */
 void CMMCore::definePixelSizeConfig(const char* resolutionID, const char* deviceLabel, const char* propName, const char* value) throw (CMMError)
+{
+   addPixelSizeSetting(resolutionID, deviceLabel, propName, value);
+
+   LOG_DEBUG(coreLogger_) << "Pixel size config: "
+      "preset " << resolutionID << ": added setting : " <<
+      deviceLabel << "-" << propName << " = " << value;
+}
+
+/**
+ * Validates and adds a config preset setting, without logging it.
+ */
+void CMMCore::addConfigSetting(const char* groupName, const char* configName,
+      const char* deviceLabel, const char* propName, const char* value) throw (CMMError)
+{
+   CheckConfigGroupName(groupName);
+   CheckConfigPresetName(configName);
+   CheckDeviceLabel(deviceLabel);
+   CheckPropertyName(propName);
+   CheckPropertyValue(value);
+
+   configGroups_->Define(groupName, configName, deviceLabel, propName, value);
+}
+
+/**
+ * Validates and adds a pixel size preset setting, without logging it.
+ */
+void CMMCore::addPixelSizeSetting(const char* resolutionID,
+      const char* deviceLabel, const char* propName, const char* value) throw (CMMError)
 {
    CheckConfigPresetName(resolutionID);
    CheckDeviceLabel(deviceLabel);
@@ -4916,10 +6339,6 @@ void CMMCore::definePixelSizeConfig(const char* resolutionID, const char* device
    CheckPropertyValue(value);
 
    pixelSizeGroup_->Define(resolutionID, deviceLabel, propName, value);
-
-   LOG_DEBUG(coreLogger_) << "Pixel size config: "
-      "preset " << resolutionID << ": added setting : " <<
-      deviceLabel << "-" << propName << " = " << value;
 }
 
 /**
@@ -5357,8 +6776,7 @@ string CMMCore::getCurrentPixelSizeConfig(bool cached) throw (CMMError)
 				}
 				else
 				{
-               MMThreadGuard scg(stateCacheLock_);
-               value = stateCache_.getSetting(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str()).getPropertyValue();
+               value = getPropertyFromCache(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str());
 				}
                PropertySetting ss(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str(), value.c_str()); // state setting
                curState.addSetting(ss);
@@ -6640,8 +8058,11 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
  * Format specification:
  * Each line consists of a number of string fields separated by "," (comma) characters.
  * Lines beginning with "#" are ignored (can be used for comments).
- * Each line in the file will be parsed by the system and as a result a corresponding command
- * will be immediately executed.
+ * The whole file is parsed first, and an error is reported without changing
+ * anything if any line has the wrong number of fields. The commands are then
+ * executed in order. All device adapter modules named in the file are loaded
+ * up front, concurrently; pre-initialization properties that already have
+ * the requested value are not set again.
  * The first field in the line always specifies the command from the following set of values:
  *    Device - executes loadDevice()
  *    Label - executes defineStateLabel() command
@@ -6691,250 +8112,361 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
    if (!fileName)
       throw CMMError("Null filename");
 
-   ifstream is;
-   is.open(fileName, ios_base::in);
-   if (!is.is_open())
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+
+   std::vector<mm::ConfigCommand> commands;
    {
-      logError(fileName, getCoreErrorText(MMERR_FileOpenFailed).c_str());
-      throw CMMError(ToQuotedString(fileName) + ": " + getCoreErrorText(MMERR_FileOpenFailed),
-            MMERR_FileOpenFailed);
+      ifstream is;
+      is.open(fileName, ios_base::in | ios_base::binary);
+      if (!is.is_open())
+      {
+         logError(fileName, getCoreErrorText(MMERR_FileOpenFailed).c_str());
+         throw CMMError(ToQuotedString(fileName) + ": " + getCoreErrorText(MMERR_FileOpenFailed),
+               MMERR_FileOpenFailed);
+      }
+      commands = mm::ParseConfigFile(is);
    }
 
-   // Process commands
-   const int maxLineLength = 4 * MM::MaxStrLength + 4; // accommodate up to 4 strings and delimiters
-   char line[maxLineLength+1];
-   vector<string> tokens;
+   // Report malformed lines before anything is applied
+   std::vector<std::string> modules;
+   for (std::vector<mm::ConfigCommand>::const_iterator it = commands.begin(),
+         end = commands.end(); it != end; ++it)
+   {
+      if (it->type == mm::ConfigCommand::Invalid)
+      {
+         if (externalCallback_)
+            externalCallback_->onSystemConfigurationLoaded();
+         std::ostringstream errorText;
+         errorText << "Line " << it->lineNumber << ": " << it->line << endl;
+         errorText << getCoreErrorText(MMERR_InvalidCFGEntry) << " (" <<
+            ToQuotedString(it->line) << ")" << endl << endl;
+         throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+      }
+      if (it->type == mm::ConfigCommand::LoadDevice)
+         modules.push_back(it->args[1]);
+   }
 
-   int lineCount = 0;
+   LOG_DEBUG(coreLogger_) << "Parsed " << commands.size() <<
+      " configuration commands; will preload " << modules.size() <<
+      " device adapter modules";
+   pluginManager_->LoadDeviceAdapters(modules);
 
-   while(is.getline(line, maxLineLength, '\n'))
+   // Until the devices are initialized (by the Core-Initialize property), the
+   // properties being set are pre-initialization properties, whose current
+   // values are simply what was last set; setting an equal value is a no-op.
+   bool initialized = false;
+   size_t skippedProperties = 0;
+   for (size_t i = 0; i < commands.size(); )
    {
-      // strip a potential Windows/dos CR
-      istringstream il(line);
-      il.getline(line, maxLineLength, '\r');
-
-      lineCount++;
-      if (strlen(line) > 0)
+      try
       {
-         if (line[0] == '#')
+         const mm::ConfigCommand& command = commands[i];
+         if (command.IsPresetDefinition())
          {
-            // comment, so skip processing
+            applyPresetDefinitions(commands, i);
             continue;
          }
 
-         // parse tokens
-         tokens.clear();
-         CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
+         if (command.type == mm::ConfigCommand::SetProperty)
+         {
+            if (!initialized && isRedundantPreInitProperty(command))
+            {
+               ++skippedProperties;
+               ++i;
+               continue;
+            }
+            if (command.args[0] == MM::g_Keyword_CoreDevice &&
+                  command.args[1] == MM::g_Keyword_CoreInitialize)
+               initialized = true;
+         }
 
-         try
+         applyConfigCommand(command);
+         ++i;
+      }
+      catch (CMMError& err)
+      {
+         if (externalCallback_)
+            externalCallback_->onSystemConfigurationLoaded();
+         std::ostringstream errorText;
+         errorText << "Line " << commands[i].lineNumber << ": " << commands[i].line << endl;
+         errorText << err.getFullMsg() << endl << endl;
+         throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+      }
+   }
+
+   LOG_INFO(coreLogger_) << "Applied " << commands.size() <<
+      " configuration commands in " <<
+      (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds() <<
+      " ms (" << skippedProperties << " unchanged properties skipped)";
+
+   updateAllowedChannelGroups();
+
+   // file parsing finished, try to set startup configuration
+   if (isConfigDefined(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup))
+   {
+      // We need to build the system state cache once here because setConfig()
+      // can fail in certain cases otherwise.
+      waitForSystem();
+      updateSystemStateCache();
+
+      this->setConfig(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup);
+   }
+
+   waitForSystem();
+   updateSystemStateCache();
+
+   if (externalCallback_)
+   {
+      externalCallback_->onSystemConfigurationLoaded();
+   }
+}
+
+/**
+ * Executes a single (non-preset) command from a configuration file.
+ */
+void CMMCore::applyConfigCommand(const mm::ConfigCommand& command) throw (CMMError)
+{
+   const std::vector<std::string>& args = command.args;
+   switch (command.type)
+   {
+      case mm::ConfigCommand::LoadDevice:
+         loadDevice(args[0].c_str(), args[1].c_str(), args[2].c_str());
+         break;
+      case mm::ConfigCommand::SetProperty:
+         setProperty(args[0].c_str(), args[1].c_str(), args[2].c_str());
+         break;
+      case mm::ConfigCommand::SetDelay:
+         setDeviceDelayMs(args[0].c_str(), atof(args[1].c_str()));
+         break;
+      case mm::ConfigCommand::SetFocusDirection:
+         setFocusDirection(args[0].c_str(), atol(args[1].c_str()));
+         break;
+      case mm::ConfigCommand::DefineLabel:
+         defineStateLabel(args[0].c_str(), atol(args[1].c_str()), args[2].c_str());
+         break;
+      case mm::ConfigCommand::ObsoleteConfiguration:
+         LOG_WARNING(coreLogger_) << "Obsolete command " <<
+            MM::g_CFGCommand_Configuration << " ignored in configuration file";
+         break;
+      case mm::ConfigCommand::SetPixelSize:
+         setPixelSizeUm(args[0].c_str(), atof(args[1].c_str()));
+         break;
+      case mm::ConfigCommand::SetPixelSizeAffine:
          {
+            std::vector<double> affineT(6);
+            for (int i = 0; i < 6; i++)
+               affineT[i] = atof(args[i + 1].c_str());
+            setPixelSizeAffine(args[0].c_str(), affineT);
+         }
+         break;
+      case mm::ConfigCommand::DefinePropertyBlock:
+         definePropertyBlock(args[0].c_str(), args[1].c_str(), args[2].c_str());
+         break;
+      case mm::ConfigCommand::AssignImageSynchro:
+         assignImageSynchro(args[0].c_str());
+         break;
+      case mm::ConfigCommand::SetParent:
+         setParentLabel(args[0].c_str(), args[1].c_str());
+         break;
+      case mm::ConfigCommand::DefineConfigGroup:
+      case mm::ConfigCommand::DefineConfig:
+      case mm::ConfigCommand::DefinePixelSizeConfig:
+      case mm::ConfigCommand::Invalid:
+         assert(false);
+         break;
+   }
+}
 
-            // non-empty and non-comment lines mush have at least one token
-            if (tokens.size() < 1)
-               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
-                     MMERR_InvalidCFGEntry);
+/**
+ * Defines the consecutive config group and pixel size presets starting at
+ * commands[next], logging a summary rather than each setting. Advances next
+ * past the last preset definition, or leaves it at the failed command.
+ */
+void CMMCore::applyPresetDefinitions(const std::vector<mm::ConfigCommand>& commands,
+      size_t& next) throw (CMMError)
+{
+   size_t groups = 0, settings = 0, pixelSizeSettings = 0;
+   const size_t begin = next;
+   size_t& i = next;
+   for (; i < commands.size() && commands[i].IsPresetDefinition(); ++i)
+   {
+      const std::vector<std::string>& args = commands[i].args;
+      switch (commands[i].type)
+      {
+         case mm::ConfigCommand::DefineConfigGroup:
+            defineConfigGroup(args[0].c_str());
+            ++groups;
+            break;
+         case mm::ConfigCommand::DefineConfig:
+            addConfigSetting(args[0].c_str(), args[1].c_str(),
+                  args[2].c_str(), args[3].c_str(), args[4].c_str());
+            ++settings;
+            break;
+         case mm::ConfigCommand::DefinePixelSizeConfig:
+            addPixelSizeSetting(args[0].c_str(), args[1].c_str(),
+                  args[2].c_str(), args[3].c_str());
+            ++pixelSizeSettings;
+            break;
+         default:
+            assert(false);
+            break;
+      }
+   }
 
-            if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
-            {
-               // load device command
-               // -------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
-            {
-               // set property command
-               // --------------------
-               if (tokens.size() == 4)
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-               else if (tokens.size() == 3)
-                  // ...assuming here that the last missing toke represents an empty string
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
-            {
-               // set delay command
-               // -----------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
-            {
-               // set focus direction command
-               // ---------------------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
-            {
-               // define label command
-               // --------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 5)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
-                  " ignored in configuration file";
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
-            {
-               // define grouped configuration command
-               // ------------------------------------
-               if (tokens.size() == 6)
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
-               else if (tokens.size() == 5)
-               {
-                  // we will assume here that the last (missing) token is representing an empty string
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
-               }
-               else if (tokens.size() == 2)
-                  defineConfigGroup(tokens[1].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
-            {
-               // define pixel size configuration command
-               // ---------------------------------------
-               if (tokens.size() == 5)
-                  definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
-            {
-               // set pixel size
-               // --------------
-               if (tokens.size() == 3)
-                  setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
-            {
-               // set affine transform
-               // --------------
-               //
-               if (tokens.size() == 8)
-               {
-                  std::vector<double> *affineT = new std::vector<double>(6);
-                  for (int i = 0; i < 6; i++)
-                  {
-                     affineT->at(i) = atof(tokens[i + 2].c_str());
-                  }
-                  setPixelSizeAffine(tokens[1].c_str(), *affineT);
-                  delete affineT;
-               }
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               definePropertyBlock(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
-            {
-               // define image synchro
-               // --------------------
-               if (tokens.size() != 2)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               assignImageSynchro(tokens[1].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
-            {
-               // set parent ID
-               // -------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-
-               setParentLabel(tokens[1].c_str(), tokens[2].c_str());
-            }
+   LOG_DEBUG(coreLogger_) << "Configuration lines " << commands[begin].lineNumber <<
+      "-" << commands[i - 1].lineNumber << ": defined " << groups <<
+      " config groups, " << settings << " preset settings and " <<
+      pixelSizeSettings << " pixel size settings";
+}
+
+/**
+ * Returns true if a Property command from a configuration file would set a
+ * pre-initialization property to the value it already has.
+ */
+bool CMMCore::isRedundantPreInitProperty(const mm::ConfigCommand& command)
+{
+   const std::string& label = command.args[0];
+   if (label == MM::g_Keyword_CoreDevice)
+      return false;
+
+   try
+   {
+      boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+      mm::DeviceModuleLockGuard guard(pDevice);
+      const std::string& propName = command.args[1];
+      return pDevice->HasProperty(propName) &&
+         pDevice->GetPropertyInitStatus(propName.c_str()) &&
+         pDevice->GetProperty(propName) == command.args[2];
+   }
+   catch (const CMMError&)
+   {
+      // Let setProperty() report the error
+      return false;
+   }
+}
+
+
+/**
+ * Register a callback (listener class).
+ * MMCore will send notifications on internal events using this interface.
+ * By default the notifications are delivered on the thread that generates
+ * them; see enableAsyncCallbacks() for delivery on a separate thread.
+ */
+void CMMCore::registerCallback(MMEventCallback* cb)
+{
+   externalCallback_ = 0;
+   callbackDispatcher_->SetTarget(cb);
+   if (cb)
+      externalCallback_ = asyncCallbacks_ ? callbackDispatcher_.get() : cb;
+}
+
+/**
+ * Selects how notifications are delivered to the registered callback.
+ *
+ * When enabled, notifications are queued and delivered in order on a
+ * dedicated thread, so that device threads (such as stage polling or camera
+ * threads) are not held up by a slow listener. A newer notification for the
+ * same subject as the most recently queued one (e.g. the next position of
+ * the same stage) replaces it, so that a burst of updates is delivered as
+ * its latest value.
+ *
+ * When disabled (the default), notifications are delivered synchronously on
+ * the thread that generates them. Pending notifications are delivered before
+ * switching.
+ *
+ * @param enable   true for asynchronous delivery
+ */
+void CMMCore::enableAsyncCallbacks(bool enable)
+{
+   if (enable == asyncCallbacks_)
+      return;
 
-         }
-         catch (CMMError& err)
-         {
-            if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
-            std::ostringstream errorText;
-            errorText << "Line " << lineCount << ": " << line << endl;
-            errorText << err.getFullMsg() << endl << endl;
-            throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
-         }
-      }
+   MMEventCallback* cb = callbackDispatcher_->GetTarget();
+   if (enable)
+   {
+      asyncCallbacks_ = true;
+      if (cb)
+         externalCallback_ = callbackDispatcher_.get();
+   }
+   else
+   {
+      asyncCallbacks_ = false;
+      if (cb)
+         externalCallback_ = cb;
+      callbackDispatcher_->Flush();
    }
+   LOG_DEBUG(coreLogger_) << "Asynchronous callbacks " <<
+      (enable ? "enabled" : "disabled");
+}
 
-   updateAllowedChannelGroups();
+/**
+ * Returns true if notifications are delivered on a dedicated thread.
+ */
+bool CMMCore::asyncCallbacksEnabled()
+{
+   return asyncCallbacks_;
+}
 
-   // file parsing finished, try to set startup configuration
-   if (isConfigDefined(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup))
-   {
-      // We need to build the system state cache once here because setConfig()
-      // can fail in certain cases otherwise.
-      waitForSystem();
-      updateSystemStateCache();
+/**
+ * Waits until all queued notifications have been delivered to the registered
+ * callback. Returns immediately if called from within a notification.
+ */
+void CMMCore::flushCallbacks()
+{
+   callbackDispatcher_->Flush();
+}
 
-      this->setConfig(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup);
-   }
+/**
+ * Returns the number of notifications waiting to be delivered.
+ */
+long CMMCore::getCallbackQueueDepth()
+{
+   return static_cast<long>(callbackDispatcher_->GetQueueDepth());
+}
 
-   waitForSystem();
-   updateSystemStateCache();
+/**
+ * Returns the largest number of notifications that have been waiting to be
+ * delivered at the same time.
+ */
+long CMMCore::getCallbackQueueMaxDepth()
+{
+   return static_cast<long>(callbackDispatcher_->GetMaxQueueDepth());
+}
 
-   if (externalCallback_)
-   {
-      externalCallback_->onSystemConfigurationLoaded();
-   }
+/**
+ * Returns the number of notifications delivered on the callback thread.
+ */
+long CMMCore::getCallbackDeliveredCount()
+{
+   return static_cast<long>(callbackDispatcher_->GetDeliveredCount());
 }
 
+/**
+ * Returns the number of notifications that were merged into a pending
+ * notification for the same subject instead of being queued.
+ */
+long CMMCore::getCallbackCoalescedCount()
+{
+   return static_cast<long>(callbackDispatcher_->GetCoalescedCount());
+}
 
 /**
- * Register a callback (listener class).
- * MMCore will send notifications on internal events using this interface
+ * Returns the mean time, in milliseconds, that notifications waited in the
+ * queue before being delivered.
  */
-void CMMCore::registerCallback(MMEventCallback* cb)
+double CMMCore::getCallbackMeanLatencyMs()
 {
-   externalCallback_ = cb;
+   return callbackDispatcher_->GetMeanLatencyMs();
+}
+
+/**
+ * Returns the longest time, in milliseconds, that a notification waited in
+ * the queue before being delivered.
+ */
+double CMMCore::getCallbackMaxLatencyMs()
+{
+   return callbackDispatcher_->GetMaxLatencyMs();
 }
 
 
@@ -7228,6 +8760,11 @@ void CMMCore::InitializeErrorMessages()
    errorText_[MMERR_NullPointerException] = "Null Pointer Exception.";
    errorText_[MMERR_CreatePeripheralFailed] = "Hub failed to create specified peripheral device.";
    errorText_[MMERR_BadAffineTransform] = "Bad affine transform.  Affine transforms need to have 6 numbers; 2 rows of 3 column.";
+   errorText_[MMERR_UnknownOperation] = "Unknown operation id (the operation may already have been waited for).";
+   errorText_[MMERR_InvalidSequencePlan] = "Invalid hardware sequence.";
+   errorText_[MMERR_InvalidImageHandle] = "Invalid image handle (the image may already have been released).";
+   errorText_[MMERR_ImageNotMultiROIPacked] = "The image is not stored as packed multi-ROI image.";
+   errorText_[MMERR_InvalidMultiROIIndex] = "Invalid ROI index.";
 }
 
 void CMMCore::CreateCoreProperties()
@@ -7286,6 +8823,12 @@ void CMMCore::CreateCoreProperties()
    CoreProperty propBusyTimeoutMs;
    properties_->Add(MM::g_Keyword_CoreTimeoutMs, propBusyTimeoutMs);
 
+   // Concurrent initialization of independent devices
+   CoreProperty propParallelInit("0", false);
+   propParallelInit.AddAllowedValue("0");
+   propParallelInit.AddAllowedValue("1");
+   properties_->Add(MM::g_Keyword_CoreParallelInitialize, propParallelInit);
+
    properties_->Refresh();
 }
 
@@ -7389,10 +8932,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
       if (setting.getDeviceLabel().compare(MM::g_Keyword_CoreDevice) == 0)
       {
          properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
-         }
+         stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
       }
       else
       {
@@ -7405,10 +8945,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
             pDevice->SetProperty(setting.getPropertyName(),
                   setting.getPropertyValue());
 
-            {
-               MMThreadGuard scg(stateCacheLock_);
-               stateCache_.addSetting(setting);
-            }
+            stateCache_->Set(setting);
          }
          catch (const CMMError&)
          {
@@ -7452,10 +8989,7 @@ int CMMCore::applyProperties(vector<PropertySetting>& props, string& lastError)
          pDevice->SetProperty(props[i].getPropertyName(),
                props[i].getPropertyValue());
 
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(props[i]);
-         }
+         stateCache_->Set(props[i]);
       }
       catch (const CMMError& e)
       {
@@ -7499,6 +9033,163 @@ string CMMCore::getCoreErrorText(int code) const
    return txt;
 }
 
+/**
+ * Applies the shape change of the current image processor, if any, to an
+ * image shape. Returns true if the shape changes.
+ */
+bool CMMCore::getProcessedImageShape(unsigned& width, unsigned& height,
+      unsigned& byteDepth)
+{
+   boost::shared_ptr<ImageProcessorInstance> imageProcessor =
+      currentImageProcessor_.lock();
+   if (!imageProcessor)
+      return false;
+
+   unsigned outWidth, outHeight, outDepth;
+   if (imageProcessor->GetOutputShape(width, height, byteDepth,
+            outWidth, outHeight, outDepth) != DEVICE_OK)
+      return false;
+   if (outWidth == width && outHeight == height && outDepth == byteDepth)
+      return false;
+   width = outWidth;
+   height = outHeight;
+   byteDepth = outDepth;
+   return true;
+}
+
+/**
+ * Sizes the circular buffer for the images of a camera, as they come out of
+ * the current image processor.
+ */
+bool CMMCore::initializeCircularBufferFor(boost::shared_ptr<CameraInstance> camera)
+{
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned depth = camera->GetImageBytesPerPixel();
+   boost::shared_ptr<const mm::MultiROILayout> layout;
+   // ROI coordinates are meaningless once a processor reshapes the image
+   if (!getProcessedImageShape(width, height, depth) && multiROIPacking_)
+      layout = getMultiROILayoutFor(camera, width, height);
+   return cbuf_->Initialize(camera->GetNumberOfChannels(), width, height, depth,
+         layout);
+}
+
+/**
+ * Returns the packed layout for the multiple ROIs of a camera, or null if
+ * the camera has none or they do not match its image. The caller must hold
+ * the camera's module lock.
+ */
+boost::shared_ptr<const mm::MultiROILayout> CMMCore::getMultiROILayoutFor(
+      boost::shared_ptr<CameraInstance> camera, unsigned width,
+      unsigned height)
+{
+   boost::shared_ptr<const mm::MultiROILayout> none;
+   if (!camera->SupportsMultiROI() || !camera->IsMultiROISet())
+      return none;
+   unsigned count = 0;
+   if (camera->GetMultiROICount(count) != DEVICE_OK || count == 0)
+      return none;
+   std::vector<unsigned> xs(count), ys(count), widths(count), heights(count);
+   unsigned actualCount = count;
+   if (camera->GetMultiROI(&xs[0], &ys[0], &widths[0], &heights[0],
+            &actualCount) != DEVICE_OK || actualCount == 0 ||
+         actualCount > count)
+      return none;
+   xs.resize(actualCount);
+   ys.resize(actualCount);
+   widths.resize(actualCount);
+   heights.resize(actualCount);
+
+   boost::shared_ptr<const mm::MultiROILayout> layout =
+      boost::make_shared<mm::MultiROILayout>(xs, ys, widths, heights,
+            width, height);
+   if (layout->IsEmpty())
+   {
+      LOG_WARNING(coreLogger_) << "Not packing multi-ROI images: the " <<
+         actualCount << " ROIs do not match the " << width << "x" <<
+         height << " camera image";
+      return none;
+   }
+   LOG_DEBUG(coreLogger_) << "Packing " << actualCount <<
+      " ROIs of the " << width << "x" << height << " camera image into " <<
+      layout->GetPackedPixelCount() << " pixels";
+   return layout;
+}
+
+/**
+ * Returns the layout of an image in the circular buffer if it holds packed
+ * multi-ROI pixels, or null if it holds a whole frame.
+ */
+boost::shared_ptr<const mm::MultiROILayout> CMMCore::packedLayoutOf(
+      const mm::ImgBuffer* image) const
+{
+   boost::shared_ptr<const mm::MultiROILayout> layout =
+      cbuf_->GetMultiROILayout();
+   if (layout && (image->Height() != 1 ||
+            image->Width() != layout->GetPackedPixelCount()))
+      layout.reset();
+   return layout;
+}
+
+/**
+ * Returns the pixels of an image from the circular buffer as a whole frame,
+ * unpacking packed multi-ROI images into a per-thread buffer for the given
+ * camera channel.
+ */
+void* CMMCore::fullFramePixels(const mm::ImgBuffer* image,
+      unsigned channel) const
+{
+   boost::shared_ptr<const mm::MultiROILayout> layout = packedLayoutOf(image);
+   if (!layout)
+      return const_cast<unsigned char*>(image->GetPixels());
+
+   if (!unpackedImages_.get())
+      unpackedImages_.reset(new std::vector< std::vector<unsigned char> >());
+   std::vector< std::vector<unsigned char> >& frames = *unpackedImages_;
+   if (frames.size() <= channel)
+      frames.resize(channel + 1);
+   std::vector<unsigned char>& frame = frames[channel];
+   frame.resize((size_t)layout->GetFrameWidth() * layout->GetFrameHeight() *
+         image->Depth());
+   layout->Unpack(&frame[0], image->GetPixels(), image->Depth());
+   return &frame[0];
+}
+
+/**
+ * Runs the current image processor on a snapped image. Processors that keep
+ * the image shape work in place; the output of others goes to a Core-owned
+ * buffer (one per camera channel) whose pointer is returned.
+ */
+void* CMMCore::processSnappedImage(
+      boost::shared_ptr<ImageProcessorInstance> imageProcessor, void* pixels,
+      unsigned channel, unsigned width, unsigned height, unsigned byteDepth)
+   throw (CMMError)
+{
+   unsigned outWidth, outHeight, outDepth;
+   int ret = imageProcessor->GetOutputShape(width, height, byteDepth,
+         outWidth, outHeight, outDepth);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, imageProcessor).c_str(), MMERR_DEVICE_GENERIC);
+
+   if (outWidth == width && outHeight == height && outDepth == byteDepth)
+   {
+      imageProcessor->Process((unsigned char*)pixels, width, height, byteDepth);
+      return pixels;
+   }
+
+   if (processedImages_.size() <= channel)
+      processedImages_.resize(channel + 1);
+   std::vector<unsigned char>& processed = processedImages_[channel];
+   processed.resize((size_t)outWidth * outHeight * outDepth);
+   if (processed.empty())
+      throw CMMError(getCoreErrorText(MMERR_CameraBufferReadFailed).c_str(), MMERR_CameraBufferReadFailed);
+   ret = imageProcessor->ProcessTo((const unsigned char*)pixels,
+         width, height, byteDepth, &processed[0], outWidth, outHeight, outDepth);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, imageProcessor).c_str(), MMERR_DEVICE_GENERIC);
+   return &processed[0];
+}
+
 void CMMCore::logError(const char* device, const char* msg)
 {
    // TODO Fix various inconsistent usages of this function.
@@ -7639,6 +9330,319 @@ MM::DeviceDetectionStatus CMMCore::detectDevice(char* label)
    return result;
 }
 
+/**
+ * Enables or disables the recording of device call statistics.
+ *
+ * While enabled, the Core times its calls into each device that may talk to
+ * the hardware (property access, Busy(), snapping, stage moves, serial
+ * I/O, and so on), as well as its waits for the lock of the device's
+ * adapter module, which the Core holds during most calls. Counts and
+ * latency histograms are kept per device and call name; the lock wait is
+ * recorded under the call name "ModuleLockWait".
+ *
+ * The overhead is a clock reading before and after each call and a short
+ * locked update; when disabled (the default), it is negligible. Disabling
+ * keeps the statistics gathered so far.
+ */
+void CMMCore::enableDeviceCallStats(bool enable)
+{
+   deviceCallStatsEnabled_ = enable;
+   std::vector<std::string> labels = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = labels.begin(),
+         end = labels.end(); it != end; ++it)
+   {
+      deviceManager_->GetDevice(*it)->GetCallStats().SetEnabled(enable);
+   }
+   LOG_DEBUG(coreLogger_) << "Device call statistics " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether device call statistics are being recorded.
+ */
+bool CMMCore::isDeviceCallStatsEnabled()
+{
+   return deviceCallStatsEnabled_;
+}
+
+/**
+ * Discards the device call statistics of all devices.
+ */
+void CMMCore::resetDeviceCallStats()
+{
+   std::vector<std::string> labels = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = labels.begin(),
+         end = labels.end(); it != end; ++it)
+   {
+      deviceManager_->GetDevice(*it)->GetCallStats().Reset();
+   }
+}
+
+/**
+ * Returns the names of the calls recorded for a device since the
+ * statistics were last reset, in alphabetical order.
+ *
+ * @param label   the device label
+ */
+std::vector<std::string> CMMCore::getDeviceCallNames(const char* label) throw (CMMError)
+{
+   return deviceManager_->GetDevice(label)->GetCallStats().GetCallNames();
+}
+
+/**
+ * Returns how many times a call into a device was recorded.
+ *
+ * @param label      the device label
+ * @param callName   the call, as returned by getDeviceCallNames()
+ */
+long CMMCore::getDeviceCallCount(const char* label, const char* callName) throw (CMMError)
+{
+   if (!callName)
+      throw CMMError("Null call name");
+   mm::LatencyHistogram histogram =
+      deviceManager_->GetDevice(label)->GetCallStats().GetHistogram(callName);
+   return static_cast<long>(histogram.GetCount());
+}
+
+/**
+ * Returns a percentile of the recorded latencies of a call into a device.
+ *
+ * Latencies are kept in histograms with a relative precision of 12.5%;
+ * the value returned is the upper bound of the bucket holding the
+ * percentile (but no more than the maximum recorded latency). A percentile
+ * of 100 gives the exact maximum. Returns 0 if the call was not recorded.
+ *
+ * @param label        the device label
+ * @param callName     the call, as returned by getDeviceCallNames()
+ * @param percentile   0 to 100
+ */
+double CMMCore::getDeviceCallLatencyMs(const char* label, const char* callName,
+      double percentile) throw (CMMError)
+{
+   if (!callName)
+      throw CMMError("Null call name");
+   mm::LatencyHistogram histogram =
+      deviceManager_->GetDevice(label)->GetCallStats().GetHistogram(callName);
+   return histogram.GetPercentile(percentile) / 1000.0;
+}
+
+/**
+ * Returns the total time spent in a call into a device, over all recorded
+ * calls.
+ *
+ * @param label      the device label
+ * @param callName   the call, as returned by getDeviceCallNames()
+ */
+double CMMCore::getDeviceCallTotalMs(const char* label, const char* callName) throw (CMMError)
+{
+   if (!callName)
+      throw CMMError("Null call name");
+   mm::LatencyHistogram histogram =
+      deviceManager_->GetDevice(label)->GetCallStats().GetHistogram(callName);
+   return histogram.GetTotal() / 1000.0;
+}
+
+/**
+ * Writes the device call statistics of all devices to the log, one line per
+ * device and call, with the count, the total and mean time, and latency
+ * percentiles.
+ */
+void CMMCore::logDeviceCallStats()
+{
+   std::vector<std::string> labels = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = labels.begin(),
+         end = labels.end(); it != end; ++it)
+   {
+      const mm::DeviceCallStats& stats =
+         deviceManager_->GetDevice(*it)->GetCallStats();
+      std::vector<std::string> calls = stats.GetCallNames();
+      for (std::vector<std::string>::const_iterator call = calls.begin(),
+            callsEnd = calls.end(); call != callsEnd; ++call)
+      {
+         mm::LatencyHistogram h = stats.GetHistogram(*call);
+         if (h.GetCount() == 0)
+            continue;
+         LOG_INFO(coreLogger_) << "Device call stats: " << *it << " " <<
+            *call << ": count " << h.GetCount() <<
+            ", total " << h.GetTotal() / 1000.0 << " ms" <<
+            ", mean " << h.GetTotal() / 1000.0 / h.GetCount() << " ms" <<
+            ", p50 " << h.GetPercentile(50.0) / 1000.0 << " ms" <<
+            ", p90 " << h.GetPercentile(90.0) / 1000.0 << " ms" <<
+            ", p99 " << h.GetPercentile(99.0) / 1000.0 << " ms" <<
+            ", max " << h.GetMax() / 1000.0 << " ms";
+      }
+   }
+}
+
+/**
+ * Enables or disables frame tracing.
+ *
+ * While enabled, each frame a camera inserts into the sequence buffer is
+ * stamped (with a monotonic clock) when it reaches the Core, before and
+ * after the image processor, when its insert into the buffer starts and
+ * completes, and when it is popped (popNextImage() and related functions,
+ * or acquireNextImageHandle()). Frames dropped because the buffer was full
+ * are counted as overflows.
+ *
+ * When disabled (the default), tracing costs a check of a flag per frame.
+ * Disabling keeps the traces and statistics gathered so far.
+ */
+void CMMCore::enableFrameTracing(bool enable)
+{
+   frameTracer_->SetEnabled(enable);
+   LOG_DEBUG(coreLogger_) << "Frame tracing " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether frame tracing is enabled.
+ */
+bool CMMCore::isFrameTracingEnabled()
+{
+   return frameTracer_->IsEnabled();
+}
+
+/**
+ * Discards the frame traces and statistics gathered so far.
+ */
+void CMMCore::resetFrameTracing()
+{
+   frameTracer_->Reset();
+}
+
+/**
+ * Returns the number of traced frames inserted into the sequence buffer.
+ */
+long CMMCore::getFrameTraceInsertedCount()
+{
+   return static_cast<long>(frameTracer_->GetInsertedCount());
+}
+
+/**
+ * Returns the number of traced frames popped from the sequence buffer.
+ */
+long CMMCore::getFrameTracePoppedCount()
+{
+   return static_cast<long>(frameTracer_->GetPoppedCount());
+}
+
+/**
+ * Returns the number of frames dropped because the sequence buffer was full
+ * while tracing was enabled.
+ */
+long CMMCore::getFrameTraceOverflowCount()
+{
+   return static_cast<long>(frameTracer_->GetOverflowCount());
+}
+
+/**
+ * Returns the rate, in frames per second, at which traced frames were
+ * inserted into the sequence buffer (from the first to the last insert).
+ */
+double CMMCore::getFrameTraceInsertRate()
+{
+   return frameTracer_->GetInsertRate();
+}
+
+/**
+ * Returns a percentile of the time traced frames spent in the image
+ * processor. Frames that were not processed are not counted.
+ *
+ * Like the device call statistics, times are kept in histograms with a
+ * relative precision of 12.5%; see getDeviceCallLatencyMs().
+ *
+ * @param percentile   0 to 100
+ */
+double CMMCore::getFrameTraceProcessingMs(double percentile)
+{
+   return frameTracer_->GetProcessingHistogram().GetPercentile(percentile) / 1000.0;
+}
+
+/**
+ * Returns a percentile of the time from the camera handing a traced frame to
+ * the Core until the frame is in the sequence buffer, including processing.
+ *
+ * @param percentile   0 to 100
+ */
+double CMMCore::getFrameTraceInsertLatencyMs(double percentile)
+{
+   return frameTracer_->GetInsertHistogram().GetPercentile(percentile) / 1000.0;
+}
+
+/**
+ * Returns a percentile of the time traced frames spent in the sequence
+ * buffer before being popped.
+ *
+ * @param percentile   0 to 100
+ */
+double CMMCore::getFrameTraceResidenceMs(double percentile)
+{
+   return frameTracer_->GetResidenceHistogram().GetPercentile(percentile) / 1000.0;
+}
+
+/**
+ * Saves the most recent frame traces (up to 100000) and overflows in the
+ * Chrome trace event format, for viewing in chrome://tracing or Perfetto.
+ *
+ * Each camera has a track with the stages of its frames (Frame, spanning
+ * from the Core callback to the buffer; Process; and Insert, or Spill for
+ * frames that went to the spill file); the time each frame spent in the
+ * buffer is shown as an async "Queued" event. Overflows are instant events.
+ * Timestamps are in microseconds of the Core's monotonic clock.
+ *
+ * @param fileName   the file to write
+ */
+void CMMCore::saveFrameTrace(const char* fileName) throw (CMMError)
+{
+   if (!fileName)
+      throw CMMError("Null filename");
+
+   ofstream os;
+   os.open(fileName, ios_base::out | ios_base::trunc);
+   if (!os.is_open())
+   {
+      logError(fileName, getCoreErrorText(MMERR_FileOpenFailed).c_str());
+      throw CMMError(ToQuotedString(fileName) + ": " + getCoreErrorText(MMERR_FileOpenFailed),
+            MMERR_FileOpenFailed);
+   }
+   os << frameTracer_->GetChromeTrace();
+   LOG_INFO(coreLogger_) << "Saved frame trace to " << fileName;
+}
+
+/**
+ * Writes the frame tracing statistics to the log: frame counts and insert
+ * rate, and percentiles of the processing time, insert latency and buffer
+ * residence time.
+ */
+void CMMCore::logFrameTraceStats()
+{
+   LOG_INFO(coreLogger_) << "Frame trace: inserted " <<
+      frameTracer_->GetInsertedCount() << ", popped " <<
+      frameTracer_->GetPoppedCount() << ", overflows " <<
+      frameTracer_->GetOverflowCount() << ", insert rate " <<
+      frameTracer_->GetInsertRate() << " fps";
+
+   const char* const names[] = { "processing", "insert latency", "residence" };
+   mm::LatencyHistogram histograms[] = {
+      frameTracer_->GetProcessingHistogram(),
+      frameTracer_->GetInsertHistogram(),
+      frameTracer_->GetResidenceHistogram(),
+   };
+   for (int i = 0; i < 3; ++i)
+   {
+      const mm::LatencyHistogram& h = histograms[i];
+      if (h.GetCount() == 0)
+         continue;
+      LOG_INFO(coreLogger_) << "Frame trace " << names[i] <<
+         ": count " << h.GetCount() <<
+         ", mean " << h.GetTotal() / 1000.0 / h.GetCount() << " ms" <<
+         ", p50 " << h.GetPercentile(50.0) / 1000.0 << " ms" <<
+         ", p90 " << h.GetPercentile(90.0) / 1000.0 << " ms" <<
+         ", p99 " << h.GetPercentile(99.0) / 1000.0 << " ms" <<
+         ", max " << h.GetMax() / 1000.0 << " ms";
+   }
+}
+
 /**
  * Performs auto-detection and loading of child devices that are attached to a Hub device.
  * For example, if a motorized microscope is represented by a Hub device, it is capable of
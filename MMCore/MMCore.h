@@ -63,6 +63,7 @@
 #include "Logging/Logger.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/weak_ptr.hpp>
 
 #include <cstring>
@@ -108,8 +109,19 @@ class XYStageInstance;
 class CMMCore;
 
 namespace mm {
+   class AsyncOperations;
+   class CallbackDispatcher;
+   struct ConfigCommand;
+   class DeviceInitScheduler;
    class DeviceManager;
+   class DiskStreamWriter;
+   class FrameTracer;
+   class ImgBuffer;
    class LogManager;
+   class MultiROILayout;
+   struct SequenceAxis;
+   struct SequenceBurst;
+   class StateCache;
 } // namespace mm
 
 typedef unsigned int* imgRGB32;
@@ -149,6 +161,9 @@ public:
    void unloadAllDevices() throw (CMMError);
    void initializeAllDevices() throw (CMMError);
    void initializeDevice(const char* label) throw (CMMError);
+   void enableParallelInitialization(bool enable);
+   bool isParallelInitializationEnabled();
+   double getDeviceInitializationTimeMs(const char* label) throw (CMMError);
    void reset() throw (CMMError);
 
    void unloadLibrary(const char* moduleName) throw (CMMError);
@@ -168,6 +183,15 @@ public:
    void saveSystemConfiguration(const char* fileName) throw (CMMError);
    void loadSystemConfiguration(const char* fileName) throw (CMMError);
    void registerCallback(MMEventCallback* cb);
+   void enableAsyncCallbacks(bool enable);
+   bool asyncCallbacksEnabled();
+   void flushCallbacks();
+   long getCallbackQueueDepth();
+   long getCallbackQueueMaxDepth();
+   long getCallbackDeliveredCount();
+   long getCallbackCoalescedCount();
+   double getCallbackMeanLatencyMs();
+   double getCallbackMaxLatencyMs();
    ///@}
 
    /** \name Logging and log management. */
@@ -193,6 +217,8 @@ public:
    std::vector<std::string> getDeviceAdapterSearchPaths();
    void setDeviceAdapterSearchPaths(const std::vector<std::string>& paths);
    MMCORE_DEPRECATED(static void addSearchPath(const char *path));
+   void setDeviceAdapterIndexFile(const char* path);
+   std::string getDeviceAdapterIndexFile();
 
    std::vector<std::string> getDeviceAdapterNames() throw (CMMError);
    MMCORE_DEPRECATED(static std::vector<std::string> getDeviceLibraries() throw (CMMError));
@@ -236,6 +262,7 @@ public:
    void stopPropertySequence(const char* label, const char* propName) throw (CMMError);
    long getPropertySequenceMaxLength(const char* label, const char* propName) throw (CMMError);
    void loadPropertySequence(const char* label, const char* propName, std::vector<std::string> eventSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName, std::vector<double> eventSequence) throw (CMMError);
 
    bool deviceBusy(const char* label) throw (CMMError);
    void waitForDevice(const char* label) throw (CMMError);
@@ -285,6 +312,9 @@ public:
     */
    ///@{
    Configuration getSystemStateCache() const;
+   long getSystemStateCacheVersion() const;
+   Configuration getSystemStateCacheChangesSince(long version) const;
+   Configuration getSystemStateCacheRemovalsSince(long version) const;
    void updateSystemStateCache();
    std::string getPropertyFromCache(const char* deviceLabel,
          const char* propName) const throw (CMMError);
@@ -419,6 +449,24 @@ public:
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
 
+   long acquireLastImageHandle() throw (CMMError);
+   long acquireLastImageHandle(unsigned channel) throw (CMMError);
+   long acquireNextImageHandle() throw (CMMError);
+   long acquireNextImageHandle(unsigned channel) throw (CMMError);
+   void* getImageHandlePixels(long handle) throw (CMMError);
+   void* getImageHandlePixelsMD(long handle, Metadata& md) throw (CMMError);
+   void releaseImageHandle(long handle) throw (CMMError);
+   long getImageHandleCount();
+   void setImageHandleWaitTimeoutMs(long timeoutMs);
+   long getImageHandleWaitTimeoutMs();
+
+   void enableMultiROIPacking(bool enable);
+   bool isMultiROIPackingEnabled();
+   bool isBufferMultiROIPacked();
+   void getBufferMultiROI(std::vector<unsigned>& xs, std::vector<unsigned>& ys,
+         std::vector<unsigned>& widths, std::vector<unsigned>& heights);
+   void* getImageHandleROIPixels(long handle, unsigned roiIndex) throw (CMMError);
+
    long getRemainingImageCount();
    long getBufferTotalCapacity();
    long getBufferFreeCapacity();
@@ -428,6 +476,22 @@ public:
    void initializeCircularBuffer() throw (CMMError);
    void clearCircularBuffer() throw (CMMError);
 
+   void enableBufferSpill(const char* path, unsigned sizeMB) throw (CMMError);
+   void disableBufferSpill() throw (CMMError);
+   bool isBufferSpillEnabled();
+   long getBufferSpillCapacity();
+   long getBufferSpilledImageCount();
+   double getBufferSpillWriteMBPerSec();
+   double getBufferSpillReadMBPerSec();
+
+   void startStreamToDisk(const char* directory, const char* prefix,
+         unsigned maxFileSizeMB) throw (CMMError);
+   void stopStreamToDisk() throw (CMMError);
+   bool isStreamingToDisk();
+   long getStreamToDiskImageCount();
+   long getStreamToDiskDroppedImageCount();
+   double getStreamToDiskMBPerSec();
+
    bool isExposureSequenceable(const char* cameraLabel) throw (CMMError);
    void startExposureSequence(const char* cameraLabel) throw (CMMError);
    void stopExposureSequence(const char* cameraLabel) throw (CMMError);
@@ -436,6 +500,23 @@ public:
          std::vector<double> exposureSequence_ms) throw (CMMError);
    ///@}
 
+   /** \name Hardware-sequenced acquisition.
+    *
+    * Runs a list of frames, each with its own stage positions, channel and
+    * exposure, using device sequences wherever the hardware allows.
+    */
+   ///@{
+   std::vector<long> planHardwareSequence(std::vector<double> zPositionsUm,
+         std::vector<double> xPositionsUm, std::vector<double> yPositionsUm,
+         const char* channelGroup, std::vector<std::string> channelPresets,
+         std::vector<double> exposuresMs) throw (CMMError);
+   long startHardwareSequence(std::vector<double> zPositionsUm,
+         std::vector<double> xPositionsUm, std::vector<double> yPositionsUm,
+         const char* channelGroup, std::vector<std::string> channelPresets,
+         std::vector<double> exposuresMs) throw (CMMError);
+   void stopHardwareSequence() throw (CMMError);
+   ///@}
+
    /** \name Autofocus control. */
    ///@{
    double getLastFocusScore();
@@ -531,6 +612,22 @@ public:
          std::vector<double> ySequence) throw (CMMError);
    ///@}
 
+   /** \name Asynchronous motion and configuration.
+    *
+    * Operations that return immediately, so that several devices can move
+    * at once; each returns an id to wait for.
+    */
+   ///@{
+   long setPositionAsync(const char* stageLabel, double position) throw (CMMError);
+   long setXYPositionAsync(const char* xyStageLabel,
+         double x, double y) throw (CMMError);
+   long setStateAsync(const char* stateDeviceLabel, long state) throw (CMMError);
+   long setConfigAsync(const char* groupName, const char* configName) throw (CMMError);
+   bool isOperationDone(long operationId) throw (CMMError);
+   void waitForOperation(long operationId) throw (CMMError);
+   void waitForOperations(std::vector<long> operationIds) throw (CMMError);
+   ///@}
+
    /** \name Serial port control. */
    ///@{
    void setSerialProperties(const char* portName,
@@ -617,6 +714,42 @@ public:
    MM::DeviceDetectionStatus detectDevice(char* deviceLabel);
    ///@}
 
+   /** \name Device call statistics.
+    *
+    * Counts and latencies of calls into device adapters, per device.
+    */
+   ///@{
+   void enableDeviceCallStats(bool enable);
+   bool isDeviceCallStatsEnabled();
+   void resetDeviceCallStats();
+   std::vector<std::string> getDeviceCallNames(const char* label) throw (CMMError);
+   long getDeviceCallCount(const char* label, const char* callName) throw (CMMError);
+   double getDeviceCallLatencyMs(const char* label, const char* callName,
+         double percentile) throw (CMMError);
+   double getDeviceCallTotalMs(const char* label, const char* callName) throw (CMMError);
+   void logDeviceCallStats();
+   ///@}
+
+   /** \name Frame tracing.
+    *
+    * Timing of each frame from the camera to the consumer of the sequence
+    * buffer, with statistics and export in Chrome trace format.
+    */
+   ///@{
+   void enableFrameTracing(bool enable);
+   bool isFrameTracingEnabled();
+   void resetFrameTracing();
+   long getFrameTraceInsertedCount();
+   long getFrameTracePoppedCount();
+   long getFrameTraceOverflowCount();
+   double getFrameTraceInsertRate();
+   double getFrameTraceProcessingMs(double percentile);
+   double getFrameTraceInsertLatencyMs(double percentile);
+   double getFrameTraceResidenceMs(double percentile);
+   void saveFrameTrace(const char* fileName) throw (CMMError);
+   void logFrameTraceStats();
+   ///@}
+
    /** \name Hub and peripheral devices. */
    ///@{
    std::string getParentLabel(const char* peripheralLabel) throw (CMMError);
@@ -670,19 +803,37 @@ private:
    ConfigGroupCollection* configGroups_;
    CorePropertyCollection* properties_;
    MMEventCallback* externalCallback_;  // notification hook to the higher layer (e.g. GUI)
+   boost::shared_ptr<mm::CallbackDispatcher> callbackDispatcher_; // its target is the registered callback
+   bool asyncCallbacks_;
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
+   boost::shared_ptr<mm::DiskStreamWriter> streamWriter_;
+   // Snapped images reshaped by the image processor, per camera channel
+   std::vector< std::vector<unsigned char> > processedImages_;
+   bool multiROIPacking_;
+   // Packed multi-ROI images rebuilt for the full-frame accessors, per
+   // calling thread and camera channel
+   mutable boost::thread_specific_ptr< std::vector< std::vector<unsigned char> > > unpackedImages_;
+   // Likewise for image handles, kept until the handle is released
+   std::map< long, std::vector<unsigned char> > unpackedHandleImages_;
+   MMThreadLock unpackedHandleImagesLock_;
 
    std::vector< boost::weak_ptr<DeviceInstance> > imageSynchroDevices_;
    boost::shared_ptr<CPluginManager> pluginManager_;
    boost::shared_ptr<mm::DeviceManager> deviceManager_;
+   boost::shared_ptr<mm::DeviceInitScheduler> initScheduler_;
+   boost::shared_ptr<mm::AsyncOperations> asyncOperations_;
+   bool parallelInit_;
+   std::map<std::string, double> initTimesMs_;
+   bool deviceCallStatsEnabled_;
+   boost::shared_ptr<mm::FrameTracer> frameTracer_;
    std::map<int, std::string> errorText_;
    CPropBlockMap propBlocks_;
 
-   // Must be unlocked when calling MMEventCallback or calling device methods
-   // or acquiring a module lock
-   mutable MMThreadLock stateCacheLock_;
-   mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   boost::shared_ptr<mm::StateCache> stateCache_;
+
+   MMThreadLock hardwareSequenceLock_;
+   bool hardwareSequenceStopRequested_; // Synchronized by hardwareSequenceLock_
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
@@ -708,10 +859,53 @@ private:
    std::string getDeviceErrorText(int deviceCode, boost::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(boost::shared_ptr<DeviceInstance> pDev);
    void logError(const char* device, const char* msg);
+   bool getProcessedImageShape(unsigned& width, unsigned& height,
+         unsigned& byteDepth);
+   bool initializeCircularBufferFor(boost::shared_ptr<CameraInstance> camera);
+   boost::shared_ptr<const mm::MultiROILayout> getMultiROILayoutFor(
+         boost::shared_ptr<CameraInstance> camera, unsigned width,
+         unsigned height);
+   boost::shared_ptr<const mm::MultiROILayout> packedLayoutOf(
+         const mm::ImgBuffer* image) const;
+   void* fullFramePixels(const mm::ImgBuffer* image, unsigned channel) const;
+   void* processSnappedImage(
+         boost::shared_ptr<ImageProcessorInstance> imageProcessor,
+         void* pixels, unsigned channel, unsigned width, unsigned height,
+         unsigned byteDepth) throw (CMMError);
    void updateAllowedChannelGroups();
    void assignDefaultRole(boost::shared_ptr<DeviceInstance> pDev);
+   double initializeDeviceInstance(const std::string& label) throw (CMMError);
+   std::vector<std::string> getInitializationDependencies(
+         boost::shared_ptr<DeviceInstance> pDevice);
    void updateCoreProperty(const char* propName, MM::DeviceType devType) throw (CMMError);
    void loadSystemConfigurationImpl(const char* fileName) throw (CMMError);
+   void applyConfigCommand(const mm::ConfigCommand& command) throw (CMMError);
+   void applyPresetDefinitions(const std::vector<mm::ConfigCommand>& commands,
+         size_t& next) throw (CMMError);
+   void addConfigSetting(const char* groupName, const char* configName,
+         const char* deviceLabel, const char* propName, const char* value) throw (CMMError);
+   void addPixelSizeSetting(const char* resolutionID, const char* deviceLabel,
+         const char* propName, const char* value) throw (CMMError);
+   bool isRedundantPreInitProperty(const mm::ConfigCommand& command);
+   void setPositionAndWait(const std::string& label, double position) throw (CMMError);
+   void setXYPositionAndWait(const std::string& label, double x, double y) throw (CMMError);
+   void setStateAndWait(const std::string& label, long state) throw (CMMError);
+   void setConfigAndWait(const std::string& group, const std::string& config) throw (CMMError);
+   void throwUnknownOperation(long operationId) throw (CMMError);
+   std::vector<mm::SequenceAxis> buildSequenceAxes(
+         const std::vector<double>& zPositionsUm,
+         const std::vector<double>& xPositionsUm,
+         const std::vector<double>& yPositionsUm,
+         const char* channelGroup,
+         const std::vector<std::string>& channelPresets,
+         const std::vector<double>& exposuresMs,
+         size_t& frameCount) throw (CMMError);
+   void runHardwareSequence(const std::vector<mm::SequenceAxis>& axes,
+         const std::vector<mm::SequenceBurst>& bursts) throw (CMMError);
+   void setSequenceAxisValue(const mm::SequenceAxis& axis, size_t frame) throw (CMMError);
+   void loadSequenceAxis(const mm::SequenceAxis& axis,
+         const mm::SequenceBurst& burst) throw (CMMError);
+   void setSequenceAxisRunning(const mm::SequenceAxis& axis, bool start) throw (CMMError);
 };
 
 #endif //_MMCORE_H_
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          MonotonicClock.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cheap monotonic time source for MM::MMTime, timeouts and
+//                frame timestamps, anchored once to the wall clock.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "MonotonicClock.h"
+
+#include "../MMDevice/FixSnprintf.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/once.hpp>
+
+#include <cstdio>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace mm {
+
+namespace {
+
+struct Anchor
+{
+   long long monotonicUs;
+   boost::posix_time::ptime localTime;
+   long long mmTimeUs; // Microseconds since 2000-01-01 local time
+};
+
+Anchor g_anchor;
+boost::once_flag g_anchorOnce = BOOST_ONCE_INIT;
+
+void InitializeAnchor()
+{
+   g_anchor.localTime = boost::posix_time::microsec_clock::local_time();
+   g_anchor.monotonicUs = GetMonotonicMicroseconds();
+   const boost::posix_time::ptime epoch(boost::gregorian::date(2000, 1, 1));
+   g_anchor.mmTimeUs = (g_anchor.localTime - epoch).total_microseconds();
+}
+
+const Anchor& GetAnchor()
+{
+   boost::call_once(InitializeAnchor, g_anchorOnce);
+   return g_anchor;
+}
+
+#ifdef _WINDOWS
+long long GetPerformanceFrequency()
+{
+   LARGE_INTEGER frequency;
+   QueryPerformanceFrequency(&frequency);
+   return frequency.QuadPart;
+}
+#endif
+
+} // anonymous namespace
+
+
+long long GetMonotonicMicroseconds()
+{
+#ifdef _WINDOWS
+   // The frequency is fixed at boot; reading it again is harmless
+   static const long long frequency = GetPerformanceFrequency();
+   LARGE_INTEGER counter;
+   QueryPerformanceCounter(&counter);
+   // Split to avoid overflow of count * 1000000
+   return counter.QuadPart / frequency * 1000000 +
+      counter.QuadPart % frequency * 1000000 / frequency;
+#elif defined(__APPLE__)
+   static mach_timebase_info_data_t timebase;
+   if (timebase.denom == 0)
+      mach_timebase_info(&timebase);
+   const unsigned long long ticks = mach_absolute_time();
+   const unsigned long long perUs = 1000ULL * timebase.denom;
+   return static_cast<long long>(ticks / perUs * timebase.numer +
+         ticks % perUs * timebase.numer / perUs);
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
+MM::MMTime MonotonicToMMTime(long long monotonicUs)
+{
+   const Anchor& anchor = GetAnchor();
+   const long long us = anchor.mmTimeUs + (monotonicUs - anchor.monotonicUs);
+   return MM::MMTime(static_cast<long>(us / 1000000),
+         static_cast<long>(us % 1000000));
+}
+
+
+boost::posix_time::ptime MonotonicToLocalTime(long long monotonicUs)
+{
+   const Anchor& anchor = GetAnchor();
+   return anchor.localTime +
+      boost::posix_time::microseconds(monotonicUs - anchor.monotonicUs);
+}
+
+
+std::string FormatTimestamp(const boost::posix_time::ptime& time)
+{
+   const boost::gregorian::date::ymd_type ymd = time.date().year_month_day();
+   const boost::posix_time::time_duration tod = time.time_of_day();
+   // Ticks may be finer than microseconds (e.g. with nanosecond resolution)
+   const long long fractionalUs =
+      static_cast<long long>(tod.fractional_seconds()) * 1000000 /
+      boost::posix_time::time_duration::ticks_per_second();
+   char buffer[64];
+   snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d.%06d",
+         static_cast<int>(ymd.year), static_cast<int>(ymd.month),
+         static_cast<int>(ymd.day), static_cast<int>(tod.hours()),
+         static_cast<int>(tod.minutes()), static_cast<int>(tod.seconds()),
+         static_cast<int>(fractionalUs));
+   return buffer;
+}
+
+} // namespace mm
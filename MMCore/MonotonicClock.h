@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          MonotonicClock.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cheap monotonic time source for MM::MMTime, timeouts and
+//                frame timestamps, anchored once to the wall clock.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/MMDevice.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <string>
+
+namespace mm {
+
+// Times are read from the operating system's monotonic clock
+// (CLOCK_MONOTONIC, QueryPerformanceCounter or mach_absolute_time), which
+// does not jump when the system time is set, by NTP or for daylight saving
+// time. The first call reads the local wall-clock time once; times are then
+// converted to wall-clock time by adding the elapsed monotonic time to that
+// anchor, so they keep their meaning (MM::MMTime counts microseconds since
+// 2000-01-01 local time) without a time zone conversion per call.
+
+// Microseconds since an arbitrary origin
+long long GetMonotonicMicroseconds();
+
+MM::MMTime MonotonicToMMTime(long long monotonicUs);
+boost::posix_time::ptime MonotonicToLocalTime(long long monotonicUs);
+
+// "YYYY-MM-DD HH:MM:SS.ffffff", as in the TimeReceivedByCore image tag
+std::string FormatTimestamp(const boost::posix_time::ptime& time);
+
+} // namespace mm
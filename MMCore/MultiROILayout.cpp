@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          MultiROILayout.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Packed storage layout for multi-ROI camera frames: only the
+//                ROI rectangles, back to back, instead of the padded frame.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "MultiROILayout.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mm {
+
+MultiROILayout::MultiROILayout() :
+   packedPixelCount_(0),
+   frameWidth_(0),
+   frameHeight_(0),
+   originX_(0),
+   originY_(0)
+{
+}
+
+MultiROILayout::MultiROILayout(const std::vector<unsigned>& xs,
+      const std::vector<unsigned>& ys,
+      const std::vector<unsigned>& widths,
+      const std::vector<unsigned>& heights,
+      unsigned frameWidth, unsigned frameHeight) :
+   packedPixelCount_(0),
+   frameWidth_(0),
+   frameHeight_(0),
+   originX_(0),
+   originY_(0)
+{
+   const size_t count = widths.size();
+   if (count == 0 || xs.size() != count || ys.size() != count ||
+         heights.size() != count)
+      return;
+
+   unsigned minX = xs[0], minY = ys[0], maxX = 0, maxY = 0;
+   for (size_t i = 0; i < count; ++i)
+   {
+      if (widths[i] == 0 || heights[i] == 0)
+         return;
+      minX = std::min(minX, xs[i]);
+      minY = std::min(minY, ys[i]);
+      maxX = std::max(maxX, xs[i] + widths[i]);
+      maxY = std::max(maxY, ys[i] + heights[i]);
+   }
+
+   unsigned originX = 0, originY = 0;
+   if (maxX > frameWidth || maxY > frameHeight)
+   {
+      // Not a whole-sensor frame; must be the bounding box
+      if (maxX - minX != frameWidth || maxY - minY != frameHeight)
+         return;
+      originX = minX;
+      originY = minY;
+   }
+
+   xs_ = xs;
+   ys_ = ys;
+   widths_ = widths;
+   heights_ = heights;
+   frameWidth_ = frameWidth;
+   frameHeight_ = frameHeight;
+   originX_ = originX;
+   originY_ = originY;
+   offsets_.resize(count);
+   for (size_t i = 0; i < count; ++i)
+   {
+      offsets_[i] = packedPixelCount_;
+      packedPixelCount_ += (size_t)widths[i] * heights[i];
+   }
+}
+
+void MultiROILayout::Pack(unsigned char* packed, const unsigned char* frame,
+      unsigned byteDepth) const
+{
+   const size_t frameStride = (size_t)frameWidth_ * byteDepth;
+   for (size_t i = 0; i < widths_.size(); ++i)
+   {
+      const size_t rowBytes = (size_t)widths_[i] * byteDepth;
+      const unsigned char* src = frame +
+         (ys_[i] - originY_) * frameStride + (xs_[i] - originX_) * byteDepth;
+      unsigned char* dst = packed + offsets_[i] * byteDepth;
+      for (unsigned row = 0; row < heights_[i]; ++row)
+      {
+         memcpy(dst, src, rowBytes);
+         src += frameStride;
+         dst += rowBytes;
+      }
+   }
+}
+
+void MultiROILayout::Unpack(unsigned char* frame, const unsigned char* packed,
+      unsigned byteDepth) const
+{
+   const size_t frameStride = (size_t)frameWidth_ * byteDepth;
+   memset(frame, 0, frameStride * frameHeight_);
+   for (size_t i = 0; i < widths_.size(); ++i)
+   {
+      const size_t rowBytes = (size_t)widths_[i] * byteDepth;
+      const unsigned char* src = packed + offsets_[i] * byteDepth;
+      unsigned char* dst = frame +
+         (ys_[i] - originY_) * frameStride + (xs_[i] - originX_) * byteDepth;
+      for (unsigned row = 0; row < heights_[i]; ++row)
+      {
+         memcpy(dst, src, rowBytes);
+         src += rowBytes;
+         dst += frameStride;
+      }
+   }
+}
+
+bool MultiROILayout::operator==(const MultiROILayout& other) const
+{
+   return xs_ == other.xs_ && ys_ == other.ys_ &&
+      widths_ == other.widths_ && heights_ == other.heights_ &&
+      frameWidth_ == other.frameWidth_ && frameHeight_ == other.frameHeight_;
+}
+
+} // namespace mm
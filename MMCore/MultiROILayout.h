@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          MultiROILayout.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Packed storage layout for multi-ROI camera frames: only the
+//                ROI rectangles, back to back, instead of the padded frame.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace mm {
+
+// Describes how the ROIs set with CMMCore::setMultiROI() are laid out in the
+// frames a camera delivers, and in packed images that hold just the ROIs:
+// ROI 0 row by row, then ROI 1, and so on, with no padding in between.
+//
+// Cameras deliver multi-ROI frames either as the whole sensor or cropped to
+// the bounding box of the ROIs. If the frame is large enough to hold all
+// ROIs at their sensor coordinates, the former is assumed; otherwise the
+// frame must be exactly the bounding box.
+//
+// An empty layout (default constructed, or from ROIs that do not fit the
+// frame) means images are not packed.
+class MultiROILayout
+{
+public:
+   MultiROILayout();
+   MultiROILayout(const std::vector<unsigned>& xs,
+         const std::vector<unsigned>& ys,
+         const std::vector<unsigned>& widths,
+         const std::vector<unsigned>& heights,
+         unsigned frameWidth, unsigned frameHeight);
+
+   bool IsEmpty() const { return widths_.empty(); }
+
+   size_t GetROICount() const { return widths_.size(); }
+   // Sensor coordinates, as passed to setMultiROI()
+   unsigned GetX(size_t roi) const { return xs_[roi]; }
+   unsigned GetY(size_t roi) const { return ys_[roi]; }
+   unsigned GetWidth(size_t roi) const { return widths_[roi]; }
+   unsigned GetHeight(size_t roi) const { return heights_[roi]; }
+   // Start of the ROI in a packed image, in pixels
+   size_t GetPackedOffset(size_t roi) const { return offsets_[roi]; }
+   size_t GetPackedPixelCount() const { return packedPixelCount_; }
+
+   // Size of the (unpacked) camera frame
+   unsigned GetFrameWidth() const { return frameWidth_; }
+   unsigned GetFrameHeight() const { return frameHeight_; }
+
+   // Copy the ROIs out of a frame
+   void Pack(unsigned char* packed, const unsigned char* frame,
+         unsigned byteDepth) const;
+   // Rebuild a frame from packed ROIs; pixels outside the ROIs are zero
+   void Unpack(unsigned char* frame, const unsigned char* packed,
+         unsigned byteDepth) const;
+
+   bool operator==(const MultiROILayout& other) const;
+   bool operator!=(const MultiROILayout& other) const
+   { return !(*this == other); }
+
+private:
+   std::vector<unsigned> xs_;
+   std::vector<unsigned> ys_;
+   std::vector<unsigned> widths_;
+   std::vector<unsigned> heights_;
+   std::vector<size_t> offsets_;
+   size_t packedPixelCount_;
+   unsigned frameWidth_;
+   unsigned frameHeight_;
+   unsigned originX_; // Sensor coordinates of the frame's top left pixel
+   unsigned originY_;
+};
+
+} // namespace mm
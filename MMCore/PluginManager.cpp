@@ -38,8 +38,11 @@
 #include "PluginManager.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <set>
@@ -65,6 +68,26 @@ const char* const LIB_NAME_SUFFIX = "";
 
 std::vector<std::string> CPluginManager::fallbackSearchPaths_;
 
+
+namespace {
+
+void LoadDeviceAdapterNoThrow(const std::string& moduleName,
+      const std::string& filename,
+      boost::shared_ptr<LoadedDeviceAdapter>* module)
+{
+   try
+   {
+      *module = boost::make_shared<LoadedDeviceAdapter>(moduleName, filename);
+   }
+   catch (const CMMError&)
+   {
+      // Reported if and when the module is requested
+   }
+}
+
+} // anonymous namespace
+
+
 CPluginManager::CPluginManager()
 {
    const std::vector<std::string> paths = GetDefaultSearchPaths();
@@ -166,6 +189,77 @@ CPluginManager::GetDeviceAdapter(const char* moduleName)
    return GetDeviceAdapter(std::string(moduleName));
 }
 
+std::vector<DeviceAdapterIndex::DeviceInfo>
+CPluginManager::GetAvailableDevices(const std::string& moduleName)
+{
+   // A module that is already loaded is queried directly (it may have been
+   // loaded from a file that has since changed)
+   const std::string path =
+      FindInSearchPath(LIB_NAME_PREFIX + moduleName + LIB_NAME_SUFFIX);
+   std::vector<DeviceAdapterIndex::DeviceInfo> indexed;
+   const bool isIndexed = index_.Lookup(path, indexed);
+   if (isIndexed && !moduleMap_.count(moduleName))
+      return indexed;
+
+   boost::shared_ptr<LoadedDeviceAdapter> module = GetDeviceAdapter(moduleName);
+   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices(names.size());
+   for (size_t i = 0; i < names.size(); ++i)
+   {
+      devices[i].name = names[i];
+      devices[i].description = module->GetDeviceDescription(names[i]);
+      devices[i].type = module->GetAdvertisedDeviceType(names[i]);
+   }
+
+   if (!isIndexed)
+      index_.Update(path, devices);
+   return devices;
+}
+
+/**
+ * Load several device adapter modules, each on its own thread.
+ *
+ * Modules that are already loaded are skipped. Modules that fail to load are
+ * not reported here; GetDeviceAdapter() will retry and throw the error when
+ * the module is requested.
+ */
+void
+CPluginManager::LoadDeviceAdapters(const std::vector<std::string>& moduleNames)
+{
+   std::vector<std::string> names;
+   std::vector<std::string> filenames;
+   for (std::vector<std::string>::const_iterator it = moduleNames.begin(),
+         end = moduleNames.end(); it != end; ++it)
+   {
+      if (it->empty() || moduleMap_.count(*it) ||
+            std::find(names.begin(), names.end(), *it) != names.end())
+         continue;
+      names.push_back(*it);
+      filenames.push_back(FindInSearchPath(LIB_NAME_PREFIX + *it +
+               LIB_NAME_SUFFIX));
+   }
+
+   std::vector< boost::shared_ptr<LoadedDeviceAdapter> > modules(names.size());
+   if (names.size() == 1)
+   {
+      LoadDeviceAdapterNoThrow(names[0], filenames[0], &modules[0]);
+   }
+   else
+   {
+      boost::thread_group threads;
+      for (size_t i = 0; i < names.size(); ++i)
+         threads.create_thread(boost::bind(&LoadDeviceAdapterNoThrow,
+                  boost::cref(names[i]), boost::cref(filenames[i]), &modules[i]));
+      threads.join_all();
+   }
+
+   for (size_t i = 0; i < names.size(); ++i)
+   {
+      if (modules[i])
+         moduleMap_[names[i]] = modules[i];
+   }
+}
+
 /** 
  * Unload a module.
  */
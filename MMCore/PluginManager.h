@@ -25,6 +25,7 @@
 
 
 #include "../MMDevice/DeviceThreads.h"
+#include "LoadableModules/DeviceAdapterIndex.h"
 
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
@@ -63,6 +64,22 @@ public:
    GetDeviceAdapter(const std::string& moduleName);
    boost::shared_ptr<LoadedDeviceAdapter>
    GetDeviceAdapter(const char* moduleName);
+   /**
+    * Load the given device adapter modules concurrently, ahead of use
+    */
+   void LoadDeviceAdapters(const std::vector<std::string>& moduleNames);
+
+   /**
+    * Return the devices provided by a device adapter module, from the index
+    * if the module file has not changed since it was indexed, otherwise by
+    * loading the module
+    */
+   std::vector<DeviceAdapterIndex::DeviceInfo>
+   GetAvailableDevices(const std::string& moduleName);
+
+   // File in which the device adapter index is kept (empty for none)
+   void SetIndexFile(const std::string& path) { index_.SetFile(path); }
+   std::string GetIndexFile() const { return index_.GetFile(); }
 
 private:
    static std::vector<std::string> GetDefaultSearchPaths();
@@ -74,6 +91,7 @@ private:
    static std::vector<std::string> fallbackSearchPaths_;
 
    std::map< std::string, boost::shared_ptr<LoadedDeviceAdapter> > moduleMap_;
+   DeviceAdapterIndex index_;
 };
 
 #endif //_PLUGIN_MANAGER_H_
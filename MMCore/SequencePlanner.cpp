@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SequencePlanner.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Splits a list of per-frame device settings into bursts that
+//                can each be run as one hardware-sequenced acquisition.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SequencePlanner.h"
+
+namespace mm {
+
+size_t
+SequenceAxis::GetLength() const
+{
+   return kind == DeviceProperty ? values.size() : numbers.size();
+}
+
+
+bool
+SequenceAxis::IsSameValue(size_t frame1, size_t frame2) const
+{
+   switch (kind)
+   {
+      case DeviceProperty:
+         return values[frame1] == values[frame2];
+      case XYPosition:
+         return numbers[frame1] == numbers[frame2] &&
+            yNumbers[frame1] == yNumbers[frame2];
+      default:
+         return numbers[frame1] == numbers[frame2];
+   }
+}
+
+
+namespace {
+
+// Whether frame can be added to the burst [start, frame)
+bool
+CanExtend(const SequenceAxis& axis, size_t start, size_t frame,
+      bool constantSoFar)
+{
+   if (constantSoFar && axis.IsSameValue(start, frame))
+      return true;
+   return axis.sequenceable &&
+      static_cast<long>(frame - start + 1) <= axis.maxSequenceLength;
+}
+
+} // anonymous namespace
+
+
+std::vector<SequenceBurst>
+PlanSequenceBursts(const std::vector<SequenceAxis>& axes, size_t frameCount)
+{
+   std::vector<SequenceBurst> bursts;
+   std::vector<bool> constant(axes.size());
+   size_t start = 0;
+   while (start < frameCount)
+   {
+      constant.assign(axes.size(), true);
+      size_t end = start + 1;
+      for (; end < frameCount; ++end)
+      {
+         bool fits = true;
+         for (size_t i = 0; i < axes.size() && fits; ++i)
+            fits = CanExtend(axes[i], start, end, constant[i]);
+         if (!fits)
+            break;
+         for (size_t i = 0; i < axes.size(); ++i)
+            constant[i] = constant[i] && axes[i].IsSameValue(start, end);
+      }
+
+      SequenceBurst burst;
+      burst.start = start;
+      burst.length = end - start;
+      bursts.push_back(burst);
+      start = end;
+   }
+   return bursts;
+}
+
+
+bool
+IsConstantDuring(const SequenceAxis& axis, const SequenceBurst& burst)
+{
+   for (size_t i = 1; i < burst.length; ++i)
+   {
+      if (!axis.IsSameValue(burst.start, burst.start + i))
+         return false;
+   }
+   return true;
+}
+
+} // namespace mm
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SequencePlanner.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Splits a list of per-frame device settings into bursts that
+//                can each be run as one hardware-sequenced acquisition.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// One independently controlled setting (a stage position, a device
+// property or the camera exposure) and its value for each frame
+struct SequenceAxis
+{
+   enum Kind
+   {
+      FocusPosition,  // numbers: position in um
+      XYPosition,     // numbers, yNumbers: x and y in um
+      DeviceProperty, // values: property values
+      Exposure        // numbers: exposure in ms
+   };
+
+   Kind kind;
+   std::string device;
+   std::string property; // DeviceProperty only
+
+   std::vector<std::string> values;
+   std::vector<double> numbers;
+   std::vector<double> yNumbers;
+
+   // Whether the device can step through a loaded sequence of values on
+   // hardware triggers, and how many values it can hold
+   bool sequenceable;
+   long maxSequenceLength;
+
+   size_t GetLength() const;
+   bool IsSameValue(size_t frame1, size_t frame2) const;
+};
+
+// Frames [start, start + length)
+struct SequenceBurst
+{
+   size_t start;
+   size_t length;
+};
+
+// Returns the fewest bursts that cover all frames in order, such that in
+// each burst every axis either stays constant (and can be set once before
+// the burst) or is sequenceable with the burst fitting within its maximum
+// sequence length. All axes must have the same length. Bursts are chosen
+// greedily, which gives the fewest bursts because any part of a valid burst
+// is also a valid burst.
+std::vector<SequenceBurst> PlanSequenceBursts(
+      const std::vector<SequenceAxis>& axes, size_t frameCount);
+
+bool IsConstantDuring(const SequenceAxis& axis, const SequenceBurst& burst);
+
+} // namespace mm
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StateCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of device property values, versioned so that readers
+//                can fetch only what changed.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "StateCache.h"
+
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace mm {
+
+namespace {
+
+bool
+CompareKeys(const PropertySetting& a, const PropertySetting& b)
+{
+   return a.getKey() < b.getKey();
+}
+
+} // anonymous namespace
+
+
+StateCache::StateCache() :
+   version_(0)
+{
+}
+
+
+void
+StateCache::Set(const PropertySetting& setting)
+{
+   const std::string key = setting.getKey();
+   Shard& shard = GetShard(key);
+   boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+   std::map<std::string, Entry>::iterator it = shard.entries.find(key);
+   if (it != shard.entries.end())
+   {
+      Entry& entry = it->second;
+      if (!entry.removed &&
+            entry.setting.getPropertyValue() == setting.getPropertyValue() &&
+            entry.setting.getReadOnly() == setting.getReadOnly())
+         return;
+      entry.setting = setting;
+      entry.removed = false;
+      entry.generation = NextGeneration();
+      return;
+   }
+
+   Entry entry;
+   entry.setting = setting;
+   entry.removed = false;
+   entry.generation = NextGeneration();
+   shard.entries.insert(std::make_pair(key, entry));
+}
+
+
+bool
+StateCache::Get(const std::string& device, const std::string& property,
+      PropertySetting& setting) const
+{
+   const std::string key =
+      PropertySetting::generateKey(device.c_str(), property.c_str());
+   const Shard& shard = GetShard(key);
+   boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+   std::map<std::string, Entry>::const_iterator it = shard.entries.find(key);
+   if (it == shard.entries.end() || it->second.removed)
+      return false;
+   setting = it->second.setting;
+   return true;
+}
+
+
+void
+StateCache::Replace(const Configuration& config)
+{
+   std::set<std::string> keys;
+   for (size_t i = 0; i < config.size(); ++i)
+   {
+      PropertySetting setting = config.getSetting(i);
+      keys.insert(setting.getKey());
+      Set(setting);
+   }
+
+   for (size_t s = 0; s < shardCount_; ++s)
+   {
+      Shard& shard = shards_[s];
+      boost::lock_guard<boost::mutex> lock(shard.mutex);
+      for (std::map<std::string, Entry>::iterator it = shard.entries.begin(),
+            end = shard.entries.end(); it != end; ++it)
+      {
+         Entry& entry = it->second;
+         if (!entry.removed && keys.find(it->first) == keys.end())
+         {
+            entry.removed = true;
+            entry.generation = NextGeneration();
+         }
+      }
+   }
+}
+
+
+Configuration
+StateCache::GetAll() const
+{
+   return Collect(-1, false);
+}
+
+
+long
+StateCache::GetVersion() const
+{
+   boost::lock_guard<boost::mutex> lock(versionMutex_);
+   return version_;
+}
+
+
+Configuration
+StateCache::GetChangesSince(long version) const
+{
+   return Collect(version, false);
+}
+
+
+Configuration
+StateCache::GetRemovalsSince(long version) const
+{
+   return Collect(version, true);
+}
+
+
+StateCache::Shard&
+StateCache::GetShard(const std::string& key)
+{
+   return shards_[boost::hash<std::string>()(key) % shardCount_];
+}
+
+
+const StateCache::Shard&
+StateCache::GetShard(const std::string& key) const
+{
+   return shards_[boost::hash<std::string>()(key) % shardCount_];
+}
+
+
+long
+StateCache::NextGeneration()
+{
+   // Called with the shard locked, so that a reader that has seen the new
+   // version also sees the entry (after waiting for the shard lock)
+   boost::lock_guard<boost::mutex> lock(versionMutex_);
+   return ++version_;
+}
+
+
+Configuration
+StateCache::Collect(long sinceVersion, bool removed) const
+{
+   std::vector<PropertySetting> settings;
+   for (size_t s = 0; s < shardCount_; ++s)
+   {
+      const Shard& shard = shards_[s];
+      boost::lock_guard<boost::mutex> lock(shard.mutex);
+      for (std::map<std::string, Entry>::const_iterator it = shard.entries.begin(),
+            end = shard.entries.end(); it != end; ++it)
+      {
+         const Entry& entry = it->second;
+         if (entry.removed == removed && entry.generation > sinceVersion)
+            settings.push_back(entry.setting);
+      }
+   }
+
+   // Group by device, as in a configuration from the devices
+   std::sort(settings.begin(), settings.end(), CompareKeys);
+   Configuration config;
+   for (std::vector<PropertySetting>::const_iterator it = settings.begin(),
+         end = settings.end(); it != end; ++it)
+      config.addSetting(*it);
+   return config;
+}
+
+} // namespace mm
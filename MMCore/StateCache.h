@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StateCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of device property values, versioned so that readers
+//                can fetch only what changed.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Configuration.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+
+namespace mm {
+
+// Property values by device and property name.
+//
+// Every change (including removal) takes the next number from a global
+// version counter and records it as the generation of the entry, so that
+// GetChangesSince() and GetRemovalsSince() only need to return entries with
+// a newer generation. Setting an entry to the value it already has is not a
+// change.
+//
+// Entries are spread over independently locked shards, so that writers to
+// different properties do not wait for each other or for a reader copying
+// the whole cache. As a consequence, a copy of the whole cache is not a
+// snapshot of one instant. A reader that wants every change exactly once
+// should call GetVersion() before GetChangesSince(); a change may then be
+// reported twice, but never missed.
+class StateCache
+{
+public:
+   StateCache();
+
+   void Set(const PropertySetting& setting);
+   // Returns false if the property is not cached
+   bool Get(const std::string& device, const std::string& property,
+         PropertySetting& setting) const;
+   // Make the cache hold exactly the settings in config
+   void Replace(const Configuration& config);
+
+   Configuration GetAll() const;
+   long GetVersion() const;
+   Configuration GetChangesSince(long version) const;
+   Configuration GetRemovalsSince(long version) const;
+
+private:
+   struct Entry
+   {
+      PropertySetting setting;
+      long generation;
+      bool removed; // Kept so that the removal can be reported
+   };
+
+   struct Shard
+   {
+      mutable boost::mutex mutex;
+      std::map<std::string, Entry> entries;
+   };
+
+   static const size_t shardCount_ = 16;
+
+   Shard& GetShard(const std::string& key);
+   const Shard& GetShard(const std::string& key) const;
+   long NextGeneration();
+   Configuration Collect(long sinceVersion, bool removed) const;
+
+   Shard shards_[shardCount_];
+   mutable boost::mutex versionMutex_;
+   long version_;
+};
+
+} // namespace mm
@@ -0,0 +1,521 @@
+// Acquisition throughput benchmark for MMCore.
+//
+// Drives CMMCore headlessly through snap, continuous and hardware-sequenced
+// acquisition using the DemoCamera or SequenceTester device adapters, and
+// prints one JSON object per mode (JSON Lines) with frame rate, dropped
+// frames and CPU time per frame. Snap mode reports the time per snap and
+// getImage() ("snapMs"); the other modes report the latency from insertion
+// into the circular buffer to pop ("latencyMs"). Not run by 'make check'; build with 'make benchmark'.
+//
+// Example:
+//    AcquisitionBenchmark --adapter-path ../../lib --adapter DemoCamera
+//       --width 2048 --height 2048 --exposure 1 --frames 2000
+
+#include "MMCore.h"
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+namespace {
+
+struct Options
+{
+   std::string adapterPath;
+   std::string adapter;
+   std::vector<std::string> modes;
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerPixel;
+   double exposureMs;
+   double intervalMs;
+   long frames;
+   unsigned bufferMB;
+   unsigned pollUs;
+   std::string outputFile;
+
+   Options() :
+      adapterPath("."),
+      adapter("DemoCamera"),
+      width(512),
+      height(512),
+      bytesPerPixel(1),
+      exposureMs(1.0),
+      intervalMs(0.0),
+      frames(1000),
+      bufferMB(256),
+      pollUs(100)
+   {
+      modes.push_back("snap");
+      modes.push_back("continuous");
+      modes.push_back("sequence");
+   }
+};
+
+struct Result
+{
+   std::string mode;
+   long framesReceived;
+   long framesDropped;
+   long bufferResets;
+   bool overflowed;
+   double elapsedS;
+   double cpuS;
+   std::vector<double> latenciesMs; // Per snap in snap mode
+   std::string error;
+
+   Result() :
+      framesReceived(0),
+      framesDropped(0),
+      bufferResets(0),
+      overflowed(false),
+      elapsedS(0.0),
+      cpuS(0.0)
+   {}
+};
+
+
+void PrintUsage()
+{
+   std::cerr <<
+      "Usage: AcquisitionBenchmark [options]\n"
+      "  --adapter-path DIR   Directory containing the device adapters (.)\n"
+      "  --adapter NAME       DemoCamera or SequenceTester (DemoCamera)\n"
+      "  --modes LIST         Comma-separated: snap,continuous,sequence (all)\n"
+      "  --width N            Frame width in pixels (512)\n"
+      "  --height N           Frame height in pixels (512)\n"
+      "  --bytes-per-pixel N  1 or 2; DemoCamera only (1)\n"
+      "  --exposure MS        Camera exposure; sets the frame rate (1)\n"
+      "  --interval MS        Sequence interval (0)\n"
+      "  --frames N           Frames per mode (1000)\n"
+      "  --buffer-mb N        Circular buffer size (256)\n"
+      "  --poll-us N          Sleep between empty buffer polls (100)\n"
+      "  --output FILE        Append results to FILE instead of stdout\n";
+}
+
+
+std::vector<std::string> SplitList(const std::string& list)
+{
+   std::vector<std::string> items;
+   std::istringstream stream(list);
+   std::string item;
+   while (std::getline(stream, item, ','))
+      if (!item.empty())
+         items.push_back(item);
+   return items;
+}
+
+
+bool ParseArgs(int argc, char** argv, Options& opts)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg(argv[i]);
+      if (arg == "--help" || arg == "-h" || i + 1 >= argc)
+         return false;
+      const std::string value(argv[++i]);
+      try
+      {
+         if (arg == "--adapter-path")
+            opts.adapterPath = value;
+         else if (arg == "--adapter")
+            opts.adapter = value;
+         else if (arg == "--modes")
+            opts.modes = SplitList(value);
+         else if (arg == "--width")
+            opts.width = boost::lexical_cast<unsigned>(value);
+         else if (arg == "--height")
+            opts.height = boost::lexical_cast<unsigned>(value);
+         else if (arg == "--bytes-per-pixel")
+            opts.bytesPerPixel = boost::lexical_cast<unsigned>(value);
+         else if (arg == "--exposure")
+            opts.exposureMs = boost::lexical_cast<double>(value);
+         else if (arg == "--interval")
+            opts.intervalMs = boost::lexical_cast<double>(value);
+         else if (arg == "--frames")
+            opts.frames = boost::lexical_cast<long>(value);
+         else if (arg == "--buffer-mb")
+            opts.bufferMB = boost::lexical_cast<unsigned>(value);
+         else if (arg == "--poll-us")
+            opts.pollUs = boost::lexical_cast<unsigned>(value);
+         else if (arg == "--output")
+            opts.outputFile = value;
+         else
+            return false;
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+         std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+         return false;
+      }
+   }
+   return opts.frames > 0 &&
+      (opts.bytesPerPixel == 1 || opts.bytesPerPixel == 2);
+}
+
+
+// User plus system CPU time of the whole process (all threads), in seconds
+double ProcessCPUSeconds()
+{
+#ifdef _WINDOWS
+   FILETIME creation, exit, kernel, user;
+   if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+      return 0.0;
+   ULARGE_INTEGER k, u;
+   k.LowPart = kernel.dwLowDateTime;
+   k.HighPart = kernel.dwHighDateTime;
+   u.LowPart = user.dwLowDateTime;
+   u.HighPart = user.dwHighDateTime;
+   return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0.0;
+   return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+
+double Percentile(const std::vector<double>& sorted, double fraction)
+{
+   if (sorted.empty())
+      return 0.0;
+   size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+   return sorted[std::min(index, sorted.size() - 1)];
+}
+
+
+std::string JsonString(const std::string& s)
+{
+   std::string out("\"");
+   for (size_t i = 0; i < s.size(); ++i)
+   {
+      const char c = s[i];
+      if (c == '"' || c == '\\')
+         out += std::string("\\") + c;
+      else if (static_cast<unsigned char>(c) < 0x20)
+      {
+         char buf[8];
+         snprintf(buf, sizeof(buf), "\\u%04x", c);
+         out += buf;
+      }
+      else
+         out += c;
+   }
+   return out + "\"";
+}
+
+
+void SetUpDevices(CMMCore& core, const Options& opts)
+{
+   std::vector<std::string> paths;
+   paths.push_back(opts.adapterPath);
+   core.setDeviceAdapterSearchPaths(paths);
+
+   if (opts.adapter == "DemoCamera")
+   {
+      core.loadDevice("Camera", "DemoCamera", "DCam");
+      core.loadDevice("Z", "DemoCamera", "DStage");
+      core.initializeAllDevices();
+
+      core.setProperty("Camera", "OnCameraCCDXSize", static_cast<long>(opts.width));
+      core.setProperty("Camera", "OnCameraCCDYSize", static_cast<long>(opts.height));
+      core.setProperty("Camera", MM::g_Keyword_PixelType,
+            opts.bytesPerPixel == 2 ? "16bit" : "8bit");
+      // Reuse the generated image so that the benchmark measures the core
+      // rather than the demo image synthesis
+      core.setProperty("Camera", "FastImage", 1L);
+      core.setProperty("Z", "UseSequences", "Yes");
+   }
+   else if (opts.adapter == "SequenceTester")
+   {
+      core.loadDevice("Hub", "SequenceTester", "THub");
+      core.loadDevice("Camera", "SequenceTester", "TCamera");
+      core.loadDevice("Z", "SequenceTester", "TZStage");
+      core.setParentLabel("Camera", "Hub");
+      core.setParentLabel("Z", "Hub");
+      core.setProperty("Camera", "ImageMode", "MachineReadable");
+      core.setProperty("Camera", "ImageWidth", static_cast<long>(opts.width));
+      core.setProperty("Camera", "ImageHeight", static_cast<long>(opts.height));
+      core.initializeAllDevices();
+
+      // Step the Z sequence on each exposure of the camera
+      core.setProperty("Z", "TriggerSourceDevice", "Camera");
+      core.setProperty("Z", "TriggerSourcePort", "ExposureStartEdge");
+      core.setProperty("Z", "TriggerSequenceMaxLength", opts.frames);
+   }
+   else
+   {
+      throw CMMError("Unknown adapter: " + opts.adapter);
+   }
+
+   core.setCameraDevice("Camera");
+   core.setFocusDevice("Z");
+   core.setExposure(opts.exposureMs);
+   core.setCircularBufferMemoryFootprint(opts.bufferMB);
+}
+
+
+void RunSnap(CMMCore& core, const Options& opts, Result& result)
+{
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+   for (long i = 0; i < opts.frames; ++i)
+   {
+      const boost::posix_time::ptime t0 =
+         boost::posix_time::microsec_clock::local_time();
+      core.snapImage();
+      core.getImage();
+      const boost::posix_time::ptime t1 =
+         boost::posix_time::microsec_clock::local_time();
+      result.latenciesMs.push_back((t1 - t0).total_microseconds() / 1000.0);
+      ++result.framesReceived;
+   }
+   result.elapsedS = (boost::posix_time::microsec_clock::local_time() - start).
+      total_microseconds() * 1e-6;
+}
+
+
+// Pops frames until the requested count has arrived or the sequence has
+// ended and the buffer is drained. Latency is measured from the
+// TimeReceivedByCore tag that the circular buffer adds on insertion.
+void PopFrames(CMMCore& core, const Options& opts,
+      const boost::posix_time::ptime& start, Result& result)
+{
+   const long capacity = core.getBufferTotalCapacity();
+   long nextImageNumber = 0;
+   while (result.framesReceived < opts.frames)
+   {
+      if (core.getRemainingImageCount() == 0)
+      {
+         if (!core.isSequenceRunning() && core.getRemainingImageCount() == 0)
+            break;
+         boost::this_thread::sleep(boost::posix_time::microseconds(opts.pollUs));
+         continue;
+      }
+
+      Metadata md;
+      core.popNextImageMD(md);
+      const boost::posix_time::ptime popped =
+         boost::posix_time::microsec_clock::local_time();
+      ++result.framesReceived;
+
+      if (md.HasTag(MM::g_Keyword_Metadata_TimeInCore))
+      {
+         const boost::posix_time::ptime inserted =
+            boost::posix_time::time_from_string(
+                  md.GetSingleTag(MM::g_Keyword_Metadata_TimeInCore).GetValue());
+         result.latenciesMs.push_back((popped - inserted).total_microseconds() / 1000.0);
+      }
+
+      // Image numbers are consecutive per camera and restart when the
+      // camera clears the buffer on overflow, at which point the buffer was
+      // full of frames that we had not popped
+      if (md.HasTag(MM::g_Keyword_Metadata_ImageNumber))
+      {
+         const long imageNumber = boost::lexical_cast<long>(
+               md.GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue());
+         if (imageNumber < nextImageNumber)
+         {
+            ++result.bufferResets;
+            result.framesDropped += capacity + imageNumber;
+         }
+         else
+            result.framesDropped += imageNumber - nextImageNumber;
+         nextImageNumber = imageNumber + 1;
+      }
+   }
+   result.elapsedS = (boost::posix_time::microsec_clock::local_time() - start).
+      total_microseconds() * 1e-6;
+   result.overflowed = core.isBufferOverflowed();
+}
+
+
+void RunContinuous(CMMCore& core, const Options& opts, Result& result)
+{
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+   core.startContinuousSequenceAcquisition(opts.intervalMs);
+   try
+   {
+      PopFrames(core, opts, start, result);
+   }
+   catch (...)
+   {
+      core.stopSequenceAcquisition();
+      throw;
+   }
+   core.stopSequenceAcquisition();
+}
+
+
+void RunSequence(CMMCore& core, const Options& opts, Result& result)
+{
+   const bool stageSequence = core.isStageSequenceable("Z");
+   if (stageSequence)
+   {
+      const long length = std::min(opts.frames,
+            core.getStageSequenceMaxLength("Z"));
+      std::vector<double> positions;
+      for (long i = 0; i < length; ++i)
+         positions.push_back(static_cast<double>(i % 100));
+      core.loadStageSequence("Z", positions);
+      core.startStageSequence("Z");
+   }
+
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+   try
+   {
+      core.startSequenceAcquisition(opts.frames, opts.intervalMs, false);
+      PopFrames(core, opts, start, result);
+   }
+   catch (...)
+   {
+      core.stopSequenceAcquisition();
+      if (stageSequence)
+         core.stopStageSequence("Z");
+      throw;
+   }
+   core.stopSequenceAcquisition();
+   if (stageSequence)
+      core.stopStageSequence("Z");
+
+   // The camera sends exactly the requested number of frames
+   result.framesDropped = opts.frames - result.framesReceived;
+}
+
+
+Result RunMode(CMMCore& core, const Options& opts, const std::string& mode)
+{
+   Result result;
+   result.mode = mode;
+   try
+   {
+      core.clearCircularBuffer();
+      const double cpuStart = ProcessCPUSeconds();
+      if (mode == "snap")
+         RunSnap(core, opts, result);
+      else if (mode == "continuous")
+         RunContinuous(core, opts, result);
+      else if (mode == "sequence")
+         RunSequence(core, opts, result);
+      else
+         result.error = "Unknown mode";
+      result.cpuS = ProcessCPUSeconds() - cpuStart;
+   }
+   catch (const CMMError& e)
+   {
+      result.error = e.getFullMsg();
+   }
+   return result;
+}
+
+
+std::string FormatResult(CMMCore& core, const Options& opts,
+      const Result& result)
+{
+   std::vector<double> sorted(result.latenciesMs);
+   std::sort(sorted.begin(), sorted.end());
+
+   const double frames = static_cast<double>(result.framesReceived);
+   const double fps = result.elapsedS > 0.0 ? frames / result.elapsedS : 0.0;
+   const double frameBytes = static_cast<double>(opts.width) * opts.height *
+      core.getBytesPerPixel();
+
+   std::ostringstream out;
+   out << "{\"benchmark\":\"acquisition\""
+      << ",\"adapter\":" << JsonString(opts.adapter)
+      << ",\"mode\":" << JsonString(result.mode)
+      << ",\"width\":" << opts.width
+      << ",\"height\":" << opts.height
+      << ",\"bytesPerPixel\":" << core.getBytesPerPixel()
+      << ",\"exposureMs\":" << opts.exposureMs
+      << ",\"intervalMs\":" << opts.intervalMs
+      << ",\"framesRequested\":" << opts.frames
+      << ",\"framesReceived\":" << result.framesReceived
+      << ",\"framesDropped\":" << result.framesDropped
+      << ",\"bufferResets\":" << result.bufferResets
+      << ",\"bufferOverflowed\":" << (result.overflowed ? "true" : "false")
+      << ",\"elapsedS\":" << result.elapsedS
+      << ",\"fps\":" << fps
+      << ",\"mbPerS\":" << fps * frameBytes / (1024.0 * 1024.0)
+      << ",\"cpuMsPerFrame\":" << (frames > 0 ? 1000.0 * result.cpuS / frames : 0.0)
+      << (result.mode == "snap" ? ",\"snapMs\":{" : ",\"latencyMs\":{")
+      << "\"p50\":" << Percentile(sorted, 0.50)
+      << ",\"p90\":" << Percentile(sorted, 0.90)
+      << ",\"p99\":" << Percentile(sorted, 0.99)
+      << ",\"max\":" << (sorted.empty() ? 0.0 : sorted.back())
+      << "}";
+   if (!result.error.empty())
+      out << ",\"error\":" << JsonString(result.error);
+   out << "}";
+   return out.str();
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   Options opts;
+   if (!ParseArgs(argc, argv, opts))
+   {
+      PrintUsage();
+      return 2;
+   }
+
+   std::ofstream file;
+   if (!opts.outputFile.empty())
+   {
+      file.open(opts.outputFile.c_str(), std::ios::out | std::ios::app);
+      if (!file)
+      {
+         std::cerr << "Cannot open " << opts.outputFile << "\n";
+         return 1;
+      }
+   }
+   std::ostream& out = opts.outputFile.empty() ? std::cout : file;
+
+   CMMCore core;
+   core.enableStderrLog(false);
+   try
+   {
+      SetUpDevices(core, opts);
+   }
+   catch (const CMMError& e)
+   {
+      std::cerr << "Device setup failed: " << e.getFullMsg() << "\n";
+      return 1;
+   }
+
+   int status = 0;
+   for (size_t i = 0; i < opts.modes.size(); ++i)
+   {
+      Result result = RunMode(core, opts, opts.modes[i]);
+      if (!result.error.empty())
+         status = 1;
+      out << FormatResult(core, opts, result) << std::endl;
+   }
+
+   core.unloadAllDevices();
+   return status;
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include "AsyncOperations.h"
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+
+namespace {
+
+// Operations that block until released, and count how many are running
+class Gate
+{
+public:
+   Gate() : open_(false), running_(0), maxRunning_(0) {}
+
+   void Pass()
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      maxRunning_ = std::max(maxRunning_, ++running_);
+      cond_.notify_all();
+      while (!open_)
+         cond_.wait(lock);
+      --running_;
+   }
+
+   void WaitForRunning(int count)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (running_ < count)
+         cond_.wait(lock);
+   }
+
+   void Open()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      open_ = true;
+      cond_.notify_all();
+   }
+
+   int GetMaxRunning()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return maxRunning_;
+   }
+
+private:
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   bool open_;
+   int running_;
+   int maxRunning_;
+};
+
+void Fail()
+{
+   throw CMMError("Stage stuck", MMERR_DEVICE_GENERIC);
+}
+
+void ThrowInt()
+{
+   throw 42;
+}
+
+void WaitFor(mm::AsyncOperations* ops, long id, bool* collected)
+{
+   *collected = ops->Wait(id);
+}
+
+} // anonymous namespace
+
+
+TEST(AsyncOperationsTests, RunsOperationsConcurrently)
+{
+   mm::AsyncOperations ops;
+   Gate gate;
+   std::vector<long> ids;
+   for (int i = 0; i < 3; ++i)
+      ids.push_back(ops.Start(boost::bind(&Gate::Pass, &gate)));
+
+   // Would block forever if the operations ran one at a time
+   gate.WaitForRunning(3);
+   bool done = true;
+   ASSERT_TRUE(ops.IsDone(ids[0], done));
+   EXPECT_FALSE(done);
+
+   gate.Open();
+   for (size_t i = 0; i < ids.size(); ++i)
+      EXPECT_TRUE(ops.Wait(ids[i]));
+   EXPECT_EQ(3, gate.GetMaxRunning());
+   EXPECT_TRUE(ops.GetIds().empty());
+}
+
+TEST(AsyncOperationsTests, ReportsErrorOnce)
+{
+   mm::AsyncOperations ops;
+   long id = ops.Start(&Fail);
+   EXPECT_TRUE(ops.IsKnown(id));
+   try
+   {
+      ops.Wait(id);
+      FAIL() << "Error was not rethrown";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ("Stage stuck", e.getMsg());
+      EXPECT_EQ(MMERR_DEVICE_GENERIC, e.getCode());
+   }
+   EXPECT_FALSE(ops.IsKnown(id));
+   EXPECT_FALSE(ops.Wait(id));
+}
+
+TEST(AsyncOperationsTests, ReportsUnknownExceptions)
+{
+   mm::AsyncOperations ops;
+   long id = ops.Start(&ThrowInt);
+   EXPECT_THROW(ops.Wait(id), CMMError);
+   EXPECT_FALSE(ops.IsKnown(id));
+}
+
+TEST(AsyncOperationsTests, OnlyOneWaiterCollects)
+{
+   Gate gate;
+   mm::AsyncOperations ops;
+   long id = ops.Start(boost::bind(&Gate::Pass, &gate));
+   gate.WaitForRunning(1);
+
+   bool collected[2];
+   boost::thread first(boost::bind(&WaitFor, &ops, id, &collected[0]));
+   boost::thread second(boost::bind(&WaitFor, &ops, id, &collected[1]));
+   gate.Open();
+   first.join();
+   second.join();
+   EXPECT_NE(collected[0], collected[1]);
+   EXPECT_FALSE(ops.IsKnown(id));
+}
+
+TEST(AsyncOperationsTests, IdsAreNotReused)
+{
+   mm::AsyncOperations ops;
+   long first = ops.Start(&Fail);
+   ops.Clear();
+   long second = ops.Start(&Fail);
+   EXPECT_LT(0, first);
+   EXPECT_NE(first, second);
+   bool done;
+   EXPECT_FALSE(ops.IsDone(first, done));
+}
+
+TEST(AsyncOperationsTests, CoreRejectsInvalidRequests)
+{
+   CMMCore core;
+   EXPECT_THROW(core.setPositionAsync("NoSuchStage", 1.0), CMMError);
+   EXPECT_THROW(core.setConfigAsync("NoSuchGroup", "NoSuchPreset"), CMMError);
+   EXPECT_THROW(core.waitForOperation(42), CMMError);
+   EXPECT_THROW(core.isOperationDone(42), CMMError);
+   EXPECT_NO_THROW(core.waitForOperations(std::vector<long>()));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+
+#include "CallbackDispatcher.h"
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+// Records notifications; optionally blocks in the first stage notification
+// until released, to simulate a slow listener.
+class RecordingCallback : public MMEventCallback
+{
+public:
+   RecordingCallback() : block_(false), blocked_(false) {}
+
+   void BlockNextStageEvent()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      block_ = true;
+   }
+
+   void WaitUntilBlocked()
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!blocked_)
+         cond_.wait(lock);
+   }
+
+   void Release()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      block_ = false;
+      cond_.notify_all();
+   }
+
+   std::vector<std::string> Events()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return events_;
+   }
+
+   virtual void onPropertyChanged(const char* name, const char* propName,
+         const char* propValue)
+   {
+      Record(std::string("prop ") + name + " " + propName + " " + propValue);
+   }
+
+   virtual void onStagePositionChanged(char* name, double pos)
+   {
+      std::ostringstream s;
+      s << "stage " << name << " " << pos;
+      Record(s.str());
+
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (block_)
+      {
+         blocked_ = true;
+         cond_.notify_all();
+         while (block_)
+            cond_.wait(lock);
+      }
+   }
+
+   virtual void onXYStagePositionChanged(char* name, double xpos, double ypos)
+   {
+      std::ostringstream s;
+      s << "xy " << name << " " << xpos << " " << ypos;
+      Record(s.str());
+   }
+
+private:
+   void Record(const std::string& event)
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      events_.push_back(event);
+   }
+
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   bool block_;
+   bool blocked_;
+   std::vector<std::string> events_;
+};
+
+// Releases the listener once the dispatcher's queue has been cleared
+void ReleaseWhenQueueEmpty(RecordingCallback* cb,
+      mm::CallbackDispatcher* dispatcher)
+{
+   while (dispatcher->GetQueueDepth() > 0)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+   cb->Release();
+}
+
+char* Label(const char* label)
+{
+   static std::vector<char> buf;
+   buf.assign(label, label + strlen(label) + 1);
+   return &buf[0];
+}
+
+} // anonymous namespace
+
+
+TEST(CallbackDispatcherTests, DeliversInOrder)
+{
+   RecordingCallback cb;
+   mm::CallbackDispatcher dispatcher;
+   dispatcher.SetTarget(&cb);
+
+   dispatcher.onStagePositionChanged(Label("Z"), 1.0);
+   dispatcher.onPropertyChanged("Camera", "Exposure", "10");
+   dispatcher.onXYStagePositionChanged(Label("XY"), 2.0, 3.0);
+   dispatcher.Flush();
+
+   std::vector<std::string> events = cb.Events();
+   ASSERT_EQ(3u, events.size());
+   EXPECT_EQ("stage Z 1", events[0]);
+   EXPECT_EQ("prop Camera Exposure 10", events[1]);
+   EXPECT_EQ("xy XY 2 3", events[2]);
+   EXPECT_EQ(3u, dispatcher.GetDeliveredCount());
+   EXPECT_EQ(0u, dispatcher.GetQueueDepth());
+}
+
+TEST(CallbackDispatcherTests, CoalescesWhileListenerIsBusy)
+{
+   RecordingCallback cb;
+   mm::CallbackDispatcher dispatcher;
+   dispatcher.SetTarget(&cb);
+
+   cb.BlockNextStageEvent();
+   dispatcher.onStagePositionChanged(Label("Z"), 0.0);
+   cb.WaitUntilBlocked();
+
+   for (int i = 1; i <= 100; ++i)
+      dispatcher.onStagePositionChanged(Label("Z"), i);
+   for (int i = 1; i <= 100; ++i)
+      dispatcher.onPropertyChanged("Camera", "Exposure", i % 2 ? "1" : "2");
+   dispatcher.onPropertyChanged("Camera", "Gain", "5");
+   dispatcher.onStagePositionChanged(Label("Z2"), 7.0);
+   EXPECT_EQ(4u, dispatcher.GetQueueDepth());
+
+   cb.Release();
+   dispatcher.Flush();
+
+   std::vector<std::string> events = cb.Events();
+   ASSERT_EQ(5u, events.size());
+   EXPECT_EQ("stage Z 0", events[0]);
+   EXPECT_EQ("stage Z 100", events[1]);
+   EXPECT_EQ("prop Camera Exposure 2", events[2]);
+   EXPECT_EQ("prop Camera Gain 5", events[3]);
+   EXPECT_EQ("stage Z2 7", events[4]);
+   EXPECT_EQ(198u, dispatcher.GetCoalescedCount());
+   EXPECT_EQ(4u, dispatcher.GetMaxQueueDepth());
+   EXPECT_GT(dispatcher.GetMaxLatencyMs(), 0.0);
+}
+
+TEST(CallbackDispatcherTests, CoalescesOnlyWithLastQueued)
+{
+   RecordingCallback cb;
+   mm::CallbackDispatcher dispatcher;
+   dispatcher.SetTarget(&cb);
+
+   cb.BlockNextStageEvent();
+   dispatcher.onStagePositionChanged(Label("Z"), 0.0);
+   cb.WaitUntilBlocked();
+
+   dispatcher.onStagePositionChanged(Label("Z"), 1.0);
+   dispatcher.onPropertyChanged("Camera", "Exposure", "10");
+   dispatcher.onStagePositionChanged(Label("Z"), 2.0);
+   dispatcher.onStagePositionChanged(Label("Z"), 3.0);
+   EXPECT_EQ(3u, dispatcher.GetQueueDepth());
+
+   cb.Release();
+   dispatcher.Flush();
+
+   std::vector<std::string> events = cb.Events();
+   ASSERT_EQ(4u, events.size());
+   EXPECT_EQ("stage Z 0", events[0]);
+   EXPECT_EQ("stage Z 1", events[1]);
+   EXPECT_EQ("prop Camera Exposure 10", events[2]);
+   EXPECT_EQ("stage Z 3", events[3]);
+   EXPECT_EQ(1u, dispatcher.GetCoalescedCount());
+}
+
+TEST(CallbackDispatcherTests, NothingIsDeliveredAfterTargetIsCleared)
+{
+   RecordingCallback cb;
+   mm::CallbackDispatcher dispatcher;
+   dispatcher.SetTarget(&cb);
+
+   cb.BlockNextStageEvent();
+   dispatcher.onStagePositionChanged(Label("Z"), 0.0);
+   cb.WaitUntilBlocked();
+   dispatcher.onStagePositionChanged(Label("Z"), 1.0);
+
+   // SetTarget() discards the queued notification and then waits for the
+   // blocked one, so release it from another thread
+   boost::thread releaser(boost::bind(&ReleaseWhenQueueEmpty, &cb, &dispatcher));
+   dispatcher.SetTarget(0);
+   releaser.join();
+
+   dispatcher.onStagePositionChanged(Label("Z"), 2.0);
+   dispatcher.Flush();
+   std::vector<std::string> events = cb.Events();
+   ASSERT_EQ(1u, events.size());
+   EXPECT_EQ("stage Z 0", events[0]);
+}
+
+TEST(CallbackDispatcherTests, CoreDeliversSynchronouslyOrAsynchronously)
+{
+   RecordingCallback cb;
+   CMMCore core;
+   core.registerCallback(&cb);
+   ASSERT_FALSE(core.asyncCallbacksEnabled());
+
+   core.setProperty("Core", "AutoShutter", "0");
+   std::vector<std::string> events = cb.Events();
+   ASSERT_EQ(1u, events.size());
+   EXPECT_EQ("prop Core AutoShutter 0", events[0]);
+   EXPECT_EQ(0, core.getCallbackDeliveredCount());
+
+   core.enableAsyncCallbacks(true);
+   core.setProperty("Core", "AutoShutter", "1");
+   core.flushCallbacks();
+   events = cb.Events();
+   ASSERT_EQ(2u, events.size());
+   EXPECT_EQ("prop Core AutoShutter 1", events[1]);
+   EXPECT_EQ(1, core.getCallbackDeliveredCount());
+
+   core.registerCallback(0);
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
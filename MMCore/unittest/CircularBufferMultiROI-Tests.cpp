@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "MultiROILayout.h"
+
+#include <boost/make_shared.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace {
+
+// Two ROIs on a 1024x1024 sensor: 100x20 at (10, 30) and 50x40 at (500, 900)
+boost::shared_ptr<const mm::MultiROILayout> MakeLayout(unsigned frameWidth,
+      unsigned frameHeight)
+{
+   std::vector<unsigned> xs, ys, widths, heights;
+   xs.push_back(10); ys.push_back(30); widths.push_back(100); heights.push_back(20);
+   xs.push_back(500); ys.push_back(900); widths.push_back(50); heights.push_back(40);
+   return boost::make_shared<mm::MultiROILayout>(xs, ys, widths, heights,
+         frameWidth, frameHeight);
+}
+
+// 16-bit frame whose pixels encode their sensor coordinates
+std::vector<unsigned short> MakeFrame(unsigned width, unsigned height,
+      unsigned originX, unsigned originY)
+{
+   std::vector<unsigned short> frame(width * height);
+   for (unsigned y = 0; y < height; ++y)
+      for (unsigned x = 0; x < width; ++x)
+         frame[y * width + x] = static_cast<unsigned short>(
+               (originX + x) * 7 + (originY + y) * 13);
+   return frame;
+}
+
+unsigned short PixelAt(unsigned x, unsigned y)
+{
+   return static_cast<unsigned short>(x * 7 + y * 13);
+}
+
+} // anonymous namespace
+
+
+TEST(MultiROILayoutTests, PacksBoundingBoxFrame)
+{
+   // Bounding box: (10, 30) to (550, 940)
+   boost::shared_ptr<const mm::MultiROILayout> layout = MakeLayout(540, 910);
+   ASSERT_FALSE(layout->IsEmpty());
+   ASSERT_EQ(2u, layout->GetROICount());
+   EXPECT_EQ(0u, layout->GetPackedOffset(0));
+   EXPECT_EQ(2000u, layout->GetPackedOffset(1));
+   EXPECT_EQ(4000u, layout->GetPackedPixelCount());
+
+   std::vector<unsigned short> frame = MakeFrame(540, 910, 10, 30);
+   std::vector<unsigned short> packed(layout->GetPackedPixelCount());
+   layout->Pack(reinterpret_cast<unsigned char*>(&packed[0]),
+         reinterpret_cast<const unsigned char*>(&frame[0]), 2);
+   EXPECT_EQ(PixelAt(10, 30), packed[0]);
+   EXPECT_EQ(PixelAt(109, 49), packed[1999]);
+   EXPECT_EQ(PixelAt(500, 900), packed[2000]);
+   EXPECT_EQ(PixelAt(549, 939), packed[3999]);
+
+   std::vector<unsigned short> unpacked(frame.size(), 0xffff);
+   layout->Unpack(reinterpret_cast<unsigned char*>(&unpacked[0]),
+         reinterpret_cast<const unsigned char*>(&packed[0]), 2);
+   EXPECT_EQ(frame[0], unpacked[0]);
+   EXPECT_EQ(frame[909 * 540 + 539], unpacked[909 * 540 + 539]);
+   EXPECT_EQ(0, unpacked[540 * 100 + 200]); // Between the ROIs
+}
+
+TEST(MultiROILayoutTests, PacksWholeSensorFrame)
+{
+   boost::shared_ptr<const mm::MultiROILayout> layout = MakeLayout(1024, 1024);
+   ASSERT_FALSE(layout->IsEmpty());
+
+   std::vector<unsigned short> frame = MakeFrame(1024, 1024, 0, 0);
+   std::vector<unsigned short> packed(layout->GetPackedPixelCount());
+   layout->Pack(reinterpret_cast<unsigned char*>(&packed[0]),
+         reinterpret_cast<const unsigned char*>(&frame[0]), 2);
+   EXPECT_EQ(PixelAt(10, 30), packed[0]);
+   EXPECT_EQ(PixelAt(549, 939), packed[3999]);
+}
+
+TEST(MultiROILayoutTests, RejectsROIsOutsideFrame)
+{
+   EXPECT_TRUE(MakeLayout(540, 900)->IsEmpty());
+   EXPECT_TRUE(MakeLayout(512, 512)->IsEmpty());
+   EXPECT_TRUE(mm::MultiROILayout().IsEmpty());
+}
+
+TEST(CircularBufferMultiROITests, StoresPackedImages)
+{
+   CircularBuffer unpackedBuffer(10);
+   ASSERT_TRUE(unpackedBuffer.Initialize(1, 540, 910, 2));
+
+   boost::shared_ptr<const mm::MultiROILayout> layout = MakeLayout(540, 910);
+   CircularBuffer cb(10);
+   ASSERT_TRUE(cb.Initialize(1, 540, 910, 2, layout));
+   ASSERT_TRUE(cb.GetMultiROILayout().get() != 0);
+   EXPECT_EQ(4000u, cb.Width());
+   EXPECT_EQ(1u, cb.Height());
+   EXPECT_GT(cb.GetSize(), 100 * unpackedBuffer.GetSize());
+
+   std::vector<unsigned short> frame = MakeFrame(540, 910, 10, 30);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   ASSERT_TRUE(cb.InsertImage(reinterpret_cast<unsigned char*>(&frame[0]),
+            540, 910, 2, &md));
+
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(4000u, img->Width());
+   EXPECT_EQ(1u, img->Height());
+   const unsigned short* pixels =
+      reinterpret_cast<const unsigned short*>(img->GetPixels());
+   EXPECT_EQ(PixelAt(10, 30), pixels[0]);
+   EXPECT_EQ(PixelAt(500, 900), pixels[2000]);
+
+   // Metadata describes the camera frame
+   const Metadata& imgMd = img->GetMetadata();
+   EXPECT_EQ("540", imgMd.GetSingleTag("Width").GetValue());
+   EXPECT_EQ("910", imgMd.GetSingleTag("Height").GetValue());
+   EXPECT_EQ("2", imgMd.GetSingleTag(
+            MM::g_Keyword_Metadata_MultiROICount).GetValue());
+}
+
+TEST(CircularBufferMultiROITests, AcceptsPrepackedImages)
+{
+   boost::shared_ptr<const mm::MultiROILayout> layout = MakeLayout(540, 910);
+   CircularBuffer cb(10);
+   ASSERT_TRUE(cb.Initialize(1, 540, 910, 2, layout));
+
+   std::vector<unsigned short> packed(4000, 42);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   ASSERT_TRUE(cb.InsertImage(reinterpret_cast<unsigned char*>(&packed[0]),
+            4000, 1, 2, &md));
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(42, reinterpret_cast<const unsigned short*>(img->GetPixels())[3999]);
+   EXPECT_EQ("540", img->GetMetadata().GetSingleTag("Width").GetValue());
+
+   std::vector<unsigned short> other(100 * 100);
+   EXPECT_THROW(cb.InsertImage(reinterpret_cast<unsigned char*>(&other[0]),
+            100, 100, 2, &md), CMMError);
+}
+
+TEST(CircularBufferMultiROITests, LayoutMustMatchFrameSize)
+{
+   CircularBuffer cb(10);
+   EXPECT_FALSE(cb.Initialize(1, 1024, 1024, 2, MakeLayout(540, 910)));
+
+   // An empty layout means no packing
+   ASSERT_TRUE(cb.Initialize(1, 540, 910, 2,
+            boost::make_shared<mm::MultiROILayout>()));
+   EXPECT_TRUE(cb.GetMultiROILayout().get() == 0);
+   EXPECT_EQ(540u, cb.Width());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
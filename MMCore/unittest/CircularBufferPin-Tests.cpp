@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+const unsigned width = 512;
+const unsigned height = 512; // 256 KiB per 8-bit frame
+
+bool InsertFrame(CircularBuffer& cb, unsigned char value)
+{
+   std::vector<unsigned char> pixels(width * height, value);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   return cb.InsertImage(&pixels[0], width, height, 1, &md);
+}
+
+void UnpinLater(CircularBuffer* cb, long handle)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   cb->Unpin(handle);
+}
+
+} // anonymous namespace
+
+
+TEST(CircularBufferPinTests, PinnedImageIsNotOverwritten)
+{
+   CircularBuffer cb(1); // 4 frames
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+
+   long handle = cb.PinNextImage(0);
+   ASSERT_GT(handle, 0);
+   const mm::ImgBuffer* pinned = cb.GetPinnedImage(handle);
+   ASSERT_TRUE(pinned != 0);
+   const unsigned char* pixels = pinned->GetPixels();
+   EXPECT_EQ(0, pixels[0]);
+
+   // Reuses the pinned slot
+   ASSERT_TRUE(InsertFrame(cb, 4));
+   EXPECT_EQ(pinned, cb.GetPinnedImage(handle));
+   EXPECT_EQ(pixels, pinned->GetPixels());
+   EXPECT_EQ(0, pixels[0]);
+   EXPECT_EQ(0, pixels[width * height - 1]);
+
+   for (unsigned char i = 1; i < 5; ++i)
+   {
+      const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+      ASSERT_TRUE(img != 0);
+      EXPECT_EQ(i, img->GetPixels()[0]);
+   }
+   EXPECT_FALSE(cb.Overflow());
+
+   EXPECT_EQ(1u, cb.GetPinnedImageCount());
+   EXPECT_TRUE(cb.Unpin(handle));
+   EXPECT_EQ(0u, cb.GetPinnedImageCount());
+   EXPECT_FALSE(cb.Unpin(handle));
+   EXPECT_TRUE(cb.GetPinnedImage(handle) == 0);
+}
+
+TEST(CircularBufferPinTests, TopImageCanBePinnedMoreThanOnce)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   EXPECT_EQ(0, cb.PinTopImage(0));
+   EXPECT_EQ(0, cb.PinNextImage(0));
+
+   ASSERT_TRUE(InsertFrame(cb, 7));
+   long first = cb.PinTopImage(0);
+   long second = cb.PinTopImage(0);
+   ASSERT_GT(first, 0);
+   ASSERT_GT(second, 0);
+   EXPECT_NE(first, second);
+   EXPECT_EQ(cb.GetPinnedImage(first), cb.GetPinnedImage(second));
+   EXPECT_EQ("Cam", cb.GetPinnedImage(first)->GetMetadata().
+         GetSingleTag("Camera").GetValue());
+   EXPECT_EQ(0, cb.PinTopImage(1)); // No such channel
+
+   EXPECT_TRUE(cb.Unpin(first));
+   EXPECT_TRUE(cb.Unpin(second));
+}
+
+TEST(CircularBufferPinTests, ProducerWaitsForPinnedSlot)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   cb.SetPinWaitTimeoutMs(10);
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+   long handle = cb.PinNextImage(0);
+   ASSERT_GT(handle, 0);
+
+   // Times out
+   EXPECT_FALSE(InsertFrame(cb, 4));
+   EXPECT_TRUE(cb.Overflow());
+   EXPECT_EQ(0, cb.GetPinnedImage(handle)->GetPixels()[0]);
+
+   // Succeeds once the slot is released (the pin outlives Clear())
+   cb.Clear();
+   cb.SetPinWaitTimeoutMs(10000);
+   boost::thread releaser(boost::bind(UnpinLater, &cb, handle));
+   EXPECT_TRUE(InsertFrame(cb, 4));
+   releaser.join();
+   EXPECT_EQ(0u, cb.GetPinnedImageCount());
+   EXPECT_FALSE(cb.Overflow());
+   EXPECT_EQ(4, cb.GetTopImage()[0]);
+}
+
+TEST(CircularBufferPinTests, PinnedImageSurvivesReinitialization)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   ASSERT_TRUE(InsertFrame(cb, 42));
+   long handle = cb.PinTopImage(0);
+   ASSERT_GT(handle, 0);
+
+   ASSERT_TRUE(cb.Initialize(1, width / 2, height / 2, 2));
+   const mm::ImgBuffer* pinned = cb.GetPinnedImage(handle);
+   ASSERT_TRUE(pinned != 0);
+   EXPECT_EQ(width, pinned->Width());
+   EXPECT_EQ(42, pinned->GetPixels()[width * height - 1]);
+   EXPECT_TRUE(cb.Unpin(handle));
+}
+
+TEST(CircularBufferPinTests, SpilledTopImageIsCopied)
+{
+   const char* tmp = std::getenv("TMPDIR");
+   const std::string path = std::string(tmp ? tmp : "/tmp") +
+      "/mmcore-pin-test.bin";
+
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   cb.EnableSpill(path, 1);
+   for (unsigned char i = 0; i < 6; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+   ASSERT_EQ(2u, cb.GetSpilledImageCount());
+
+   long handle = cb.PinTopImage(0);
+   ASSERT_GT(handle, 0);
+   for (unsigned char i = 0; i < 6; ++i)
+      ASSERT_TRUE(cb.GetNextImageBuffer(0) != 0);
+   EXPECT_EQ(5, cb.GetPinnedImage(handle)->GetPixels()[0]);
+   EXPECT_TRUE(cb.Unpin(handle));
+   cb.DisableSpill();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+const unsigned width = 512;
+const unsigned height = 512; // 256 KiB per 8-bit frame
+
+std::string SpillPath()
+{
+   const char* tmp = std::getenv("TMPDIR");
+   return std::string(tmp ? tmp : "/tmp") + "/mmcore-spill-test.bin";
+}
+
+bool InsertFrame(CircularBuffer& cb, unsigned char value)
+{
+   std::vector<unsigned char> pixels(width * height, value);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   return cb.InsertImage(&pixels[0], width, height, 1, &md);
+}
+
+} // anonymous namespace
+
+
+TEST(CircularBufferSpillTests, FramesAreReturnedInOrder)
+{
+   CircularBuffer cb(1); // 4 frames in RAM
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   ASSERT_EQ(4u, cb.GetSize());
+
+   cb.EnableSpill(SpillPath(), 2); // 8 frames on disk
+   ASSERT_TRUE(cb.IsSpillEnabled());
+   ASSERT_EQ(8u, cb.GetSpillCapacity());
+   ASSERT_EQ(12u, cb.GetSize());
+
+   for (unsigned char i = 0; i < 10; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+   EXPECT_EQ(10u, cb.GetRemainingImageCount());
+   EXPECT_EQ(6u, cb.GetSpilledImageCount());
+
+   // The newest frame is in the spill file
+   const unsigned char* top = cb.GetTopImage();
+   ASSERT_TRUE(top != 0);
+   EXPECT_EQ(9, top[0]);
+
+   for (unsigned char i = 0; i < 10; ++i)
+   {
+      const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+      ASSERT_TRUE(img != 0);
+      EXPECT_EQ(i, img->GetPixels()[0]);
+      EXPECT_EQ(i, img->GetPixels()[width * height - 1]);
+      EXPECT_EQ(CDeviceUtils::ConvertToString(i),
+            img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue());
+   }
+   EXPECT_TRUE(cb.GetNextImageBuffer(0) == 0);
+   EXPECT_EQ(0u, cb.GetSpilledImageCount());
+   EXPECT_FALSE(cb.Overflow());
+}
+
+TEST(CircularBufferSpillTests, OverflowsWhenSpillIsFull)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   cb.EnableSpill(SpillPath(), 1);
+
+   for (unsigned char i = 0; i < 8; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+   EXPECT_FALSE(InsertFrame(cb, 8));
+   EXPECT_TRUE(cb.Overflow());
+
+   cb.DisableSpill();
+   EXPECT_FALSE(cb.IsSpillEnabled());
+   EXPECT_EQ(4u, cb.GetRemainingImageCount());
+}
+
+TEST(CircularBufferSpillTests, NoSpillWhenDisabled)
+{
+   CircularBuffer cb(1);
+   ASSERT_TRUE(cb.Initialize(1, width, height, 1));
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(InsertFrame(cb, i));
+   EXPECT_FALSE(InsertFrame(cb, 4));
+   EXPECT_EQ(0u, cb.GetSpilledImageCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include "ConfigFileParser.h"
+#include "MMCore.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+std::vector<mm::ConfigCommand> Parse(const std::string& text)
+{
+   std::istringstream in(text);
+   return mm::ParseConfigFile(in);
+}
+
+// Writes a configuration file that is removed when the object goes away
+class TempConfigFile
+{
+public:
+   explicit TempConfigFile(const std::string& text) :
+      path_("ConfigFileParser-Tests.cfg")
+   {
+      std::ofstream out(path_.c_str(), std::ios_base::binary);
+      out << text;
+   }
+   ~TempConfigFile() { std::remove(path_.c_str()); }
+   const char* Path() const { return path_.c_str(); }
+
+private:
+   std::string path_;
+};
+
+} // anonymous namespace
+
+
+TEST(ConfigFileParserTests, SkipsCommentsBlankLinesAndUnknownCommands)
+{
+   std::vector<mm::ConfigCommand> commands = Parse(
+         "# Generated\r\n"
+         "\r\n"
+         "Frobnicate,1,2\r\n"
+         "Device,Cam,DemoCamera,DCam\r\n");
+   ASSERT_EQ(1u, commands.size());
+   EXPECT_EQ(mm::ConfigCommand::LoadDevice, commands[0].type);
+   EXPECT_EQ(4, commands[0].lineNumber);
+   EXPECT_EQ("Device,Cam,DemoCamera,DCam", commands[0].line);
+   ASSERT_EQ(3u, commands[0].args.size());
+   EXPECT_EQ("Cam", commands[0].args[0]);
+   EXPECT_EQ("DCam", commands[0].args[2]);
+}
+
+TEST(ConfigFileParserTests, FillsInOmittedTrailingValue)
+{
+   std::vector<mm::ConfigCommand> commands = Parse(
+         "Property,Cam,Description,\n"
+         "ConfigGroup,Channel,DAPI,Cam,Mode,\n"
+         "ConfigGroup,Channel\n");
+   ASSERT_EQ(3u, commands.size());
+   EXPECT_EQ(mm::ConfigCommand::SetProperty, commands[0].type);
+   ASSERT_EQ(3u, commands[0].args.size());
+   EXPECT_EQ("", commands[0].args[2]);
+   EXPECT_EQ(mm::ConfigCommand::DefineConfig, commands[1].type);
+   ASSERT_EQ(5u, commands[1].args.size());
+   EXPECT_EQ("", commands[1].args[4]);
+   EXPECT_EQ(mm::ConfigCommand::DefineConfigGroup, commands[2].type);
+   EXPECT_TRUE(commands[1].IsPresetDefinition());
+   EXPECT_TRUE(commands[2].IsPresetDefinition());
+}
+
+TEST(ConfigFileParserTests, MarksWrongFieldCountInvalid)
+{
+   std::vector<mm::ConfigCommand> commands = Parse(
+         "Device,Cam,DemoCamera\n"
+         "PixelSizeAffine,Res10x,1,0,0,0,1\n"
+         ",,,\n"
+         "Parent,Z,Hub\n");
+   ASSERT_EQ(4u, commands.size());
+   EXPECT_EQ(mm::ConfigCommand::Invalid, commands[0].type);
+   EXPECT_EQ(mm::ConfigCommand::Invalid, commands[1].type);
+   EXPECT_EQ(mm::ConfigCommand::Invalid, commands[2].type);
+   EXPECT_EQ(mm::ConfigCommand::SetParent, commands[3].type);
+}
+
+TEST(ConfigFileParserTests, CoreAppliesConfigFile)
+{
+   TempConfigFile file(
+         "Property,Core,Initialize,1\n"
+         "ConfigGroup,Shutter,Auto,Core,AutoShutter,1\n"
+         "ConfigGroup,Shutter,Manual,Core,AutoShutter,0\n"
+         "ConfigGroup,Empty\n"
+         "Property,Core,AutoShutter,0\n");
+   CMMCore core;
+   core.loadSystemConfiguration(file.Path());
+   EXPECT_TRUE(core.isGroupDefined("Empty"));
+   EXPECT_TRUE(core.isConfigDefined("Shutter", "Manual"));
+   EXPECT_EQ("0", core.getProperty("Core", "AutoShutter"));
+   EXPECT_EQ("Manual", core.getCurrentConfig("Shutter"));
+}
+
+TEST(ConfigFileParserTests, CoreRejectsMalformedFileBeforeApplying)
+{
+   TempConfigFile file(
+         "Property,Core,AutoShutter,0\n"
+         "ConfigGroup,Shutter,Auto,Core\n");
+   CMMCore core;
+   try
+   {
+      core.loadSystemConfiguration(file.Path());
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_InvalidConfigurationFile, e.getCode());
+      EXPECT_NE(std::string::npos, e.getMsg().find("Line 2"));
+   }
+   EXPECT_EQ("1", core.getProperty("Core", "AutoShutter"));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "LoadableModules/DeviceAdapterIndex.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+const char* const modulePath = "DeviceAdapterIndex-Tests.module";
+const char* const indexPath = "DeviceAdapterIndex-Tests.index";
+
+void WriteFile(const char* path, const std::string& contents)
+{
+   std::ofstream out(path, std::ios_base::binary);
+   out << contents;
+}
+
+std::vector<DeviceAdapterIndex::DeviceInfo> MakeDevices()
+{
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices(2);
+   devices[0].name = "DCam";
+   devices[0].description = "Demo camera";
+   devices[0].type = MM::CameraDevice;
+   devices[1].name = "DStage";
+   devices[1].description = "Tab\there, newline\nhere, backslash\\";
+   devices[1].type = MM::StageDevice;
+   return devices;
+}
+
+class DeviceAdapterIndexTest : public ::testing::Test
+{
+protected:
+   virtual void SetUp()
+   {
+      WriteFile(modulePath, "not really a shared library");
+      std::remove(indexPath);
+   }
+   virtual void TearDown()
+   {
+      std::remove(modulePath);
+      std::remove(indexPath);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(DeviceAdapterIndexTest, PersistsDevices)
+{
+   {
+      DeviceAdapterIndex index;
+      index.SetFile(indexPath);
+      std::vector<DeviceAdapterIndex::DeviceInfo> devices;
+      EXPECT_FALSE(index.Lookup(modulePath, devices));
+      index.Update(modulePath, MakeDevices());
+   }
+
+   DeviceAdapterIndex index;
+   index.SetFile(indexPath);
+   ASSERT_EQ(1u, index.GetSize());
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices;
+   ASSERT_TRUE(index.Lookup(modulePath, devices));
+   ASSERT_EQ(2u, devices.size());
+   EXPECT_EQ("DCam", devices[0].name);
+   EXPECT_EQ(MM::CameraDevice, devices[0].type);
+   EXPECT_EQ("DStage", devices[1].name);
+   EXPECT_EQ(MakeDevices()[1].description, devices[1].description);
+   EXPECT_EQ(MM::StageDevice, devices[1].type);
+}
+
+TEST_F(DeviceAdapterIndexTest, IgnoresChangedModule)
+{
+   DeviceAdapterIndex index;
+   index.SetFile(indexPath);
+   index.Update(modulePath, MakeDevices());
+
+   WriteFile(modulePath, "a rebuilt module of a different size");
+   std::vector<DeviceAdapterIndex::DeviceInfo> devices;
+   EXPECT_FALSE(index.Lookup(modulePath, devices));
+
+   std::remove(modulePath);
+   EXPECT_FALSE(index.Lookup(modulePath, devices));
+}
+
+TEST_F(DeviceAdapterIndexTest, IgnoresCorruptIndexFile)
+{
+   WriteFile(indexPath, "# Micro-Manager device adapter index, version 1\n"
+         "module\tx\t1\t2\t3\t4\t1\n"
+         "garbage\n");
+   DeviceAdapterIndex index;
+   index.SetFile(indexPath);
+   EXPECT_EQ(0u, index.GetSize());
+
+   WriteFile(indexPath, "# Something else\n");
+   index.SetFile("");
+   index.SetFile(indexPath);
+   EXPECT_EQ(0u, index.GetSize());
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCallStats.h"
+
+#include <string>
+#include <vector>
+
+
+TEST(LatencyHistogramTests, BucketsBoundRelativeError)
+{
+   for (long long us = 0; us < 1000000; us += 1 + us / 100)
+   {
+      const int index = mm::LatencyHistogram::BucketIndex(us);
+      ASSERT_LT(index, mm::LatencyHistogram::BucketCount);
+      const long long upper = mm::LatencyHistogram::BucketUpperBound(index);
+      ASSERT_GE(upper, us);
+      ASSERT_LE(upper - us, us / 8);
+      if (index > 0)
+      {
+         ASSERT_LT(mm::LatencyHistogram::BucketUpperBound(index - 1), us);
+      }
+   }
+}
+
+TEST(LatencyHistogramTests, HugeValuesGoToLastBucket)
+{
+   EXPECT_EQ(mm::LatencyHistogram::BucketCount - 1,
+         mm::LatencyHistogram::BucketIndex(1LL << 60));
+
+   mm::LatencyHistogram h;
+   h.Record(1LL << 60);
+   EXPECT_EQ(1LL << 60, h.GetPercentile(50.0));
+}
+
+TEST(LatencyHistogramTests, EmptyHistogramReportsZero)
+{
+   mm::LatencyHistogram h;
+   EXPECT_EQ(0, h.GetCount());
+   EXPECT_EQ(0, h.GetMin());
+   EXPECT_EQ(0, h.GetMax());
+   EXPECT_EQ(0, h.GetPercentile(99.0));
+}
+
+TEST(LatencyHistogramTests, Percentiles)
+{
+   mm::LatencyHistogram h;
+   for (long long us = 1; us <= 1000; ++us)
+      h.Record(us);
+   EXPECT_EQ(1000, h.GetCount());
+   EXPECT_EQ(500500, h.GetTotal());
+   EXPECT_EQ(1, h.GetMin());
+   EXPECT_EQ(1000, h.GetMax());
+   EXPECT_EQ(1, h.GetPercentile(0.0));
+   EXPECT_EQ(1000, h.GetPercentile(100.0));
+
+   const long long p50 = h.GetPercentile(50.0);
+   EXPECT_GE(p50, 500);
+   EXPECT_LE(p50, 500 + 500 / 8);
+   const long long p99 = h.GetPercentile(99.0);
+   EXPECT_GE(p99, 990);
+   EXPECT_LE(p99, 1000);
+
+   h.Reset();
+   EXPECT_EQ(0, h.GetCount());
+   EXPECT_EQ(0, h.GetPercentile(50.0));
+}
+
+TEST(DeviceCallStatsTests, RecordsOnlyWhenEnabled)
+{
+   mm::DeviceCallStats stats;
+   {
+      mm::DeviceCallStats::Timer timer(stats, "SnapImage");
+   }
+   EXPECT_TRUE(stats.GetCallNames().empty());
+
+   stats.SetEnabled(true);
+   {
+      mm::DeviceCallStats::Timer timer(stats, "SnapImage");
+   }
+   {
+      mm::DeviceCallStats::Timer timer(stats, "SnapImage");
+   }
+   stats.Record(mm::DeviceCallStats::ModuleLockWaitName, 42);
+
+   std::vector<std::string> names = stats.GetCallNames();
+   ASSERT_EQ(2u, names.size());
+   EXPECT_EQ(std::string(mm::DeviceCallStats::ModuleLockWaitName), names[0]);
+   EXPECT_EQ("SnapImage", names[1]);
+   EXPECT_EQ(2, stats.GetHistogram("SnapImage").GetCount());
+   EXPECT_EQ(42, stats.GetHistogram(mm::DeviceCallStats::ModuleLockWaitName).GetMax());
+   EXPECT_EQ(0, stats.GetHistogram("Busy").GetCount());
+
+   // Disabling keeps what was recorded
+   stats.SetEnabled(false);
+   EXPECT_EQ(2, stats.GetHistogram("SnapImage").GetCount());
+
+   stats.Reset();
+   EXPECT_TRUE(stats.GetCallNames().empty());
+}
+
+TEST(DeviceCallStatsTests, TimerRecordsCallsThatThrow)
+{
+   mm::DeviceCallStats stats;
+   stats.SetEnabled(true);
+   try
+   {
+      mm::DeviceCallStats::Timer timer(stats, "SetProperty");
+      throw 1;
+   }
+   catch (int)
+   {
+   }
+   EXPECT_EQ(1, stats.GetHistogram("SetProperty").GetCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#include "DeviceInitScheduler.h"
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+std::vector<std::string> Deps(const char* a = 0, const char* b = 0)
+{
+   std::vector<std::string> deps;
+   if (a)
+      deps.push_back(a);
+   if (b)
+      deps.push_back(b);
+   return deps;
+}
+
+// Records the order in which devices start and finish initializing
+class Recorder
+{
+public:
+   Recorder() : active_(0), maxActive_(0), sleepMs_(0) {}
+
+   void SetSleepMs(int ms) { sleepMs_ = ms; }
+   void FailOn(const std::string& label) { fail_ = label; }
+
+   void Init(const std::string& label)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         started_.push_back(label);
+         maxActive_ = std::max(maxActive_, ++active_);
+      }
+      if (sleepMs_ > 0)
+         boost::this_thread::sleep(boost::posix_time::milliseconds(sleepMs_));
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      --active_;
+      if (label == fail_)
+         throw CMMError("Failed: " + label);
+      finished_.push_back(label);
+   }
+
+   size_t FinishedIndex(const std::string& label)
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return std::find(finished_.begin(), finished_.end(), label) -
+         finished_.begin();
+   }
+
+   size_t StartedIndex(const std::string& label)
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return std::find(started_.begin(), started_.end(), label) -
+         started_.begin();
+   }
+
+   std::vector<std::string> Started()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return started_;
+   }
+
+   int MaxActive()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return maxActive_;
+   }
+
+private:
+   boost::mutex mutex_;
+   std::vector<std::string> started_;
+   std::vector<std::string> finished_;
+   int active_;
+   int maxActive_;
+   int sleepMs_;
+   std::string fail_;
+};
+
+// A device that looks up an earlier device during initialization
+void InitLookingUp(mm::DeviceInitScheduler* scheduler, Recorder* recorder,
+      std::vector<std::string>* seen, const std::string& label)
+{
+   if (label == "Late")
+   {
+      scheduler->WaitForDevice("Late", "Slow");
+      seen->push_back(recorder->FinishedIndex("Slow") == 0 ? "ready" : "missing");
+      return;
+   }
+   recorder->Init(label);
+}
+
+} // anonymous namespace
+
+
+TEST(DeviceInitSchedulerTests, IndependentDevicesRunConcurrently)
+{
+   Recorder recorder;
+   recorder.SetSleepMs(50);
+   mm::DeviceInitScheduler scheduler;
+   scheduler.AddDevice("A", Deps());
+   scheduler.AddDevice("B", Deps());
+   scheduler.AddDevice("C", Deps());
+
+   scheduler.Run(boost::bind(&Recorder::Init, &recorder, _1));
+
+   EXPECT_EQ(3, recorder.MaxActive());
+   EXPECT_EQ(3u, scheduler.GetInitializedDevices().size());
+   EXPECT_GE(scheduler.GetInitTimeMs("B"), 40.0);
+}
+
+TEST(DeviceInitSchedulerTests, DependenciesInitializeFirst)
+{
+   Recorder recorder;
+   recorder.SetSleepMs(10);
+   mm::DeviceInitScheduler scheduler;
+   scheduler.AddDevice("Port", Deps());
+   scheduler.AddDevice("Hub", Deps("Port"));
+   scheduler.AddDevice("Peripheral1", Deps("Hub"));
+   scheduler.AddDevice("Peripheral2", Deps("Hub", "Peripheral1"));
+   scheduler.AddDevice("Other", Deps("NotLoaded"));
+   // Dependencies on later devices are ignored
+   scheduler.AddDevice("Early", Deps("Late"));
+   scheduler.AddDevice("Late", Deps());
+
+   scheduler.Run(boost::bind(&Recorder::Init, &recorder, _1));
+
+   EXPECT_LT(recorder.FinishedIndex("Port"), recorder.StartedIndex("Hub"));
+   EXPECT_LT(recorder.FinishedIndex("Hub"), recorder.StartedIndex("Peripheral1"));
+   EXPECT_LT(recorder.FinishedIndex("Peripheral1"),
+         recorder.StartedIndex("Peripheral2"));
+
+   std::vector<std::string> initialized = scheduler.GetInitializedDevices();
+   ASSERT_EQ(7u, initialized.size());
+   EXPECT_EQ("Port", initialized[0]);
+   EXPECT_EQ("Late", initialized[6]);
+}
+
+TEST(DeviceInitSchedulerTests, FailureStopsDependentDevices)
+{
+   Recorder recorder;
+   recorder.FailOn("Hub");
+   mm::DeviceInitScheduler scheduler;
+   scheduler.AddDevice("Hub", Deps());
+   scheduler.AddDevice("Peripheral", Deps("Hub"));
+
+   EXPECT_THROW(scheduler.Run(boost::bind(&Recorder::Init, &recorder, _1)),
+         CMMError);
+   EXPECT_EQ(1u, recorder.Started().size());
+   EXPECT_TRUE(scheduler.GetInitializedDevices().empty());
+}
+
+TEST(DeviceInitSchedulerTests, DeviceCanWaitForEarlierDevice)
+{
+   Recorder recorder;
+   recorder.SetSleepMs(50);
+   mm::DeviceInitScheduler scheduler;
+   scheduler.AddDevice("Slow", Deps());
+   scheduler.AddDevice("Late", Deps());
+
+   std::vector<std::string> seen;
+   scheduler.Run(boost::bind(&InitLookingUp, &scheduler, &recorder, &seen, _1));
+
+   ASSERT_EQ(1u, seen.size());
+   EXPECT_EQ("ready", seen[0]);
+}
+
+TEST(DeviceInitSchedulerTests, CoreRecordsInitializationTime)
+{
+   CMMCore core;
+   EXPECT_FALSE(core.isParallelInitializationEnabled());
+   core.initializeAllDevices();
+   core.setProperty("Core", "ParallelInitialize", "1");
+   EXPECT_TRUE(core.isParallelInitializationEnabled());
+   core.initializeAllDevices();
+   core.enableParallelInitialization(false);
+   EXPECT_EQ("0", core.getProperty("Core", "ParallelInitialize"));
+   EXPECT_THROW(core.getDeviceInitializationTimeMs("NoSuchDevice"), CMMError);
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
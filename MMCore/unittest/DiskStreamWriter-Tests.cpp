@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "DiskStreamWriter.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+std::string StreamDir()
+{
+   const char* tmp = std::getenv("TMPDIR");
+   return std::string(tmp ? tmp : "/tmp") + "/mmcore-stream-test";
+}
+
+std::vector<char> ReadFile(const std::string& path)
+{
+   std::ifstream f(path.c_str(), std::ios::binary);
+   return std::vector<char>((std::istreambuf_iterator<char>(f)),
+         std::istreambuf_iterator<char>());
+}
+
+unsigned CountLines(const std::string& path)
+{
+   std::ifstream f(path.c_str());
+   std::string line;
+   unsigned n = 0;
+   while (std::getline(f, line))
+      ++n;
+   return n;
+}
+
+} // anonymous namespace
+
+
+TEST(DiskStreamWriterTests, WritesFramesBackToBack)
+{
+   const unsigned width = 1000, height = 1000; // Not a multiple of page size
+   std::vector<unsigned char> pixels(width * height);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+
+   {
+      mm::DiskStreamWriter writer(StreamDir(), "wbb", 1024);
+      for (unsigned i = 0; i < 40; ++i)
+      {
+         pixels.assign(pixels.size(), static_cast<unsigned char>(i));
+         ASSERT_TRUE(writer.Append(&pixels[0], pixels.size(), width, height,
+                  1, 0, md));
+      }
+      EXPECT_TRUE(writer.Stop());
+      EXPECT_FALSE(writer.Stop());
+      EXPECT_EQ(40u, writer.GetImageCount());
+      EXPECT_EQ(0u, writer.GetDroppedImageCount());
+      EXPECT_EQ(40u * width * height, writer.GetBytesWritten());
+      EXPECT_EQ("", writer.GetLastError());
+   }
+
+   std::vector<char> data = ReadFile(StreamDir() + "/wbb_0000.raw");
+   ASSERT_EQ(40u * width * height, data.size());
+   for (unsigned i = 0; i < 40; ++i)
+   {
+      EXPECT_EQ(static_cast<char>(i), data[i * width * height]);
+      EXPECT_EQ(static_cast<char>(i), data[(i + 1) * width * height - 1]);
+   }
+   EXPECT_EQ(40u, CountLines(StreamDir() + "/wbb_0000.index.jsonl"));
+}
+
+TEST(DiskStreamWriterTests, RollsOverToNewFiles)
+{
+   const unsigned width = 1024, height = 512; // 0.5 MB
+   std::vector<unsigned char> pixels(width * height, 7);
+   Metadata md;
+
+   mm::DiskStreamWriter writer(StreamDir(), "roll", 2);
+   for (unsigned i = 0; i < 9; ++i)
+      ASSERT_TRUE(writer.Append(&pixels[0], pixels.size(), width, height,
+               1, 0, md));
+   writer.Stop();
+
+   EXPECT_EQ(4u * width * height, ReadFile(StreamDir() + "/roll_0000.raw").size());
+   EXPECT_EQ(4u * width * height, ReadFile(StreamDir() + "/roll_0001.raw").size());
+   EXPECT_EQ(1u * width * height, ReadFile(StreamDir() + "/roll_0002.raw").size());
+   EXPECT_EQ(4u, CountLines(StreamDir() + "/roll_0001.index.jsonl"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "FrameTrace.h"
+#include "MonotonicClock.h"
+
+#include <boost/make_shared.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace {
+
+mm::FrameTrace MakeTrace(long long receivedUs)
+{
+   mm::FrameTrace trace;
+   trace.receivedUs = receivedUs;
+   trace.processStartUs = receivedUs + 10;
+   trace.processEndUs = receivedUs + 110;
+   trace.insertStartUs = receivedUs + 120;
+   trace.insertedUs = receivedUs + 200;
+   return trace;
+}
+
+bool InsertFrame(CircularBuffer& cb, const mm::FrameTrace* trace)
+{
+   std::vector<unsigned char> frame(512 * 512 * 2);
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   return cb.InsertImage(&frame[0], 512, 512, 2, &md, trace);
+}
+
+} // anonymous namespace
+
+
+TEST(FrameTracerTests, AggregatesStages)
+{
+   mm::FrameTracer tracer;
+   tracer.SetEnabled(true);
+   for (int i = 0; i < 11; ++i)
+   {
+      mm::FrameTrace trace = MakeTrace(1000000 + i * 10000);
+      tracer.RecordInserted(trace, "Cam");
+      EXPECT_EQ(i, trace.id);
+      EXPECT_EQ(0, trace.camera);
+      trace.poppedUs = trace.insertedUs + 5000;
+      tracer.RecordPopped(trace);
+   }
+   tracer.RecordOverflow(2000000);
+
+   EXPECT_EQ(11, tracer.GetInsertedCount());
+   EXPECT_EQ(11, tracer.GetPoppedCount());
+   EXPECT_EQ(1, tracer.GetOverflowCount());
+   EXPECT_DOUBLE_EQ(100.0, tracer.GetInsertRate());
+   EXPECT_EQ(100, tracer.GetProcessingHistogram().GetMax());
+   EXPECT_EQ(200, tracer.GetInsertHistogram().GetMax());
+   EXPECT_EQ(5000, tracer.GetResidenceHistogram().GetMax());
+   EXPECT_EQ(11, tracer.GetResidenceHistogram().GetCount());
+
+   std::vector<mm::FrameTrace> traces = tracer.GetTraces();
+   ASSERT_EQ(11u, traces.size());
+   EXPECT_EQ(1000000 + 200 + 5000, traces[0].poppedUs);
+}
+
+TEST(FrameTracerTests, KeepsMostRecentTraces)
+{
+   mm::FrameTracer tracer(3);
+   tracer.SetEnabled(true);
+   std::vector<mm::FrameTrace> inserted;
+   for (int i = 0; i < 5; ++i)
+   {
+      inserted.push_back(MakeTrace(1000 * (i + 1)));
+      tracer.RecordInserted(inserted.back(), i % 2 ? "Odd" : "Even");
+   }
+   // Popping a frame whose trace is no longer kept still counts
+   inserted[0].poppedUs = 10000;
+   tracer.RecordPopped(inserted[0]);
+   inserted[4].poppedUs = 10000;
+   tracer.RecordPopped(inserted[4]);
+
+   std::vector<mm::FrameTrace> traces = tracer.GetTraces();
+   ASSERT_EQ(3u, traces.size());
+   EXPECT_EQ(2, traces[0].id);
+   EXPECT_EQ(0, traces[1].poppedUs);
+   EXPECT_EQ(10000, traces[2].poppedUs);
+   EXPECT_EQ(1, traces[1].camera);
+   EXPECT_EQ(2, tracer.GetPoppedCount());
+   ASSERT_EQ(2u, tracer.GetCameraNames().size());
+   EXPECT_EQ("Odd", tracer.GetCameraNames()[1]);
+}
+
+TEST(FrameTracerTests, DisabledOrResetIgnoresFrames)
+{
+   mm::FrameTracer tracer;
+   mm::FrameTrace trace = MakeTrace(1000);
+   tracer.RecordInserted(trace, "Cam");
+   EXPECT_EQ(-1, trace.id);
+   tracer.RecordOverflow(1000);
+   EXPECT_EQ(0, tracer.GetInsertedCount());
+   EXPECT_EQ(0, tracer.GetOverflowCount());
+
+   tracer.SetEnabled(true);
+   tracer.RecordInserted(trace, "Cam");
+   EXPECT_EQ(0, trace.id);
+   tracer.Reset();
+   trace.poppedUs = 2000;
+   tracer.RecordPopped(trace); // Inserted before the reset
+   EXPECT_EQ(0, tracer.GetInsertedCount());
+   EXPECT_EQ(0, tracer.GetPoppedCount());
+   EXPECT_EQ(0, tracer.GetResidenceHistogram().GetCount());
+   EXPECT_TRUE(tracer.GetTraces().empty());
+}
+
+TEST(FrameTracerTests, ExportsChromeTrace)
+{
+   mm::FrameTracer tracer;
+   tracer.SetEnabled(true);
+   mm::FrameTrace trace = MakeTrace(1000);
+   tracer.RecordInserted(trace, "Cam \"A\"");
+   trace.poppedUs = 5000;
+   tracer.RecordPopped(trace);
+   tracer.RecordOverflow(6000);
+
+   const std::string json = tracer.GetChromeTrace();
+   EXPECT_EQ(0u, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+   EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"Cam \\\"A\\\"\"}"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":1000,\"dur\":200,\"pid\":1,\"tid\":1"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Process\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":1010,\"dur\":100,"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Insert\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":1120,\"dur\":80,"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Queued\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":0,\"ts\":1200,"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Queued\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":0,\"ts\":5000,"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"Overflow\",\"cat\":\"buffer\",\"ph\":\"i\",\"s\":\"p\",\"ts\":6000,"));
+   EXPECT_EQ("\n]}\n", json.substr(json.size() - 4));
+}
+
+TEST(CircularBufferTraceTests, StampsInsertAndPop)
+{
+   boost::shared_ptr<mm::FrameTracer> tracer =
+      boost::make_shared<mm::FrameTracer>();
+   tracer->SetEnabled(true);
+   CircularBuffer cb(10);
+   cb.SetFrameTracer(tracer);
+   ASSERT_TRUE(cb.Initialize(1, 512, 512, 2));
+
+   mm::FrameTrace trace;
+   trace.receivedUs = mm::GetMonotonicMicroseconds();
+   ASSERT_TRUE(InsertFrame(cb, &trace));
+   ASSERT_TRUE(InsertFrame(cb, 0)); // Not traced
+   EXPECT_EQ(1, tracer->GetInsertedCount());
+
+   ASSERT_TRUE(cb.GetNextImageBuffer(0) != 0);
+   ASSERT_TRUE(cb.GetNextImageBuffer(0) != 0);
+   EXPECT_EQ(1, tracer->GetPoppedCount());
+
+   std::vector<mm::FrameTrace> traces = tracer->GetTraces();
+   ASSERT_EQ(1u, traces.size());
+   EXPECT_EQ(trace.receivedUs, traces[0].receivedUs);
+   EXPECT_EQ(0, traces[0].processStartUs);
+   EXPECT_LE(traces[0].receivedUs, traces[0].insertStartUs);
+   EXPECT_LE(traces[0].insertStartUs, traces[0].insertedUs);
+   EXPECT_LE(traces[0].insertedUs, traces[0].poppedUs);
+   EXPECT_FALSE(traces[0].spilled);
+   EXPECT_EQ("Cam", tracer->GetCameraNames()[0]);
+
+   // A slot's trace does not outlive its frame
+   ASSERT_TRUE(InsertFrame(cb, 0));
+   ASSERT_TRUE(cb.GetNextImageBuffer(0) != 0);
+   EXPECT_EQ(1, tracer->GetPoppedCount());
+}
+
+TEST(CircularBufferTraceTests, CountsOverflows)
+{
+   boost::shared_ptr<mm::FrameTracer> tracer =
+      boost::make_shared<mm::FrameTracer>();
+   tracer->SetEnabled(true);
+   CircularBuffer cb(1);
+   cb.SetFrameTracer(tracer);
+   ASSERT_TRUE(cb.Initialize(1, 512, 512, 2));
+   ASSERT_EQ(2u, cb.GetSize());
+
+   mm::FrameTrace trace;
+   EXPECT_TRUE(InsertFrame(cb, &trace));
+   EXPECT_TRUE(InsertFrame(cb, &trace));
+   EXPECT_FALSE(InsertFrame(cb, &trace));
+   EXPECT_EQ(2, tracer->GetInsertedCount());
+   EXPECT_EQ(1, tracer->GetOverflowCount());
+
+   // Clearing the buffer discards its frames' traces
+   cb.Clear();
+   ASSERT_TRUE(InsertFrame(cb, 0));
+   ASSERT_TRUE(cb.GetNextImageBuffer(0) != 0);
+   EXPECT_EQ(0, tracer->GetPoppedCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
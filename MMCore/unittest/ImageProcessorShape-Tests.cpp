@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "../MMDevice/DeviceBase.h"
+#include "../MMDevice/ImageProcessorSequence.h"
+
+#include <vector>
+
+
+namespace {
+
+// Keeps the shape; relies on the CImageProcessorBase defaults
+class Inverter : public CImageProcessorBase<Inverter>
+{
+public:
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "Inverter"); }
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   bool Busy() { return false; }
+
+   int Process(unsigned char* buffer, unsigned width, unsigned height,
+         unsigned byteDepth)
+   {
+      for (size_t i = 0; i < (size_t)width * height * byteDepth; ++i)
+         buffer[i] = (unsigned char)~buffer[i];
+      return DEVICE_OK;
+   }
+};
+
+// Crop, 2x2 binning and 16- to 8-bit, like the demo ImageReducer
+class Reducer : public CImageProcessorBase<Reducer>
+{
+public:
+   Reducer() : x0_(0), y0_(0), cropWidth_(0), cropHeight_(0), binning_(1),
+      to8Bit_(false) {}
+
+   void SetCrop(unsigned x0, unsigned y0, unsigned width, unsigned height)
+   { x0_ = x0; y0_ = y0; cropWidth_ = width; cropHeight_ = height; }
+   void SetBinning(unsigned binning) { binning_ = binning; }
+   void SetTo8Bit(bool to8Bit) { to8Bit_ = to8Bit; }
+
+   void GetName(char* name) const { CDeviceUtils::CopyLimitedString(name, "Reducer"); }
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   bool Busy() { return false; }
+
+   int Process(unsigned char*, unsigned width, unsigned height,
+         unsigned byteDepth)
+   {
+      unsigned w, h, d;
+      GetOutputShape(width, height, byteDepth, w, h, d);
+      if (w != width || h != height || d != byteDepth)
+         return DEVICE_NOT_SUPPORTED;
+      return DEVICE_OK;
+   }
+
+   int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth)
+   {
+      outWidth = (cropWidth_ > 0 ? cropWidth_ : width - x0_) / binning_;
+      outHeight = (cropHeight_ > 0 ? cropHeight_ : height - y0_) / binning_;
+      outByteDepth = (to8Bit_ && byteDepth == 2) ? 1 : byteDepth;
+      return DEVICE_OK;
+   }
+
+   int ProcessTo(const unsigned char* source, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+         unsigned outHeight, unsigned outByteDepth)
+   {
+      unsigned w, h, d;
+      GetOutputShape(width, height, byteDepth, w, h, d);
+      if (w != outWidth || h != outHeight || d != outByteDepth)
+         return DEVICE_INCOMPATIBLE_IMAGE;
+
+      for (unsigned oy = 0; oy < h; ++oy)
+      {
+         for (unsigned ox = 0; ox < w; ++ox)
+         {
+            unsigned sum = 0;
+            for (unsigned by = 0; by < binning_; ++by)
+               for (unsigned bx = 0; bx < binning_; ++bx)
+                  sum += Sample(source, width, byteDepth,
+                        x0_ + ox * binning_ + bx, y0_ + oy * binning_ + by);
+            const unsigned value = sum / (binning_ * binning_);
+            if (d == 1)
+               destination[oy * w + ox] = (unsigned char)(byteDepth == 2 ? value >> 8 : value);
+            else
+               ((unsigned short*)destination)[oy * w + ox] = (unsigned short)value;
+         }
+      }
+      return DEVICE_OK;
+   }
+
+private:
+   static unsigned Sample(const unsigned char* image, unsigned width,
+         unsigned byteDepth, unsigned x, unsigned y)
+   {
+      if (byteDepth == 2)
+         return ((const unsigned short*)image)[y * width + x];
+      return image[y * width + x];
+   }
+
+   unsigned x0_, y0_, cropWidth_, cropHeight_;
+   unsigned binning_;
+   bool to8Bit_;
+};
+
+// 16-bit image whose pixel (x, y) is 256 * (y * width + x)
+std::vector<unsigned short> MakeRamp(unsigned width, unsigned height)
+{
+   std::vector<unsigned short> image(width * height);
+   for (unsigned i = 0; i < image.size(); ++i)
+      image[i] = (unsigned short)(256 * i);
+   return image;
+}
+
+} // anonymous namespace
+
+
+TEST(ImageProcessorShapeTests, DefaultKeepsShape)
+{
+   Inverter inverter;
+   unsigned w, h, d;
+   ASSERT_EQ(DEVICE_OK, inverter.GetOutputShape(8, 4, 2, w, h, d));
+   EXPECT_EQ(8u, w);
+   EXPECT_EQ(4u, h);
+   EXPECT_EQ(2u, d);
+
+   std::vector<unsigned char> source(8 * 4 * 2, 0x0f);
+   std::vector<unsigned char> destination(source.size());
+   ASSERT_EQ(DEVICE_OK, inverter.ProcessTo(&source[0], 8, 4, 2,
+            &destination[0], 8, 4, 2));
+   EXPECT_EQ(0xf0, destination[0]);
+   EXPECT_EQ(0xf0, destination.back());
+   EXPECT_EQ(0x0f, source[0]);
+}
+
+TEST(ImageProcessorShapeTests, DefaultRejectsOtherShape)
+{
+   Inverter inverter;
+   std::vector<unsigned char> source(8 * 4, 0x0f);
+   std::vector<unsigned char> destination(source.size(), 0x55);
+   EXPECT_EQ(DEVICE_INCOMPATIBLE_IMAGE, inverter.ProcessTo(&source[0], 8, 4, 1,
+            &destination[0], 4, 4, 1));
+   EXPECT_EQ(0x55, destination[0]);
+}
+
+TEST(ImageProcessorShapeTests, ReducerCropsBinsAndConverts)
+{
+   Reducer reducer;
+   reducer.SetCrop(2, 1, 4, 2);
+   reducer.SetBinning(2);
+   reducer.SetTo8Bit(true);
+
+   unsigned w, h, d;
+   ASSERT_EQ(DEVICE_OK, reducer.GetOutputShape(8, 4, 2, w, h, d));
+   ASSERT_EQ(2u, w);
+   ASSERT_EQ(1u, h);
+   ASSERT_EQ(1u, d);
+
+   std::vector<unsigned short> source = MakeRamp(8, 4);
+   // One guard byte after the output
+   std::vector<unsigned char> destination(w * h * d + 1, 0x55);
+   ASSERT_EQ(DEVICE_OK, reducer.ProcessTo((const unsigned char*)&source[0],
+            8, 4, 2, &destination[0], w, h, d));
+   // Mean of pixels 10, 11, 18, 19 and of 12, 13, 20, 21, in the high byte
+   EXPECT_EQ(14, destination[0]);
+   EXPECT_EQ(16, destination[1]);
+   EXPECT_EQ(0x55, destination[2]);
+
+   // The settings changed after the caller sized its buffer
+   reducer.SetBinning(1);
+   EXPECT_EQ(DEVICE_INCOMPATIBLE_IMAGE, reducer.ProcessTo(
+            (const unsigned char*)&source[0], 8, 4, 2, &destination[0], w, h, d));
+   EXPECT_EQ(14, destination[0]);
+   EXPECT_EQ(0x55, destination[2]);
+}
+
+TEST(ImageProcessorShapeTests, CircularBufferTakesProcessedShape)
+{
+   Reducer reducer;
+   reducer.SetBinning(2);
+   reducer.SetTo8Bit(true);
+
+   const unsigned width = 64, height = 32, byteDepth = 2;
+   unsigned w, h, d;
+   ASSERT_EQ(DEVICE_OK, reducer.GetOutputShape(width, height, byteDepth, w, h, d));
+
+   CircularBuffer cb(10);
+   ASSERT_TRUE(cb.Initialize(1, w, h, d));
+
+   std::vector<unsigned short> source = MakeRamp(width, height);
+   std::vector<unsigned char> processed(w * h * d);
+   ASSERT_EQ(DEVICE_OK, reducer.ProcessTo((const unsigned char*)&source[0],
+            width, height, byteDepth, &processed[0], w, h, d));
+
+   Metadata md;
+   md.PutImageTag("Camera", "Cam");
+   ASSERT_TRUE(cb.InsertImage(&processed[0], w, h, d, &md));
+   EXPECT_THROW(cb.InsertImage((const unsigned char*)&source[0],
+            width, height, byteDepth, &md), CMMError);
+
+   const mm::ImgBuffer* image = cb.GetNextImageBuffer(0);
+   ASSERT_TRUE(image != 0);
+   EXPECT_EQ(32u, image->Width());
+   EXPECT_EQ(16u, image->Height());
+   EXPECT_EQ(1u, image->Depth());
+   EXPECT_EQ(processed.back(), image->GetPixels()[w * h - 1]);
+   EXPECT_TRUE(cb.GetNextImageBuffer(0) == 0);
+}
+
+TEST(ImageProcessorSequenceTests, ComposesShapes)
+{
+   Reducer crop, bin;
+   Inverter inverter;
+   crop.SetCrop(4, 0, 32, 16);
+   bin.SetBinning(2);
+   bin.SetTo8Bit(true);
+
+   std::vector<MM::ImageProcessor*> processors;
+   processors.push_back(&crop);
+   processors.push_back(&inverter);
+   processors.push_back(0); // Empty slot
+   processors.push_back(&bin);
+
+   unsigned w, h, d;
+   ASSERT_EQ(DEVICE_OK, ImageProcessorSequence::GetOutputShape(processors,
+            64, 32, 2, w, h, d));
+   EXPECT_EQ(16u, w);
+   EXPECT_EQ(8u, h);
+   EXPECT_EQ(1u, d);
+
+   std::vector<MM::ImageProcessor*> none(2, (MM::ImageProcessor*)0);
+   ASSERT_EQ(DEVICE_OK, ImageProcessorSequence::GetOutputShape(none,
+            64, 32, 2, w, h, d));
+   EXPECT_EQ(64u, w);
+   EXPECT_EQ(32u, h);
+   EXPECT_EQ(2u, d);
+}
+
+TEST(ImageProcessorSequenceTests, ProcessesInStages)
+{
+   Reducer crop, bin;
+   Inverter inverter;
+   crop.SetCrop(4, 0, 32, 16);
+   bin.SetBinning(2);
+   bin.SetTo8Bit(true);
+
+   std::vector<MM::ImageProcessor*> processors;
+   processors.push_back(&crop);
+   processors.push_back(&inverter);
+   processors.push_back(0);
+   processors.push_back(&bin);
+
+   unsigned w, h, d;
+   ASSERT_EQ(DEVICE_OK, ImageProcessorSequence::GetOutputShape(processors,
+            64, 32, 2, w, h, d));
+
+   std::vector<unsigned short> source(64 * 32, 0x1234);
+   std::vector<unsigned char> destination(w * h * d + 1, 0x55);
+   ImageProcessorSequence sequence;
+   ASSERT_EQ(DEVICE_OK, sequence.ProcessTo(processors,
+            (const unsigned char*)&source[0], 64, 32, 2,
+            &destination[0], w, h, d));
+   EXPECT_EQ(0xed, destination[0]); // High byte of ~0x1234
+   EXPECT_EQ(0xed, destination[w * h - 1]);
+   EXPECT_EQ(0x55, destination[w * h]);
+
+   // A stage changed its settings after the caller sized its buffer
+   bin.SetBinning(1);
+   destination.assign(destination.size(), 0x55);
+   EXPECT_EQ(DEVICE_INCOMPATIBLE_IMAGE, sequence.ProcessTo(processors,
+            (const unsigned char*)&source[0], 64, 32, 2,
+            &destination[0], w, h, d));
+   EXPECT_EQ(0x55, destination[0]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "CoreUtils.h"
+#include "MonotonicClock.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <string>
+
+
+TEST(MonotonicClockTests, NeverGoesBackward)
+{
+   long long previous = mm::GetMonotonicMicroseconds();
+   for (int i = 0; i < 100000; ++i)
+   {
+      const long long now = mm::GetMonotonicMicroseconds();
+      ASSERT_GE(now, previous);
+      previous = now;
+   }
+}
+
+TEST(MonotonicClockTests, MeasuresSleep)
+{
+   const MM::MMTime start = GetMMTimeNow();
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   const double elapsedMs = (GetMMTimeNow() - start).getMsec();
+   EXPECT_GE(elapsedMs, 49.0);
+   EXPECT_LT(elapsedMs, 1000.0);
+}
+
+TEST(MonotonicClockTests, AgreesWithWallClock)
+{
+   // Anchored to local time, so close to the old computation unless the
+   // system time was changed while the test was running
+   const MM::MMTime wall =
+      GetMMTimeNow(boost::posix_time::microsec_clock::local_time());
+   const MM::MMTime monotonic = GetMMTimeNow();
+   EXPECT_LT(std::abs((monotonic - wall).getMsec()), 1000.0);
+
+   const boost::posix_time::ptime local =
+      mm::MonotonicToLocalTime(mm::GetMonotonicMicroseconds());
+   EXPECT_LT(std::abs((local - boost::posix_time::microsec_clock::local_time())
+            .total_milliseconds()), 1000);
+}
+
+TEST(MonotonicClockTests, FormatsTimestamp)
+{
+   const boost::posix_time::ptime t(boost::gregorian::date(2024, 3, 7),
+         boost::posix_time::time_duration(9, 5, 2) +
+         boost::posix_time::microseconds(42));
+   EXPECT_EQ("2024-03-07 09:05:02.000042", mm::FormatTimestamp(t));
+   EXPECT_EQ(t, boost::posix_time::time_from_string(mm::FormatTimestamp(t)));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include "SequencePlanner.h"
+
+#include <string>
+#include <vector>
+
+
+namespace {
+
+mm::SequenceAxis MakeFocusAxis(const double* positions, size_t count,
+      bool sequenceable, long maxLength)
+{
+   mm::SequenceAxis axis;
+   axis.kind = mm::SequenceAxis::FocusPosition;
+   axis.device = "Z";
+   axis.numbers.assign(positions, positions + count);
+   axis.sequenceable = sequenceable;
+   axis.maxSequenceLength = maxLength;
+   return axis;
+}
+
+mm::SequenceAxis MakePropertyAxis(const char* const* values, size_t count,
+      bool sequenceable, long maxLength)
+{
+   mm::SequenceAxis axis;
+   axis.kind = mm::SequenceAxis::DeviceProperty;
+   axis.device = "Shutter";
+   axis.property = "State";
+   axis.values.assign(values, values + count);
+   axis.sequenceable = sequenceable;
+   axis.maxSequenceLength = maxLength;
+   return axis;
+}
+
+std::vector<size_t> Lengths(const std::vector<mm::SequenceBurst>& bursts)
+{
+   std::vector<size_t> lengths;
+   size_t next = 0;
+   for (size_t i = 0; i < bursts.size(); ++i)
+   {
+      EXPECT_EQ(next, bursts[i].start);
+      next = bursts[i].start + bursts[i].length;
+      lengths.push_back(bursts[i].length);
+   }
+   return lengths;
+}
+
+} // anonymous namespace
+
+
+TEST(SequencePlannerTests, ConstantAxisDoesNotSplit)
+{
+   const double z[] = { 1.0, 1.0, 1.0, 1.0, 1.0 };
+   std::vector<mm::SequenceAxis> axes;
+   axes.push_back(MakeFocusAxis(z, 5, false, 0));
+   std::vector<size_t> lengths = Lengths(mm::PlanSequenceBursts(axes, 5));
+   ASSERT_EQ(1u, lengths.size());
+   EXPECT_EQ(5u, lengths[0]);
+}
+
+TEST(SequencePlannerTests, NonSequenceableAxisSplitsAtChanges)
+{
+   const double z[] = { 1.0, 1.0, 2.0, 3.0, 3.0 };
+   std::vector<mm::SequenceAxis> axes;
+   axes.push_back(MakeFocusAxis(z, 5, false, 0));
+   std::vector<size_t> lengths = Lengths(mm::PlanSequenceBursts(axes, 5));
+   ASSERT_EQ(3u, lengths.size());
+   EXPECT_EQ(2u, lengths[0]);
+   EXPECT_EQ(1u, lengths[1]);
+   EXPECT_EQ(2u, lengths[2]);
+}
+
+TEST(SequencePlannerTests, SequenceableAxisSplitsAtMaxLength)
+{
+   const double z[] = { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0 };
+   std::vector<mm::SequenceAxis> axes;
+   axes.push_back(MakeFocusAxis(z, 7, true, 3));
+   std::vector<size_t> lengths = Lengths(mm::PlanSequenceBursts(axes, 7));
+   ASSERT_EQ(3u, lengths.size());
+   EXPECT_EQ(3u, lengths[0]);
+   EXPECT_EQ(3u, lengths[1]);
+   EXPECT_EQ(1u, lengths[2]);
+}
+
+TEST(SequencePlannerTests, CombinesAxes)
+{
+   // Channel is sequenced, focus is set between bursts
+   const double z[] = { 1.0, 1.0, 1.0, 1.0, 2.0, 2.0 };
+   const char* const channel[] = { "A", "B", "A", "B", "A", "B" };
+   std::vector<mm::SequenceAxis> axes;
+   axes.push_back(MakeFocusAxis(z, 6, false, 0));
+   axes.push_back(MakePropertyAxis(channel, 6, true, 100));
+   std::vector<mm::SequenceBurst> bursts = mm::PlanSequenceBursts(axes, 6);
+   std::vector<size_t> lengths = Lengths(bursts);
+   ASSERT_EQ(2u, lengths.size());
+   EXPECT_EQ(4u, lengths[0]);
+   EXPECT_EQ(2u, lengths[1]);
+   EXPECT_TRUE(mm::IsConstantDuring(axes[0], bursts[0]));
+   EXPECT_FALSE(mm::IsConstantDuring(axes[1], bursts[0]));
+}
+
+TEST(SequencePlannerTests, ComparesBothXYCoordinates)
+{
+   mm::SequenceAxis axis;
+   axis.kind = mm::SequenceAxis::XYPosition;
+   axis.device = "XY";
+   axis.numbers.assign(3, 10.0);
+   axis.yNumbers.push_back(0.0);
+   axis.yNumbers.push_back(0.0);
+   axis.yNumbers.push_back(5.0);
+   axis.sequenceable = false;
+   axis.maxSequenceLength = 0;
+   EXPECT_TRUE(axis.IsSameValue(0, 1));
+   EXPECT_FALSE(axis.IsSameValue(1, 2));
+
+   std::vector<mm::SequenceAxis> axes(1, axis);
+   std::vector<size_t> lengths = Lengths(mm::PlanSequenceBursts(axes, 3));
+   ASSERT_EQ(2u, lengths.size());
+   EXPECT_EQ(2u, lengths[0]);
+   EXPECT_EQ(1u, lengths[1]);
+}
+
+TEST(SequencePlannerTests, NoAxesGivesSingleBurst)
+{
+   std::vector<mm::SequenceAxis> axes;
+   std::vector<size_t> lengths = Lengths(mm::PlanSequenceBursts(axes, 10));
+   ASSERT_EQ(1u, lengths.size());
+   EXPECT_EQ(10u, lengths[0]);
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include "StateCache.h"
+
+
+TEST(StateCacheTests, GetReturnsLastSetValue)
+{
+   mm::StateCache cache;
+   PropertySetting s;
+   EXPECT_FALSE(cache.Get("Camera", "Exposure", s));
+
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Camera", "Exposure", "20"));
+   ASSERT_TRUE(cache.Get("Camera", "Exposure", s));
+   EXPECT_EQ("20", s.getPropertyValue());
+   EXPECT_EQ(1u, cache.GetAll().size());
+}
+
+TEST(StateCacheTests, SettingSameValueIsNotAChange)
+{
+   mm::StateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   long version = cache.GetVersion();
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   EXPECT_EQ(version, cache.GetVersion());
+   EXPECT_EQ(0u, cache.GetChangesSince(version).size());
+}
+
+TEST(StateCacheTests, ChangesSinceReturnsOnlyNewerEntries)
+{
+   mm::StateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   long version = cache.GetVersion();
+
+   cache.Set(PropertySetting("Stage", "Position", "5"));
+   cache.Set(PropertySetting("Shutter", "State", "1"));
+
+   Configuration changes = cache.GetChangesSince(version);
+   ASSERT_EQ(2u, changes.size());
+   EXPECT_TRUE(changes.isSettingIncluded(PropertySetting("Stage", "Position", "5")));
+   EXPECT_TRUE(changes.isSettingIncluded(PropertySetting("Shutter", "State", "1")));
+   EXPECT_EQ(3u, cache.GetChangesSince(0).size());
+   EXPECT_EQ(0u, cache.GetChangesSince(cache.GetVersion()).size());
+}
+
+TEST(StateCacheTests, ReplaceReportsRemovals)
+{
+   mm::StateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   long version = cache.GetVersion();
+
+   Configuration config;
+   config.addSetting(PropertySetting("Camera", "Exposure", "10"));
+   config.addSetting(PropertySetting("Shutter", "State", "0"));
+   cache.Replace(config);
+
+   Configuration changes = cache.GetChangesSince(version);
+   ASSERT_EQ(1u, changes.size());
+   EXPECT_EQ("Shutter", changes.getSetting(0).getDeviceLabel());
+
+   Configuration removals = cache.GetRemovalsSince(version);
+   ASSERT_EQ(1u, removals.size());
+   EXPECT_EQ("Stage", removals.getSetting(0).getDeviceLabel());
+
+   PropertySetting s;
+   EXPECT_FALSE(cache.Get("Stage", "Position", s));
+   EXPECT_EQ(2u, cache.GetAll().size());
+   EXPECT_EQ(0u, cache.GetRemovalsSince(cache.GetVersion()).size());
+}
+
+TEST(StateCacheTests, SetAfterRemovalRestoresEntry)
+{
+   mm::StateCache cache;
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   cache.Replace(Configuration());
+   long version = cache.GetVersion();
+
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   EXPECT_EQ(1u, cache.GetChangesSince(version).size());
+   EXPECT_EQ(0u, cache.GetRemovalsSince(version).size());
+   EXPECT_EQ(1u, cache.GetAll().size());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
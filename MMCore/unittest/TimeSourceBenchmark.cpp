@@ -0,0 +1,119 @@
+// Time source benchmark for MMCore.
+//
+// Compares the cost of reading the time the way the Core used to (local
+// wall-clock time, with a time zone conversion per call) with the monotonic
+// time source, for MM::MMTime, device clock ticks and per-frame timestamps.
+// Prints one JSON object per case (JSON Lines) with the calls per second.
+// Not run by 'make check'; build with 'make benchmark'.
+//
+// Example:
+//    TimeSourceBenchmark --min-time 0.5
+
+#include "CoreUtils.h"
+#include "MonotonicClock.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+
+
+namespace {
+
+volatile long g_sink; // Keeps the compiler from dropping the calls
+
+void LegacyMMTime()
+{
+   g_sink = GetMMTimeNow(boost::posix_time::microsec_clock::local_time()).uSec_;
+}
+
+void MonotonicMMTime()
+{
+   g_sink = GetMMTimeNow().uSec_;
+}
+
+void LegacyClockTicks()
+{
+   boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
+   boost::gregorian::date today(boost::gregorian::day_clock::local_day());
+   boost::posix_time::ptime start(today);
+   g_sink = static_cast<long>((t - start).total_microseconds());
+}
+
+void MonotonicClockTicks()
+{
+   g_sink = static_cast<long>(mm::GetMonotonicMicroseconds());
+}
+
+std::ostringstream* g_legacyStream;
+
+void LegacyFrameTimestamp()
+{
+   *g_legacyStream << boost::posix_time::microsec_clock::local_time();
+   g_sink = static_cast<long>(g_legacyStream->str().size());
+   g_legacyStream->str(std::string());
+   g_legacyStream->clear();
+}
+
+void MonotonicFrameTimestamp()
+{
+   g_sink = static_cast<long>(mm::FormatTimestamp(
+            mm::MonotonicToLocalTime(mm::GetMonotonicMicroseconds())).size());
+}
+
+double CallsPerSecond(void (*call)(), double minTimeS)
+{
+   const long long start = mm::GetMonotonicMicroseconds();
+   long long elapsedUs = 0;
+   long calls = 0;
+   do
+   {
+      for (int i = 0; i < 1000; ++i)
+         call();
+      calls += 1000;
+      elapsedUs = mm::GetMonotonicMicroseconds() - start;
+   } while (elapsedUs < minTimeS * 1e6);
+   return calls / (elapsedUs / 1e6);
+}
+
+void Report(const char* name, double legacyRate, double rate)
+{
+   std::cout << "{\"benchmark\":\"timeSource\""
+      << ",\"case\":\"" << name << "\""
+      << ",\"legacyCallsPerS\":" << legacyRate
+      << ",\"monotonicCallsPerS\":" << rate
+      << ",\"speedup\":" << rate / legacyRate
+      << "}" << std::endl;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   double minTimeS = 0.25;
+   if (argc == 3 && std::string(argv[1]) == "--min-time")
+      minTimeS = std::atof(argv[2]);
+   else if (argc != 1 || minTimeS <= 0.0)
+   {
+      std::cerr << "Usage: " << argv[0] << " [--min-time SECONDS]\n";
+      return 2;
+   }
+
+   // The frame timestamp format used by the circular buffer
+   std::ostringstream legacyStream;
+   legacyStream.imbue(std::locale(legacyStream.getloc(),
+            new boost::posix_time::time_facet("%Y-%m-%d %H:%M:%s")));
+   g_legacyStream = &legacyStream;
+
+   Report("MMTime", CallsPerSecond(LegacyMMTime, minTimeS),
+         CallsPerSecond(MonotonicMMTime, minTimeS));
+   Report("ClockTicksUs", CallsPerSecond(LegacyClockTicks, minTimeS),
+         CallsPerSecond(MonotonicClockTicks, minTimeS));
+   Report("FrameTimestamp", CallsPerSecond(LegacyFrameTimestamp, minTimeS),
+         CallsPerSecond(MonotonicFrameTimestamp, minTimeS));
+   return 0;
+}
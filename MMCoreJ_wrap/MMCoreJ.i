@@ -628,6 +628,10 @@
 %ignore MetadataKeyError;
 %ignore MetadataIndexError;
 
+// The void* typemap above would copy a whole camera image from the pixels of
+// a single ROI; Java code reads packed multi-ROI images as full frames.
+%ignore CMMCore::getImageHandleROIPixels;
+
 
 %typemap(javaimports) CMMCore %{
    import mmcorej.org.json.JSONObject;
@@ -465,6 +465,25 @@ public:
       return pProp->AddToSequence(value);
    }
 
+   /**
+    * This function is used by the Core to communicate a sequence of numbers
+    * to the device. The values are stored as numbers in the property, where
+    * the property's action handler can obtain them with
+    * GetNumericSequence() (or, as strings, with GetSequence()).
+    * @param name - name of the sequenceable property
+    * @param values - the sequence
+    * @param count - number of values
+    */
+   virtual int SetPropertySequence(const char* name, const double* values, long count)
+   {
+      MM::Property* pProp;
+      int ret = GetSequenceableProperty(&pProp, name);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      return pProp->SetSequence(values, count);
+   }
+
    /**
     * This function is used by the Core to communicate a sequence to the device
     * Sends the sequence to the device by calling the properties functor
@@ -2068,6 +2087,26 @@ class CAutoFocusBase : public CDeviceBase<MM::AutoFocus, U>
 template <class U>
 class CImageProcessorBase : public CDeviceBase<MM::ImageProcessor, U>
 {
+public:
+   // Processors keep the image shape unless they override these two
+   virtual int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth)
+   {
+      outWidth = width;
+      outHeight = height;
+      outByteDepth = byteDepth;
+      return DEVICE_OK;
+   }
+
+   virtual int ProcessTo(const unsigned char* source, unsigned width,
+         unsigned height, unsigned byteDepth, unsigned char* destination,
+         unsigned outWidth, unsigned outHeight, unsigned outByteDepth)
+   {
+      if (outWidth != width || outHeight != height || outByteDepth != byteDepth)
+         return DEVICE_INCOMPATIBLE_IMAGE;
+      memcpy(destination, source, (size_t)width * height * byteDepth);
+      return this->Process(destination, width, height, byteDepth);
+   }
 };
 
 /**
@@ -38,15 +38,16 @@ public:
 
    virtual int svc() = 0;
 
+   // Returns 0 if the thread was started
    virtual int activate()
    {
 #ifdef _WIN32
       DWORD id;
       thread_ = CreateThread(NULL, 0, ThreadProc, this, 0, &id);
+      return thread_ != NULL ? 0 : 1;
 #else
-      pthread_create(&thread_, NULL, ThreadProc, this);
+      return pthread_create(&thread_, NULL, ThreadProc, this);
 #endif
-      return 0; // TODO: return thread id
    }
 
    void wait()
@@ -0,0 +1,491 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        FocusScore.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Image sharpness (focus) metrics for autofocus devices.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FocusScore.h"
+#include "DeviceThreads.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FOCUSSCORE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const char* const g_MetricNames[] = {
+   "MedianHighPass",
+   "NormalizedVariance",
+   "Brenner",
+   "Tenengrad",
+   "LaplacianEnergy",
+};
+const unsigned g_MetricCount = sizeof(g_MetricNames) / sizeof(g_MetricNames[0]);
+
+// Regions are split so that each thread gets at least this many pixels, and
+// smaller regions are scored on the calling thread only. Threads are started
+// for each call; at this size starting one costs a few percent of the time
+// its band takes even with the cheapest metric (see FocusScoreBenchmark).
+const unsigned long minPixelsPerThread = 1 << 19;
+const unsigned maxThreads = 8;
+
+unsigned ProcessorCount()
+{
+#ifdef WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+   long count = sysconf(_SC_NPROCESSORS_ONLN);
+   return count > 0 ? static_cast<unsigned>(count) : 1;
+#endif
+}
+
+template <typename T>
+inline void Sort2(T& a, T& b)
+{
+   T t = std::min(a, b);
+   b = std::max(a, b);
+   a = t;
+}
+
+// Median of 9 with a fixed comparison network (no branches, so that the
+// calling loop can be vectorized)
+template <typename T>
+inline T Median9(T p0, T p1, T p2, T p3, T p4, T p5, T p6, T p7, T p8)
+{
+   Sort2(p1, p2); Sort2(p4, p5); Sort2(p7, p8);
+   Sort2(p0, p1); Sort2(p3, p4); Sort2(p6, p7);
+   Sort2(p1, p2); Sort2(p4, p5); Sort2(p7, p8);
+   Sort2(p0, p3); Sort2(p5, p8); Sort2(p4, p7);
+   Sort2(p3, p6); Sort2(p1, p4); Sort2(p2, p5);
+   Sort2(p4, p7); Sort2(p4, p2); Sort2(p6, p4);
+   Sort2(p4, p2);
+   return p4;
+}
+
+#ifdef FOCUSSCORE_SSE2
+// Unsigned 16-bit min/max with SSE2 only: t = saturate(a - b) is zero
+// unless a > b, so min = a - t and max = b + t.
+template <>
+inline void Sort2(__m128i& a, __m128i& b)
+{
+   __m128i t = _mm_subs_epu16(a, b);
+   a = _mm_sub_epi16(a, t);
+   b = _mm_add_epi16(b, t);
+}
+
+// Load 8 pixels as 16-bit lanes
+inline __m128i Load8(const unsigned char* p)
+{
+   return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+         _mm_setzero_si128());
+}
+
+inline __m128i Load8(const unsigned short* p)
+{
+   return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+#endif
+
+inline void TrackExtremes(unsigned v, FocusScorer::BandResult& r)
+{
+   if (v < r.lo1)
+   {
+      r.lo2 = r.lo1;
+      r.lo1 = v;
+   }
+   else if (v < r.lo2)
+      r.lo2 = v;
+   if (v > r.hi1)
+   {
+      r.hi2 = r.hi1;
+      r.hi1 = v;
+   }
+   else if (v > r.hi2)
+      r.hi2 = v;
+}
+
+void ResetResult(FocusScorer::BandResult& r)
+{
+   r.sum = r.sumSq = r.score = 0;
+   r.lo1 = r.lo2 = UINT_MAX;
+   r.hi1 = r.hi2 = 0;
+}
+
+class BandWorker : public MMDeviceThreadBase
+{
+public:
+   BandWorker(FocusScorer* scorer, FocusScorer::Phase phase,
+         unsigned row0, unsigned row1, FocusScorer::BandResult* result) :
+      scorer_(scorer), phase_(phase), row0_(row0), row1_(row1), result_(result)
+   {}
+
+   int svc()
+   {
+      scorer_->RunBand(phase_, row0_, row1_, *result_);
+      return 0;
+   }
+
+private:
+   FocusScorer* scorer_;
+   FocusScorer::Phase phase_;
+   unsigned row0_, row1_;
+   FocusScorer::BandResult* result_;
+};
+
+} // anonymous namespace
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FocusScorer class
+//
+const char* FocusScorer::GetMetricName(Metric metric)
+{
+   unsigned index = static_cast<unsigned>(metric);
+   return index < g_MetricCount ? g_MetricNames[index] : "";
+}
+
+bool FocusScorer::GetMetricFromName(const std::string& name, Metric& metric)
+{
+   for (unsigned i = 0; i < g_MetricCount; ++i)
+   {
+      if (name == g_MetricNames[i])
+      {
+         metric = static_cast<Metric>(i);
+         return true;
+      }
+   }
+   return false;
+}
+
+std::vector<std::string> FocusScorer::GetMetricNames()
+{
+   return std::vector<std::string>(g_MetricNames, g_MetricNames + g_MetricCount);
+}
+
+FocusScorer::FocusScorer() :
+   metric_(MedianHighPass),
+   cropFactor_(1.0),
+   roiX_(0), roiY_(0), roiXSize_(0), roiYSize_(0),
+   threadCount_(0),
+   pixels_(0),
+   width_(0), height_(0), byteDepth_(0),
+   x0_(0), y0_(0), w_(0), h_(0),
+   mean_(0.0),
+   stdOverMean_(0.0),
+   dynamicRange_(0.0)
+{
+}
+
+FocusScorer::~FocusScorer()
+{
+}
+
+void FocusScorer::SetCropFactor(double cropFactor)
+{
+   cropFactor_ = (cropFactor > 0.0 && cropFactor <= 1.0) ? cropFactor : 1.0;
+}
+
+void FocusScorer::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize)
+{
+   roiX_ = x;
+   roiY_ = y;
+   roiXSize_ = xSize;
+   roiYSize_ = ySize;
+}
+
+void FocusScorer::ClearROI()
+{
+   SetROI(0, 0, 0, 0);
+}
+
+double FocusScorer::Score(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned byteDepth)
+{
+   mean_ = stdOverMean_ = dynamicRange_ = 0.0;
+   if (pixels == 0 || (byteDepth != 1 && byteDepth != 2))
+      return 0.0;
+
+   pixels_ = pixels;
+   width_ = width;
+   height_ = height;
+   byteDepth_ = byteDepth;
+
+   if (roiXSize_ > 0 && roiYSize_ > 0)
+   {
+      x0_ = std::min(roiX_, width);
+      y0_ = std::min(roiY_, height);
+      w_ = std::min(roiXSize_, width - x0_);
+      h_ = std::min(roiYSize_, height - y0_);
+   }
+   else
+   {
+      w_ = static_cast<unsigned>(cropFactor_ * width);
+      h_ = static_cast<unsigned>(cropFactor_ * height);
+      x0_ = (width - w_) / 2;
+      y0_ = (height - h_) / 2;
+   }
+   if (w_ == 0 || h_ == 0)
+      return 0.0;
+
+   if (metric_ == MedianHighPass)
+      median_.resize(static_cast<size_t>(w_) * h_);
+
+   std::vector<BandResult>& results = results_;
+   RunPhase(PhaseSource, results);
+
+   BandResult total;
+   ResetResult(total);
+   for (size_t i = 0; i < results.size(); ++i)
+   {
+      total.sum += results[i].sum;
+      total.sumSq += results[i].sumSq;
+      total.score += results[i].score;
+      if (metric_ == MedianHighPass)
+      {
+         TrackExtremes(results[i].lo1, total);
+         TrackExtremes(results[i].lo2, total);
+         TrackExtremes(results[i].hi1, total);
+         TrackExtremes(results[i].hi2, total);
+      }
+   }
+
+   const double n = static_cast<double>(w_) * h_;
+   mean_ = total.sum / n;
+   double variance = 0.0;
+   if (n > 1)
+      variance = std::max(0.0, (total.sumSq - total.sum * mean_) / (n - 1));
+   if (mean_ != 0.0)
+      stdOverMean_ = sqrt(variance) / mean_;
+
+   switch (metric_)
+   {
+      case MedianHighPass:
+      {
+         // The high-pass filter is applied to the median image normalized by
+         // the mean, to reduce the effect of bleaching
+         RunPhase(PhaseHighPass, results);
+         unsigned long long sumSq = 0;
+         for (size_t i = 0; i < results.size(); ++i)
+            sumSq += results[i].score;
+         const double scaling = mean_ != 0.0 ? 1.0 / mean_ : 1.0;
+         if (n >= 2)
+            dynamicRange_ = 0.5 * scaling *
+               ((double)total.hi1 + total.hi2 - total.lo1 - total.lo2);
+         return sumSq * scaling * scaling;
+      }
+      case NormalizedVariance:
+         return mean_ != 0.0 ? variance / mean_ : 0.0;
+      default:
+         return static_cast<double>(total.score);
+   }
+}
+
+void FocusScorer::RunPhase(Phase phase, std::vector<BandResult>& results)
+{
+   unsigned threads = threadCount_ > 0 ? threadCount_ : ProcessorCount();
+   const unsigned long pixels = static_cast<unsigned long>(w_) * h_;
+   threads = std::min<unsigned long>(threads, std::max(1UL, pixels / minPixelsPerThread));
+   threads = std::min(std::min(threads, maxThreads), h_);
+
+   results.resize(threads);
+   std::vector<BandWorker*> workers;
+   for (unsigned i = 1; i < threads; ++i)
+   {
+      BandWorker* worker = new BandWorker(this, phase,
+            (unsigned)((unsigned long long)h_ * i / threads),
+            (unsigned)((unsigned long long)h_ * (i + 1) / threads), &results[i]);
+      worker->activate();
+      workers.push_back(worker);
+   }
+   RunBand(phase, 0, h_ / threads, results[0]);
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      workers[i]->wait();
+      delete workers[i];
+   }
+}
+
+void FocusScorer::RunBand(Phase phase, unsigned row0, unsigned row1,
+      BandResult& result)
+{
+   ResetResult(result);
+   if (byteDepth_ == 1)
+      RunBandT(pixels_, phase, row0, row1, result);
+   else
+      RunBandT(reinterpret_cast<const unsigned short*>(pixels_), phase,
+            row0, row1, result);
+}
+
+template <typename T>
+void FocusScorer::RunBandT(const T* pixels, Phase phase, unsigned row0,
+      unsigned row1, BandResult& result)
+{
+   const size_t stride = width_;
+
+   if (phase == PhaseHighPass)
+   {
+      // Diagonal high-pass [-2 -1 0; -1 0 1; 0 1 2] over the interior of
+      // the median image
+      const unsigned short* m = &median_[0];
+      unsigned long long score = 0;
+      for (unsigned l = std::max(row0, 1U); l < std::min(row1, h_ - 1); ++l)
+      {
+         const unsigned short* up = m + (size_t)(l - 1) * w_;
+         const unsigned short* mid = m + (size_t)l * w_;
+         const unsigned short* down = m + (size_t)(l + 1) * w_;
+         long long rowScore = 0;
+         for (unsigned k = 1; k + 1 < w_; ++k)
+         {
+            long long c = -2 * up[k - 1] - up[k] - mid[k - 1] + mid[k + 1] +
+               down[k] + 2 * down[k + 1];
+            rowScore += c * c;
+         }
+         score += rowScore;
+      }
+      result.score = score;
+      return;
+   }
+
+   for (unsigned r = row0; r < row1; ++r)
+   {
+      const unsigned y = y0_ + r;
+      const T* row = pixels + y * stride;
+
+      // Statistics of the region
+      unsigned long long sum = 0, sumSq = 0;
+      for (unsigned x = x0_; x < x0_ + w_; ++x)
+      {
+         const unsigned v = row[x];
+         sum += v;
+         sumSq += (unsigned long long)v * v;
+      }
+      result.sum += sum;
+      result.sumSq += sumSq;
+
+      const T* up = pixels + (y > 0 ? y - 1 : 0) * stride;
+      const T* down = pixels + (y + 1 < height_ ? y + 1 : y) * stride;
+
+      long long score = 0;
+      switch (metric_)
+      {
+         case MedianHighPass:
+         {
+            // 3x3 median, replicating the image edges
+            unsigned short* dest = &median_[0] + (size_t)r * w_;
+            const unsigned xBegin = std::max(x0_, 1U);
+            const unsigned xEnd = std::min(x0_ + w_, width_ - 1);
+            if (xBegin < xEnd)
+            {
+               const T* u = up + xBegin - 1;
+               const T* c = row + xBegin - 1;
+               const T* d = down + xBegin - 1;
+               unsigned short* out = dest + (xBegin - x0_);
+               const unsigned n = xEnd - xBegin;
+               unsigned j = 0;
+#ifdef FOCUSSCORE_SSE2
+               for (; j + 8 <= n; j += 8)
+               {
+                  __m128i m = Median9<__m128i>(
+                        Load8(u + j), Load8(u + j + 1), Load8(u + j + 2),
+                        Load8(c + j), Load8(c + j + 1), Load8(c + j + 2),
+                        Load8(d + j), Load8(d + j + 1), Load8(d + j + 2));
+                  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), m);
+               }
+#endif
+               for (; j < n; ++j)
+               {
+                  out[j] = Median9<T>(u[j], u[j + 1], u[j + 2],
+                        c[j], c[j + 1], c[j + 2],
+                        d[j], d[j + 1], d[j + 2]);
+               }
+            }
+            const unsigned edges[2] = { x0_, x0_ + w_ - 1 };
+            for (unsigned e = 0; e < 2; ++e)
+            {
+               const unsigned x = edges[e];
+               if (x >= xBegin && x < xEnd)
+                  continue;
+               const unsigned xm = x > 0 ? x - 1 : 0;
+               const unsigned xp = x + 1 < width_ ? x + 1 : x;
+               dest[x - x0_] = Median9<T>(
+                     up[xm], up[x], up[xp],
+                     row[xm], row[x], row[xp],
+                     down[xm], down[x], down[xp]);
+            }
+            for (unsigned x = x0_; x < x0_ + w_; ++x)
+               TrackExtremes(dest[x - x0_], result);
+            break;
+         }
+
+         case Brenner:
+         {
+            const unsigned xEnd = std::min(x0_ + w_, width_ >= 2 ? width_ - 2 : 0);
+            for (unsigned x = x0_; x < xEnd; ++x)
+            {
+               const int d = (int)row[x + 2] - (int)row[x];
+               score += d * d;
+            }
+            break;
+         }
+
+         case Tenengrad:
+         {
+            if (y == 0 || y + 1 >= height_)
+               break;
+            const unsigned xBegin = std::max(x0_, 1U);
+            const unsigned xEnd = std::min(x0_ + w_, width_ - 1);
+            for (unsigned x = xBegin; x < xEnd; ++x)
+            {
+               const long long gx = ((int)up[x + 1] + 2 * (int)row[x + 1] + (int)down[x + 1]) -
+                  ((int)up[x - 1] + 2 * (int)row[x - 1] + (int)down[x - 1]);
+               const long long gy = ((int)down[x - 1] + 2 * (int)down[x] + (int)down[x + 1]) -
+                  ((int)up[x - 1] + 2 * (int)up[x] + (int)up[x + 1]);
+               score += gx * gx + gy * gy;
+            }
+            break;
+         }
+
+         case LaplacianEnergy:
+         {
+            if (y == 0 || y + 1 >= height_)
+               break;
+            const unsigned xBegin = std::max(x0_, 1U);
+            const unsigned xEnd = std::min(x0_ + w_, width_ - 1);
+            for (unsigned x = xBegin; x < xEnd; ++x)
+            {
+               const long long lap = 4 * (int)row[x] - (int)row[x - 1] -
+                  (int)row[x + 1] - (int)up[x] - (int)down[x];
+               score += lap * lap;
+            }
+            break;
+         }
+
+         default:
+            break;
+      }
+      result.score += score;
+   }
+}
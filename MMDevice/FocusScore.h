@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        FocusScore.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Image sharpness (focus) metrics for autofocus devices.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#if !defined(_FOCUS_SCORE_)
+#define _FOCUS_SCORE_
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// FocusScorer class
+// ~~~~~~~~~~~~~~~~~
+// Computes a focus score (larger is sharper) for an 8- or 16-bit grayscale
+// image, over a region of interest. The scorer owns its working buffers and
+// reuses them from call to call, so scoring during a focus search does not
+// allocate. Pixel sums are computed in integer arithmetic in loops that the
+// compiler can vectorize, and large regions are split into bands of rows
+// that are processed on several threads.
+//
+// Metrics:
+//  - MedianHighPass: 3x3 median filter, then the sum of squares of a
+//    diagonal high-pass filter [-2 -1 0; -1 0 1; 0 1 2], normalized by the
+//    squared mean (the original SimpleAutofocus measure).
+//  - NormalizedVariance: variance divided by the mean.
+//  - Brenner: sum of squared differences of pixels two columns apart.
+//  - Tenengrad: sum of squared Sobel gradient magnitudes.
+//  - LaplacianEnergy: sum of squares of the 4-neighbor Laplacian.
+//
+// A scorer is not thread-safe; use one per device.
+//
+
+class FocusScorer
+{
+public:
+   enum Metric
+   {
+      MedianHighPass,
+      NormalizedVariance,
+      Brenner,
+      Tenengrad,
+      LaplacianEnergy
+   };
+
+   static const char* GetMetricName(Metric metric);
+   static bool GetMetricFromName(const std::string& name, Metric& metric);
+   static std::vector<std::string> GetMetricNames();
+
+   FocusScorer();
+   ~FocusScorer();
+
+   Metric GetMetric() const {return metric_;}
+   void SetMetric(Metric metric) {metric_ = metric;}
+
+   // Score the centered cropFactor (0 < cropFactor <= 1) fraction of each
+   // dimension of the image. Ignored while an explicit ROI is set.
+   void SetCropFactor(double cropFactor);
+   // Score the given region (clipped to the image). A zero-size ROI means
+   // the crop factor is used.
+   void SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize);
+   void ClearROI();
+
+   // Number of threads used for large regions; 0 means one per processor.
+   void SetThreadCount(unsigned count) {threadCount_ = count;}
+
+   // Returns the focus score, or 0 for an unsupported byte depth.
+   double Score(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth);
+
+   // Statistics of the region from the last call to Score()
+   double GetMean() const {return mean_;}
+   double GetStdOverMean() const {return stdOverMean_;}
+   // Half the spread between the two highest and two lowest values of the
+   // mean-normalized, median-filtered region (MedianHighPass only)
+   double GetNormalizedDynamicRange() const {return dynamicRange_;}
+
+   // Used by the band worker threads
+   struct BandResult
+   {
+      unsigned long long sum;
+      unsigned long long sumSq;
+      unsigned long long score;
+      unsigned lo1, lo2, hi1, hi2;
+   };
+   enum Phase
+   {
+      PhaseSource,  // Statistics, plus the metric or the median filter
+      PhaseHighPass // MedianHighPass only, after the median of all bands
+   };
+   void RunBand(Phase phase, unsigned row0, unsigned row1, BandResult& result);
+
+private:
+   FocusScorer(const FocusScorer&);
+   FocusScorer& operator=(const FocusScorer&);
+
+   template <typename T>
+   void RunBandT(const T* pixels, Phase phase, unsigned row0, unsigned row1,
+         BandResult& result);
+   void RunPhase(Phase phase, std::vector<BandResult>& results);
+
+   Metric metric_;
+   double cropFactor_;
+   unsigned roiX_, roiY_, roiXSize_, roiYSize_;
+   unsigned threadCount_;
+
+   // Current image and region
+   const unsigned char* pixels_;
+   unsigned width_, height_, byteDepth_;
+   unsigned x0_, y0_, w_, h_;
+
+   std::vector<unsigned short> median_; // w_ x h_, MedianHighPass only
+   std::vector<BandResult> results_;
+
+   double mean_;
+   double stdOverMean_;
+   double dynamicRange_;
+};
+
+#endif // !defined(_FOCUS_SCORE_)
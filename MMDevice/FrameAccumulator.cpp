@@ -0,0 +1,304 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        FrameAccumulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Integer frame accumulator for frame grabbers: averaging,
+//                summation, running (sliding window) averaging and
+//                median-of-N rank filtering of a stream of frames.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameAccumulator.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMEACCUMULATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Per-row kernels. The scalar tails (and the whole loop on non-SSE2 targets)
+// are simple enough for the compiler to vectorize on its own.
+
+inline void AddRow(unsigned* acc, const unsigned char* src, unsigned n)
+{
+   unsigned j = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   for (; j + 16 <= n; j += 16)
+   {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      __m128i* a = reinterpret_cast<__m128i*>(acc + j);
+      _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+      _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+      _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+      _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+   }
+#endif
+   for (; j < n; ++j)
+      acc[j] += src[j];
+}
+
+inline void AddRow(unsigned* acc, const unsigned short* src, unsigned n)
+{
+   unsigned j = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   for (; j + 8 <= n; j += 8)
+   {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+      __m128i* a = reinterpret_cast<__m128i*>(acc + j);
+      _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+      _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+   }
+#endif
+   for (; j < n; ++j)
+      acc[j] += src[j];
+}
+
+inline void SubtractRow(unsigned* acc, const unsigned short* src, unsigned n)
+{
+   unsigned j = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   for (; j + 8 <= n; j += 8)
+   {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+      __m128i* a = reinterpret_cast<__m128i*>(acc + j);
+      _mm_storeu_si128(a, _mm_sub_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+      _mm_storeu_si128(a + 1, _mm_sub_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+   }
+#endif
+   for (; j < n; ++j)
+      acc[j] -= src[j];
+}
+
+template <typename T>
+inline void CopyRow(unsigned short* dest, const T* src, unsigned n)
+{
+   for (unsigned j = 0; j < n; ++j)
+      dest[j] = src[j];
+}
+
+// Above this divisor the 40-bit reciprocal is no longer exact for sums of
+// 16-bit pixels (the error bound is divisor^2 / 2^24), so we fall back to
+// division.
+const unsigned maxReciprocalDivisor = 4096;
+
+} // anonymous namespace
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameAccumulator class
+//
+FrameAccumulator::FrameAccumulator() :
+   width_(0),
+   height_(0),
+   length_(1),
+   mode_(Average),
+   frameCount_(0),
+   historyHead_(0),
+   historyCount_(0)
+{
+}
+
+unsigned FrameAccumulator::GetFrameCount() const
+{
+   return KeepsHistory() ? historyCount_ : frameCount_;
+}
+
+void FrameAccumulator::Resize(unsigned width, unsigned height)
+{
+   width_ = width;
+   height_ = height;
+   Reset();
+}
+
+void FrameAccumulator::SetLength(unsigned length)
+{
+   length_ = length > 0 ? length : 1;
+   Reset();
+}
+
+void FrameAccumulator::SetMode(Mode mode)
+{
+   mode_ = mode;
+   Reset();
+}
+
+void FrameAccumulator::Reset()
+{
+   const size_t size = static_cast<size_t>(width_) * height_;
+   sum_.assign(size, 0);
+   frameCount_ = 0;
+
+   if (KeepsHistory())
+      history_.resize(size * length_);
+   else
+      std::vector<unsigned short>().swap(history_);
+   historyHead_ = 0;
+   historyCount_ = 0;
+}
+
+void FrameAccumulator::AddFrame(const unsigned char* pixels,
+      unsigned sourceWidth, unsigned offsetX, unsigned offsetY)
+{
+   AddFrameT(pixels, sourceWidth, offsetX, offsetY);
+}
+
+void FrameAccumulator::AddFrame(const unsigned short* pixels,
+      unsigned sourceWidth, unsigned offsetX, unsigned offsetY)
+{
+   AddFrameT(pixels, sourceWidth, offsetX, offsetY);
+}
+
+template <typename T>
+void FrameAccumulator::AddFrameT(const T* pixels, unsigned sourceWidth,
+      unsigned offsetX, unsigned offsetY)
+{
+   assert(offsetX + width_ <= sourceWidth);
+   const size_t size = static_cast<size_t>(width_) * height_;
+   if (size == 0)
+      return;
+
+   if (!KeepsHistory())
+   {
+      for (unsigned i = 0; i < height_; ++i)
+      {
+         const T* src = pixels + static_cast<size_t>(offsetY + i) * sourceWidth + offsetX;
+         AddRow(&sum_[0] + static_cast<size_t>(i) * width_, src, width_);
+      }
+      ++frameCount_;
+      return;
+   }
+
+   // Overwrite the oldest frame in the ring, keeping the window sum current
+   unsigned short* slot = &history_[0] + historyHead_ * size;
+   const bool replacing = historyCount_ == length_;
+   for (unsigned i = 0; i < height_; ++i)
+   {
+      const T* src = pixels + static_cast<size_t>(offsetY + i) * sourceWidth + offsetX;
+      unsigned short* row = slot + static_cast<size_t>(i) * width_;
+      unsigned* acc = &sum_[0] + static_cast<size_t>(i) * width_;
+      if (mode_ == RunningAverage && replacing)
+         SubtractRow(acc, row, width_);
+      CopyRow(row, src, width_);
+      if (mode_ == RunningAverage)
+         AddRow(acc, row, width_);
+   }
+
+   historyHead_ = (historyHead_ + 1) % length_;
+   if (!replacing)
+      ++historyCount_;
+}
+
+void FrameAccumulator::GetOutput(unsigned char* dest, unsigned byteDepth) const
+{
+   assert(byteDepth == 1 || byteDepth == 2);
+   const size_t size = static_cast<size_t>(width_) * height_;
+   const unsigned count = GetFrameCount();
+   if (count == 0)
+   {
+      memset(dest, 0, size * byteDepth);
+      return;
+   }
+
+   const unsigned divisor = (mode_ == Sum) ? 1 : count;
+   if (byteDepth == 1)
+   {
+      if (mode_ == Median)
+         MedianT(dest, UCHAR_MAX);
+      else
+         NormalizeT(dest, divisor, UCHAR_MAX);
+   }
+   else
+   {
+      unsigned short* dest16 = reinterpret_cast<unsigned short*>(dest);
+      if (mode_ == Median)
+         MedianT(dest16, USHRT_MAX);
+      else
+         NormalizeT(dest16, divisor, USHRT_MAX);
+   }
+}
+
+template <typename T>
+void FrameAccumulator::NormalizeT(T* dest, unsigned divisor,
+      unsigned maxValue) const
+{
+   const size_t size = sum_.size();
+   const unsigned* sum = size > 0 ? &sum_[0] : 0;
+
+   if (divisor == 1)
+   {
+      for (size_t i = 0; i < size; ++i)
+         dest[i] = static_cast<T>(std::min(sum[i], maxValue));
+   }
+   else if (divisor < maxReciprocalDivisor)
+   {
+      // Round to nearest, dividing by multiplication with a 40-bit
+      // fixed-point reciprocal
+      const unsigned long long reciprocal =
+         ((1ULL << 40) + divisor - 1) / divisor;
+      const unsigned half = divisor / 2;
+      for (size_t i = 0; i < size; ++i)
+      {
+         unsigned q = static_cast<unsigned>(
+               (static_cast<unsigned long long>(sum[i] + half) * reciprocal) >> 40);
+         dest[i] = static_cast<T>(std::min(q, maxValue));
+      }
+   }
+   else
+   {
+      const unsigned long long half = divisor / 2;
+      for (size_t i = 0; i < size; ++i)
+      {
+         unsigned q = static_cast<unsigned>((sum[i] + half) / divisor);
+         dest[i] = static_cast<T>(std::min(q, maxValue));
+      }
+   }
+}
+
+template <typename T>
+void FrameAccumulator::MedianT(T* dest, unsigned maxValue) const
+{
+   const size_t size = static_cast<size_t>(width_) * height_;
+   const unsigned n = historyCount_;
+   const unsigned mid = n / 2;
+   rankScratch_.resize(n);
+   unsigned short* values = &rankScratch_[0];
+   const unsigned short* history = &history_[0];
+
+   for (size_t i = 0; i < size; ++i)
+   {
+      for (unsigned k = 0; k < n; ++k)
+         values[k] = history[k * size + i];
+
+      std::nth_element(values, values + mid, values + n);
+      unsigned median = values[mid];
+      if (n % 2 == 0)
+      {
+         // Mean of the two central values; the lower one is the largest
+         // element of the first half after nth_element()
+         unsigned lower = *std::max_element(values, values + mid);
+         median = (lower + median + 1) / 2;
+      }
+      dest[i] = static_cast<T>(std::min(median, maxValue));
+   }
+}
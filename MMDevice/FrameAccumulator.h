@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        FrameAccumulator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Integer frame accumulator for frame grabbers: averaging,
+//                summation, running (sliding window) averaging and
+//                median-of-N rank filtering of a stream of frames.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#if !defined(_FRAME_ACCUMULATOR_)
+#define _FRAME_ACCUMULATOR_
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// FrameAccumulator class
+// ~~~~~~~~~~~~~~~~~~~~~~
+// Combines a series of 8- or 16-bit frames into one output frame. Pixel sums
+// are kept in 32-bit integers, so that the accumulate and normalize loops
+// stay in integer arithmetic (SSE2 where available) instead of converting
+// every pixel to double.
+//
+// Modes:
+//  - Average: mean of the frames added since Reset(), rounded to nearest.
+//  - Sum: sum of the frames added since Reset(), clamped to the output
+//    depth.
+//  - RunningAverage: mean of the last Length() frames. Reset() is not
+//    needed between output frames; each new frame replaces the oldest one.
+//  - Median: per-pixel median of the last Length() frames (rank filter,
+//    effective against shot noise and single-frame artifacts).
+//
+// RunningAverage and Median keep a history of Length() frames.
+//
+
+class FrameAccumulator
+{
+public:
+   enum Mode
+   {
+      Average,
+      Sum,
+      RunningAverage,
+      Median
+   };
+
+   FrameAccumulator();
+
+   unsigned Width() const {return width_;}
+   unsigned Height() const {return height_;}
+   unsigned Length() const {return length_;}
+   Mode GetMode() const {return mode_;}
+   // Number of frames contributing to the output
+   unsigned GetFrameCount() const;
+
+   // Changing the size, length or mode discards accumulated frames
+   void Resize(unsigned width, unsigned height);
+   void SetLength(unsigned length);
+   void SetMode(Mode mode);
+   void Reset();
+
+   // Adds the width x height region at (offsetX, offsetY) of a source frame
+   // that is sourceWidth pixels wide.
+   void AddFrame(const unsigned char* pixels, unsigned sourceWidth,
+         unsigned offsetX = 0, unsigned offsetY = 0);
+   void AddFrame(const unsigned short* pixels, unsigned sourceWidth,
+         unsigned offsetX = 0, unsigned offsetY = 0);
+
+   // Writes the combined frame (width x height pixels of byteDepth 1 or 2)
+   // into dest. Values that do not fit the output depth are clamped. If no
+   // frames have been added, the output is zero.
+   void GetOutput(unsigned char* dest, unsigned byteDepth) const;
+
+private:
+   template <typename T>
+   void AddFrameT(const T* pixels, unsigned sourceWidth,
+         unsigned offsetX, unsigned offsetY);
+   template <typename T>
+   void NormalizeT(T* dest, unsigned divisor, unsigned maxValue) const;
+   template <typename T>
+   void MedianT(T* dest, unsigned maxValue) const;
+   bool KeepsHistory() const
+   {return mode_ == RunningAverage || mode_ == Median;}
+
+   unsigned width_;
+   unsigned height_;
+   unsigned length_;
+   Mode mode_;
+
+   std::vector<unsigned> sum_;
+   unsigned frameCount_;
+
+   // Ring of the last length_ frames (RunningAverage and Median only)
+   std::vector<unsigned short> history_;
+   unsigned historyHead_;
+   unsigned historyCount_;
+
+   mutable std::vector<unsigned short> rankScratch_;
+};
+
+#endif // !defined(_FRAME_ACCUMULATOR_)
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        ImageProcessorSequence.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Runs a sequence of image processors, some of which may
+//                change the image shape, as one processor.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ImageProcessorSequence.h"
+
+#include <string.h>
+
+int ImageProcessorSequence::GetOutputShape(
+      const std::vector<MM::ImageProcessor*>& processors,
+      unsigned width, unsigned height, unsigned byteDepth,
+      unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth)
+{
+   outWidth = width;
+   outHeight = height;
+   outByteDepth = byteDepth;
+   for (size_t i = 0; i < processors.size(); ++i)
+   {
+      if (!processors[i])
+         continue;
+      unsigned w, h, d;
+      int ret = processors[i]->GetOutputShape(outWidth, outHeight, outByteDepth,
+            w, h, d);
+      if (ret != DEVICE_OK)
+         return ret;
+      outWidth = w;
+      outHeight = h;
+      outByteDepth = d;
+   }
+   return DEVICE_OK;
+}
+
+int ImageProcessorSequence::ProcessTo(
+      const std::vector<MM::ImageProcessor*>& processors,
+      const unsigned char* source, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+      unsigned outHeight, unsigned outByteDepth)
+{
+   stageImage_.assign(source, source + (size_t)width * height * byteDepth);
+
+   int ret = DEVICE_OK;
+   for (size_t i = 0; i < processors.size() && ret == DEVICE_OK; ++i)
+   {
+      MM::ImageProcessor* processor = processors[i];
+      if (!processor || stageImage_.empty())
+         continue;
+
+      unsigned w, h, d;
+      ret = processor->GetOutputShape(width, height, byteDepth, w, h, d);
+      if (ret != DEVICE_OK)
+         break;
+      if (w == width && h == height && d == byteDepth)
+      {
+         processor->Process(&stageImage_[0], width, height, byteDepth);
+         continue;
+      }
+
+      nextStageImage_.resize((size_t)w * h * d);
+      if (!nextStageImage_.empty())
+         ret = processor->ProcessTo(&stageImage_[0], width, height, byteDepth,
+               &nextStageImage_[0], w, h, d);
+      stageImage_.swap(nextStageImage_);
+      width = w;
+      height = h;
+      byteDepth = d;
+   }
+
+   if (ret == DEVICE_OK &&
+         (width != outWidth || height != outHeight || byteDepth != outByteDepth))
+      ret = DEVICE_INCOMPATIBLE_IMAGE;
+   if (ret == DEVICE_OK && !stageImage_.empty())
+      memcpy(destination, &stageImage_[0], stageImage_.size());
+   return ret;
+}
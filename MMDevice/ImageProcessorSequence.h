@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        ImageProcessorSequence.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Runs a sequence of image processors, some of which may
+//                change the image shape, as one processor.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#if !defined(_IMAGE_PROCESSOR_SEQUENCE_)
+#define _IMAGE_PROCESSOR_SEQUENCE_
+
+#include "MMDevice.h"
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ImageProcessorSequence class
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Implements GetOutputShape() and ProcessTo() for a list of processors run
+// one after the other (null entries are skipped). The output shape is that
+// of the last processor. Processors that keep the shape run in place on an
+// intermediate image; the others write the next intermediate image, sized
+// for the shape they report. The result is only copied out if it has the
+// shape the caller expects.
+//
+
+class ImageProcessorSequence
+{
+public:
+   static int GetOutputShape(const std::vector<MM::ImageProcessor*>& processors,
+         unsigned width, unsigned height, unsigned byteDepth,
+         unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth);
+
+   int ProcessTo(const std::vector<MM::ImageProcessor*>& processors,
+         const unsigned char* source, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned char* destination, unsigned outWidth,
+         unsigned outHeight, unsigned outByteDepth);
+
+private:
+   std::vector<unsigned char> stageImage_;
+   std::vector<unsigned char> nextStageImage_;
+};
+
+#endif // !defined(_IMAGE_PROCESSOR_SEQUENCE_)
@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 70
+#define DEVICE_INTERFACE_VERSION 72
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -285,6 +285,12 @@ namespace MM {
        * Add one value to the sequence
        */
       virtual int AddToPropertySequence(const char* propertyName, const char* value) = 0;
+      /**
+       * Replace the sequence with count numeric values, without converting
+       * them to strings. Same effect as ClearPropertySequence() followed by
+       * AddToPropertySequence() for each value.
+       */
+      virtual int SetPropertySequence(const char* propertyName, const double* values, long count) = 0;
       /**
        * Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
        */
@@ -879,6 +885,28 @@ namespace MM {
       // image processor API
       virtual int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) = 0;
 
+      /**
+       * Reports the size and pixel depth of the images produced from input
+       * images of the given size and depth. Processors that change the
+       * shape of images (binning, cropping, bit-depth reduction) return a
+       * different shape; others return the input shape.
+       */
+      virtual int GetOutputShape(unsigned width, unsigned height, unsigned byteDepth,
+            unsigned& outWidth, unsigned& outHeight, unsigned& outByteDepth) = 0;
+      /**
+       * Processes an image into a separate buffer, which holds an image of
+       * the given output shape (as reported by GetOutputShape()). The source
+       * image is not modified. This is how the Core runs processors that
+       * change the image shape.
+       *
+       * The settings may have changed since GetOutputShape() was called;
+       * if the processor would now produce a different shape, it must not
+       * write to the destination and return DEVICE_INCOMPATIBLE_IMAGE.
+       */
+      virtual int ProcessTo(const unsigned char* source, unsigned width,
+            unsigned height, unsigned byteDepth, unsigned char* destination,
+            unsigned outWidth, unsigned outHeight, unsigned outByteDepth) = 0;
+
 
    };
 
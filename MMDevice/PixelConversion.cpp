@@ -0,0 +1,870 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        PixelConversion.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Conversion of common camera pixel formats (packed mono,
+//                shifted mono, RGB, YUV 4:2:2) to Micro-Manager image
+//                formats, vectorized with run-time CPU dispatch.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PixelConversion.h"
+
+#include <string.h>
+
+// The SIMD kernels are compiled for their instruction set regardless of the
+// compiler flags (GCC and Clang need a target attribute for that; MSVC
+// allows any intrinsic) and only called if the processor supports it.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define PIXELCONVERSION_X86
+#define PIXELCONVERSION_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define PIXELCONVERSION_X86
+#define PIXELCONVERSION_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+PixelConverter::InstructionSet DetectInstructionSet()
+{
+#if defined(PIXELCONVERSION_X86) && defined(__GNUC__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      return PixelConverter::AVX2;
+   if (__builtin_cpu_supports("ssse3"))
+      return PixelConverter::SSSE3;
+   if (__builtin_cpu_supports("sse2"))
+      return PixelConverter::SSE2;
+#elif defined(PIXELCONVERSION_X86)
+   int info[4];
+   __cpuid(info, 0);
+   const int maxLeaf = info[0];
+   __cpuid(info, 1);
+   const bool sse2 = (info[3] & (1 << 26)) != 0;
+   const bool ssse3 = (info[2] & (1 << 9)) != 0;
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   const bool avx = (info[2] & (1 << 28)) != 0;
+   // AVX2 also needs the OS to save the YMM registers
+   if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+   {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5))
+         return PixelConverter::AVX2;
+   }
+   if (ssse3)
+      return PixelConverter::SSSE3;
+   if (sse2)
+      return PixelConverter::SSE2;
+#endif
+   return PixelConverter::Scalar;
+}
+
+volatile int g_instructionSetLimit = PixelConverter::AVX2;
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar kernels; also used for the tails of the SIMD loops
+
+// Formats with 2 pixels in 3 bytes
+enum PairFormat
+{
+   Mono10Packed,
+   Mono12p,
+   Mono12Packed
+};
+
+void UnpackPairsScalar(PairFormat format, unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   size_t i = 0;
+   for (; i + 2 <= pixelCount; i += 2, src += 3)
+   {
+      const unsigned b0 = src[0], b1 = src[1], b2 = src[2];
+      switch (format)
+      {
+         case Mono10Packed:
+            dst[i] = static_cast<unsigned short>((b0 << 2) | (b1 & 0x3));
+            dst[i + 1] = static_cast<unsigned short>((b2 << 2) | ((b1 >> 4) & 0x3));
+            break;
+         case Mono12p:
+            dst[i] = static_cast<unsigned short>(b0 | ((b1 & 0xf) << 8));
+            dst[i + 1] = static_cast<unsigned short>((b1 >> 4) | (b2 << 4));
+            break;
+         case Mono12Packed:
+            dst[i] = static_cast<unsigned short>((b0 << 4) | (b1 & 0xf));
+            dst[i + 1] = static_cast<unsigned short>((b2 << 4) | (b1 >> 4));
+            break;
+      }
+   }
+   if (i < pixelCount) // Odd count: last pixel is in 2 bytes
+   {
+      const unsigned b0 = src[0], b1 = src[1];
+      switch (format)
+      {
+         case Mono10Packed:
+            dst[i] = static_cast<unsigned short>((b0 << 2) | (b1 & 0x3));
+            break;
+         case Mono12p:
+            dst[i] = static_cast<unsigned short>(b0 | ((b1 & 0xf) << 8));
+            break;
+         case Mono12Packed:
+            dst[i] = static_cast<unsigned short>((b0 << 4) | (b1 & 0xf));
+            break;
+      }
+   }
+}
+
+void UnpackMono10pScalar(unsigned short* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   // Every pixel spans two bytes, so this never reads past the packed data
+   for (size_t i = 0; i < pixelCount; ++i)
+   {
+      const size_t bit = 10 * i;
+      const unsigned word = src[bit / 8] | (src[bit / 8 + 1] << 8);
+      dst[i] = static_cast<unsigned short>((word >> (bit % 8)) & 0x3ff);
+   }
+}
+
+void ShiftRight16Scalar(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   for (size_t i = 0; i < pixelCount; ++i)
+      dst[i] = static_cast<unsigned short>(src[i] >> shift);
+}
+
+void ShiftLeft16Scalar(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   for (size_t i = 0; i < pixelCount; ++i)
+      dst[i] = static_cast<unsigned short>(src[i] << shift);
+}
+
+// RGB order (red first) if swap, else BGR
+void Color24ToBGRAScalar(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool swap)
+{
+   const int r = swap ? 0 : 2, b = swap ? 2 : 0;
+   for (size_t i = 0; i < pixelCount; ++i, src += 3, dst += 4)
+   {
+      dst[0] = src[b];
+      dst[1] = src[1];
+      dst[2] = src[r];
+      dst[3] = 255;
+   }
+}
+
+inline unsigned char Clip(int value)
+{
+   if (value <= 0)
+      return 0;
+   if (value >= 255)
+      return 255;
+   return static_cast<unsigned char>(value);
+}
+
+// YUYV if yFirst, else UYVY; converts 2 * pairs pixels
+void YUV422ToBGRAScalar(unsigned char* dst, const unsigned char* src,
+      size_t pairs, bool yFirst)
+{
+   const int y0Index = yFirst ? 0 : 1, uIndex = yFirst ? 1 : 0;
+   for (size_t i = 0; i < pairs; ++i, src += 4, dst += 8)
+   {
+      const int d = src[uIndex] - 128;
+      const int e = src[uIndex + 2] - 128;
+      for (int k = 0; k < 2; ++k)
+      {
+         const int c = src[y0Index + 2 * k] - 16;
+         dst[4 * k] = Clip((298 * c + 516 * d + 128) >> 8);
+         dst[4 * k + 1] = Clip((298 * c - 100 * d - 208 * e + 128) >> 8);
+         dst[4 * k + 2] = Clip((298 * c + 409 * e + 128) >> 8);
+         dst[4 * k + 3] = 255;
+      }
+   }
+}
+
+void Shift16To8Scalar(unsigned char* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   for (size_t i = 0; i < pixelCount; ++i)
+   {
+      const unsigned v = src[i] >> shift;
+      dst[i] = static_cast<unsigned char>(v > 255 ? 255 : v);
+   }
+}
+
+#ifdef PIXELCONVERSION_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// SIMD kernels. Each returns the number of pixels it converted (a multiple
+// of its block size); the caller converts the rest with the scalar kernel.
+// Loads never go past the end of the source.
+
+// Shuffle and masks that turn 2-pixels-in-3-bytes data into 16-bit pixels:
+// each pixel is a 16-bit word of two of its bytes, then
+// (w & maskW) | ((w >> 4) & mask4) | ((w >> 6) & mask6) with masks given
+// for an (even, odd) pixel pair
+struct PairUnpacking
+{
+   char shuffle[16];
+   int maskW, mask4, mask6;
+};
+
+const PairUnpacking& GetPairUnpacking(PairFormat format)
+{
+   static const PairUnpacking mono10Packed = {
+      { 1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11 },
+      0x00000003, 0x00030000, 0x03fc03fc };
+   static const PairUnpacking mono12p = {
+      { 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11 },
+      0x00000fff, static_cast<int>(0xffff0000), 0 };
+   static const PairUnpacking mono12Packed = {
+      { 1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11 },
+      0x0000000f, static_cast<int>(0xffff0ff0), 0 };
+   switch (format)
+   {
+      case Mono10Packed: return mono10Packed;
+      case Mono12p: return mono12p;
+      default: return mono12Packed;
+   }
+}
+
+PIXELCONVERSION_TARGET("ssse3")
+size_t UnpackPairsSSSE3(PairFormat format, unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   const PairUnpacking& u = GetPairUnpacking(format);
+   const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u.shuffle));
+   const __m128i maskW = _mm_set1_epi32(u.maskW);
+   const __m128i mask4 = _mm_set1_epi32(u.mask4);
+   const __m128i mask6 = _mm_set1_epi32(u.mask6);
+   const size_t srcBytes = pixelCount / 2 * 3;
+
+   size_t i = 0;
+   // 8 pixels from 12 of the 16 loaded bytes
+   for (size_t j = 0; j + 16 <= srcBytes; i += 8, j += 12)
+   {
+      __m128i w = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j)), shuffle);
+      __m128i r = _mm_or_si128(_mm_and_si128(w, maskW),
+            _mm_and_si128(_mm_srli_epi16(w, 4), mask4));
+      r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi16(w, 6), mask6));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+size_t UnpackPairsAVX2(PairFormat format, unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   const PairUnpacking& u = GetPairUnpacking(format);
+   const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u.shuffle));
+   const __m256i shuffle = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(shuffle128), shuffle128, 1);
+   const __m256i maskW = _mm256_set1_epi32(u.maskW);
+   const __m256i mask4 = _mm256_set1_epi32(u.mask4);
+   const __m256i mask6 = _mm256_set1_epi32(u.mask6);
+   const size_t srcBytes = pixelCount / 2 * 3;
+
+   size_t i = 0;
+   // 16 pixels from 24 bytes, 12 in each 128-bit lane
+   for (size_t j = 0; j + 28 <= srcBytes; i += 16, j += 24)
+   {
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j + 12)), 1);
+      __m256i w = _mm256_shuffle_epi8(in, shuffle);
+      __m256i r = _mm256_or_si256(_mm256_and_si256(w, maskW),
+            _mm256_and_si256(_mm256_srli_epi16(w, 4), mask4));
+      r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi16(w, 6), mask6));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+   }
+   return i;
+}
+
+// Mono10p: each pixel is a 16-bit word of its two bytes, shifted left so
+// that its bits are at the top (multiplying by 64, 16, 4, 1), then right by 6
+PIXELCONVERSION_TARGET("ssse3")
+size_t UnpackMono10pSSSE3(unsigned short* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4,
+         5, 6, 6, 7, 7, 8, 8, 9);
+   const __m128i scale = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+   const size_t srcBytes = pixelCount / 4 * 5;
+
+   size_t i = 0;
+   // 8 pixels from 10 of the 16 loaded bytes
+   for (size_t j = 0; j + 16 <= srcBytes; i += 8, j += 10)
+   {
+      __m128i w = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j)), shuffle);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+            _mm_srli_epi16(_mm_mullo_epi16(w, scale), 6));
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+size_t UnpackMono10pAVX2(unsigned short* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   const __m256i shuffle = _mm256_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4,
+         5, 6, 6, 7, 7, 8, 8, 9, 0, 1, 1, 2, 2, 3, 3, 4,
+         5, 6, 6, 7, 7, 8, 8, 9);
+   const __m256i scale = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1,
+         64, 16, 4, 1, 64, 16, 4, 1);
+   const size_t srcBytes = pixelCount / 4 * 5;
+
+   size_t i = 0;
+   for (size_t j = 0; j + 26 <= srcBytes; i += 16, j += 20)
+   {
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j + 10)), 1);
+      __m256i w = _mm256_shuffle_epi8(in, shuffle);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+            _mm256_srli_epi16(_mm256_mullo_epi16(w, scale), 6));
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("sse2")
+size_t Shift16SSE2(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift, bool right)
+{
+   const __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+   size_t i = 0;
+   for (; i + 8 <= pixelCount; i += 8)
+   {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      v = right ? _mm_srl_epi16(v, count) : _mm_sll_epi16(v, count);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+size_t Shift16AVX2(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift, bool right)
+{
+   const __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+   size_t i = 0;
+   for (; i + 16 <= pixelCount; i += 16)
+   {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      v = right ? _mm256_srl_epi16(v, count) : _mm256_sll_epi16(v, count);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+   }
+   return i;
+}
+
+// Byte shuffles from 4 packed 24-bit pixels to 4 BGRA pixels with zero
+// alpha
+const char g_rgbToBGRA[16] = { 2, 1, 0, -128, 5, 4, 3, -128,
+   8, 7, 6, -128, 11, 10, 9, -128 };
+const char g_bgrToBGRA[16] = { 0, 1, 2, -128, 3, 4, 5, -128,
+   6, 7, 8, -128, 9, 10, 11, -128 };
+
+PIXELCONVERSION_TARGET("ssse3")
+size_t Color24ToBGRASSSE3(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool swap)
+{
+   const __m128i shuffle = _mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(swap ? g_rgbToBGRA : g_bgrToBGRA));
+   const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+   const size_t srcBytes = 3 * pixelCount;
+
+   size_t i = 0;
+   // 4 pixels from 12 of the 16 loaded bytes
+   for (size_t j = 0; j + 16 <= srcBytes; i += 4, j += 12)
+   {
+      __m128i v = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j)), shuffle);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i),
+            _mm_or_si128(v, alpha));
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+size_t Color24ToBGRAAVX2(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool swap)
+{
+   const __m128i shuffle128 = _mm_loadu_si128(
+         reinterpret_cast<const __m128i*>(swap ? g_rgbToBGRA : g_bgrToBGRA));
+   const __m256i shuffle = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(shuffle128), shuffle128, 1);
+   const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+   const size_t srcBytes = 3 * pixelCount;
+
+   size_t i = 0;
+   // 8 pixels from 24 bytes, 12 in each 128-bit lane
+   for (size_t j = 0; j + 28 <= srcBytes; i += 8, j += 24)
+   {
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j + 12)), 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i),
+            _mm256_or_si256(_mm256_shuffle_epi8(in, shuffle), alpha));
+   }
+   return i;
+}
+
+// YUV 4:2:2 with the arithmetic of YUV422ToBGRAScalar. Luma and chroma are
+// split into 16-bit lanes, chroma duplicated for both pixels of a pair, and
+// each color computed with _mm_madd_epi16 on interleaved (c, d) or (c, e)
+// lanes with the matching coefficient pair.
+
+PIXELCONVERSION_TARGET("sse2")
+inline __m128i ScaleAndClipSSE2(__m128i lo, __m128i hi)
+{
+   // (x + 128) >> 8, clipped to 0-255, in the low 8 bytes
+   const __m128i round = _mm_set1_epi32(128);
+   lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 8);
+   hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 8);
+   return _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+}
+
+PIXELCONVERSION_TARGET("sse2")
+inline __m128i DotSSE2(__m128i a, __m128i b, __m128i coeffs, __m128i& hi)
+{
+   hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), coeffs);
+   return _mm_madd_epi16(_mm_unpacklo_epi16(a, b), coeffs);
+}
+
+PIXELCONVERSION_TARGET("sse2")
+size_t YUV422ToBGRASSE2(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool yFirst)
+{
+   const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+   const __m128i lowWords = _mm_set1_epi32(0x0000ffff);
+   const __m128i yOffset = _mm_set1_epi16(16);
+   const __m128i uvOffset = _mm_set1_epi16(128);
+   const __m128i alpha = _mm_set1_epi16(-1);
+   const __m128i cBlue = _mm_set_epi16(516, 298, 516, 298, 516, 298, 516, 298);
+   const __m128i cGreen = _mm_set_epi16(-100, 298, -100, 298, -100, 298, -100, 298);
+   const __m128i cGreenV = _mm_set_epi16(0, -208, 0, -208, 0, -208, 0, -208);
+   const __m128i cRed = _mm_set_epi16(409, 298, 409, 298, 409, 298, 409, 298);
+
+   size_t i = 0;
+   for (; i + 8 <= pixelCount; i += 8)
+   {
+      __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+      __m128i y = yFirst ? _mm_and_si128(in, lowBytes) : _mm_srli_epi16(in, 8);
+      __m128i uv = yFirst ? _mm_srli_epi16(in, 8) : _mm_and_si128(in, lowBytes);
+      __m128i u = _mm_and_si128(uv, lowWords);
+      u = _mm_or_si128(u, _mm_slli_epi32(u, 16));
+      __m128i v = _mm_srli_epi32(uv, 16);
+      v = _mm_or_si128(v, _mm_slli_epi32(v, 16));
+
+      __m128i c = _mm_sub_epi16(y, yOffset);
+      __m128i d = _mm_sub_epi16(u, uvOffset);
+      __m128i e = _mm_sub_epi16(v, uvOffset);
+
+      __m128i hi, hi2;
+      __m128i lo = DotSSE2(c, d, cBlue, hi);
+      __m128i b = ScaleAndClipSSE2(lo, hi);
+      lo = DotSSE2(c, d, cGreen, hi);
+      __m128i lo2 = DotSSE2(e, e, cGreenV, hi2);
+      __m128i g = ScaleAndClipSSE2(_mm_add_epi32(lo, lo2), _mm_add_epi32(hi, hi2));
+      lo = DotSSE2(c, e, cRed, hi);
+      __m128i r = ScaleAndClipSSE2(lo, hi);
+
+      __m128i bg = _mm_unpacklo_epi8(b, g);
+      __m128i ra = _mm_unpacklo_epi8(r, alpha);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i),
+            _mm_unpacklo_epi16(bg, ra));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i + 16),
+            _mm_unpackhi_epi16(bg, ra));
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+inline __m256i ScaleAndClipAVX2(__m256i lo, __m256i hi)
+{
+   const __m256i round = _mm256_set1_epi32(128);
+   lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 8);
+   hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 8);
+   return _mm256_packus_epi16(_mm256_packs_epi32(lo, hi), _mm256_setzero_si256());
+}
+
+PIXELCONVERSION_TARGET("avx2")
+inline __m256i DotAVX2(__m256i a, __m256i b, __m256i coeffs, __m256i& hi)
+{
+   hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coeffs);
+   return _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coeffs);
+}
+
+// Same as the SSE2 kernel in each 128-bit lane
+PIXELCONVERSION_TARGET("avx2")
+size_t YUV422ToBGRAAVX2(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool yFirst)
+{
+   const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+   const __m256i lowWords = _mm256_set1_epi32(0x0000ffff);
+   const __m256i yOffset = _mm256_set1_epi16(16);
+   const __m256i uvOffset = _mm256_set1_epi16(128);
+   const __m256i alpha = _mm256_set1_epi16(-1);
+   const __m256i cBlue = _mm256_set1_epi32((516 << 16) | 298);
+   const __m256i cGreen = _mm256_set1_epi32(static_cast<int>((0xff9cu << 16) | 298)); // -100, 298
+   const __m256i cGreenV = _mm256_set1_epi32(0xff30); // 0, -208
+   const __m256i cRed = _mm256_set1_epi32((409 << 16) | 298);
+
+   size_t i = 0;
+   for (; i + 16 <= pixelCount; i += 16)
+   {
+      __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+      __m256i y = yFirst ? _mm256_and_si256(in, lowBytes) : _mm256_srli_epi16(in, 8);
+      __m256i uv = yFirst ? _mm256_srli_epi16(in, 8) : _mm256_and_si256(in, lowBytes);
+      __m256i u = _mm256_and_si256(uv, lowWords);
+      u = _mm256_or_si256(u, _mm256_slli_epi32(u, 16));
+      __m256i v = _mm256_srli_epi32(uv, 16);
+      v = _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+
+      __m256i c = _mm256_sub_epi16(y, yOffset);
+      __m256i d = _mm256_sub_epi16(u, uvOffset);
+      __m256i e = _mm256_sub_epi16(v, uvOffset);
+
+      __m256i hi, hi2;
+      __m256i lo = DotAVX2(c, d, cBlue, hi);
+      __m256i b = ScaleAndClipAVX2(lo, hi);
+      lo = DotAVX2(c, d, cGreen, hi);
+      __m256i lo2 = DotAVX2(e, e, cGreenV, hi2);
+      __m256i g = ScaleAndClipAVX2(_mm256_add_epi32(lo, lo2), _mm256_add_epi32(hi, hi2));
+      lo = DotAVX2(c, e, cRed, hi);
+      __m256i r = ScaleAndClipAVX2(lo, hi);
+
+      __m256i bg = _mm256_unpacklo_epi8(b, g);
+      __m256i ra = _mm256_unpacklo_epi8(r, alpha);
+      // Pixels 0-3 and 8-11, and 4-7 and 12-15
+      __m256i first = _mm256_unpacklo_epi16(bg, ra);
+      __m256i second = _mm256_unpackhi_epi16(bg, ra);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i),
+            _mm256_permute2x128_si256(first, second, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i + 32),
+            _mm256_permute2x128_si256(first, second, 0x31));
+   }
+   return i;
+}
+
+// min(v, 255) for unsigned 16-bit lanes is v - saturating(v - 255); the
+// result then packs to bytes without signed saturation going wrong
+PIXELCONVERSION_TARGET("sse2")
+size_t Shift16To8SSE2(unsigned char* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   const __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+   const __m128i max8 = _mm_set1_epi16(255);
+   size_t i = 0;
+   for (; i + 16 <= pixelCount; i += 16)
+   {
+      __m128i a = _mm_srl_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), count);
+      __m128i b = _mm_srl_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8)), count);
+      a = _mm_sub_epi16(a, _mm_subs_epu16(a, max8));
+      b = _mm_sub_epi16(b, _mm_subs_epu16(b, max8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+   }
+   return i;
+}
+
+PIXELCONVERSION_TARGET("avx2")
+size_t Shift16To8AVX2(unsigned char* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   const __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+   const __m256i max8 = _mm256_set1_epi16(255);
+   size_t i = 0;
+   for (; i + 32 <= pixelCount; i += 32)
+   {
+      __m256i a = _mm256_srl_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), count);
+      __m256i b = _mm256_srl_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16)), count);
+      a = _mm256_min_epu16(a, max8);
+      b = _mm256_min_epu16(b, max8);
+      // Packing works within 128-bit lanes; put the quarters back in order
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+   }
+   return i;
+}
+
+#endif // PIXELCONVERSION_X86
+
+void UnpackPairs(PairFormat format, unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const PixelConverter::InstructionSet set = PixelConverter::GetInstructionSet();
+   if (set >= PixelConverter::AVX2)
+      done = UnpackPairsAVX2(format, dst, src, pixelCount);
+   else if (set >= PixelConverter::SSSE3)
+      done = UnpackPairsSSSE3(format, dst, src, pixelCount);
+#endif
+   UnpackPairsScalar(format, dst + done, src + done / 2 * 3, pixelCount - done);
+}
+
+void Shift16(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift, bool right)
+{
+   if (shift >= 16)
+   {
+      memset(dst, 0, pixelCount * sizeof(unsigned short));
+      return;
+   }
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const PixelConverter::InstructionSet set = PixelConverter::GetInstructionSet();
+   if (set >= PixelConverter::AVX2)
+      done = Shift16AVX2(dst, src, pixelCount, shift, right);
+   else if (set >= PixelConverter::SSE2)
+      done = Shift16SSE2(dst, src, pixelCount, shift, right);
+#endif
+   if (right)
+      ShiftRight16Scalar(dst + done, src + done, pixelCount - done, shift);
+   else
+      ShiftLeft16Scalar(dst + done, src + done, pixelCount - done, shift);
+}
+
+void Color24ToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool swap)
+{
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const PixelConverter::InstructionSet set = PixelConverter::GetInstructionSet();
+   if (set >= PixelConverter::AVX2)
+      done = Color24ToBGRAAVX2(dst, src, pixelCount, swap);
+   else if (set >= PixelConverter::SSSE3)
+      done = Color24ToBGRASSSE3(dst, src, pixelCount, swap);
+#endif
+   Color24ToBGRAScalar(dst + 4 * done, src + 3 * done, pixelCount - done, swap);
+}
+
+void YUV422ToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount, bool yFirst)
+{
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const PixelConverter::InstructionSet set = PixelConverter::GetInstructionSet();
+   if (set >= PixelConverter::AVX2)
+      done = YUV422ToBGRAAVX2(dst, src, pixelCount, yFirst);
+   else if (set >= PixelConverter::SSE2)
+      done = YUV422ToBGRASSE2(dst, src, pixelCount, yFirst);
+#endif
+   YUV422ToBGRAScalar(dst + 4 * done, src + 2 * done,
+         (pixelCount - done) / 2, yFirst);
+}
+
+} // anonymous namespace
+
+
+PixelConverter::InstructionSet
+PixelConverter::GetSupportedInstructionSet()
+{
+   // Detecting twice in a race is harmless
+   static const InstructionSet supported = DetectInstructionSet();
+   return supported;
+}
+
+
+PixelConverter::InstructionSet
+PixelConverter::GetInstructionSet()
+{
+   const InstructionSet supported = GetSupportedInstructionSet();
+   const InstructionSet limit =
+      static_cast<InstructionSet>(g_instructionSetLimit);
+   return limit < supported ? limit : supported;
+}
+
+
+void
+PixelConverter::SetInstructionSetLimit(InstructionSet limit)
+{
+   g_instructionSetLimit = limit;
+}
+
+
+const char*
+PixelConverter::GetInstructionSetName(InstructionSet set)
+{
+   switch (set)
+   {
+      case Scalar: return "Scalar";
+      case SSE2: return "SSE2";
+      case SSSE3: return "SSSE3";
+      case AVX2: return "AVX2";
+   }
+   return "Unknown";
+}
+
+
+void
+PixelConverter::UnpackMono10p(unsigned short* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const InstructionSet set = GetInstructionSet();
+   if (set >= AVX2)
+      done = UnpackMono10pAVX2(dst, src, pixelCount);
+   else if (set >= SSSE3)
+      done = UnpackMono10pSSSE3(dst, src, pixelCount);
+#endif
+   UnpackMono10pScalar(dst + done, src + done / 4 * 5, pixelCount - done);
+}
+
+
+void
+PixelConverter::UnpackMono10Packed(unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   UnpackPairs(Mono10Packed, dst, src, pixelCount);
+}
+
+
+void
+PixelConverter::UnpackMono12p(unsigned short* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   UnpackPairs(Mono12p, dst, src, pixelCount);
+}
+
+
+void
+PixelConverter::UnpackMono12Packed(unsigned short* dst,
+      const unsigned char* src, size_t pixelCount)
+{
+   UnpackPairs(Mono12Packed, dst, src, pixelCount);
+}
+
+
+void
+PixelConverter::ShiftRight16(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   Shift16(dst, src, pixelCount, shift, true);
+}
+
+
+void
+PixelConverter::ShiftLeft16(unsigned short* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   Shift16(dst, src, pixelCount, shift, false);
+}
+
+
+void
+PixelConverter::RGB8ToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   Color24ToBGRA(dst, src, pixelCount, true);
+}
+
+
+void
+PixelConverter::BGR8ToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   Color24ToBGRA(dst, src, pixelCount, false);
+}
+
+
+void
+PixelConverter::YUYVToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   YUV422ToBGRA(dst, src, pixelCount, true);
+}
+
+
+void
+PixelConverter::UYVYToBGRA(unsigned char* dst, const unsigned char* src,
+      size_t pixelCount)
+{
+   YUV422ToBGRA(dst, src, pixelCount, false);
+}
+
+
+void
+PixelConverter::Shift16To8(unsigned char* dst, const unsigned short* src,
+      size_t pixelCount, unsigned shift)
+{
+   if (shift > 15)
+      shift = 15; // Nothing is left of the top bit beyond this either way
+   size_t done = 0;
+#ifdef PIXELCONVERSION_X86
+   const InstructionSet set = GetInstructionSet();
+   if (set >= AVX2)
+      done = Shift16To8AVX2(dst, src, pixelCount, shift);
+   else if (set >= SSE2)
+      done = Shift16To8SSE2(dst, src, pixelCount, shift);
+#endif
+   Shift16To8Scalar(dst + done, src + done, pixelCount - done, shift);
+}
+
+
+void
+PixelConverter::Build16To8Lut(unsigned char* lut, unsigned bitDepth,
+      unsigned minValue, unsigned maxValue)
+{
+   if (bitDepth > 16)
+      bitDepth = 16;
+   const unsigned size = 1u << bitDepth;
+   for (unsigned v = 0; v < size; ++v)
+   {
+      if (v >= maxValue)
+         lut[v] = 255;
+      else if (v <= minValue)
+         lut[v] = 0;
+      else // minValue < v < maxValue
+      {
+         const unsigned range = maxValue - minValue;
+         lut[v] = static_cast<unsigned char>(
+               ((v - minValue) * 255u + range / 2) / range);
+      }
+   }
+}
+
+
+void
+PixelConverter::Apply16To8Lut(unsigned char* dst, const unsigned short* src,
+      size_t pixelCount, const unsigned char* lut, unsigned bitDepth)
+{
+   // Table lookups do not vectorize profitably (gathers are slower than
+   // scalar loads here); unrolling lets the loads overlap
+   const unsigned mask = bitDepth >= 16 ? 0xffffu : (1u << bitDepth) - 1;
+   size_t i = 0;
+   for (; i + 4 <= pixelCount; i += 4)
+   {
+      const unsigned char a = lut[src[i] & mask];
+      const unsigned char b = lut[src[i + 1] & mask];
+      const unsigned char c = lut[src[i + 2] & mask];
+      const unsigned char d = lut[src[i + 3] & mask];
+      dst[i] = a;
+      dst[i + 1] = b;
+      dst[i + 2] = c;
+      dst[i + 3] = d;
+   }
+   for (; i < pixelCount; ++i)
+      dst[i] = lut[src[i] & mask];
+}
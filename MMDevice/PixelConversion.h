@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        PixelConversion.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMDevice - Device adapter kit
+//
+// DESCRIPTION:   Conversion of common camera pixel formats (packed mono,
+//                shifted mono, RGB, YUV 4:2:2) to Micro-Manager image
+//                formats, vectorized with run-time CPU dispatch.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+///////////////////////////////////////////////////////////////////////////////
+
+#if !defined(_PIXEL_CONVERSION_)
+#define _PIXEL_CONVERSION_
+
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PixelConverter class
+// ~~~~~~~~~~~~~~~~~~~~
+// Converts runs of pixels from the formats cameras deliver to the formats
+// Micro-Manager images use: 16-bit little-endian gray with the value in the
+// low bits, 8-bit gray, and 32-bit color with bytes in the order blue,
+// green, red, alpha (alpha is set to 255).
+//
+// Each conversion has a scalar implementation and, on x86, SSE2, SSSE3
+// and/or AVX2 implementations. The fastest one the processor supports is
+// chosen at run time, so adapters built for the baseline instruction set
+// still use wider instructions where available. All implementations give
+// identical results.
+//
+// Functions take the destination first, like memcpy, and a pixel count;
+// convert an image with row padding one row at a time. Source and
+// destination must not overlap, except for the in-place shifts. No
+// alignment is required.
+//
+
+class PixelConverter
+{
+public:
+   enum InstructionSet
+   {
+      Scalar,
+      SSE2,
+      SSSE3,
+      AVX2
+   };
+
+   // Best instruction set supported by the processor (and compiler)
+   static InstructionSet GetSupportedInstructionSet();
+   // Instruction set used by the conversions: the supported one, unless
+   // limited with SetInstructionSetLimit()
+   static InstructionSet GetInstructionSet();
+   // Restrict the conversions to at most the given instruction set (for
+   // testing and benchmarking); not meant to be changed during conversions
+   static void SetInstructionSetLimit(InstructionSet limit);
+   static const char* GetInstructionSetName(InstructionSet set);
+
+   // Packed mono formats to 16-bit. The "p" formats (GenICam Mono10p,
+   // Mono12p) are packed least significant bit first: 4 pixels in 5 bytes
+   // and 2 pixels in 3 bytes. The "Packed" formats (GigE Vision
+   // Mono10Packed, Mono12Packed) hold the high 8 bits of 2 pixels in the
+   // first and third bytes and their low bits in the middle byte.
+   static void UnpackMono10p(unsigned short* dst, const unsigned char* src,
+         size_t pixelCount);
+   static void UnpackMono10Packed(unsigned short* dst,
+         const unsigned char* src, size_t pixelCount);
+   static void UnpackMono12p(unsigned short* dst, const unsigned char* src,
+         size_t pixelCount);
+   static void UnpackMono12Packed(unsigned short* dst,
+         const unsigned char* src, size_t pixelCount);
+
+   // Shift 16-bit pixels, e.g. from MSB-aligned to LSB-aligned (right by 16
+   // minus the bit depth). dst may be the same as src.
+   static void ShiftRight16(unsigned short* dst, const unsigned short* src,
+         size_t pixelCount, unsigned shift);
+   static void ShiftLeft16(unsigned short* dst, const unsigned short* src,
+         size_t pixelCount, unsigned shift);
+
+   // 24-bit color to 32-bit BGRA
+   static void RGB8ToBGRA(unsigned char* dst, const unsigned char* src,
+         size_t pixelCount);
+   static void BGR8ToBGRA(unsigned char* dst, const unsigned char* src,
+         size_t pixelCount);
+
+   // YUV 4:2:2 (BT.601, video range) to BGRA; pixelCount must be even
+   static void YUYVToBGRA(unsigned char* dst, const unsigned char* src,
+         size_t pixelCount);
+   static void UYVYToBGRA(unsigned char* dst, const unsigned char* src,
+         size_t pixelCount);
+
+   // 16-bit to 8-bit by dropping the low bits: dst = min(src >> shift, 255)
+   static void Shift16To8(unsigned char* dst, const unsigned short* src,
+         size_t pixelCount, unsigned shift);
+   // Fill a table of 2^bitDepth entries (bitDepth at most 16) that maps
+   // minValue (and below) to 0 and maxValue (and above) to 255, linearly
+   // in between
+   static void Build16To8Lut(unsigned char* lut, unsigned bitDepth,
+         unsigned minValue, unsigned maxValue);
+   // 16-bit to 8-bit through a table from Build16To8Lut(); bits of the
+   // source above bitDepth are ignored
+   static void Apply16To8Lut(unsigned char* dst, const unsigned short* src,
+         size_t pixelCount, const unsigned char* lut, unsigned bitDepth);
+
+private:
+   PixelConverter();
+};
+
+#endif // !defined(_PIXEL_CONVERSION_)
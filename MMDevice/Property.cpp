@@ -87,6 +87,95 @@ void MM::Property::SetSequenceable(long sequenceMaxSize)
    sequenceMaxSize_ = sequenceMaxSize;
 }
 
+namespace {
+
+// Shortest of the usual precisions that converts back to the same number
+string FormatSequenceValue(double value)
+{
+   char buf[BUFSIZE];
+   snprintf(buf, BUFSIZE, "%.15g", value);
+   if (strtod(buf, 0) != value)
+      snprintf(buf, BUFSIZE, "%.17g", value);
+   return buf;
+}
+
+} // anonymous namespace
+
+int MM::Property::AddToSequence(const char* value)
+{
+   try
+   {
+      if (numericSequence_)
+      {
+         sequenceEvents_ = GetSequence();
+         numericSequenceEvents_.clear();
+         numericSequence_ = false;
+      }
+      sequenceEvents_.push_back(value);
+      if (sequenceEvents_.size() > (unsigned) GetSequenceMaxSize())
+         return DEVICE_SEQUENCE_TOO_LARGE;
+   } catch (...)
+   {
+      return MM_CODE_ERR;
+   }
+
+   return DEVICE_OK;
+}
+
+int MM::Property::SetSequence(const double* values, long count)
+{
+   try
+   {
+      sequenceEvents_.clear();
+      numericSequenceEvents_.assign(values, values + count);
+      numericSequence_ = true;
+      if (count > GetSequenceMaxSize())
+         return DEVICE_SEQUENCE_TOO_LARGE;
+   } catch (...)
+   {
+      return MM_CODE_ERR;
+   }
+
+   return DEVICE_OK;
+}
+
+vector<string> MM::Property::GetSequence() const
+{
+   if (!numericSequence_)
+      return sequenceEvents_;
+
+   vector<string> sequence;
+   sequence.reserve(numericSequenceEvents_.size());
+   for (vector<double>::const_iterator it = numericSequenceEvents_.begin(),
+         end = numericSequenceEvents_.end(); it != end; ++it)
+      sequence.push_back(FormatSequenceValue(*it));
+   return sequence;
+}
+
+bool MM::Property::GetNumericSequence(vector<double>& values) const
+{
+   if (numericSequence_)
+   {
+      values = numericSequenceEvents_;
+      return true;
+   }
+
+   vector<double> parsed;
+   parsed.reserve(sequenceEvents_.size());
+   for (vector<string>::const_iterator it = sequenceEvents_.begin(),
+         end = sequenceEvents_.end(); it != end; ++it)
+   {
+      const char* begin = it->c_str();
+      char* stop;
+      double value = strtod(begin, &stop);
+      if (stop == begin || *stop != '\0')
+         return false;
+      parsed.push_back(value);
+   }
+   values.swap(parsed);
+   return true;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // MM::StringProperty
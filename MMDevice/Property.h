@@ -63,6 +63,8 @@ public:
    virtual void SetSequenceable(long sequenceSize) = 0;
    virtual  long GetSequenceMaxSize() const = 0;
    virtual std::vector<std::string> GetSequence() const = 0;
+   // Sequence values as numbers; false if any value is not a number
+   virtual bool GetNumericSequence(std::vector<double>& values) const = 0;
    virtual int ClearSequence() = 0;
    virtual int AddToSequence(const char* value) = 0;
    virtual int SendSequence() = 0;
@@ -136,6 +138,7 @@ public:
       sequenceable_(false),
       sequenceMaxSize_(0),
       sequenceEvents_(),
+      numericSequence_(false),
       lowerLimit_(0.0),
       upperLimit_(0.0),
       name_(name)
@@ -236,6 +239,8 @@ public:
          if (sequenceEvents_.size() > 0){
             sequenceEvents_.clear();
          }
+         numericSequenceEvents_.clear();
+         numericSequence_ = false;
       } catch (...)
       {
          return MM_CODE_ERR;
@@ -244,20 +249,13 @@ public:
       return DEVICE_OK;
    }
 
-   int AddToSequence(const char* value) 
-   {
-      try
-      {
-         sequenceEvents_.push_back(value);
-         if (sequenceEvents_.size() > (unsigned) GetSequenceMaxSize())           
-            return DEVICE_SEQUENCE_TOO_LARGE;
-      } catch (...)
-      {
-         return MM_CODE_ERR;
-      }
+   int AddToSequence(const char* value);
 
-      return DEVICE_OK;
-   }
+   /**
+    * Replaces the sequence with numeric values. The values are kept as
+    * numbers; GetSequence() formats them only if it is called.
+    */
+   int SetSequence(const double* values, long count);
 
    int SendSequence() 
    {
@@ -272,10 +270,8 @@ public:
       return name_;
    }
 
-   std::vector<std::string> GetSequence() const
-   {
-      return sequenceEvents_;
-   }
+   std::vector<std::string> GetSequence() const;
+   bool GetNumericSequence(std::vector<double>& values) const;
 
    int StartSequence() 
    {
@@ -301,6 +297,10 @@ protected:
    bool sequenceable_;
    long sequenceMaxSize_;
    std::vector<std::string> sequenceEvents_;
+   // If numericSequence_, the sequence is held in numericSequenceEvents_
+   // instead of sequenceEvents_
+   bool numericSequence_;
+   std::vector<double> numericSequenceEvents_;
    double lowerLimit_;
    double upperLimit_;
    std::map<std::string, long> values_; // allowed values
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include "FocusScore.h"
+
+#include <cstdlib>
+#include <vector>
+
+
+namespace {
+
+std::vector<unsigned short> MakeImage(unsigned width, unsigned height,
+      unsigned period)
+{
+   // Square pattern with the given period, plus a little noise
+   std::vector<unsigned short> img(width * height);
+   std::srand(1);
+   for (unsigned y = 0; y < height; ++y)
+      for (unsigned x = 0; x < width; ++x)
+         img[y * width + x] = static_cast<unsigned short>(
+               (((x / period) + (y / period)) % 2 ? 200 : 100) + std::rand() % 4);
+   return img;
+}
+
+std::vector<unsigned short> BoxBlur(const std::vector<unsigned short>& img,
+      unsigned width, unsigned height)
+{
+   std::vector<unsigned short> out(img);
+   for (unsigned y = 2; y + 2 < height; ++y)
+      for (unsigned x = 2; x + 2 < width; ++x)
+      {
+         unsigned sum = 0;
+         for (int dy = -2; dy <= 2; ++dy)
+            for (int dx = -2; dx <= 2; ++dx)
+               sum += img[(y + dy) * width + x + dx];
+         out[y * width + x] = static_cast<unsigned short>(sum / 25);
+      }
+   return out;
+}
+
+double Score(FocusScorer& scorer, const std::vector<unsigned short>& img,
+      unsigned width, unsigned height)
+{
+   return scorer.Score(reinterpret_cast<const unsigned char*>(&img[0]),
+         width, height, 2);
+}
+
+} // anonymous namespace
+
+
+TEST(FocusScoreTests, MetricNamesRoundTrip)
+{
+   std::vector<std::string> names = FocusScorer::GetMetricNames();
+   ASSERT_EQ(5u, names.size());
+   for (unsigned i = 0; i < names.size(); ++i)
+   {
+      FocusScorer::Metric metric;
+      ASSERT_TRUE(FocusScorer::GetMetricFromName(names[i], metric));
+      ASSERT_EQ(names[i], FocusScorer::GetMetricName(metric));
+   }
+   FocusScorer::Metric metric;
+   ASSERT_FALSE(FocusScorer::GetMetricFromName("NoSuchMetric", metric));
+}
+
+TEST(FocusScoreTests, SharpImageScoresHigher)
+{
+   const unsigned w = 64, h = 48;
+   std::vector<unsigned short> sharp = MakeImage(w, h, 4);
+   std::vector<unsigned short> blurred = BoxBlur(sharp, w, h);
+
+   FocusScorer scorer;
+   std::vector<std::string> names = FocusScorer::GetMetricNames();
+   for (unsigned i = 0; i < names.size(); ++i)
+   {
+      FocusScorer::Metric metric;
+      FocusScorer::GetMetricFromName(names[i], metric);
+      scorer.SetMetric(metric);
+      EXPECT_GT(Score(scorer, sharp, w, h), Score(scorer, blurred, w, h))
+         << names[i];
+   }
+}
+
+TEST(FocusScoreTests, BandsGiveSameScoreAsSingleThread)
+{
+   // Large enough for 4 bands
+   const unsigned w = 1500, h = 1403;
+   std::vector<unsigned short> img = MakeImage(w, h, 3);
+
+   FocusScorer single, multi;
+   single.SetThreadCount(1);
+   multi.SetThreadCount(4);
+   std::vector<std::string> names = FocusScorer::GetMetricNames();
+   for (unsigned i = 0; i < names.size(); ++i)
+   {
+      FocusScorer::Metric metric;
+      FocusScorer::GetMetricFromName(names[i], metric);
+      single.SetMetric(metric);
+      multi.SetMetric(metric);
+      EXPECT_DOUBLE_EQ(Score(single, img, w, h), Score(multi, img, w, h))
+         << names[i];
+      EXPECT_DOUBLE_EQ(single.GetNormalizedDynamicRange(),
+            multi.GetNormalizedDynamicRange()) << names[i];
+   }
+}
+
+TEST(FocusScoreTests, EightAndSixteenBitAgree)
+{
+   const unsigned w = 40, h = 30;
+   std::vector<unsigned short> img16 = MakeImage(w, h, 5);
+   std::vector<unsigned char> img8(img16.begin(), img16.end());
+
+   FocusScorer scorer;
+   scorer.SetMetric(FocusScorer::Tenengrad);
+   double s8 = scorer.Score(&img8[0], w, h, 1);
+   ASSERT_DOUBLE_EQ(s8, Score(scorer, img16, w, h));
+   ASSERT_EQ(0.0, scorer.Score(&img8[0], w, h, 4));
+}
+
+TEST(FocusScoreTests, ROIRestrictsStatistics)
+{
+   const unsigned w = 8, h = 4;
+   std::vector<unsigned short> img(w * h, 10);
+   img[1 * w + 5] = 30;
+   img[2 * w + 6] = 50;
+
+   FocusScorer scorer;
+   scorer.SetMetric(FocusScorer::NormalizedVariance);
+   scorer.SetROI(4, 1, 4, 2);
+   Score(scorer, img, w, h);
+   ASSERT_DOUBLE_EQ((6 * 10 + 30 + 50) / 8.0, scorer.GetMean());
+
+   scorer.SetROI(0, 0, 4, 4);
+   ASSERT_EQ(0.0, Score(scorer, img, w, h));
+   ASSERT_DOUBLE_EQ(10.0, scorer.GetMean());
+
+   // Crop factor selects the centered region
+   scorer.ClearROI();
+   scorer.SetCropFactor(0.5);
+   Score(scorer, img, w, h);
+   ASSERT_DOUBLE_EQ((7 * 10 + 30) / 8.0, scorer.GetMean());
+}
+
+TEST(FocusScoreTests, MedianRemovesIsolatedHotPixels)
+{
+   const unsigned w = 16, h = 16;
+   std::vector<unsigned short> img(w * h, 100);
+   img[5 * w + 5] = 4000;
+   img[0] = 4000;
+
+   FocusScorer scorer;
+   scorer.SetMetric(FocusScorer::MedianHighPass);
+   ASSERT_EQ(0.0, Score(scorer, img, w, h));
+   ASSERT_EQ(0.0, scorer.GetNormalizedDynamicRange());
+
+   scorer.SetMetric(FocusScorer::LaplacianEnergy);
+   ASSERT_GT(Score(scorer, img, w, h), 0.0);
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+// Timing benchmark for FocusScorer.
+//
+// Scores a synthetic image with every metric, on one thread and with the
+// default thread count, and prints one JSON object per metric and thread
+// count (JSON Lines) with the wall-clock time per score. Small regions show
+// the cost of starting threads, large ones the gain from using them. Not
+// run by 'make check'; build with 'make benchmark'.
+//
+// Example:
+//    FocusScoreBenchmark --width 2048 --height 2048 --byte-depth 2
+
+#include "FocusScore.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+struct Options
+{
+   unsigned width;
+   unsigned height;
+   unsigned byteDepth;
+   unsigned threads; // 0 for one per processor
+   double minTimeS;
+
+   Options() :
+      width(2048),
+      height(2048),
+      byteDepth(2),
+      threads(0),
+      minTimeS(0.25)
+   {}
+};
+
+volatile double g_sink; // Keeps the compiler from dropping the calls
+
+// Milliseconds of wall-clock time per score
+double Measure(FocusScorer& scorer, const std::vector<unsigned char>& image,
+      const Options& opts)
+{
+   g_sink = scorer.Score(&image[0], opts.width, opts.height, opts.byteDepth);
+   long runs = 0;
+   const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+   double elapsedS = 0.0;
+   do
+   {
+      g_sink = scorer.Score(&image[0], opts.width, opts.height, opts.byteDepth);
+      ++runs;
+      elapsedS = (boost::posix_time::microsec_clock::universal_time() - start)
+         .total_microseconds() * 1e-6;
+   } while (elapsedS < opts.minTimeS);
+   return 1000.0 * elapsedS / runs;
+}
+
+bool ParseOptions(int argc, char** argv, Options& opts)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg(argv[i]);
+      if (i + 1 >= argc)
+         return false;
+      const char* value = argv[++i];
+      if (arg == "--width")
+         opts.width = std::strtoul(value, 0, 10);
+      else if (arg == "--height")
+         opts.height = std::strtoul(value, 0, 10);
+      else if (arg == "--byte-depth")
+         opts.byteDepth = std::strtoul(value, 0, 10);
+      else if (arg == "--threads")
+         opts.threads = std::strtoul(value, 0, 10);
+      else if (arg == "--min-time")
+         opts.minTimeS = std::atof(value);
+      else
+         return false;
+   }
+   return opts.width > 0 && opts.height > 0 &&
+      (opts.byteDepth == 1 || opts.byteDepth == 2) && opts.minTimeS > 0.0;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   Options opts;
+   if (!ParseOptions(argc, argv, opts))
+   {
+      std::cerr << "Usage: " << argv[0] <<
+         " [--width N] [--height N] [--byte-depth 1|2] [--threads N]"
+         " [--min-time SECONDS]\n";
+      return 2;
+   }
+
+   // Noise over a gradient, so that every metric has something to measure
+   const size_t pixels = static_cast<size_t>(opts.width) * opts.height;
+   std::vector<unsigned char> image(pixels * opts.byteDepth);
+   unsigned state = 1;
+   for (size_t i = 0; i < pixels; ++i)
+   {
+      state = state * 1103515245u + 12345u;
+      const unsigned value = (i % opts.width) * 16 + ((state >> 16) & 0xff);
+      if (opts.byteDepth == 1)
+         image[i] = static_cast<unsigned char>(value >> 4);
+      else
+         reinterpret_cast<unsigned short*>(&image[0])[i] =
+            static_cast<unsigned short>(value);
+   }
+
+   const std::vector<std::string> metrics = FocusScorer::GetMetricNames();
+   for (size_t m = 0; m < metrics.size(); ++m)
+   {
+      FocusScorer scorer;
+      FocusScorer::Metric metric;
+      FocusScorer::GetMetricFromName(metrics[m], metric);
+      scorer.SetMetric(metric);
+
+      const unsigned threadCounts[2] = { 1, opts.threads };
+      for (int t = 0; t < 2; ++t)
+      {
+         scorer.SetThreadCount(threadCounts[t]);
+         std::cout << "{\"benchmark\":\"focusScore\""
+            << ",\"metric\":\"" << metrics[m] << "\""
+            << ",\"width\":" << opts.width
+            << ",\"height\":" << opts.height
+            << ",\"byteDepth\":" << opts.byteDepth
+            << ",\"threads\":" << threadCounts[t]
+            << ",\"msPerScore\":" << Measure(scorer, image, opts)
+            << "}" << std::endl;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "FrameAccumulator.h"
+
+#include <vector>
+
+
+TEST(FrameAccumulatorTests, AverageIsRoundedToNearest)
+{
+   FrameAccumulator acc;
+   acc.Resize(20, 2);
+   std::vector<unsigned char> a(40), b(40), c(40);
+   for (unsigned i = 0; i < 40; ++i)
+   {
+      a[i] = static_cast<unsigned char>(i);
+      b[i] = static_cast<unsigned char>(i + 1);
+      c[i] = 255;
+   }
+   acc.AddFrame(&a[0], 20);
+   acc.AddFrame(&b[0], 20);
+   acc.AddFrame(&c[0], 20);
+   ASSERT_EQ(3u, acc.GetFrameCount());
+
+   std::vector<unsigned char> out(40);
+   acc.GetOutput(&out[0], 1);
+   for (unsigned i = 0; i < 40; ++i)
+      ASSERT_EQ((i + (i + 1) + 255 + 1) / 3, out[i]);
+}
+
+TEST(FrameAccumulatorTests, SumIsClampedToOutputDepth)
+{
+   FrameAccumulator acc;
+   acc.SetMode(FrameAccumulator::Sum);
+   acc.Resize(3, 1);
+   const unsigned short frame[] = { 1, 30000, 60000 };
+   acc.AddFrame(frame, 3);
+   acc.AddFrame(frame, 3);
+
+   unsigned short out[3];
+   acc.GetOutput(reinterpret_cast<unsigned char*>(out), 2);
+   ASSERT_EQ(2, out[0]);
+   ASSERT_EQ(60000, out[1]);
+   ASSERT_EQ(65535, out[2]);
+}
+
+TEST(FrameAccumulatorTests, SourceRegionIsSelected)
+{
+   FrameAccumulator acc;
+   acc.Resize(2, 2);
+   const unsigned char frame[] = {
+      0, 0, 0, 0,
+      0, 1, 2, 0,
+      0, 3, 4, 0,
+   };
+   acc.AddFrame(frame, 4, 1, 1);
+
+   unsigned char out[4];
+   acc.GetOutput(out, 1);
+   for (unsigned i = 0; i < 4; ++i)
+      ASSERT_EQ(i + 1, out[i]);
+}
+
+TEST(FrameAccumulatorTests, RunningAverageUsesLastNFrames)
+{
+   FrameAccumulator acc;
+   acc.SetMode(FrameAccumulator::RunningAverage);
+   acc.SetLength(2);
+   acc.Resize(17, 1);
+
+   unsigned char out[17];
+   for (unsigned char v = 10; v <= 50; v += 10)
+   {
+      std::vector<unsigned char> frame(17, v);
+      acc.AddFrame(&frame[0], 17);
+   }
+   ASSERT_EQ(2u, acc.GetFrameCount());
+   acc.GetOutput(out, 1);
+   for (unsigned i = 0; i < 17; ++i)
+      ASSERT_EQ(45, out[i]);
+}
+
+TEST(FrameAccumulatorTests, MedianRejectsOutliers)
+{
+   FrameAccumulator acc;
+   acc.SetMode(FrameAccumulator::Median);
+   acc.SetLength(3);
+   acc.Resize(2, 1);
+
+   const unsigned char f1[] = { 10, 200 };
+   const unsigned char f2[] = { 255, 20 };
+   const unsigned char f3[] = { 12, 22 };
+   acc.AddFrame(f1, 2);
+   acc.AddFrame(f2, 2);
+   acc.AddFrame(f3, 2);
+
+   unsigned char out[2];
+   acc.GetOutput(out, 1);
+   ASSERT_EQ(12, out[0]);
+   ASSERT_EQ(22, out[1]);
+
+   // Even count: mean of the central pair
+   acc.Reset();
+   acc.AddFrame(f1, 2);
+   acc.AddFrame(f3, 2);
+   acc.GetOutput(out, 1);
+   ASSERT_EQ(11, out[0]);
+   ASSERT_EQ(111, out[1]);
+}
+
+TEST(FrameAccumulatorTests, OutputIsZeroWithoutFrames)
+{
+   FrameAccumulator acc;
+   acc.Resize(2, 2);
+   unsigned char out[4] = { 1, 2, 3, 4 };
+   acc.GetOutput(out, 1);
+   for (unsigned i = 0; i < 4; ++i)
+      ASSERT_EQ(0, out[i]);
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+
+#include "PixelConversion.h"
+
+#include <cstring>
+#include <vector>
+
+
+namespace {
+
+std::vector<unsigned char> PseudoRandomBytes(size_t count)
+{
+   std::vector<unsigned char> bytes(count);
+   unsigned state = 12345;
+   for (size_t i = 0; i < count; ++i)
+   {
+      state = state * 1103515245u + 12345u;
+      bytes[i] = static_cast<unsigned char>(state >> 16);
+   }
+   return bytes;
+}
+
+std::vector<PixelConverter::InstructionSet> SupportedInstructionSets()
+{
+   std::vector<PixelConverter::InstructionSet> sets;
+   for (int s = PixelConverter::Scalar;
+         s <= PixelConverter::GetSupportedInstructionSet(); ++s)
+      sets.push_back(static_cast<PixelConverter::InstructionSet>(s));
+   return sets;
+}
+
+// Restores the default instruction set when a test ends
+class PixelConversionTests : public ::testing::Test
+{
+protected:
+   virtual void TearDown()
+   {
+      PixelConverter::SetInstructionSetLimit(PixelConverter::AVX2);
+   }
+};
+
+// Runs a conversion of count pixels (with count + 1 destination elements,
+// the last of which must stay untouched) with every supported instruction
+// set and checks that all give the scalar result
+template <typename Src, typename Dst, typename Convert>
+void ExpectSameWithAllInstructionSets(const std::vector<Src>& src,
+      size_t dstElementsPerPixel, Convert convert)
+{
+   const size_t counts[] = { 0, 1, 2, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 100, 1001 };
+   std::vector<PixelConverter::InstructionSet> sets = SupportedInstructionSets();
+   for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+   {
+      const size_t count = counts[c];
+      std::vector<Dst> expected(count * dstElementsPerPixel + 1, 0x5a);
+      PixelConverter::SetInstructionSetLimit(PixelConverter::Scalar);
+      convert(&expected[0], &src[0], count);
+      ASSERT_EQ(0x5a, expected.back()) << count << " pixels";
+
+      for (size_t s = 1; s < sets.size(); ++s)
+      {
+         std::vector<Dst> actual(count * dstElementsPerPixel + 1, 0x5a);
+         PixelConverter::SetInstructionSetLimit(sets[s]);
+         convert(&actual[0], &src[0], count);
+         ASSERT_EQ(expected, actual) << count << " pixels, " <<
+            PixelConverter::GetInstructionSetName(sets[s]);
+      }
+   }
+}
+
+void ShiftRight4(unsigned short* dst, const unsigned short* src, size_t n)
+{
+   PixelConverter::ShiftRight16(dst, src, n, 4);
+}
+
+void ShiftLeft6(unsigned short* dst, const unsigned short* src, size_t n)
+{
+   PixelConverter::ShiftLeft16(dst, src, n, 6);
+}
+
+void Shift16To8By0(unsigned char* dst, const unsigned short* src, size_t n)
+{
+   PixelConverter::Shift16To8(dst, src, n, 0);
+}
+
+void Shift16To8By4(unsigned char* dst, const unsigned short* src, size_t n)
+{
+   PixelConverter::Shift16To8(dst, src, n, 4);
+}
+
+void EvenYUYVToBGRA(unsigned char* dst, const unsigned char* src, size_t n)
+{
+   PixelConverter::YUYVToBGRA(dst, src, n & ~size_t(1));
+}
+
+void EvenUYVYToBGRA(unsigned char* dst, const unsigned char* src, size_t n)
+{
+   PixelConverter::UYVYToBGRA(dst, src, n & ~size_t(1));
+}
+
+} // anonymous namespace
+
+
+TEST_F(PixelConversionTests, UnpacksMono12p)
+{
+   // Pixels 0x321 and 0x654
+   const unsigned char src[] = { 0x21, 0x43, 0x65, 0x87, 0x09 };
+   unsigned short dst[3];
+   PixelConverter::UnpackMono12p(dst, src, 3);
+   EXPECT_EQ(0x321, dst[0]);
+   EXPECT_EQ(0x654, dst[1]);
+   EXPECT_EQ(0x987, dst[2]);
+}
+
+TEST_F(PixelConversionTests, UnpacksMono12Packed)
+{
+   const unsigned char src[] = { 0x32, 0x41, 0x65, 0x98, 0x07 };
+   unsigned short dst[3];
+   PixelConverter::UnpackMono12Packed(dst, src, 3);
+   EXPECT_EQ(0x321, dst[0]);
+   EXPECT_EQ(0x654, dst[1]);
+   EXPECT_EQ(0x987, dst[2]);
+}
+
+TEST_F(PixelConversionTests, UnpacksMono10p)
+{
+   // 0x3ff, 0x000, 0x2aa, 0x155, least significant bit first
+   const unsigned char src[] = { 0xff, 0x03, 0xa0, 0x6a, 0x55 };
+   unsigned short dst[4];
+   PixelConverter::UnpackMono10p(dst, src, 4);
+   EXPECT_EQ(0x3ff, dst[0]);
+   EXPECT_EQ(0x000, dst[1]);
+   EXPECT_EQ(0x2aa, dst[2]);
+   EXPECT_EQ(0x155, dst[3]);
+}
+
+TEST_F(PixelConversionTests, UnpacksMono10Packed)
+{
+   // 0x2a5 and 0x15a
+   const unsigned char src[] = { 0xa9, 0x21, 0x56 };
+   unsigned short dst[2];
+   PixelConverter::UnpackMono10Packed(dst, src, 2);
+   EXPECT_EQ(0x2a5, dst[0]);
+   EXPECT_EQ(0x15a, dst[1]);
+}
+
+TEST_F(PixelConversionTests, ConvertsColorToBGRA)
+{
+   const unsigned char src[] = { 1, 2, 3, 4, 5, 6 };
+   unsigned char dst[8];
+   PixelConverter::RGB8ToBGRA(dst, src, 2);
+   const unsigned char fromRGB[] = { 3, 2, 1, 255, 6, 5, 4, 255 };
+   EXPECT_EQ(0, memcmp(fromRGB, dst, 8));
+   PixelConverter::BGR8ToBGRA(dst, src, 2);
+   const unsigned char fromBGR[] = { 1, 2, 3, 255, 4, 5, 6, 255 };
+   EXPECT_EQ(0, memcmp(fromBGR, dst, 8));
+}
+
+TEST_F(PixelConversionTests, ConvertsYUVToBGRA)
+{
+   // Black and white (video range), then pure red
+   const unsigned char yuyv[] = { 16, 128, 235, 128, 82, 90, 82, 240 };
+   const unsigned char uyvy[] = { 128, 16, 128, 235, 90, 82, 240, 82 };
+   const unsigned char expected[] = { 0, 0, 0, 255, 255, 255, 255, 255,
+      0, 0, 255, 255, 0, 0, 255, 255 };
+   unsigned char dst[16];
+   PixelConverter::YUYVToBGRA(dst, yuyv, 4);
+   for (int i = 0; i < 16; ++i)
+      EXPECT_NEAR(expected[i], dst[i], 1) << i;
+   PixelConverter::UYVYToBGRA(dst, uyvy, 4);
+   for (int i = 0; i < 16; ++i)
+      EXPECT_NEAR(expected[i], dst[i], 1) << i;
+}
+
+TEST_F(PixelConversionTests, ShiftsAndScalesTo8Bit)
+{
+   const unsigned short src[] = { 0x0ff0, 0xfff0, 0x0010 };
+   unsigned short shifted[3];
+   PixelConverter::ShiftRight16(shifted, src, 3, 4);
+   EXPECT_EQ(0x0ff, shifted[0]);
+   EXPECT_EQ(0xfff, shifted[1]);
+   EXPECT_EQ(0x001, shifted[2]);
+
+   unsigned char bytes[3];
+   PixelConverter::Shift16To8(bytes, src, 3, 4);
+   EXPECT_EQ(255, bytes[0]);
+   EXPECT_EQ(255, bytes[1]);
+   EXPECT_EQ(1, bytes[2]);
+}
+
+TEST_F(PixelConversionTests, LutMapsRangeLinearly)
+{
+   std::vector<unsigned char> lut(4096);
+   PixelConverter::Build16To8Lut(&lut[0], 12, 100, 1120);
+   EXPECT_EQ(0, lut[0]);
+   EXPECT_EQ(0, lut[100]);
+   EXPECT_EQ(128, lut[610]);
+   EXPECT_EQ(255, lut[1120]);
+   EXPECT_EQ(255, lut[4095]);
+
+   // Bits above the bit depth are ignored
+   const unsigned short src[] = { 610, 0xf000 | 610, 4095 };
+   unsigned char dst[3];
+   PixelConverter::Apply16To8Lut(dst, src, 3, &lut[0], 12);
+   EXPECT_EQ(128, dst[0]);
+   EXPECT_EQ(128, dst[1]);
+   EXPECT_EQ(255, dst[2]);
+}
+
+TEST_F(PixelConversionTests, AllInstructionSetsAgree)
+{
+   const std::vector<unsigned char> bytes = PseudoRandomBytes(8192);
+   std::vector<unsigned short> words(bytes.size() / 2);
+   for (size_t i = 0; i < words.size(); ++i)
+      words[i] = static_cast<unsigned short>(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned short>(bytes, 1,
+         PixelConverter::UnpackMono10p);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned short>(bytes, 1,
+         PixelConverter::UnpackMono10Packed);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned short>(bytes, 1,
+         PixelConverter::UnpackMono12p);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned short>(bytes, 1,
+         PixelConverter::UnpackMono12Packed);
+   ExpectSameWithAllInstructionSets<unsigned short, unsigned short>(words, 1,
+         ShiftRight4);
+   ExpectSameWithAllInstructionSets<unsigned short, unsigned short>(words, 1,
+         ShiftLeft6);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned char>(bytes, 4,
+         PixelConverter::RGB8ToBGRA);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned char>(bytes, 4,
+         PixelConverter::BGR8ToBGRA);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned char>(bytes, 4,
+         EvenYUYVToBGRA);
+   ExpectSameWithAllInstructionSets<unsigned char, unsigned char>(bytes, 4,
+         EvenUYVYToBGRA);
+   ExpectSameWithAllInstructionSets<unsigned short, unsigned char>(words, 1,
+         Shift16To8By0);
+   ExpectSameWithAllInstructionSets<unsigned short, unsigned char>(words, 1,
+         Shift16To8By4);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,221 @@
+// Throughput benchmark for PixelConverter.
+//
+// Runs every conversion with each instruction set the processor supports on
+// a synthetic image and prints one JSON object per conversion and
+// instruction set (JSON Lines) with the pixel rate and the speedup over the
+// scalar implementation. Not run by 'make check'; build with
+// 'make benchmark'.
+//
+// Example:
+//    PixelConversionBenchmark --width 2048 --height 2048 --min-time 0.5
+
+#include "PixelConversion.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+struct Options
+{
+   size_t width;
+   size_t height;
+   double minTimeS;
+
+   Options() :
+      width(2048),
+      height(2048),
+      minTimeS(0.25)
+   {}
+};
+
+struct Buffers
+{
+   std::vector<unsigned char> bytes; // Source for byte formats
+   std::vector<unsigned short> words; // Source for 16-bit formats
+   std::vector<unsigned char> bgra;
+   std::vector<unsigned short> mono16;
+   std::vector<unsigned char> mono8;
+   std::vector<unsigned char> lut;
+};
+
+enum Conversion
+{
+   Mono10p,
+   Mono10Packed,
+   Mono12p,
+   Mono12Packed,
+   ShiftRight16,
+   RGB8ToBGRA,
+   BGR8ToBGRA,
+   YUYVToBGRA,
+   UYVYToBGRA,
+   Shift16To8,
+   Lut16To8,
+   ConversionCount
+};
+
+const char* ConversionName(Conversion conversion)
+{
+   switch (conversion)
+   {
+      case Mono10p: return "Mono10p";
+      case Mono10Packed: return "Mono10Packed";
+      case Mono12p: return "Mono12p";
+      case Mono12Packed: return "Mono12Packed";
+      case ShiftRight16: return "ShiftRight16";
+      case RGB8ToBGRA: return "RGB8ToBGRA";
+      case BGR8ToBGRA: return "BGR8ToBGRA";
+      case YUYVToBGRA: return "YUYVToBGRA";
+      case UYVYToBGRA: return "UYVYToBGRA";
+      case Shift16To8: return "Shift16To8";
+      case Lut16To8: return "Lut16To8";
+      default: return "";
+   }
+}
+
+void Convert(Conversion conversion, Buffers& b, size_t pixels)
+{
+   switch (conversion)
+   {
+      case Mono10p:
+         PixelConverter::UnpackMono10p(&b.mono16[0], &b.bytes[0], pixels);
+         break;
+      case Mono10Packed:
+         PixelConverter::UnpackMono10Packed(&b.mono16[0], &b.bytes[0], pixels);
+         break;
+      case Mono12p:
+         PixelConverter::UnpackMono12p(&b.mono16[0], &b.bytes[0], pixels);
+         break;
+      case Mono12Packed:
+         PixelConverter::UnpackMono12Packed(&b.mono16[0], &b.bytes[0], pixels);
+         break;
+      case ShiftRight16:
+         PixelConverter::ShiftRight16(&b.mono16[0], &b.words[0], pixels, 4);
+         break;
+      case RGB8ToBGRA:
+         PixelConverter::RGB8ToBGRA(&b.bgra[0], &b.bytes[0], pixels);
+         break;
+      case BGR8ToBGRA:
+         PixelConverter::BGR8ToBGRA(&b.bgra[0], &b.bytes[0], pixels);
+         break;
+      case YUYVToBGRA:
+         PixelConverter::YUYVToBGRA(&b.bgra[0], &b.bytes[0], pixels);
+         break;
+      case UYVYToBGRA:
+         PixelConverter::UYVYToBGRA(&b.bgra[0], &b.bytes[0], pixels);
+         break;
+      case Shift16To8:
+         PixelConverter::Shift16To8(&b.mono8[0], &b.words[0], pixels, 4);
+         break;
+      case Lut16To8:
+         PixelConverter::Apply16To8Lut(&b.mono8[0], &b.words[0], pixels,
+               &b.lut[0], 12);
+         break;
+      default:
+         break;
+   }
+}
+
+// Megapixels per second of processor time
+double Measure(Conversion conversion, Buffers& buffers, size_t pixels,
+      double minTimeS)
+{
+   Convert(conversion, buffers, pixels); // Warm up caches
+   long runs = 0;
+   const std::clock_t start = std::clock();
+   double elapsedS = 0.0;
+   do
+   {
+      Convert(conversion, buffers, pixels);
+      ++runs;
+      elapsedS = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+   } while (elapsedS < minTimeS);
+   return runs * (pixels / 1e6) / elapsedS;
+}
+
+bool ParseOptions(int argc, char** argv, Options& opts)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg(argv[i]);
+      if (i + 1 >= argc)
+         return false;
+      const char* value = argv[++i];
+      if (arg == "--width")
+         opts.width = std::strtoul(value, 0, 10);
+      else if (arg == "--height")
+         opts.height = std::strtoul(value, 0, 10);
+      else if (arg == "--min-time")
+         opts.minTimeS = std::atof(value);
+      else
+         return false;
+   }
+   return opts.width > 0 && opts.height > 0 && opts.minTimeS > 0.0;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   Options opts;
+   if (!ParseOptions(argc, argv, opts))
+   {
+      std::cerr << "Usage: " << argv[0] <<
+         " [--width N] [--height N] [--min-time SECONDS]\n";
+      return 2;
+   }
+
+   // Even width, so that the YUV conversions can use the whole image
+   const size_t pixels = (opts.width & ~size_t(1)) * opts.height;
+   Buffers buffers;
+   buffers.bytes.resize(3 * pixels);
+   buffers.words.resize(pixels);
+   unsigned state = 1;
+   for (size_t i = 0; i < buffers.bytes.size(); ++i)
+   {
+      state = state * 1103515245u + 12345u;
+      buffers.bytes[i] = static_cast<unsigned char>(state >> 16);
+   }
+   for (size_t i = 0; i < pixels; ++i)
+      buffers.words[i] = static_cast<unsigned short>(
+            buffers.bytes[2 * i] | (buffers.bytes[2 * i + 1] << 8));
+   buffers.bgra.resize(4 * pixels);
+   buffers.mono16.resize(pixels);
+   buffers.mono8.resize(pixels);
+   buffers.lut.resize(1 << 12);
+   PixelConverter::Build16To8Lut(&buffers.lut[0], 12, 100, 4000);
+
+   const PixelConverter::InstructionSet supported =
+      PixelConverter::GetSupportedInstructionSet();
+   for (int c = 0; c < ConversionCount; ++c)
+   {
+      const Conversion conversion = static_cast<Conversion>(c);
+      double scalarRate = 0.0;
+      for (int s = PixelConverter::Scalar; s <= supported; ++s)
+      {
+         const PixelConverter::InstructionSet set =
+            static_cast<PixelConverter::InstructionSet>(s);
+         PixelConverter::SetInstructionSetLimit(set);
+         const double rate = Measure(conversion, buffers, pixels, opts.minTimeS);
+         if (set == PixelConverter::Scalar)
+            scalarRate = rate;
+
+         std::cout << "{\"benchmark\":\"pixelConversion\""
+            << ",\"conversion\":\"" << ConversionName(conversion) << "\""
+            << ",\"instructionSet\":\""
+            << PixelConverter::GetInstructionSetName(set) << "\""
+            << ",\"width\":" << opts.width
+            << ",\"height\":" << opts.height
+            << ",\"megapixelsPerS\":" << rate
+            << ",\"speedup\":" << (scalarRate > 0.0 ? rate / scalarRate : 0.0)
+            << "}" << std::endl;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "Property.h"
+
+#include <string>
+#include <vector>
+
+using namespace MM;
+
+
+TEST(PropertySequenceTests, NumericSequenceIsKeptAsNumbers)
+{
+   FloatProperty fp("TestProp");
+   fp.SetSequenceable(10);
+
+   const double values[] = { 0.1, 2.5, -3.0, 1e-7 };
+   ASSERT_EQ(DEVICE_OK, fp.SetSequence(values, 4));
+
+   std::vector<double> numbers;
+   ASSERT_TRUE(fp.GetNumericSequence(numbers));
+   ASSERT_EQ(4u, numbers.size());
+   for (size_t i = 0; i < 4; ++i)
+      EXPECT_EQ(values[i], numbers[i]);
+
+   std::vector<std::string> strings = fp.GetSequence();
+   ASSERT_EQ(4u, strings.size());
+   EXPECT_EQ("0.1", strings[0]);
+   EXPECT_EQ("2.5", strings[1]);
+   EXPECT_EQ("-3", strings[2]);
+   for (size_t i = 0; i < 4; ++i)
+      EXPECT_EQ(values[i], strtod(strings[i].c_str(), 0));
+}
+
+TEST(PropertySequenceTests, StringSequenceCanBeReadAsNumbers)
+{
+   IntegerProperty ip("TestProp");
+   ip.SetSequenceable(10);
+   ASSERT_EQ(DEVICE_OK, ip.AddToSequence("1"));
+   ASSERT_EQ(DEVICE_OK, ip.AddToSequence("-20"));
+
+   std::vector<double> numbers;
+   ASSERT_TRUE(ip.GetNumericSequence(numbers));
+   ASSERT_EQ(2u, numbers.size());
+   EXPECT_EQ(1.0, numbers[0]);
+   EXPECT_EQ(-20.0, numbers[1]);
+
+   ASSERT_EQ(DEVICE_OK, ip.AddToSequence("abc"));
+   EXPECT_FALSE(ip.GetNumericSequence(numbers));
+   EXPECT_EQ(2u, numbers.size());
+}
+
+TEST(PropertySequenceTests, AddingToNumericSequenceKeepsValues)
+{
+   FloatProperty fp("TestProp");
+   fp.SetSequenceable(10);
+   const double values[] = { 1.5, 2.0 };
+   ASSERT_EQ(DEVICE_OK, fp.SetSequence(values, 2));
+   ASSERT_EQ(DEVICE_OK, fp.AddToSequence("3.25"));
+
+   std::vector<std::string> strings = fp.GetSequence();
+   ASSERT_EQ(3u, strings.size());
+   EXPECT_EQ("1.5", strings[0]);
+   EXPECT_EQ("2", strings[1]);
+   EXPECT_EQ("3.25", strings[2]);
+
+   ASSERT_EQ(DEVICE_OK, fp.ClearSequence());
+   EXPECT_TRUE(fp.GetSequence().empty());
+   std::vector<double> numbers;
+   ASSERT_TRUE(fp.GetNumericSequence(numbers));
+   EXPECT_TRUE(numbers.empty());
+}
+
+TEST(PropertySequenceTests, RejectsTooLongNumericSequence)
+{
+   FloatProperty fp("TestProp");
+   fp.SetSequenceable(2);
+   const double values[] = { 1.0, 2.0, 3.0 };
+   EXPECT_EQ(DEVICE_SEQUENCE_TOO_LARGE, fp.SetSequence(values, 3));
+   EXPECT_EQ(DEVICE_OK, fp.SetSequence(values, 2));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}